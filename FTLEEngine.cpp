@@ -0,0 +1,286 @@
+#include "FTLEEngine.h"
+#include "parallel_utils.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Tracers per sampler call during composition
+const std::size_t kBatchSize = 1024;
+
+// Largest eigenvalue of a symmetric 3x3 matrix (closed form)
+double maxEigenvalueSymmetric(const double a[3][3]) {
+    double p1 = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    if (p1 == 0.0) {
+        return std::max({a[0][0], a[1][1], a[2][2]});
+    }
+
+    double q = (a[0][0] + a[1][1] + a[2][2]) / 3.0;
+    double p2 = (a[0][0] - q) * (a[0][0] - q) + (a[1][1] - q) * (a[1][1] - q) + (a[2][2] - q) * (a[2][2] - q) + 2.0 * p1;
+    double p = std::sqrt(p2 / 6.0);
+
+    double b[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            b[i][j] = (a[i][j] - (i == j ? q : 0.0)) / p;
+        }
+    }
+    double r = 0.5 * (b[0][0] * (b[1][1] * b[2][2] - b[1][2] * b[2][1])
+                    - b[0][1] * (b[1][0] * b[2][2] - b[1][2] * b[2][0])
+                    + b[0][2] * (b[1][0] * b[2][1] - b[1][1] * b[2][0]));
+    r = std::clamp(r, -1.0, 1.0);
+
+    double phi = std::acos(r) / 3.0;
+    return q + 2.0 * p * std::cos(phi);
+}
+
+} // namespace
+
+FTLEEngine::FTLEEngine(const Volume4D& vx, const Volume4D& vy, const Volume4D& vz, const FTLEOptions& options)
+    : velocity(vx, vy, vz), options(options), frames(vx.size_t()) {
+    if (this->options.refinement == 0 || this->options.windowFrames == 0 || this->options.substeps == 0) {
+        throw std::invalid_argument("FTLEEngine: refinement, windowFrames and substeps must be positive");
+    }
+    this->options.tileSize = std::max<std::size_t>(1, this->options.tileSize);
+
+    // The flow map runs through the time-interpolated, periodic cardiac cycle
+    velocity.set_temporal_interpolation(true);
+    velocity.set_periodic_time(true);
+
+    std::size_t dims[3] = {vx.size_x(), vx.size_y(), vx.size_z()};
+    for (int a = 0; a < 3; a++) {
+        grid[a] = (dims[a] - 1) * this->options.refinement + 1;
+    }
+}
+
+FTLEEngine::~FTLEEngine() = default;
+
+std::size_t FTLEEngine::step_frame(std::size_t frame, long steps) const {
+    long count = static_cast<long>(frames);
+    return static_cast<std::size_t>(((static_cast<long>(frame) + steps) % count + count) % count);
+}
+
+const FTLEEngine::Segment& FTLEEngine::segment(std::size_t frame) {
+    for (const auto& cached : segments) {
+        if (cached->frame == frame) {
+            return *cached;
+        }
+    }
+
+    // Keep one window's worth of segments; consecutive windows share all but one
+    while (segments.size() > options.windowFrames) {
+        segments.pop_front();
+    }
+
+    std::unique_ptr<Segment> seg = std::make_unique<Segment>();
+    seg->frame = frame;
+    seg->dx.resize(grid[0], grid[1], grid[2], 1);
+    seg->dy.resize(grid[0], grid[1], grid[2], 1);
+    seg->dz.resize(grid[0], grid[1], grid[2], 1);
+    integrate_segment(*seg);
+    seg->sampler = std::make_unique<VelocitySampler>(seg->dx, seg->dy, seg->dz);
+
+    segments.push_back(std::move(seg));
+    return *segments.back();
+}
+
+void FTLEEngine::integrate_segment(Segment& seg) const {
+    const std::size_t tile = options.tileSize;
+    const std::size_t tilesX = (grid[0] + tile - 1) / tile;
+    const std::size_t tilesY = (grid[1] + tile - 1) / tile;
+    const std::size_t tilesZ = (grid[2] + tile - 1) / tile;
+    const float refinement = static_cast<float>(options.refinement);
+    const float direction = options.backward ? -1.0f : 1.0f;
+    const float h = direction / static_cast<float>(options.substeps); // Frames per RK4 step
+    // Voxels per unit velocity per step, along each axis
+    const float hsx = h * options.velocityScale[0];
+    const float hsy = h * options.velocityScale[1];
+    const float hsz = h * options.velocityScale[2];
+
+    float* outX = seg.dx.frame_data(0);
+    float* outY = seg.dy.frame_data(0);
+    float* outZ = seg.dz.frame_data(0);
+
+    // Each tile of tracers is integrated independently with SoA batches
+    parallelFor(0, tilesX * tilesY * tilesZ, [&](std::size_t tileIndex) {
+        std::size_t bx = (tileIndex % tilesX) * tile;
+        std::size_t by = ((tileIndex / tilesX) % tilesY) * tile;
+        std::size_t bz = (tileIndex / (tilesX * tilesY)) * tile;
+        std::size_t ex = std::min(grid[0], bx + tile);
+        std::size_t ey = std::min(grid[1], by + tile);
+        std::size_t ez = std::min(grid[2], bz + tile);
+
+        std::vector<std::size_t> nodes;
+        std::vector<float> x, y, z;
+        for (std::size_t k = bz; k < ez; k++) {
+            for (std::size_t j = by; j < ey; j++) {
+                for (std::size_t i = bx; i < ex; i++) {
+                    nodes.push_back((k * grid[1] + j) * grid[0] + i);
+                    x.push_back(i / refinement);
+                    y.push_back(j / refinement);
+                    z.push_back(k / refinement);
+                }
+            }
+        }
+
+        std::size_t n = nodes.size();
+        std::vector<float> x0 = x, y0 = y, z0 = z;
+        std::vector<float> px(n), py(n), pz(n);
+        std::vector<float> kx(n), ky(n), kz(n);
+        std::vector<float> sx(n), sy(n), sz(n);
+
+        float time = static_cast<float>(seg.frame);
+        for (std::size_t step = 0; step < options.substeps; step++) {
+            // k1
+            velocity.sample_soa(x.data(), y.data(), z.data(), n, kx.data(), ky.data(), kz.data(), time);
+            for (std::size_t i = 0; i < n; i++) {
+                sx[i] = kx[i];
+                sy[i] = ky[i];
+                sz[i] = kz[i];
+                px[i] = x[i] + 0.5f * hsx * kx[i];
+                py[i] = y[i] + 0.5f * hsy * ky[i];
+                pz[i] = z[i] + 0.5f * hsz * kz[i];
+            }
+            // k2
+            velocity.sample_soa(px.data(), py.data(), pz.data(), n, kx.data(), ky.data(), kz.data(), time + 0.5f * h);
+            for (std::size_t i = 0; i < n; i++) {
+                sx[i] += 2.0f * kx[i];
+                sy[i] += 2.0f * ky[i];
+                sz[i] += 2.0f * kz[i];
+                px[i] = x[i] + 0.5f * hsx * kx[i];
+                py[i] = y[i] + 0.5f * hsy * ky[i];
+                pz[i] = z[i] + 0.5f * hsz * kz[i];
+            }
+            // k3
+            velocity.sample_soa(px.data(), py.data(), pz.data(), n, kx.data(), ky.data(), kz.data(), time + 0.5f * h);
+            for (std::size_t i = 0; i < n; i++) {
+                sx[i] += 2.0f * kx[i];
+                sy[i] += 2.0f * ky[i];
+                sz[i] += 2.0f * kz[i];
+                px[i] = x[i] + hsx * kx[i];
+                py[i] = y[i] + hsy * ky[i];
+                pz[i] = z[i] + hsz * kz[i];
+            }
+            // k4
+            velocity.sample_soa(px.data(), py.data(), pz.data(), n, kx.data(), ky.data(), kz.data(), time + h);
+            for (std::size_t i = 0; i < n; i++) {
+                x[i] += hsx / 6.0f * (sx[i] + kx[i]);
+                y[i] += hsy / 6.0f * (sy[i] + ky[i]);
+                z[i] += hsz / 6.0f * (sz[i] + kz[i]);
+            }
+            time += h;
+        }
+
+        for (std::size_t i = 0; i < n; i++) {
+            outX[nodes[i]] = (x[i] - x0[i]) * refinement;
+            outY[nodes[i]] = (y[i] - y0[i]) * refinement;
+            outZ[nodes[i]] = (z[i] - z0[i]) * refinement;
+        }
+    });
+}
+
+void FTLEEngine::compose_window(std::size_t frame, std::vector<float>& x, std::vector<float>& y, std::vector<float>& z) {
+    std::size_t nodeCount = grid[0] * grid[1] * grid[2];
+    x.resize(nodeCount);
+    y.resize(nodeCount);
+    z.resize(nodeCount);
+    for (std::size_t k = 0; k < grid[2]; k++) {
+        for (std::size_t j = 0; j < grid[1]; j++) {
+            for (std::size_t i = 0; i < grid[0]; i++) {
+                std::size_t node = (k * grid[1] + j) * grid[0] + i;
+                x[node] = static_cast<float>(i);
+                y[node] = static_cast<float>(j);
+                z[node] = static_cast<float>(k);
+            }
+        }
+    }
+
+    // Chain the one-frame maps: X <- X + D_k(X)
+    long direction = options.backward ? -1 : 1;
+    for (std::size_t s = 0; s < options.windowFrames; s++) {
+        const Segment& seg = segment(step_frame(frame, direction * static_cast<long>(s)));
+        const VelocitySampler& displacement = *seg.sampler;
+
+        parallelForRange(0, nodeCount, [&](std::size_t begin, std::size_t end) {
+            std::vector<float> dx(kBatchSize), dy(kBatchSize), dz(kBatchSize);
+            for (std::size_t start = begin; start < end; start += kBatchSize) {
+                std::size_t m = std::min(kBatchSize, end - start);
+                displacement.sample_soa(x.data() + start, y.data() + start, z.data() + start, m,
+                                        dx.data(), dy.data(), dz.data());
+                for (std::size_t i = 0; i < m; i++) {
+                    x[start + i] += dx[i];
+                    y[start + i] += dy[i];
+                    z[start + i] += dz[i];
+                }
+            }
+        }, kBatchSize);
+    }
+}
+
+void FTLEEngine::ftle_from_flow_map(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z,
+                                    float* out) const {
+    const std::size_t strides[3] = {1, grid[0], grid[0] * grid[1]};
+    const float* map[3] = {x.data(), y.data(), z.data()};
+    const double duration = static_cast<double>(options.windowFrames) * options.frameDuration;
+
+    parallelFor(0, grid[2], [&](std::size_t k) {
+        for (std::size_t j = 0; j < grid[1]; j++) {
+            for (std::size_t i = 0; i < grid[0]; i++) {
+                std::size_t node = (k * grid[1] + j) * grid[0] + i;
+                std::size_t index[3] = {i, j, k};
+
+                // Flow map gradient by central differences (one-sided at the edges)
+                double jac[3][3];
+                for (int axis = 0; axis < 3; axis++) {
+                    std::size_t lo = index[axis] > 0 ? node - strides[axis] : node;
+                    std::size_t hi = index[axis] + 1 < grid[axis] ? node + strides[axis] : node;
+                    double span = static_cast<double>((hi - lo) / strides[axis]);
+                    for (int c = 0; c < 3; c++) {
+                        jac[c][axis] = span > 0.0 ? (map[c][hi] - map[c][lo]) / span : 0.0;
+                    }
+                }
+
+                // Right Cauchy-Green tensor C = J^T J
+                double cg[3][3];
+                for (int a = 0; a < 3; a++) {
+                    for (int b = 0; b < 3; b++) {
+                        cg[a][b] = jac[0][a] * jac[0][b] + jac[1][a] * jac[1][b] + jac[2][a] * jac[2][b];
+                    }
+                }
+
+                double lambda = std::max(maxEigenvalueSymmetric(cg), 1e-12);
+                out[node] = static_cast<float>(0.5 * std::log(lambda) / duration);
+            }
+        }
+    });
+}
+
+void FTLEEngine::compute_frame(std::size_t frame, Volume4D& out) {
+    if (frame >= frames) {
+        throw std::out_of_range("FTLEEngine::compute_frame: Frame out of range");
+    }
+    if (out.size_x() != grid[0] || out.size_y() != grid[1] || out.size_z() != grid[2] || out.size_t() <= frame) {
+        throw std::invalid_argument("FTLEEngine::compute_frame: Output volume is not on the tracer grid");
+    }
+
+    std::vector<float> x, y, z;
+    compose_window(frame, x, y, z);
+    ftle_from_flow_map(x, y, z, out.frame_data(frame));
+}
+
+Volume4D FTLEEngine::compute() {
+    Volume4D ftle(grid[0], grid[1], grid[2], frames);
+
+    std::cout << "Computing " << (options.backward ? "backward" : "forward") << " FTLE on "
+              << grid[0] << " x " << grid[1] << " x " << grid[2] << " tracers, window "
+              << options.windowFrames << " frames" << std::endl;
+
+    // Visit start frames in the order that lets consecutive windows share segments
+    for (std::size_t i = 0; i < frames; i++) {
+        std::size_t frame = options.backward ? step_frame(0, -static_cast<long>(i)) : i;
+        compute_frame(frame, ftle);
+    }
+    return ftle;
+}
@@ -0,0 +1,84 @@
+#ifndef FTLE_ENGINE_H
+#define FTLE_ENGINE_H
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "Volume4D.h"
+#include "VelocitySampler.h"
+
+/**
+ * Settings for FTLE computation
+ */
+struct FTLEOptions {
+    std::size_t refinement = 1;   // Tracers per voxel along each axis
+    std::size_t windowFrames = 4; // Integration window |T| in frames
+    bool backward = false;        // Backward-time FTLE (attracting structures) instead of forward (repelling)
+    std::size_t substeps = 4;     // RK4 steps per frame when integrating a flow-map segment
+    float velocityScale[3] = {1.0f, 1.0f, 1.0f}; // Voxels per frame for a velocity of 1, along each axis
+    float frameDuration = 1.0f;   // Duration of one frame; FTLE is reported per this time unit
+    std::size_t tileSize = 16;    // Tracers per tile edge for parallel integration
+};
+
+/**
+ * Finite-time Lyapunov exponent fields over the cardiac cycle
+ *
+ * A dense grid of tracers (one per voxel, or finer with refinement) is advected through
+ * the time-interpolated, periodic velocity field. Integration is split into one-frame
+ * flow-map segments, each computed once in parallel over tiles and cached; the flow map
+ * for a window of T frames is the composition of T segments (interpolating each segment
+ * map), so moving the window by one frame only integrates one new segment.
+ *
+ * Positions are voxel coordinates; the output grid has (n - 1) * refinement + 1 nodes per axis.
+ */
+class FTLEEngine {
+public:
+    FTLEEngine(const Volume4D& vx, const Volume4D& vy, const Volume4D& vz, const FTLEOptions& options = FTLEOptions());
+    ~FTLEEngine();
+
+    FTLEEngine(const FTLEEngine&) = delete;
+    FTLEEngine& operator=(const FTLEEngine&) = delete;
+
+    /**
+     * Compute the FTLE field for every frame of the cycle
+     *
+     * @return Volume4D on the tracer grid with one FTLE volume per start frame
+     */
+    Volume4D compute();
+
+    /**
+     * Compute the FTLE field for the window starting at one frame
+     *
+     * @param frame Start frame of the integration window
+     * @param out Destination volume (tracer grid, size_t() >= frame + 1); FTLE is written to time index frame
+     */
+    void compute_frame(std::size_t frame, Volume4D& out);
+
+    std::size_t grid_x() const { return grid[0]; }
+    std::size_t grid_y() const { return grid[1]; }
+    std::size_t grid_z() const { return grid[2]; }
+
+private:
+    // One-frame flow map, stored as a displacement field (tracer grid units)
+    struct Segment {
+        std::size_t frame;
+        Volume4D dx, dy, dz;
+        std::unique_ptr<VelocitySampler> sampler;
+    };
+
+    const Segment& segment(std::size_t frame);
+    void integrate_segment(Segment& seg) const;
+    void compose_window(std::size_t frame, std::vector<float>& x, std::vector<float>& y, std::vector<float>& z);
+    void ftle_from_flow_map(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z,
+                            float* out) const;
+    std::size_t step_frame(std::size_t frame, long steps) const;
+
+    VelocitySampler velocity;
+    FTLEOptions options;
+    std::size_t frames;
+    std::size_t grid[3];
+    std::deque<std::unique_ptr<Segment>> segments; // Cached segments, most recent last
+};
+
+#endif // FTLE_ENGINE_H
@@ -0,0 +1,225 @@
+#include "FlowStatistics.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "parallel_utils.h"
+
+namespace {
+
+bool sameGrid(const Volume4D& a, const Volume4D& b) {
+    return a.size_x() == b.size_x() && a.size_y() == b.size_y() && a.size_z() == b.size_z();
+}
+
+// One frame, or one per frame of the velocity
+bool validAuxiliary(const Volume4D* volume, const Volume4D& velocity) {
+    return !volume || (sameGrid(*volume, velocity) && (volume->size_t() == 1 || volume->size_t() == velocity.size_t()));
+}
+
+float histogramPercentile(const std::vector<std::uint64_t>& histogram, float binWidth, double p) {
+    std::uint64_t total = 0;
+    for (std::uint64_t count : histogram) {
+        total += count;
+    }
+    if (total == 0) {
+        return 0.0f;
+    }
+
+    double target = std::min(std::max(p, 0.0), 1.0) * static_cast<double>(total);
+    std::uint64_t cumulative = 0;
+    for (std::size_t b = 0; b < histogram.size(); b++) {
+        if (histogram[b] > 0 && static_cast<double>(cumulative + histogram[b]) >= target) {
+            double fraction = (target - static_cast<double>(cumulative)) / static_cast<double>(histogram[b]);
+            return static_cast<float>((b + fraction) * binWidth);
+        }
+        cumulative += histogram[b];
+    }
+    return static_cast<float>(histogram.size() * binWidth);
+}
+
+bool insideMask(const float* inside, std::size_t i, float threshold) {
+    return !inside || inside[i] > threshold;
+}
+
+// Largest in-mask speed over the cycle (1 if there is none), from per-slice maxima
+float maskedMaxSpeed(const Volume4D& vx, const Volume4D& vy, const Volume4D& vz, const FlowStatisticsOptions& options) {
+    const std::size_t sliceSize = vx.size_x() * vx.size_y();
+    std::vector<float> sliceMax(vx.size_z(), 0.0f);
+    parallelFor(0, vx.size_z(), [&](std::size_t k) {
+        const std::size_t offset = k * sliceSize;
+        float maxSquared = 0.0f;
+        for (std::size_t t = 0; t < vx.size_t(); t++) {
+            const float* x = vx.frame_data(t) + offset;
+            const float* y = vy.frame_data(t) + offset;
+            const float* z = vz.frame_data(t) + offset;
+            const float* inside = options.mask ? options.mask->frame_data(options.mask->size_t() == 1 ? 0 : t) + offset : nullptr;
+            for (std::size_t i = 0; i < sliceSize; i++) {
+                if (insideMask(inside, i, options.maskThreshold)) {
+                    maxSquared = std::max(maxSquared, x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+                }
+            }
+        }
+        sliceMax[k] = std::sqrt(maxSquared);
+    });
+    float maximum = sliceMax.empty() ? 0.0f : *std::max_element(sliceMax.begin(), sliceMax.end());
+    return maximum > 0.0f ? maximum : 1.0f;
+}
+
+// Sums of one slice for every frame
+struct SlicePartial {
+    std::vector<double> energy;
+    std::vector<double> maskedEnergy;
+    std::vector<double> speedSum;
+    std::vector<std::size_t> count;
+    std::vector<float> maxSpeed;
+    std::vector<std::uint32_t> histogram;  // Frame-major, histogramBins per frame
+};
+
+} // namespace
+
+float FlowStatistics::percentile(double p) const {
+    return histogramPercentile(histogram, binWidth, p);
+}
+
+float FlowStatistics::saturated_fraction() const {
+    std::uint64_t total = 0;
+    for (std::uint64_t count : histogram) {
+        total += count;
+    }
+    return total > 0 ? static_cast<float>(static_cast<double>(histogram.back()) / static_cast<double>(total)) : 0.0f;
+}
+
+float FlowStatistics::frame_percentile(std::size_t t, double p) const {
+    return histogramPercentile(frames.at(t).histogram, binWidth, p);
+}
+
+std::size_t FlowStatistics::peak_frame() const {
+    std::size_t peak = 0;
+    for (std::size_t t = 1; t < frames.size(); t++) {
+        if (frames[t].maskedKineticEnergy > frames[peak].maskedKineticEnergy) {
+            peak = t;
+        }
+    }
+    return peak;
+}
+
+FlowStatistics computeFlowStatistics(const Volume4D& vx, const Volume4D& vy, const Volume4D& vz,
+                                     const Volume4D* magnitude, const FlowStatisticsOptions& options) {
+    if (!sameGrid(vx, vy) || !sameGrid(vx, vz) || vy.size_t() != vx.size_t() || vz.size_t() != vx.size_t()) {
+        throw std::invalid_argument("computeFlowStatistics: velocity components differ in size");
+    }
+    if (!validAuxiliary(magnitude, vx) || !validAuxiliary(options.mask, vx)) {
+        throw std::invalid_argument("computeFlowStatistics: magnitude or mask does not match the velocity");
+    }
+
+    const std::size_t nz = vx.size_z(), nt = vx.size_t();
+    const std::size_t sliceSize = vx.size_x() * vx.size_y();
+    const std::size_t bins = std::max<std::size_t>(1, options.histogramBins);
+    const float range = options.histogramRange > 0.0f ? options.histogramRange : maskedMaxSpeed(vx, vy, vz, options);
+    const float binsPerSpeed = static_cast<float>(bins) / range;
+    const double energyScale = 0.5 * options.density * options.voxelVolume * options.velocityScale * options.velocityScale;
+
+    FlowStatistics result;
+    result.binWidth = range / static_cast<float>(bins);
+    if (options.computeMaps) {
+        result.pcmra.set_category(MemoryCategory::Velocity);
+        result.pcmra.resize(vx.size_x(), vx.size_y(), nz, 1);
+        result.velocityVariance.set_category(MemoryCategory::Velocity);
+        result.velocityVariance.resize(vx.size_x(), vx.size_y(), nz, 1);
+    }
+
+    std::vector<SlicePartial> partials(nz);
+    parallelFor(0, nz, [&](std::size_t k) {
+        SlicePartial& partial = partials[k];
+        partial.energy.assign(nt, 0.0);
+        partial.maskedEnergy.assign(nt, 0.0);
+        partial.speedSum.assign(nt, 0.0);
+        partial.count.assign(nt, 0);
+        partial.maxSpeed.assign(nt, 0.0f);
+        partial.histogram.assign(nt * bins, 0);
+
+        // Voxel-wise sums over the cycle for the temporal maps: v, v^2 per component and magnitude x speed
+        std::vector<double> moments(options.computeMaps ? 7 * sliceSize : 0, 0.0);
+
+        const std::size_t offset = k * sliceSize;
+        for (std::size_t t = 0; t < nt; t++) {
+            const float* x = vx.frame_data(t) + offset;
+            const float* y = vy.frame_data(t) + offset;
+            const float* z = vz.frame_data(t) + offset;
+            const float* inside = options.mask ? options.mask->frame_data(options.mask->size_t() == 1 ? 0 : t) + offset : nullptr;
+            const float* weight = magnitude ? magnitude->frame_data(magnitude->size_t() == 1 ? 0 : t) + offset : nullptr;
+            std::uint32_t* histogram = partial.histogram.data() + t * bins;
+
+            double energy = 0.0, maskedEnergy = 0.0, speedSum = 0.0;
+            std::size_t count = 0;
+            float maxSpeed = 0.0f;
+            for (std::size_t i = 0; i < sliceSize; i++) {
+                float squared = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+                float speed = std::sqrt(squared);
+                energy += squared;
+                if (insideMask(inside, i, options.maskThreshold)) {
+                    maskedEnergy += squared;
+                    speedSum += speed;
+                    count++;
+                    maxSpeed = std::max(maxSpeed, speed);
+                    std::size_t bin = speed < range ? std::min(bins - 1, static_cast<std::size_t>(speed * binsPerSpeed)) : bins - 1;
+                    histogram[bin]++;
+                }
+                if (options.computeMaps) {
+                    double* m = moments.data() + 7 * i;
+                    m[0] += x[i];
+                    m[1] += y[i];
+                    m[2] += z[i];
+                    m[3] += static_cast<double>(x[i]) * x[i];
+                    m[4] += static_cast<double>(y[i]) * y[i];
+                    m[5] += static_cast<double>(z[i]) * z[i];
+                    m[6] += weight ? weight[i] * speed : speed;
+                }
+            }
+            partial.energy[t] = energy * energyScale;
+            partial.maskedEnergy[t] = maskedEnergy * energyScale;
+            partial.speedSum[t] = speedSum;
+            partial.count[t] = count;
+            partial.maxSpeed[t] = maxSpeed;
+        }
+
+        if (options.computeMaps) {
+            float* pcmra = result.pcmra.frame_data(0) + offset;
+            float* variance = result.velocityVariance.frame_data(0) + offset;
+            for (std::size_t i = 0; i < sliceSize; i++) {
+                const double* m = moments.data() + 7 * i;
+                double sum = 0.0;
+                for (int c = 0; c < 3; c++) {
+                    double mean = m[c] / nt;
+                    sum += std::max(0.0, m[3 + c] / nt - mean * mean);
+                }
+                variance[i] = static_cast<float>(sum);
+                pcmra[i] = static_cast<float>(m[6] / nt);
+            }
+        }
+    });
+
+    // Merge in slice order so sums do not depend on scheduling
+    result.frames.resize(nt);
+    result.histogram.assign(bins, 0);
+    for (std::size_t t = 0; t < nt; t++) {
+        FrameFlowStatistics& frame = result.frames[t];
+        frame.histogram.assign(bins, 0);
+        double speedSum = 0.0;
+        for (const SlicePartial& partial : partials) {
+            frame.kineticEnergy += partial.energy[t];
+            frame.maskedKineticEnergy += partial.maskedEnergy[t];
+            frame.maskedVoxels += partial.count[t];
+            frame.maxSpeed = std::max(frame.maxSpeed, partial.maxSpeed[t]);
+            speedSum += partial.speedSum[t];
+            const std::uint32_t* counts = partial.histogram.data() + t * bins;
+            for (std::size_t b = 0; b < bins; b++) {
+                frame.histogram[b] += counts[b];
+            }
+        }
+        frame.meanSpeed = frame.maskedVoxels > 0 ? speedSum / frame.maskedVoxels : 0.0;
+        for (std::size_t b = 0; b < bins; b++) {
+            result.histogram[b] += frame.histogram[b];
+        }
+    }
+    return result;
+}
@@ -0,0 +1,92 @@
+#ifndef FLOW_STATISTICS_H
+#define FLOW_STATISTICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Volume4D.h"
+
+/**
+ * Settings for computeFlowStatistics
+ */
+struct FlowStatisticsOptions {
+    float histogramRange = 0.0f;      // Histogram spans [0, histogramRange]; 0 = the largest in-mask speed
+    std::size_t histogramBins = 512;  // Speeds above the range are counted in the last bin
+    float velocityScale = 1.0f;       // Metres per second for a velocity of 1 (kinetic energy only)
+    double density = 1060.0;          // Blood density, kg/m^3
+    double voxelVolume = 1e-9;        // m^3 (1 mm^3); use the product of the geometry's spacing
+    const Volume4D* mask = nullptr;   // Optional, one frame or one per frame; inside if above maskThreshold
+    float maskThreshold = 0.5f;
+    bool computeMaps = true;          // Build the PC-MRA and velocity variance volumes
+};
+
+/**
+ * Reductions of one cardiac frame
+ */
+struct FrameFlowStatistics {
+    double kineticEnergy = 0.0;        // J, every voxel
+    double maskedKineticEnergy = 0.0;  // J, voxels inside the mask (every voxel without a mask)
+    std::size_t maskedVoxels = 0;
+    double meanSpeed = 0.0;            // Inside the mask
+    float maxSpeed = 0.0f;             // Inside the mask
+    std::vector<std::uint64_t> histogram;  // Speeds inside the mask
+};
+
+/**
+ * Whole-cycle results of computeFlowStatistics
+ */
+struct FlowStatistics {
+    std::vector<FrameFlowStatistics> frames;
+    std::vector<std::uint64_t> histogram;  // Speeds inside the mask, all frames
+    float binWidth = 0.0f;
+    Volume4D pcmra;             // One frame: mean over the cycle of magnitude x speed (speed alone without magnitude)
+    Volume4D velocityVariance;  // One frame: temporal variance of vx, vy and vz summed, a turbulence proxy
+
+    /**
+     * Speed below which a fraction p of the in-mask voxels of the whole cycle lie
+     *
+     * Interpolated linearly within the histogram bin, so resolution is binWidth.
+     *
+     * @param p Fraction in [0, 1]
+     */
+    float percentile(double p) const;
+
+    /**
+     * Speed percentile of one frame
+     */
+    float frame_percentile(std::size_t t, double p) const;
+
+    /**
+     * Fraction of the in-mask voxels of the whole cycle in the last bin, which also holds speeds
+     * above the range; near 1 the range was far too small and the percentiles are meaningless
+     */
+    float saturated_fraction() const;
+
+    /**
+     * Frame with the largest in-mask kinetic energy (peak systole)
+     */
+    std::size_t peak_frame() const;
+};
+
+/**
+ * Kinetic energy, speed histograms, PC-MRA and temporal variance in one parallel pass
+ *
+ * Each task takes one slice through every frame, reading vx, vy, vz, magnitude and mask once
+ * per voxel and frame, and keeps its own partial sums and histogram counts per frame; the
+ * voxel-wise temporal maps are accumulated in the same pass. Partials are merged in slice
+ * order, so results are identical for any thread count. Without a fixed histogram range, a
+ * parallel pre-pass over the velocity finds the largest in-mask speed first, so the bins
+ * cover the speeds in whatever units the velocity is in.
+ *
+ * @param vx Velocity along x
+ * @param vy Velocity along y
+ * @param vz Velocity along z
+ * @param magnitude Optional magnitude image (one frame or one per frame) for PC-MRA
+ * @param options Histogram range, physical constants, mask and map selection
+ * @return Per-frame and whole-cycle statistics
+ */
+FlowStatistics computeFlowStatistics(const Volume4D& vx, const Volume4D& vy, const Volume4D& vz,
+                                     const Volume4D* magnitude = nullptr,
+                                     const FlowStatisticsOptions& options = FlowStatisticsOptions());
+
+#endif // FLOW_STATISTICS_H
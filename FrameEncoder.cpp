@@ -0,0 +1,300 @@
+#include "FrameEncoder.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include "parallel_utils.h"
+
+namespace {
+
+const int kGifLevels[3] = {6, 7, 6};  // Palette levels of red, green, blue (252 colors)
+
+void appendWord(std::vector<unsigned char>& out, int value) {
+    out.push_back(static_cast<unsigned char>(value & 0xff));
+    out.push_back(static_cast<unsigned char>((value >> 8) & 0xff));
+}
+
+/**
+ * Variable-length LZW as used by GIF, packed LSB first into 255-byte sub-blocks
+ */
+class GifLzwEncoder {
+public:
+    explicit GifLzwEncoder(std::vector<unsigned char>& output) : out(output) {}
+
+    void encode(const std::vector<unsigned char>& indices) {
+        out.push_back(8);  // Minimum code size
+        reset_table();
+        put(kClear);
+        int prefix = indices.empty() ? 0 : indices[0];
+        for (std::size_t i = 1; i < indices.size(); i++) {
+            int value = indices[i];
+            std::uint32_t key = (static_cast<std::uint32_t>(value) << 12) | static_cast<std::uint32_t>(prefix);
+            int code = find(key);
+            if (code >= 0) {
+                prefix = code;
+                continue;
+            }
+            put(prefix);
+            prefix = value;
+            if (next < kMaxCode) {
+                insert(key, next++);
+            } else {
+                // Table full: start over with a fresh dictionary
+                reset_table();
+                clearPending = true;
+                put(kClear);
+            }
+        }
+        if (!indices.empty()) {
+            put(prefix);
+        }
+        put(kEnd);
+        flush();
+        out.push_back(0);  // Block terminator
+    }
+
+private:
+    static const int kClear = 256;
+    static const int kEnd = 257;
+    static const int kMaxCode = 4096;
+    static const std::size_t kTableSize = 5003;  // Prime above 4096 / 0.8 load
+
+    void reset_table() {
+        keys.assign(kTableSize, UINT32_MAX);
+        codes.assign(kTableSize, 0);
+        next = kEnd + 1;
+    }
+
+    int find(std::uint32_t key) const {
+        std::size_t slot = key % kTableSize;
+        while (keys[slot] != UINT32_MAX) {
+            if (keys[slot] == key) {
+                return codes[slot];
+            }
+            slot = slot + 1 == kTableSize ? 0 : slot + 1;
+        }
+        return -1;
+    }
+
+    void insert(std::uint32_t key, int code) {
+        std::size_t slot = key % kTableSize;
+        while (keys[slot] != UINT32_MAX) {
+            slot = slot + 1 == kTableSize ? 0 : slot + 1;
+        }
+        keys[slot] = key;
+        codes[slot] = static_cast<std::uint16_t>(code);
+    }
+
+    // Write a code, then widen codes once the decoder's next entry needs another bit
+    void put(int code) {
+        bits |= static_cast<std::uint32_t>(code) << bitCount;
+        bitCount += codeSize;
+        while (bitCount >= 8) {
+            byte(static_cast<unsigned char>(bits & 0xff));
+            bits >>= 8;
+            bitCount -= 8;
+        }
+        if (clearPending) {
+            codeSize = 9;
+            clearPending = false;
+        } else if (next > (1 << codeSize) - 1 && codeSize < 12) {
+            codeSize++;
+        }
+    }
+
+    void byte(unsigned char value) {
+        block[blockSize++] = value;
+        if (blockSize == 255) {
+            write_block();
+        }
+    }
+
+    void write_block() {
+        out.push_back(static_cast<unsigned char>(blockSize));
+        out.insert(out.end(), block, block + blockSize);
+        blockSize = 0;
+    }
+
+    void flush() {
+        if (bitCount > 0) {
+            byte(static_cast<unsigned char>(bits & 0xff));
+            bits = 0;
+            bitCount = 0;
+        }
+        if (blockSize > 0) {
+            write_block();
+        }
+    }
+
+    std::vector<unsigned char>& out;
+    std::vector<std::uint32_t> keys;
+    std::vector<std::uint16_t> codes;
+    int next = kEnd + 1;
+    int codeSize = 9;
+    bool clearPending = false;
+    std::uint32_t bits = 0;
+    int bitCount = 0;
+    unsigned char block[255];
+    std::size_t blockSize = 0;
+};
+
+} // namespace
+
+std::vector<unsigned char> encodeGifFrame(const CapturedFrame& frame, int delay) {
+    // GIF rows run top to bottom; 4 x 4 ordered dithering hides the banding of the fixed palette
+    static const int bayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+    std::vector<unsigned char> indices(static_cast<std::size_t>(frame.width) * frame.height);
+    for (int y = 0; y < frame.height; y++) {
+        const unsigned char* row = frame.rgb.data() + static_cast<std::size_t>(frame.height - 1 - y) * frame.width * 3;
+        unsigned char* out = indices.data() + static_cast<std::size_t>(y) * frame.width;
+        for (int x = 0; x < frame.width; x++) {
+            int threshold = bayer[y & 3][x & 3];
+            int level[3];
+            for (int c = 0; c < 3; c++) {
+                int steps = kGifLevels[c] - 1;
+                level[c] = std::min(steps, (row[3 * x + c] * steps * 16 + threshold * 255) / (255 * 16));
+            }
+            out[x] = static_cast<unsigned char>((level[0] * kGifLevels[1] + level[1]) * kGifLevels[2] + level[2]);
+        }
+    }
+
+    std::vector<unsigned char> block;
+    block.reserve(indices.size() / 2 + 64);
+    // Graphic control extension: no transparency, delay
+    block.insert(block.end(), {0x21, 0xf9, 0x04, 0x00});
+    appendWord(block, delay);
+    block.insert(block.end(), {0x00, 0x00});
+    // Image descriptor covering the whole screen, global palette
+    block.push_back(0x2c);
+    appendWord(block, 0);
+    appendWord(block, 0);
+    appendWord(block, frame.width);
+    appendWord(block, frame.height);
+    block.push_back(0x00);
+    GifLzwEncoder(block).encode(indices);
+    return block;
+}
+
+bool writeGif(const std::string& path, int width, int height, const std::vector<std::vector<unsigned char>>& frames) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Cannot create GIF file: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> header = {'G', 'I', 'F', '8', '9', 'a'};
+    appendWord(header, width);
+    appendWord(header, height);
+    header.insert(header.end(), {0xf7, 0x00, 0x00});  // 256-entry global palette
+    for (int r = 0; r < kGifLevels[0]; r++) {
+        for (int g = 0; g < kGifLevels[1]; g++) {
+            for (int b = 0; b < kGifLevels[2]; b++) {
+                header.push_back(static_cast<unsigned char>(r * 255 / (kGifLevels[0] - 1)));
+                header.push_back(static_cast<unsigned char>(g * 255 / (kGifLevels[1] - 1)));
+                header.push_back(static_cast<unsigned char>(b * 255 / (kGifLevels[2] - 1)));
+            }
+        }
+    }
+    header.resize(13 + 256 * 3, 0);
+    // NETSCAPE2.0 application extension: loop forever
+    const char* loop = "NETSCAPE2.0";
+    header.insert(header.end(), {0x21, 0xff, 0x0b});
+    header.insert(header.end(), loop, loop + 11);
+    header.insert(header.end(), {0x03, 0x01, 0x00, 0x00, 0x00});
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    for (const std::vector<unsigned char>& frame : frames) {
+        file.write(reinterpret_cast<const char*>(frame.data()), frame.size());
+    }
+    file.put(0x3b);
+    if (!file) {
+        std::cerr << "Error: Failed to write GIF file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+FrameEncoder::FrameEncoder(const std::string& pathPrefix, const std::string& fileExtension, FrameWriteFn write,
+                           const FrameEncoderOptions& encoderOptions)
+    : prefix(pathPrefix), extension(fileExtension), writeFrame(std::move(write)), options(encoderOptions),
+      queue(encoderOptions.queueFrames > 0 ? encoderOptions.queueFrames
+                                           : 2 * (encoderOptions.threads > 0 ? encoderOptions.threads
+                                                                            : std::max(1u, workerThreadCount() - 1))) {
+    // The rendering thread keeps one core; the encoders share the rest
+    std::size_t threads = options.threads > 0 ? options.threads : std::max(1u, workerThreadCount() - 1);
+    workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; i++) {
+        workers.emplace_back([this]() { worker(); });
+    }
+}
+
+FrameEncoder::~FrameEncoder() {
+    finish();
+}
+
+std::string FrameEncoder::frame_path(const std::string& pathPrefix, std::size_t index, const std::string& fileExtension) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "_%04zu.", index);
+    return pathPrefix + number + fileExtension;
+}
+
+bool FrameEncoder::submit(CapturedFrame frame) {
+    if (finished || failed) {
+        return false;
+    }
+    return queue.push(std::move(frame));
+}
+
+void FrameEncoder::worker() {
+    CapturedFrame frame;
+    while (queue.pop(frame)) {
+        try {
+            if (writeFrame(frame_path(prefix, frame.index, extension), frame)) {
+                written++;
+            } else {
+                failed = true;
+            }
+            if (!options.gifPath.empty()) {
+                std::vector<unsigned char> block = encodeGifFrame(frame, options.gifDelay);
+                std::lock_guard<std::mutex> lock(gifMutex);
+                if (gifFrames.empty()) {
+                    gifWidth = frame.width;
+                    gifHeight = frame.height;
+                } else if (frame.width != gifWidth || frame.height != gifHeight) {
+                    std::cerr << "Error: Frame " << frame.index << " differs in size, left out of the GIF" << std::endl;
+                    failed = true;
+                    continue;
+                }
+                gifFrames[frame.index] = std::move(block);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error: Encoding frame " << frame.index << " failed: " << e.what() << std::endl;
+            failed = true;
+        }
+    }
+}
+
+bool FrameEncoder::finish() {
+    if (finished) {
+        return !failed;
+    }
+    finished = true;
+    queue.close();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    if (!options.gifPath.empty() && !gifFrames.empty()) {
+        std::vector<std::vector<unsigned char>> ordered;
+        ordered.reserve(gifFrames.size());
+        for (auto& entry : gifFrames) {
+            ordered.push_back(std::move(entry.second));
+        }
+        gifFrames.clear();
+        if (!writeGif(options.gifPath, gifWidth, gifHeight, ordered)) {
+            failed = true;
+        }
+    }
+    return !failed;
+}
@@ -0,0 +1,124 @@
+#ifndef FRAME_ENCODER_H
+#define FRAME_ENCODER_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BoundedQueue.h"
+
+/**
+ * One rendered image read back from the framebuffer
+ */
+struct CapturedFrame {
+    std::size_t index = 0;            // Position in the sequence
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> rgb;   // 8-bit RGB, rows from bottom to top as read back from OpenGL
+};
+
+/**
+ * Writes one frame as an image file (e.g. a PNG through vtkPNGWriter)
+ */
+using FrameWriteFn = std::function<bool(const std::string& path, const CapturedFrame& frame)>;
+
+/**
+ * Settings for FrameEncoder
+ */
+struct FrameEncoderOptions {
+    std::size_t threads = 0;      // Encoder threads; 0 = hardware threads - 1 (at least 1)
+    std::size_t queueFrames = 0;  // Captured frames waiting for an encoder; 0 = 2 x threads
+    std::string gifPath;          // Also assemble an animated GIF here (empty = no GIF)
+    int gifDelay = 4;             // Hundredths of a second per GIF frame
+};
+
+/**
+ * Pool of encoder threads writing a numbered image sequence while the next frame renders
+ *
+ * submit() hands a captured frame to the pool and returns at once unless queueFrames frames
+ * are already waiting, so rendering runs ahead of encoding by at most that many frames.
+ * Frame i is written to <prefix>_<i, 4 digits>.<extension>. With a GIF path each thread also
+ * quantizes and LZW-compresses its frames; finish() writes them to the GIF in sequence order.
+ */
+class FrameEncoder {
+public:
+    /**
+     * @param pathPrefix Output path without frame number and extension
+     * @param extension File extension of the sequence (without dot)
+     * @param write Writer for one frame file
+     * @param options Threads, queue depth and GIF output
+     */
+    FrameEncoder(const std::string& pathPrefix, const std::string& extension, FrameWriteFn write,
+                 const FrameEncoderOptions& options = FrameEncoderOptions());
+    ~FrameEncoder();
+
+    FrameEncoder(const FrameEncoder&) = delete;
+    FrameEncoder& operator=(const FrameEncoder&) = delete;
+
+    /**
+     * Queue a frame for encoding, waiting while the queue is full
+     *
+     * @return false after finish() or once a frame failed to encode (the frame is dropped)
+     */
+    bool submit(CapturedFrame frame);
+
+    /**
+     * Wait for all queued frames and write the GIF
+     *
+     * @return true if every frame (and the GIF) was written
+     */
+    bool finish();
+
+    std::size_t frames_written() const { return written; }
+
+    /**
+     * File of frame index in a sequence
+     */
+    static std::string frame_path(const std::string& pathPrefix, std::size_t index, const std::string& extension);
+
+private:
+    void worker();
+
+    std::string prefix;
+    std::string extension;
+    FrameWriteFn writeFrame;
+    FrameEncoderOptions options;
+    BoundedQueue<CapturedFrame> queue;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> written{0};
+    std::atomic<bool> failed{false};
+    bool finished = false;
+
+    std::mutex gifMutex;
+    std::map<std::size_t, std::vector<unsigned char>> gifFrames;  // Encoded GIF image blocks by index
+    int gifWidth = 0;
+    int gifHeight = 0;
+};
+
+/**
+ * Encode a frame as one GIF image block (graphic control extension, image descriptor, LZW data)
+ *
+ * Colors are quantized to the fixed 6 x 7 x 6 palette of writeGif.
+ *
+ * @param frame Captured frame
+ * @param delay Display time in hundredths of a second
+ * @return Bytes of the block, ready to be concatenated into a GIF stream
+ */
+std::vector<unsigned char> encodeGifFrame(const CapturedFrame& frame, int delay);
+
+/**
+ * Write an endlessly looping animated GIF from blocks made by encodeGifFrame
+ *
+ * @param path Output file
+ * @param width Image width (all frames)
+ * @param height Image height (all frames)
+ * @param frames Encoded image blocks in display order
+ * @return true on success
+ */
+bool writeGif(const std::string& path, int width, int height, const std::vector<std::vector<unsigned char>>& frames);
+
+#endif // FRAME_ENCODER_H
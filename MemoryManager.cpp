@@ -0,0 +1,345 @@
+#include "MemoryManager.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+std::string formatMegabytes(std::size_t bytes) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MB";
+    return out.str();
+}
+
+} // namespace
+
+const char* memoryCategoryName(MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::Raw: return "raw";
+        case MemoryCategory::Velocity: return "velocity";
+        case MemoryCategory::VTK: return "vtk";
+        case MemoryCategory::Cache: return "cache";
+        case MemoryCategory::Other: return "other";
+        default: return "unknown";
+    }
+}
+
+MemoryManager& MemoryManager::instance() {
+    static MemoryManager manager;
+    return manager;
+}
+
+MemoryManager::MemoryManager() : budgetBytes(0), usedTotal(0), peakTotal(0), activeEvictions(0), nextEvictorId(1) {
+    std::fill(usedBytes, usedBytes + kCategories, 0);
+    std::fill(peakBytes, peakBytes + kCategories, 0);
+}
+
+void MemoryManager::set_budget(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budgetBytes = bytes;
+}
+
+std::size_t MemoryManager::budget() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return budgetBytes;
+}
+
+bool MemoryManager::fits(std::size_t bytes) const {
+    return budgetBytes == 0 || (bytes <= budgetBytes && usedTotal <= budgetBytes - bytes);
+}
+
+void MemoryManager::add(MemoryCategory category, std::size_t bytes) {
+    std::size_t c = static_cast<std::size_t>(category);
+    usedBytes[c] += bytes;
+    usedTotal += bytes;
+    peakBytes[c] = std::max(peakBytes[c], usedBytes[c]);
+    peakTotal = std::max(peakTotal, usedTotal);
+}
+
+bool MemoryManager::try_reserve(MemoryCategory category, std::size_t bytes, bool allowEviction) {
+    while (true) {
+        std::size_t shortfall;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fits(bytes)) {
+                add(category, bytes);
+                return true;
+            }
+            shortfall = usedTotal + bytes - budgetBytes;
+        }
+        // Evictors release through the manager, so they run without the accounting lock held
+        if (!allowEviction || evict(shortfall) == 0) {
+            return false;
+        }
+    }
+}
+
+void MemoryManager::reserve(MemoryCategory category, std::size_t bytes) {
+    if (try_reserve(category, bytes)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    throw MemoryBudgetError("Memory budget exceeded: cannot allocate " + formatMegabytes(bytes) +
+                            " of " + memoryCategoryName(category) + " data (" + formatMegabytes(usedTotal) +
+                            " in use, budget " + formatMegabytes(budgetBytes) + ")");
+}
+
+void MemoryManager::release(MemoryCategory category, std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::size_t c = static_cast<std::size_t>(category);
+    bytes = std::min(bytes, usedBytes[c]);
+    usedBytes[c] -= bytes;
+    usedTotal -= bytes;
+}
+
+void MemoryManager::transfer(MemoryCategory from, MemoryCategory to, std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::size_t f = static_cast<std::size_t>(from);
+    bytes = std::min(bytes, usedBytes[f]);
+    usedBytes[f] -= bytes;
+    usedTotal -= bytes;
+    add(to, bytes);
+}
+
+std::size_t MemoryManager::used(MemoryCategory category) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usedBytes[static_cast<std::size_t>(category)];
+}
+
+std::size_t MemoryManager::used_total() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usedTotal;
+}
+
+std::size_t MemoryManager::peak(MemoryCategory category) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return peakBytes[static_cast<std::size_t>(category)];
+}
+
+std::size_t MemoryManager::peak_total() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return peakTotal;
+}
+
+void MemoryManager::reset_peak() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::copy(usedBytes, usedBytes + kCategories, peakBytes);
+    peakTotal = usedTotal;
+}
+
+int MemoryManager::add_evictor(Evictor evictor) {
+    std::lock_guard<std::mutex> lock(evictorMutex);
+    int id = nextEvictorId++;
+    evictors.emplace_back(id, std::move(evictor));
+    return id;
+}
+
+void MemoryManager::remove_evictor(int id) {
+    std::unique_lock<std::mutex> lock(evictorMutex);
+    evictors.erase(std::remove_if(evictors.begin(), evictors.end(),
+                                  [id](const std::pair<int, Evictor>& entry) { return entry.first == id; }),
+                   evictors.end());
+    // A snapshot taken by evict() on another thread may still be calling it
+    evictorsIdle.wait(lock, [this]() { return activeEvictions == 0; });
+}
+
+std::size_t MemoryManager::evict(std::size_t bytesNeeded) {
+    // Callbacks run on a snapshot without the lock, so an evictor that takes its owner's
+    // lock cannot deadlock against a thread registering or removing evictors
+    std::vector<std::pair<int, Evictor>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(evictorMutex);
+        snapshot = evictors;
+        activeEvictions++;
+    }
+    std::size_t freed = 0;
+    for (auto& entry : snapshot) {
+        if (freed >= bytesNeeded) {
+            break;
+        }
+        freed += entry.second(bytesNeeded - freed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(evictorMutex);
+        activeEvictions--;
+    }
+    evictorsIdle.notify_all();
+    return freed;
+}
+
+void MemoryManager::print_report() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "=== Memory Usage ===" << std::endl;
+    for (std::size_t c = 0; c < kCategories; c++) {
+        std::cout << std::left << std::setw(10) << memoryCategoryName(static_cast<MemoryCategory>(c))
+                  << formatMegabytes(usedBytes[c]) << " (peak " << formatMegabytes(peakBytes[c]) << ")" << std::endl;
+    }
+    std::cout << std::left << std::setw(10) << "total" << formatMegabytes(usedTotal)
+              << " (peak " << formatMegabytes(peakTotal) << ")";
+    if (budgetBytes > 0) {
+        std::cout << ", budget " << formatMegabytes(budgetBytes);
+    }
+    std::cout << std::right << std::endl;
+    std::cout << "====================" << std::endl;
+}
+
+MemoryReservation::MemoryReservation(MemoryCategory category, std::size_t bytes) : category(category), bytes(bytes) {
+    MemoryManager::instance().reserve(category, bytes);
+}
+
+MemoryReservation::~MemoryReservation() {
+    if (bytes > 0) {
+        MemoryManager::instance().release(category, bytes);
+    }
+}
+
+MemoryReservation::MemoryReservation(MemoryReservation&& other) noexcept : category(other.category), bytes(other.bytes) {
+    other.bytes = 0;
+}
+
+MemoryReservation& MemoryReservation::operator=(MemoryReservation&& other) noexcept {
+    if (this != &other) {
+        if (bytes > 0) {
+            MemoryManager::instance().release(category, bytes);
+        }
+        category = other.category;
+        bytes = other.bytes;
+        other.bytes = 0;
+    }
+    return *this;
+}
+
+PooledBuffer::~PooledBuffer() {
+    give_back();
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+    : storage(std::move(other.storage)), pool(other.pool), accounted(other.accounted) {
+    other.pool = nullptr;
+    other.accounted = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+    if (this != &other) {
+        give_back();
+        storage = std::move(other.storage);
+        pool = other.pool;
+        accounted = other.accounted;
+        other.pool = nullptr;
+        other.accounted = 0;
+    }
+    return *this;
+}
+
+bool PooledBuffer::reserve_capacity(std::size_t bytes) {
+    if (bytes <= storage.capacity()) {
+        return true;
+    }
+    if (pool == nullptr) {
+        storage.reserve(bytes);
+        return true;
+    }
+    std::size_t growth = bytes > accounted ? bytes - accounted : 0;
+    if (!MemoryManager::instance().try_reserve(pool->category, growth)) {
+        return false;
+    }
+    accounted += growth;
+    storage.reserve(bytes);
+    return true;
+}
+
+void PooledBuffer::give_back() {
+    if (pool != nullptr) {
+        pool->give_back(std::move(storage), accounted);
+        pool = nullptr;
+        accounted = 0;
+    }
+    storage = std::vector<char>();
+}
+
+BufferPool::BufferPool(MemoryCategory category, std::size_t maxIdleBytes)
+    : category(category), maxIdle(maxIdleBytes), idleBytes(0) {
+    evictorId = MemoryManager::instance().add_evictor([this](std::size_t bytes) { return trim(bytes); });
+}
+
+BufferPool::~BufferPool() {
+    MemoryManager::instance().remove_evictor(evictorId);
+    trim();
+}
+
+BufferPool& BufferPool::shared() {
+    static BufferPool pool(MemoryCategory::Raw);
+    return pool;
+}
+
+PooledBuffer BufferPool::acquire(std::size_t minBytes) {
+    PooledBuffer buffer;
+    buffer.pool = this;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto best = idle.end();
+        for (auto it = idle.begin(); it != idle.end(); ++it) {
+            if (it->capacity() >= minBytes && (best == idle.end() || it->capacity() < best->capacity())) {
+                best = it;
+            }
+        }
+        if (best != idle.end()) {
+            buffer.storage = std::move(*best);
+            idle.erase(best);
+            buffer.accounted = buffer.storage.capacity();
+            idleBytes -= buffer.accounted;
+            MemoryManager::instance().transfer(MemoryCategory::Cache, category, buffer.accounted);
+            buffer.storage.clear();
+            return buffer;
+        }
+    }
+
+    // No idle buffer fits; reserve first (may evict idle buffers) so an over-budget request fails cleanly
+    if (minBytes > 0) {
+        MemoryManager::instance().reserve(category, minBytes);
+        buffer.accounted = minBytes;
+        buffer.storage.reserve(minBytes);
+    }
+    return buffer;
+}
+
+void BufferPool::give_back(std::vector<char>&& buffer, std::size_t accounted) {
+    MemoryManager& memory = MemoryManager::instance();
+    std::size_t capacity = buffer.capacity();
+
+    // Idle buffers are charged to Cache at their real capacity
+    memory.release(category, accounted);
+    if (capacity == 0) {
+        return;
+    }
+    // Size check and push under one lock, so concurrent returns cannot overshoot maxIdle.
+    // Kept only if that fits the budget as is (evicting other caches to keep one would be pointless).
+    std::lock_guard<std::mutex> lock(mutex);
+    if (idleBytes + capacity > maxIdle || !memory.try_reserve(MemoryCategory::Cache, capacity, false)) {
+        return;
+    }
+    idle.push_back(std::move(buffer));
+    idleBytes += capacity;
+}
+
+std::size_t BufferPool::trim(std::size_t bytes) {
+    std::vector<std::vector<char>> freed;
+    std::size_t freedBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!idle.empty() && freedBytes < bytes) {
+            freedBytes += idle.back().capacity();
+            freed.push_back(std::move(idle.back()));
+            idle.pop_back();
+        }
+        idleBytes -= freedBytes;
+    }
+    MemoryManager::instance().release(MemoryCategory::Cache, freedBytes);
+    return freedBytes;
+}
+
+std::size_t BufferPool::idle_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return idleBytes;
+}
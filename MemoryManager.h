@@ -0,0 +1,245 @@
+#ifndef MEMORY_MANAGER_H
+#define MEMORY_MANAGER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * What an accounted allocation holds
+ */
+enum class MemoryCategory {
+    Raw,      // Pixel data as loaded from DICOM (phase, magnitude) and loader buffers
+    Velocity, // Velocity components and other derived volumes
+    VTK,      // Copies handed to VTK (image data, polydata)
+    Cache,    // Reusable or recomputable data (pooled buffers, cached results); can be evicted
+    Other,
+    Count
+};
+
+/**
+ * Name of a category for reports
+ */
+const char* memoryCategoryName(MemoryCategory category);
+
+/**
+ * Thrown when an allocation would exceed the memory budget even after evicting caches
+ */
+class MemoryBudgetError : public std::runtime_error {
+public:
+    explicit MemoryBudgetError(const std::string& message) : std::runtime_error(message) {}
+};
+
+/**
+ * Process-wide byte accounting per category, with peak tracking and an optional budget
+ *
+ * Owners of large buffers reserve bytes before allocating and release them afterwards.
+ * When a reservation would exceed the budget, registered evictors (caches) are asked to
+ * free memory; if that is not enough the reservation fails with MemoryBudgetError, so a
+ * load fails with a clear message instead of the process being OOM-killed. Thread-safe.
+ */
+class MemoryManager {
+public:
+    // Frees up to bytesNeeded bytes (releasing them through the manager) and returns how many were freed
+    using Evictor = std::function<std::size_t(std::size_t bytesNeeded)>;
+
+    static MemoryManager& instance();
+
+    /**
+     * Set the budget for all categories together
+     *
+     * @param bytes Maximum accounted bytes; 0 disables the limit
+     */
+    void set_budget(std::size_t bytes);
+    std::size_t budget() const;
+
+    /**
+     * Account for an allocation, evicting caches if it would exceed the budget
+     *
+     * @param category Category to charge
+     * @param bytes Size of the allocation
+     * @throws MemoryBudgetError if the budget cannot be met
+     */
+    void reserve(MemoryCategory category, std::size_t bytes);
+
+    /**
+     * Like reserve(), but returns false instead of throwing
+     *
+     * @param allowEviction Whether caches may be evicted to make room
+     */
+    bool try_reserve(MemoryCategory category, std::size_t bytes, bool allowEviction = true);
+
+    void release(MemoryCategory category, std::size_t bytes);
+
+    /**
+     * Move accounted bytes between categories (no budget check; the total is unchanged)
+     */
+    void transfer(MemoryCategory from, MemoryCategory to, std::size_t bytes);
+
+    std::size_t used(MemoryCategory category) const;
+    std::size_t used_total() const;
+    std::size_t peak(MemoryCategory category) const;
+    std::size_t peak_total() const;
+    void reset_peak();
+
+    /**
+     * Register a cache that can give memory back under pressure
+     *
+     * Evictors are called without any manager lock held, on whichever thread's reserve()
+     * ran short, possibly on several threads at once. They must lock their own state and
+     * must not reserve memory themselves.
+     *
+     * @return Id for remove_evictor()
+     */
+    int add_evictor(Evictor evictor);
+
+    /**
+     * Unregister an evictor; waits for calls to it already in progress on other threads,
+     * so the owner can be destroyed afterwards
+     */
+    void remove_evictor(int id);
+
+    /**
+     * Print current and peak usage per category
+     */
+    void print_report() const;
+
+private:
+    MemoryManager();
+
+    bool fits(std::size_t bytes) const;
+    void add(MemoryCategory category, std::size_t bytes);
+    std::size_t evict(std::size_t bytesNeeded);
+
+    static const std::size_t kCategories = static_cast<std::size_t>(MemoryCategory::Count);
+
+    mutable std::mutex mutex;
+    std::size_t budgetBytes;
+    std::size_t usedBytes[kCategories];
+    std::size_t peakBytes[kCategories];
+    std::size_t usedTotal;
+    std::size_t peakTotal;
+
+    std::mutex evictorMutex;
+    std::condition_variable evictorsIdle;
+    std::vector<std::pair<int, Evictor>> evictors;
+    std::size_t activeEvictions; // evict() calls running callbacks; guarded by evictorMutex
+    int nextEvictorId;
+};
+
+/**
+ * RAII reservation for memory owned by someone else (e.g. a VTK array)
+ */
+class MemoryReservation {
+public:
+    MemoryReservation() : category(MemoryCategory::Other), bytes(0) {}
+    MemoryReservation(MemoryCategory category, std::size_t bytes);
+    ~MemoryReservation();
+
+    MemoryReservation(const MemoryReservation&) = delete;
+    MemoryReservation& operator=(const MemoryReservation&) = delete;
+    MemoryReservation(MemoryReservation&& other) noexcept;
+    MemoryReservation& operator=(MemoryReservation&& other) noexcept;
+
+    std::size_t size() const { return bytes; }
+
+private:
+    MemoryCategory category;
+    std::size_t bytes;
+};
+
+class BufferPool;
+
+/**
+ * Byte buffer borrowed from a BufferPool; returned to the pool when destroyed
+ */
+class PooledBuffer {
+public:
+    PooledBuffer() : pool(nullptr), accounted(0) {}
+    ~PooledBuffer();
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+    std::vector<char>& bytes() { return storage; }
+    const std::vector<char>& bytes() const { return storage; }
+
+    /**
+     * Grow the capacity to at least the given size, charging the growth to the pool's category
+     *
+     * Call before filling the buffer, so its growth is accounted while borrowed.
+     *
+     * @return false (buffer unchanged) if the growth does not fit the budget
+     */
+    bool reserve_capacity(std::size_t bytes);
+
+private:
+    friend class BufferPool;
+    void give_back();
+
+    std::vector<char> storage;
+    BufferPool* pool;
+    std::size_t accounted; // Capacity charged to the pool's category
+};
+
+/**
+ * Pool of byte buffers (file, slice and frame buffers) reused across loads
+ *
+ * Borrowed buffers are charged to the pool's category; idle buffers are charged to Cache
+ * and are freed first when the memory budget is tight (the pool registers an evictor).
+ */
+class BufferPool {
+public:
+    /**
+     * @param category Category charged for borrowed buffers
+     * @param maxIdleBytes Idle capacity kept for reuse; buffers beyond this are freed on return
+     */
+    explicit BufferPool(MemoryCategory category = MemoryCategory::Raw, std::size_t maxIdleBytes = 256u << 20);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * Pool shared by the DICOM loaders
+     */
+    static BufferPool& shared();
+
+    /**
+     * Borrow a buffer with at least minBytes of capacity (contents unspecified, size 0)
+     *
+     * Reuses the smallest idle buffer that is large enough, otherwise allocates.
+     *
+     * @throws MemoryBudgetError if a new allocation does not fit the budget
+     */
+    PooledBuffer acquire(std::size_t minBytes = 0);
+
+    /**
+     * Free idle buffers
+     *
+     * @param bytes Stop after freeing at least this many bytes
+     * @return Bytes freed
+     */
+    std::size_t trim(std::size_t bytes = static_cast<std::size_t>(-1));
+
+    std::size_t idle_bytes() const;
+
+private:
+    friend class PooledBuffer;
+    void give_back(std::vector<char>&& buffer, std::size_t accounted);
+
+    MemoryCategory category;
+    std::size_t maxIdle;
+    mutable std::mutex mutex;
+    std::vector<std::vector<char>> idle;
+    std::size_t idleBytes;
+    int evictorId;
+};
+
+#endif // MEMORY_MANAGER_H
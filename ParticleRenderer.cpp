@@ -0,0 +1,75 @@
+#include "ParticleRenderer.h"
+#include <vtkPointData.h>
+#include <vtkProperty.h>
+#include <algorithm>
+
+ParticleRenderer::ParticleRenderer(const ParticleSystem& particles) : particles(particles) {
+    // Buffers for the largest population; the VTK arrays only borrow them (see update())
+    std::size_t capacity = std::max<std::size_t>(1, particles.max_particles());
+    positionBuffer.resize(3 * capacity);
+    speedBuffer.resize(capacity);
+
+    positions = vtkSmartPointer<vtkFloatArray>::New();
+    positions->SetNumberOfComponents(3);
+
+    speeds = vtkSmartPointer<vtkFloatArray>::New();
+    speeds->SetName("Speed");
+
+    points = vtkSmartPointer<vtkPoints>::New();
+    points->SetData(positions);
+
+    polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->SetPoints(points);
+    polyData->GetPointData()->AddArray(speeds);
+
+    colorTable = vtkSmartPointer<vtkLookupTable>::New();
+    colorTable->SetNumberOfColors(256);
+    colorTable->SetHueRange(0.667, 0.0); // Blue to Red (low to high speed)
+    colorTable->Build();
+
+    // Gaussian splats are drawn as point sprites, one quad per particle with no extra geometry
+    mapper = vtkSmartPointer<vtkPointGaussianMapper>::New();
+    mapper->SetInputData(polyData);
+    mapper->SetScaleFactor(0.5);
+    mapper->EmissiveOff();
+    mapper->SetScalarModeToUsePointFieldData();
+    mapper->SelectColorArray("Speed");
+    mapper->SetLookupTable(colorTable);
+    mapper->SetScalarRange(0.0, 1.0);
+
+    particleActor = vtkSmartPointer<vtkActor>::New();
+    particleActor->SetMapper(mapper);
+
+    update();
+}
+
+void ParticleRenderer::update() {
+    std::size_t count = particles.size();
+    // Grows only if more particles live than the buffers were sized for (maximum raised later)
+    if (count > speedBuffer.size()) {
+        positionBuffer.resize(3 * count);
+        speedBuffer.resize(count);
+    }
+
+    if (count > 0) {
+        particles.copy_positions_interleaved(positionBuffer.data());
+        std::copy(particles.speed(), particles.speed() + count, speedBuffer.data());
+    }
+    // Point the arrays at the first count entries; save = 1 keeps VTK from freeing or
+    // reallocating the buffers, whereas SetNumberOfTuples resizes on every count change
+    positions->SetArray(positionBuffer.data(), static_cast<vtkIdType>(3 * count), 1);
+    speeds->SetArray(speedBuffer.data(), static_cast<vtkIdType>(count), 1);
+
+    positions->Modified();
+    speeds->Modified();
+    points->Modified();
+    polyData->Modified();
+}
+
+void ParticleRenderer::set_speed_range(double minSpeed, double maxSpeed) {
+    mapper->SetScalarRange(minSpeed, maxSpeed);
+}
+
+void ParticleRenderer::set_sprite_radius(double radius) {
+    mapper->SetScaleFactor(radius);
+}
@@ -0,0 +1,60 @@
+#ifndef PARTICLE_RENDERER_H
+#define PARTICLE_RENDERER_H
+
+#include <vtkSmartPointer.h>
+#include <vtkActor.h>
+#include <vtkFloatArray.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPointGaussianMapper.h>
+#include <vtkLookupTable.h>
+#include <vector>
+#include "ParticleSystem.h"
+
+/**
+ * Draws a ParticleSystem as point sprites
+ *
+ * Positions and speeds are copied into buffers sized once for max_particles() (grown only if
+ * a larger maximum is set later), and the VTK point and speed arrays are pointed at the live
+ * part of them on every update(), so animating neither allocates nor rebuilds the polydata.
+ */
+class ParticleRenderer {
+public:
+    explicit ParticleRenderer(const ParticleSystem& particles);
+
+    vtkActor* actor() const { return particleActor; }
+
+    /**
+     * Copy the current particle positions and speeds into the VTK buffers
+     */
+    void update();
+
+    /**
+     * Set the speed range mapped onto the color table
+     *
+     * @param minSpeed Speed drawn blue
+     * @param maxSpeed Speed drawn red
+     */
+    void set_speed_range(double minSpeed, double maxSpeed);
+
+    /**
+     * Set the sprite radius
+     *
+     * @param radius Radius in data coordinates (voxels)
+     */
+    void set_sprite_radius(double radius);
+
+private:
+    const ParticleSystem& particles;
+    std::vector<float> positionBuffer; // 3 x max_particles(), interleaved x y z
+    std::vector<float> speedBuffer;    // max_particles()
+    vtkSmartPointer<vtkFloatArray> positions;
+    vtkSmartPointer<vtkFloatArray> speeds;
+    vtkSmartPointer<vtkPoints> points;
+    vtkSmartPointer<vtkPolyData> polyData;
+    vtkSmartPointer<vtkLookupTable> colorTable;
+    vtkSmartPointer<vtkPointGaussianMapper> mapper;
+    vtkSmartPointer<vtkActor> particleActor;
+};
+
+#endif // PARTICLE_RENDERER_H
@@ -0,0 +1,206 @@
+#include "ParticleSystem.h"
+#include "parallel_utils.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+// Particles per sampler call; small enough for the scratch arrays to stay in L1/L2
+const std::size_t kBatchSize = 1024;
+
+// Particles per compaction chunk
+const std::size_t kCompactChunk = 1 << 16;
+
+} // namespace
+
+ParticleSystem::ParticleSystem(const VelocitySampler& sampler)
+    : sampler(sampler),
+      maxParticles(1000000),
+      lifetime(20.0f),
+      velocityScale{1.0f, 1.0f, 1.0f},
+      jitter(0.5f),
+      emitCounter(0) {}
+
+void ParticleSystem::add_mask_source(const Volume4D& mask, float threshold, std::size_t stride) {
+    if (mask.size_x() != sampler.size_x() || mask.size_y() != sampler.size_y() || mask.size_z() != sampler.size_z()) {
+        throw std::invalid_argument("ParticleSystem::add_mask_source: Mask is not on the velocity grid");
+    }
+    stride = std::max<std::size_t>(1, stride);
+
+    if (maskPoints.size() < mask.size_t()) {
+        maskPoints.resize(mask.size_t());
+    }
+    for (std::size_t t = 0; t < mask.size_t(); t++) {
+        const float* frame = mask.frame_data(t);
+        for (std::size_t z = 0; z < mask.size_z(); z += stride) {
+            for (std::size_t y = 0; y < mask.size_y(); y += stride) {
+                for (std::size_t x = 0; x < mask.size_x(); x += stride) {
+                    if (frame[(z * mask.size_y() + y) * mask.size_x() + x] > threshold) {
+                        maskPoints[t].push_back(static_cast<float>(x));
+                        maskPoints[t].push_back(static_cast<float>(y));
+                        maskPoints[t].push_back(static_cast<float>(z));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ParticleSystem::add_plane_source(const PlaneSource& plane) {
+    planes.push_back(plane);
+}
+
+void ParticleSystem::clear_sources() {
+    maskPoints.clear();
+    planes.clear();
+}
+
+void ParticleSystem::clear() {
+    px.clear();
+    py.clear();
+    pz.clear();
+    page.clear();
+    pspeed.clear();
+}
+
+void ParticleSystem::append(float x, float y, float z) {
+    px.push_back(x);
+    py.push_back(y);
+    pz.push_back(z);
+    page.push_back(0.0f);
+    pspeed.push_back(0.0f);
+}
+
+std::size_t ParticleSystem::emit(float time) {
+    std::size_t before = size();
+    std::minstd_rand gen(++emitCounter);
+    std::uniform_real_distribution<float> offset(-jitter, jitter);
+
+    if (!maskPoints.empty()) {
+        long count = static_cast<long>(maskPoints.size());
+        long frame = ((std::lround(time) % count) + count) % count;
+        const std::vector<float>& points = maskPoints[static_cast<std::size_t>(frame)];
+        for (std::size_t i = 0; i + 2 < points.size() && size() < maxParticles; i += 3) {
+            append(points[i] + offset(gen), points[i + 1] + offset(gen), points[i + 2] + offset(gen));
+        }
+    }
+
+    for (const PlaneSource& plane : planes) {
+        for (std::size_t j = 0; j < plane.countV && size() < maxParticles; j++) {
+            float b = -1.0f + 2.0f * (j + 0.5f) / plane.countV;
+            for (std::size_t i = 0; i < plane.countU && size() < maxParticles; i++) {
+                float a = -1.0f + 2.0f * (i + 0.5f) / plane.countU;
+                append(plane.center[0] + a * plane.u[0] + b * plane.v[0] + offset(gen),
+                       plane.center[1] + a * plane.u[1] + b * plane.v[1] + offset(gen),
+                       plane.center[2] + a * plane.u[2] + b * plane.v[2] + offset(gen));
+            }
+        }
+    }
+
+    return size() - before;
+}
+
+void ParticleSystem::advance(float time, float dt) {
+    std::size_t n = size();
+    if (n == 0) {
+        return;
+    }
+
+    const float hx = dt * velocityScale[0];
+    const float hy = dt * velocityScale[1];
+    const float hz = dt * velocityScale[2];
+    const float maxX = static_cast<float>(sampler.size_x() - 1);
+    const float maxY = static_cast<float>(sampler.size_y() - 1);
+    const float maxZ = static_cast<float>(sampler.size_z() - 1);
+    alive.resize(n);
+
+    // Midpoint step in batches; each chunk of particles belongs to one thread
+    parallelForRange(0, n, [&](std::size_t begin, std::size_t end) {
+        std::vector<float> vx(kBatchSize), vy(kBatchSize), vz(kBatchSize);
+        std::vector<float> mx(kBatchSize), my(kBatchSize), mz(kBatchSize);
+
+        for (std::size_t start = begin; start < end; start += kBatchSize) {
+            std::size_t m = std::min(kBatchSize, end - start);
+            float* x = px.data() + start;
+            float* y = py.data() + start;
+            float* z = pz.data() + start;
+
+            sampler.sample_soa(x, y, z, m, vx.data(), vy.data(), vz.data(), time);
+            for (std::size_t i = 0; i < m; i++) {
+                mx[i] = x[i] + 0.5f * hx * vx[i];
+                my[i] = y[i] + 0.5f * hy * vy[i];
+                mz[i] = z[i] + 0.5f * hz * vz[i];
+            }
+
+            sampler.sample_soa(mx.data(), my.data(), mz.data(), m, vx.data(), vy.data(), vz.data(), time + 0.5f * dt);
+            float* a = page.data() + start;
+            float* s = pspeed.data() + start;
+            unsigned char* keep = alive.data() + start;
+            for (std::size_t i = 0; i < m; i++) {
+                x[i] += hx * vx[i];
+                y[i] += hy * vy[i];
+                z[i] += hz * vz[i];
+                a[i] += dt;
+                s[i] = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+                bool inside = x[i] >= 0.0f && x[i] <= maxX && y[i] >= 0.0f && y[i] <= maxY && z[i] >= 0.0f && z[i] <= maxZ;
+                keep[i] = inside && a[i] <= lifetime;
+            }
+        }
+    }, kBatchSize);
+
+    // Stable parallel compaction: count survivors per chunk, prefix-sum, then scatter
+    std::size_t chunks = (n + kCompactChunk - 1) / kCompactChunk;
+    std::vector<std::size_t> offsets(chunks + 1, 0);
+    parallelFor(0, chunks, [&](std::size_t c) {
+        std::size_t begin = c * kCompactChunk;
+        std::size_t end = std::min(n, begin + kCompactChunk);
+        offsets[c + 1] = static_cast<std::size_t>(std::count(alive.begin() + begin, alive.begin() + end, 1));
+    });
+    for (std::size_t c = 0; c < chunks; c++) {
+        offsets[c + 1] += offsets[c];
+    }
+
+    std::size_t survivors = offsets[chunks];
+    if (survivors == n) {
+        return;
+    }
+
+    nx.resize(survivors);
+    ny.resize(survivors);
+    nz.resize(survivors);
+    nage.resize(survivors);
+    nspeed.resize(survivors);
+    parallelFor(0, chunks, [&](std::size_t c) {
+        std::size_t begin = c * kCompactChunk;
+        std::size_t end = std::min(n, begin + kCompactChunk);
+        std::size_t out = offsets[c];
+        for (std::size_t i = begin; i < end; i++) {
+            if (alive[i]) {
+                nx[out] = px[i];
+                ny[out] = py[i];
+                nz[out] = pz[i];
+                nage[out] = page[i];
+                nspeed[out] = pspeed[i];
+                out++;
+            }
+        }
+    });
+
+    px.swap(nx);
+    py.swap(ny);
+    pz.swap(nz);
+    page.swap(nage);
+    pspeed.swap(nspeed);
+}
+
+void ParticleSystem::copy_positions_interleaved(float* xyz) const {
+    parallelForRange(0, size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; i++) {
+            xyz[3 * i] = px[i];
+            xyz[3 * i + 1] = py[i];
+            xyz[3 * i + 2] = pz[i];
+        }
+    }, kCompactChunk);
+}
@@ -0,0 +1,122 @@
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Volume4D.h"
+#include "VelocitySampler.h"
+
+/**
+ * Rectangular emitter: a grid of countU x countV points spanning center +/- u +/- v
+ * (voxel coordinates)
+ */
+struct PlaneSource {
+    float center[3] = {0.0f, 0.0f, 0.0f};
+    float u[3] = {1.0f, 0.0f, 0.0f};
+    float v[3] = {0.0f, 1.0f, 0.0f};
+    std::size_t countU = 32;
+    std::size_t countV = 32;
+};
+
+/**
+ * Particle advection through the time-resolved velocity field
+ *
+ * Particles are kept as structure-of-arrays (x, y, z, age, speed) and advected with a
+ * midpoint (RK2) step in batches through VelocitySampler::sample_soa, spread over the
+ * worker threads. Particles that leave the grid or outlive their lifetime are compacted
+ * away after each step. Sources emit one batch of particles per call to emit(), which
+ * the caller does once per cardiac frame.
+ *
+ * Positions are voxel coordinates and time is in frames.
+ */
+class ParticleSystem {
+public:
+    explicit ParticleSystem(const VelocitySampler& sampler);
+
+    /**
+     * Emit from every voxel of a mask (sub-sampled by stride) whose value exceeds threshold
+     *
+     * @param mask Mask on the velocity grid; a 4D mask selects the frame nearest the emission time
+     * @param threshold Voxels above this value emit
+     * @param stride Emit from every stride-th voxel along each axis
+     */
+    void add_mask_source(const Volume4D& mask, float threshold = 0.5f, std::size_t stride = 1);
+
+    /**
+     * Emit from a grid of points on a plane
+     *
+     * @param plane Plane emitter in voxel coordinates
+     */
+    void add_plane_source(const PlaneSource& plane);
+
+    void clear_sources();
+
+    void set_max_particles(std::size_t count) { maxParticles = count; }
+    void set_lifetime(float frames) { lifetime = frames; }
+    // Voxels travelled per frame for a velocity of 1 (depends on spacing, frame interval and units)
+    void set_velocity_scale(float voxelsPerFrame) { set_velocity_scale(voxelsPerFrame, voxelsPerFrame, voxelsPerFrame); }
+    // Per axis, for anisotropic voxels
+    void set_velocity_scale(float x, float y, float z) {
+        velocityScale[0] = x;
+        velocityScale[1] = y;
+        velocityScale[2] = z;
+    }
+    // Random offset, in voxels, added to emitted positions to avoid visible grid patterns
+    void set_jitter(float voxels) { jitter = voxels; }
+
+    /**
+     * Emit one batch from all sources; stops early when max_particles is reached
+     *
+     * @param time Emission time in frames
+     * @return Number of particles emitted
+     */
+    std::size_t emit(float time);
+
+    /**
+     * Advance all particles by dt frames, then retire particles outside the grid or past their lifetime
+     *
+     * @param time Current time in frames
+     * @param dt Step in frames
+     */
+    void advance(float time, float dt);
+
+    void clear();
+
+    std::size_t size() const { return px.size(); }
+    std::size_t max_particles() const { return maxParticles; }
+    const float* x() const { return px.data(); }
+    const float* y() const { return py.data(); }
+    const float* z() const { return pz.data(); }
+    const float* age() const { return page.data(); }
+    const float* speed() const { return pspeed.data(); }
+
+    /**
+     * Write positions interleaved (x0, y0, z0, x1, ...) into a caller buffer, in parallel
+     *
+     * @param xyz Destination, 3 * size() floats
+     */
+    void copy_positions_interleaved(float* xyz) const;
+
+private:
+    void append(float x, float y, float z);
+
+    const VelocitySampler& sampler;
+
+    // Particle state (SoA), plus spare arrays used as the compaction target
+    std::vector<float> px, py, pz, page, pspeed;
+    std::vector<float> nx, ny, nz, nage, nspeed;
+    std::vector<unsigned char> alive;
+
+    // Mask emitter positions (interleaved xyz), one list per mask frame
+    std::vector<std::vector<float>> maskPoints;
+    std::vector<PlaneSource> planes;
+
+    std::size_t maxParticles;
+    float lifetime;
+    float velocityScale[3];
+    float jitter;
+    std::uint32_t emitCounter;
+};
+
+#endif // PARTICLE_SYSTEM_H
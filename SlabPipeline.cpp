@@ -0,0 +1,380 @@
+#include "SlabPipeline.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <mutex>
+#include "dicom_pipeline.h"
+#include "dicom_utils.h"
+#include "parallel_utils.h"
+
+namespace {
+
+bool sameShape(const Volume4D& volume, std::size_t x, std::size_t y, std::size_t z, std::size_t t) {
+    return volume.size_x() == x && volume.size_y() == y && volume.size_z() == z && volume.size_t() == t;
+}
+
+// Resize only if the shape changes, so reused slab buffers are not cleared or reallocated
+void shapeSlab(Volume4D& slab, std::size_t x, std::size_t y, std::size_t z, std::size_t t) {
+    if (!sameShape(slab, x, y, z, t)) {
+        slab.resize(x, y, z, t);
+    }
+}
+
+} // namespace
+
+Volume4D& Slab::channel(std::size_t i) {
+    if (i >= channels.size()) {
+        channels.resize(i + 1);
+    }
+    Volume4D& volume = channels[i];
+    const Volume4D& reference = channels[0];
+    if (i > 0 && !sameShape(volume, reference.size_x(), reference.size_y(), reference.size_z(), reference.size_t())) {
+        volume.set_category(MemoryCategory::Velocity);
+        volume.resize(reference.size_x(), reference.size_y(), reference.size_z(), reference.size_t());
+    }
+    return volume;
+}
+
+Volume4D& Slab::scratch(std::size_t i) {
+    if (i >= buffers.size()) {
+        buffers.resize(i + 1);
+    }
+    Volume4D& volume = buffers[i];
+    if (volume.get_category() != MemoryCategory::Velocity) {
+        volume.set_category(MemoryCategory::Velocity);
+    }
+    return volume;
+}
+
+VolumeCacheSource::VolumeCacheSource(const std::string& path) {
+    cache.open(path);
+}
+
+bool VolumeCacheSource::read(std::size_t z0, std::size_t count, Volume4D& slab) {
+    return cache.read_slab(z0, count, slab);
+}
+
+DicomSliceSource::DicomSliceSource(const std::string& dicomFolderPath)
+    : dim_x(0), dim_y(0), dim_z(0), dim_t(0), slope(1.0), intercept(0.0) {
+    if (!std::filesystem::is_directory(dicomFolderPath)) {
+        std::cerr << "Error: Slab streaming needs a folder of single-frame DICOM files: " << dicomFolderPath << std::endl;
+        return;
+    }
+
+    std::vector<int> dimensions = get4DSize(dicomFolderPath);
+    for (const auto& entry : std::filesystem::directory_iterator(dicomFolderPath)) {
+        if (entry.is_regular_file()) {
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    if (dimensions[0] <= 0 || dimensions[1] <= 0 || dimensions[2] <= 0 || dimensions[3] <= 0 ||
+        paths.size() < static_cast<std::size_t>(dimensions[2]) * dimensions[3]) {
+        std::cerr << "Error: Cannot determine the study size of " << dicomFolderPath << std::endl;
+        return;
+    }
+    readRescaleParameters(dicomFolderPath, slope, intercept);
+    dim_x = dimensions[0];
+    dim_y = dimensions[1];
+    dim_z = dimensions[2];
+    dim_t = dimensions[3];
+}
+
+bool DicomSliceSource::read(std::size_t z0, std::size_t count, Volume4D& slab) {
+    if (!valid() || z0 + count > dim_z) {
+        return false;
+    }
+    shapeSlab(slab, dim_x, dim_y, count, dim_t);
+
+    // Files of the requested slices in slab order (z fastest), so file i lands on
+    // slice i % count of frame i / count
+    std::vector<std::string> slabPaths;
+    slabPaths.reserve(count * dim_t);
+    for (std::size_t t = 0; t < dim_t; t++) {
+        for (std::size_t z = z0; z < z0 + count; z++) {
+            slabPaths.push_back(paths[t * dim_z + z]);
+        }
+    }
+
+    // Slabs are already read in parallel, so keep each slab's pipeline small
+    DicomPipelineOptions options;
+    options.readerThreads = 1;
+    options.parserThreads = 1;
+    options.converterThreads = 1;
+    options.queueDepth = 4;
+    options.readahead = 4;
+    return loadDicomFilesPipelined(slabPaths, slab, options);
+}
+
+bool VolumeSource::read(std::size_t z0, std::size_t count, Volume4D& slab) {
+    if (z0 + count > volume.size_z()) {
+        return false;
+    }
+    shapeSlab(slab, volume.size_x(), volume.size_y(), count, volume.size_t());
+
+    std::size_t sliceSize = volume.size_x() * volume.size_y();
+    for (std::size_t t = 0; t < volume.size_t(); t++) {
+        const float* source = volume.frame_data(t) + z0 * sliceSize;
+        std::copy(source, source + count * sliceSize, slab.frame_data(t));
+    }
+    return true;
+}
+
+bool runSlabPipeline(const std::vector<SlabSource*>& inputs, const std::vector<SlabStage>& stages,
+                     const std::vector<SlabOutput>& outputs, const SlabOptions& options) {
+    if (inputs.empty()) {
+        std::cerr << "Error: Slab pipeline has no inputs" << std::endl;
+        return false;
+    }
+    const SlabSource& first = *inputs[0];
+    std::size_t nx = first.size_x(), ny = first.size_y(), nz = first.size_z(), nt = first.size_t();
+    for (const SlabSource* input : inputs) {
+        if (input->size_x() != nx || input->size_y() != ny || input->size_z() != nz || input->size_t() != nt) {
+            std::cerr << "Error: Slab pipeline inputs differ in size" << std::endl;
+            return false;
+        }
+    }
+    for (const SlabOutput& output : outputs) {
+        if (output.file == nullptr || output.file->size_x() != nx || output.file->size_y() != ny ||
+            output.file->size_z() != nz || output.file->size_t() != nt) {
+            std::cerr << "Error: Slab pipeline output does not match the input size" << std::endl;
+            return false;
+        }
+    }
+    if (nz == 0) {
+        return true;
+    }
+
+    std::size_t depth = std::max<std::size_t>(1, options.slabDepth);
+    std::size_t slabCount = (nz + depth - 1) / depth;
+    // A stencil reading past the slab would silently use clamped borders in the middle of the study
+    for (const SlabStage& stage : stages) {
+        if (slabCount > 1 && stage.halo > options.halo) {
+            std::cerr << "Error: Slab pipeline needs a halo of at least " << stage.halo
+                      << " slices for its stencil stages (got " << options.halo << ")" << std::endl;
+            return false;
+        }
+    }
+    std::size_t threads = options.threads > 0 ? options.threads : workerThreadCount();
+    threads = std::min(threads, slabCount);
+
+    std::atomic<std::size_t> nextSlab(0);
+    std::atomic<bool> failed(false);
+    std::mutex errorMutex;
+
+    auto worker = [&]() {
+        Slab slab;
+        slab.studyZ = nz;
+        slab.channels.resize(inputs.size());
+        for (Volume4D& channel : slab.channels) {
+            channel.set_category(MemoryCategory::Velocity);
+        }
+
+        try {
+            for (std::size_t s = nextSlab++; s < slabCount && !failed; s = nextSlab++) {
+                std::size_t coreBegin = s * depth;
+                std::size_t coreEnd = std::min(nz, coreBegin + depth);
+                std::size_t begin = coreBegin > options.halo ? coreBegin - options.halo : 0;
+                std::size_t end = std::min(nz, coreEnd + options.halo);
+
+                slab.index = s;
+                slab.z0 = begin;
+                slab.coreBegin = coreBegin - begin;
+                slab.coreCount = coreEnd - coreBegin;
+
+                for (std::size_t i = 0; i < inputs.size(); i++) {
+                    if (!inputs[i]->read(begin, end - begin, slab.channels[i])) {
+                        throw std::runtime_error("failed to read slices " + std::to_string(begin) + "-" + std::to_string(end - 1));
+                    }
+                }
+                for (const SlabStage& stage : stages) {
+                    stage(slab);
+                }
+                for (const SlabOutput& output : outputs) {
+                    if (!output.file->write_slab(coreBegin, slab.channel(output.channel), slab.coreBegin, slab.coreCount)) {
+                        throw std::runtime_error("failed to write slices " + std::to_string(coreBegin) + "-" + std::to_string(coreEnd - 1));
+                    }
+                }
+            }
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            std::cerr << "Error: Slab pipeline: " << e.what() << std::endl;
+            failed = true;
+        }
+    };
+
+    // Workers run on the shared pool (the calling thread is one of them), not on threads of their own
+    parallelFor(0, threads, [&](std::size_t) { worker(); });
+    return !failed;
+}
+
+SlabStage rescaleStage(std::size_t channel, double slope, double intercept) {
+    const float a = static_cast<float>(slope);
+    const float b = static_cast<float>(intercept);
+    return [channel, a, b](Slab& slab) {
+        Volume4D& volume = slab.channel(channel);
+        for (std::size_t t = 0; t < volume.size_t(); t++) {
+            float* frame = volume.frame_data(t);
+            for (std::size_t i = 0; i < volume.frame_size(); i++) {
+                frame[i] = frame[i] * a + b;
+            }
+        }
+    };
+}
+
+SlabStage vencStage(std::size_t channel, float venc) {
+    const float PI = 3.14159265359f;
+    const float scale = venc / PI;
+    return [channel, scale](Slab& slab) {
+        Volume4D& volume = slab.channel(channel);
+        for (std::size_t t = 0; t < volume.size_t(); t++) {
+            float* frame = volume.frame_data(t);
+            for (std::size_t i = 0; i < volume.frame_size(); i++) {
+                frame[i] *= scale;
+            }
+        }
+    };
+}
+
+SlabStage offsetCorrectionStage(std::size_t channel, VolumeCacheFile& offsets) {
+    return [channel, &offsets](Slab& slab) {
+        Volume4D& volume = slab.channel(channel);
+        if (offsets.size_x() != volume.size_x() || offsets.size_y() != volume.size_y() ||
+            offsets.size_z() != slab.studyZ || (offsets.size_t() != 1 && offsets.size_t() != volume.size_t())) {
+            throw std::runtime_error("offset map does not match the study size");
+        }
+        Volume4D& offset = slab.scratch(channel);
+        if (!offsets.read_slab(slab.z0, volume.size_z(), offset)) {
+            throw std::runtime_error("failed to read the offset map");
+        }
+        for (std::size_t t = 0; t < volume.size_t(); t++) {
+            float* frame = volume.frame_data(t);
+            const float* map = offset.frame_data(offset.size_t() == 1 ? 0 : t);
+            for (std::size_t i = 0; i < volume.frame_size(); i++) {
+                frame[i] -= map[i];
+            }
+        }
+    };
+}
+
+SlabStage speedStage(std::size_t vx, std::size_t vy, std::size_t vz, std::size_t out) {
+    return [vx, vy, vz, out](Slab& slab) {
+        Volume4D& speed = slab.channel(out);
+        const Volume4D& x = slab.channel(vx);
+        const Volume4D& y = slab.channel(vy);
+        const Volume4D& z = slab.channel(vz);
+        for (std::size_t t = 0; t < speed.size_t(); t++) {
+            const float* u = x.frame_data(t);
+            const float* v = y.frame_data(t);
+            const float* w = z.frame_data(t);
+            float* s = speed.frame_data(t);
+            for (std::size_t i = 0; i < speed.frame_size(); i++) {
+                s[i] = std::sqrt(u[i] * u[i] + v[i] * v[i] + w[i] * w[i]);
+            }
+        }
+    };
+}
+
+SlabStage vorticityStage(std::size_t vx, std::size_t vy, std::size_t vz, std::size_t out,
+                         const float spacing[3]) {
+    const float h[3] = {spacing[0], spacing[1], spacing[2]};
+    return SlabStage([vx, vy, vz, out, h](Slab& slab) {
+        Volume4D& vorticity = slab.channel(out);
+        const Volume4D& x = slab.channel(vx);
+        const Volume4D& y = slab.channel(vy);
+        const Volume4D& z = slab.channel(vz);
+        std::size_t nx = vorticity.size_x(), ny = vorticity.size_y(), nz = vorticity.size_z();
+        std::size_t sliceSize = nx * ny;
+
+        // Only the core slices are written out, and their z neighbours are in the halo
+        for (std::size_t t = 0; t < vorticity.size_t(); t++) {
+            const float* u = x.frame_data(t);
+            const float* v = y.frame_data(t);
+            const float* w = z.frame_data(t);
+            float* curl = vorticity.frame_data(t);
+            for (std::size_t k = slab.coreBegin; k < slab.coreBegin + slab.coreCount; k++) {
+                std::size_t km = k > 0 ? k - 1 : k;
+                std::size_t kp = k + 1 < nz ? k + 1 : k;
+                float dz = kp > km ? 1.0f / ((kp - km) * h[2]) : 0.0f;
+                for (std::size_t j = 0; j < ny; j++) {
+                    std::size_t jm = j > 0 ? j - 1 : j;
+                    std::size_t jp = j + 1 < ny ? j + 1 : j;
+                    float dy = jp > jm ? 1.0f / ((jp - jm) * h[1]) : 0.0f;
+                    for (std::size_t i = 0; i < nx; i++) {
+                        std::size_t im = i > 0 ? i - 1 : i;
+                        std::size_t ip = i + 1 < nx ? i + 1 : i;
+                        float dx = ip > im ? 1.0f / ((ip - im) * h[0]) : 0.0f;
+
+                        std::size_t row = k * sliceSize + j * nx;
+                        std::size_t xm = row + im, xp = row + ip;
+                        std::size_t ym = k * sliceSize + jm * nx + i, yp = k * sliceSize + jp * nx + i;
+                        std::size_t zm = km * sliceSize + j * nx + i, zp = kp * sliceSize + j * nx + i;
+
+                        float cx = (w[yp] - w[ym]) * dy - (v[zp] - v[zm]) * dz;
+                        float cy = (u[zp] - u[zm]) * dz - (w[xp] - w[xm]) * dx;
+                        float cz = (v[xp] - v[xm]) * dx - (u[yp] - u[ym]) * dy;
+                        curl[row + i] = std::sqrt(cx * cx + cy * cy + cz * cz);
+                    }
+                }
+            }
+        }
+    }, 1);
+}
+
+SlabStage SlabStatistics::stage() {
+    return [this](Slab& slab) {
+        const Volume4D& volume = slab.channel(channel);
+        std::size_t sliceSize = volume.size_x() * volume.size_y();
+
+        Partial partial;
+        for (std::size_t t = 0; t < volume.size_t(); t++) {
+            const float* values = volume.frame_data(t) + slab.coreBegin * sliceSize;
+            for (std::size_t i = 0; i < slab.coreCount * sliceSize; i++) {
+                float value = values[i];
+                if (partial.count == 0) {
+                    partial.min = partial.max = value;
+                }
+                partial.min = std::min(partial.min, value);
+                partial.max = std::max(partial.max, value);
+                partial.sum += value;
+                partial.sumSquares += static_cast<double>(value) * value;
+                partial.count++;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (partials.size() <= slab.index) {
+            partials.resize(slab.index + 1);
+        }
+        partials[slab.index] = partial;
+    };
+}
+
+SlabStatistics::Summary SlabStatistics::summary() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Summary result;
+    double sum = 0.0, sumSquares = 0.0;
+    for (const Partial& partial : partials) {
+        if (partial.count == 0) {
+            continue;
+        }
+        if (result.count == 0) {
+            result.min = partial.min;
+            result.max = partial.max;
+        }
+        result.min = std::min(result.min, partial.min);
+        result.max = std::max(result.max, partial.max);
+        result.count += partial.count;
+        sum += partial.sum;
+        sumSquares += partial.sumSquares;
+    }
+    if (result.count > 0) {
+        result.mean = sum / result.count;
+        result.stddev = std::sqrt(std::max(0.0, sumSquares / result.count - result.mean * result.mean));
+    }
+    return result;
+}
@@ -0,0 +1,266 @@
+#ifndef SLAB_PIPELINE_H
+#define SLAB_PIPELINE_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Volume4D.h"
+#include "VolumeCache.h"
+
+/**
+ * One z-slab of a study as seen by the stages: slices [z0, z0 + size_z()) of every frame
+ *
+ * The slab holds the core slices the pass is responsible for plus up to `halo` neighbouring
+ * slices on each side (fewer at the first and last slice of the study). Stages process the
+ * whole slab; only the core slices are written out and counted in statistics.
+ */
+struct Slab {
+    std::size_t index = 0;       // Slab number, in z order
+    std::size_t z0 = 0;          // Global slice of local slice 0
+    std::size_t coreBegin = 0;   // First core slice, local
+    std::size_t coreCount = 0;   // Number of core slices
+    std::size_t studyZ = 0;      // Slices in the whole study
+    std::deque<Volume4D> channels;  // Deque, so references stay valid as channels are added
+    std::deque<Volume4D> buffers;   // Stage temporaries of any shape, see scratch()
+
+    std::size_t size_z() const { return channels.empty() ? 0 : channels[0].size_z(); }
+
+    /**
+     * Channel i, created with the shape of channel 0 if it does not exist yet
+     *
+     * Channel buffers are kept between the slabs a worker processes, so a created channel
+     * holds the previous slab's values until a stage overwrites it.
+     */
+    Volume4D& channel(std::size_t i);
+
+    /**
+     * Temporary buffer i for a stage, charged to MemoryCategory::Velocity
+     *
+     * Unlike channels it has no fixed shape; like them it is kept between the slabs a worker
+     * processes, so a stage that reshapes it to the same size every slab allocates only once.
+     */
+    Volume4D& scratch(std::size_t i);
+};
+
+/**
+ * Processing applied to every slab in stage order
+ */
+struct SlabStage {
+    std::function<void(Slab&)> run;
+    std::size_t halo = 0;   // Neighbouring slices the stage reads on each side of the core
+
+    SlabStage() = default;
+
+    // Any callable taking Slab&, so plain lambdas convert to a stage without a halo
+    template <typename Function,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<Function>::type, SlabStage>::value>::type>
+    SlabStage(Function function, std::size_t haloSlices = 0)
+        : run(std::move(function)), halo(haloSlices) {}
+
+    void operator()(Slab& slab) const { run(slab); }
+};
+
+/**
+ * Source of slabs; read() may be called from several threads at once
+ */
+class SlabSource {
+public:
+    virtual ~SlabSource() = default;
+
+    virtual std::size_t size_x() const = 0;
+    virtual std::size_t size_y() const = 0;
+    virtual std::size_t size_z() const = 0;
+    virtual std::size_t size_t() const = 0;
+
+    /**
+     * Read slices [z0, z0 + count) of every frame
+     *
+     * @param slab Destination; resized to (size_x, size_y, count, size_t) if needed
+     * @return true on success
+     */
+    virtual bool read(std::size_t z0, std::size_t count, Volume4D& slab) = 0;
+};
+
+/**
+ * Slabs of a binary volume cache file (.v4d)
+ */
+class VolumeCacheSource : public SlabSource {
+public:
+    explicit VolumeCacheSource(const std::string& path);
+
+    bool valid() const { return cache.is_open(); }
+
+    std::size_t size_x() const override { return cache.size_x(); }
+    std::size_t size_y() const override { return cache.size_y(); }
+    std::size_t size_z() const override { return cache.size_z(); }
+    std::size_t size_t() const override { return cache.size_t(); }
+    bool read(std::size_t z0, std::size_t count, Volume4D& slab) override;
+
+private:
+    VolumeCacheFile cache;
+};
+
+/**
+ * Slabs of a folder of single-frame DICOM slices (raw stored values, no rescale)
+ *
+ * Files are sorted by name and laid out like DicomFolderToVolume4D (file i is slice
+ * i % z of frame i / z); each read decodes only the files of the requested slices.
+ * Enhanced multi-frame files are not supported.
+ */
+class DicomSliceSource : public SlabSource {
+public:
+    explicit DicomSliceSource(const std::string& dicomFolderPath);
+
+    bool valid() const { return dim_x > 0 && dim_z > 0 && dim_t > 0; }
+
+    // RescaleSlope / RescaleIntercept of the series, for rescaleStage
+    double rescale_slope() const { return slope; }
+    double rescale_intercept() const { return intercept; }
+
+    std::size_t size_x() const override { return dim_x; }
+    std::size_t size_y() const override { return dim_y; }
+    std::size_t size_z() const override { return dim_z; }
+    std::size_t size_t() const override { return dim_t; }
+    bool read(std::size_t z0, std::size_t count, Volume4D& slab) override;
+
+private:
+    std::vector<std::string> paths;
+    std::size_t dim_x, dim_y, dim_z, dim_t;
+    double slope, intercept;
+};
+
+/**
+ * Slabs of a volume already in memory (copies the requested slices)
+ */
+class VolumeSource : public SlabSource {
+public:
+    explicit VolumeSource(const Volume4D& source) : volume(source) {}
+
+    std::size_t size_x() const override { return volume.size_x(); }
+    std::size_t size_y() const override { return volume.size_y(); }
+    std::size_t size_z() const override { return volume.size_z(); }
+    std::size_t size_t() const override { return volume.size_t(); }
+    bool read(std::size_t z0, std::size_t count, Volume4D& slab) override;
+
+private:
+    const Volume4D& volume;
+};
+
+/**
+ * Where the core slices of a channel are written after the stages ran
+ */
+struct SlabOutput {
+    std::size_t channel;
+    VolumeCacheFile* file;      // Created with the study's size
+};
+
+/**
+ * Settings for runSlabPipeline
+ */
+struct SlabOptions {
+    std::size_t slabDepth = 8;  // Core slices per slab
+    std::size_t halo = 0;       // Extra slices read on each side for stencil stages
+    std::size_t threads = 0;    // Slabs in flight, at most the hardware threads; 0 = hardware threads
+};
+
+/**
+ * Stream a study through the stages slab by slab
+ *
+ * Input i is read into channel i of each slab, the stages run in order, and the core slices
+ * of every output channel are written to its file. Workers run on the shared WorkStealingPool
+ * and each owns one slab's channel buffers and reuses them, so peak memory is about
+ * threads x channels x (slabDepth + 2 x halo) slices x frames, independent of the study size.
+ * Slab buffers are charged to MemoryCategory::Velocity. Results do not depend on the slab
+ * depth or thread count; a run whose halo is narrower than a stage's stencil is rejected
+ * unless the whole study fits in one slab.
+ *
+ * @param inputs Sources with identical sizes
+ * @param stages Stages applied to every slab, in order
+ * @param outputs Channels to write back
+ * @param options Slab depth, halo and thread count
+ * @return true if every slab was read, processed and written
+ */
+bool runSlabPipeline(const std::vector<SlabSource*>& inputs, const std::vector<SlabStage>& stages,
+                     const std::vector<SlabOutput>& outputs, const SlabOptions& options = SlabOptions());
+
+/**
+ * value = stored value * slope + intercept for one channel
+ */
+SlabStage rescaleStage(std::size_t channel, double slope, double intercept);
+
+/**
+ * Phase to velocity (value * venc / pi) for one channel, as applyVENC
+ */
+SlabStage vencStage(std::size_t channel, float venc);
+
+/**
+ * Subtract a static background phase offset map (size_t() == 1, or one map per frame)
+ *
+ * The map is read from its cache file slab by slab, so it is never fully in memory; each
+ * worker reads it into its scratch buffer `channel`.
+ */
+SlabStage offsetCorrectionStage(std::size_t channel, VolumeCacheFile& offsets);
+
+/**
+ * Speed |v| of the velocity channels vx, vy, vz into channel out
+ */
+SlabStage speedStage(std::size_t vx, std::size_t vy, std::size_t vz, std::size_t out);
+
+/**
+ * Vorticity magnitude |curl v| with central differences (one-sided at the study borders)
+ *
+ * Written for the core slices only, so it cannot feed another stencil stage; the stage declares
+ * a halo of 1, which runSlabPipeline enforces.
+ *
+ * @param spacing Voxel size along x, y, z
+ */
+SlabStage vorticityStage(std::size_t vx, std::size_t vy, std::size_t vz, std::size_t out,
+                         const float spacing[3]);
+
+/**
+ * Count, mean, standard deviation and range of a channel over the core slices of all slabs
+ *
+ * Partial sums are kept per slab and combined in slab order, so the result is the same for
+ * any thread count.
+ */
+class SlabStatistics {
+public:
+    struct Summary {
+        std::size_t count = 0;
+        double mean = 0.0;
+        double stddev = 0.0;
+        float min = 0.0f;
+        float max = 0.0f;
+    };
+
+    explicit SlabStatistics(std::size_t statisticsChannel) : channel(statisticsChannel) {}
+
+    SlabStatistics(const SlabStatistics&) = delete;
+    SlabStatistics& operator=(const SlabStatistics&) = delete;
+
+    /**
+     * Stage accumulating this object's channel; the object must outlive the pipeline run
+     */
+    SlabStage stage();
+
+    Summary summary() const;
+
+private:
+    struct Partial {
+        std::size_t count = 0;
+        double sum = 0.0;
+        double sumSquares = 0.0;
+        float min = 0.0f;
+        float max = 0.0f;
+    };
+
+    std::size_t channel;
+    mutable std::mutex mutex;
+    std::vector<Partial> partials;  // Indexed by slab
+};
+
+#endif // SLAB_PIPELINE_H
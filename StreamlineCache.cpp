@@ -0,0 +1,377 @@
+#include "StreamlineCache.h"
+#include "MemoryManager.h"
+#include "VolumePyramid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdList.h>
+#include <vtkIntArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+
+namespace {
+
+void hashCombine(std::uint64_t& seed, std::uint64_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+std::uint64_t doubleBits(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+} // namespace
+
+std::size_t StreamlineCache::KeyHash::operator()(const Key& key) const {
+    std::uint64_t seed = key.settings;
+    hashCombine(seed, key.x);
+    hashCombine(seed, key.y);
+    hashCombine(seed, key.z);
+    hashCombine(seed, key.frame);
+    return static_cast<std::size_t>(seed);
+}
+
+StreamlineCache::StreamlineCache()
+    : streamTracer(vtkSmartPointer<vtkStreamTracer>::New()), frame(0), seedPyramid(nullptr), bytes(0), lastSelected(0), lastTraced(0) {
+    evictorId = MemoryManager::instance().add_evictor([this](std::size_t needed) { return evict_inactive(needed); });
+}
+
+StreamlineCache::~StreamlineCache() {
+    MemoryManager::instance().remove_evictor(evictorId);
+    clear();
+}
+
+void StreamlineCache::set_field(vtkImageData* newField, std::size_t newFrame, vtkImageData* newSeedGrid) {
+    field = newField;
+    seedGrid = newSeedGrid ? newSeedGrid : newField;
+    frame = newFrame;
+}
+
+std::uint64_t StreamlineCache::settings_hash() const {
+    std::uint64_t seed = 0;
+    hashCombine(seed, doubleBits(streamTracer->GetMaximumPropagation()));
+    hashCombine(seed, static_cast<std::uint64_t>(streamTracer->GetIntegrationStepUnit()));
+    hashCombine(seed, doubleBits(streamTracer->GetInitialIntegrationStep()));
+    hashCombine(seed, doubleBits(streamTracer->GetMinimumIntegrationStep()));
+    hashCombine(seed, doubleBits(streamTracer->GetMaximumIntegrationStep()));
+    hashCombine(seed, static_cast<std::uint64_t>(streamTracer->GetMaximumNumberOfSteps()));
+    hashCombine(seed, static_cast<std::uint64_t>(streamTracer->GetIntegrationDirection()));
+    hashCombine(seed, static_cast<std::uint64_t>(streamTracer->GetIntegratorType()));
+    hashCombine(seed, doubleBits(streamTracer->GetTerminalSpeed()));
+    hashCombine(seed, static_cast<std::uint64_t>(streamTracer->GetComputeVorticity()));
+    // The field object identifies the data within a frame (e.g. after reloading a study)
+    hashCombine(seed, reinterpret_cast<std::uintptr_t>(field.GetPointer()));
+    hashCombine(seed, field ? static_cast<std::uint64_t>(field->GetMTime()) : 0);
+    return seed;
+}
+
+void StreamlineCache::select_seeds(const SeedSelection& selection, std::vector<Key>& seeds, std::uint64_t settings) const {
+    int dims[3];
+    seedGrid->GetDimensions(dims);
+    const Volume4D* full = seedPyramid && seedPyramid->component_count() >= 3 ? &seedPyramid->component(0, 0) : nullptr;
+    if (full && full->size_x() == static_cast<std::size_t>(dims[0]) && full->size_y() == static_cast<std::size_t>(dims[1]) &&
+        full->size_z() == static_cast<std::size_t>(dims[2])) {
+        select_pyramid_seeds(selection, seeds, settings);
+        return;
+    }
+
+    vtkDataArray* vectors = seedGrid->GetPointData()->GetVectors();
+    if (!vectors) {
+        return;
+    }
+    std::size_t step = static_cast<std::size_t>(std::max(1, selection.sampleRate));
+
+    for (std::size_t z = 0; z < static_cast<std::size_t>(dims[2]); z += step) {
+        for (std::size_t y = 0; y < static_cast<std::size_t>(dims[1]); y += step) {
+            for (std::size_t x = 0; x < static_cast<std::size_t>(dims[0]); x += step) {
+                vtkIdType id = static_cast<vtkIdType>((z * dims[1] + y) * dims[0] + x);
+                double v[3];
+                vectors->GetTuple(id, v);
+                double magnitude = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+                if (magnitude < selection.minVelocity || magnitude > selection.maxVelocity) {
+                    continue;
+                }
+
+                // ROI test in normalized [-1, 1] grid coordinates
+                float nx = (2.0f * x / dims[0]) - 1.0f;
+                float ny = (2.0f * y / dims[1]) - 1.0f;
+                float nz = (2.0f * z / dims[2]) - 1.0f;
+                float dx = nx - selection.roiCenter[0];
+                float dy = ny - selection.roiCenter[1];
+                float dz = nz - selection.roiCenter[2];
+                if (std::sqrt(dx * dx + dy * dy + dz * dz) > selection.roiRadius) {
+                    continue;
+                }
+                seeds.push_back({static_cast<std::uint32_t>(x), static_cast<std::uint32_t>(y),
+                                 static_cast<std::uint32_t>(z), static_cast<std::uint32_t>(frame), settings});
+            }
+        }
+    }
+}
+
+void StreamlineCache::select_pyramid_seeds(const SeedSelection& selection, std::vector<Key>& seeds, std::uint64_t settings) const {
+    std::size_t step = static_cast<std::size_t>(std::max(1, selection.sampleRate));
+
+    // Coarsest level whose voxels still fit in the sample spacing
+    std::size_t level = 0;
+    while (level + 1 < seedPyramid->level_count() && seedPyramid->factor(level + 1) <= step) {
+        level++;
+    }
+    std::size_t factor = seedPyramid->factor(level);
+    std::size_t coarseStep = std::max<std::size_t>(1, step / factor);
+
+    const Volume4D& full = seedPyramid->component(0, 0);
+    const Volume4D& vx = seedPyramid->component(level, 0);
+    const Volume4D& vy = seedPyramid->component(level, 1);
+    const Volume4D& vz = seedPyramid->component(level, 2);
+    std::size_t t = std::min(frame, vx.size_t() - 1);
+    const Volume4D* coverage = seedPyramid->has_mask() ? &seedPyramid->coverage(level) : nullptr;
+    std::size_t coverageFrame = coverage ? std::min(t, coverage->size_t() - 1) : 0;
+
+    for (std::size_t z = 0; z < vx.size_z(); z += coarseStep) {
+        for (std::size_t y = 0; y < vx.size_y(); y += coarseStep) {
+            for (std::size_t x = 0; x < vx.size_x(); x += coarseStep) {
+                if (coverage && coverage->at(x, y, z, coverageFrame) < 0.5f) {
+                    continue;
+                }
+                float u = vx.at(x, y, z, t), v = vy.at(x, y, z, t), w = vz.at(x, y, z, t);
+                float magnitude = std::sqrt(u * u + v * v + w * w);
+                if (magnitude < selection.minVelocity || magnitude > selection.maxVelocity) {
+                    continue;
+                }
+
+                // Full-resolution voxel at the center of the coarse voxel, ROI tested there
+                std::size_t fx = std::min(full.size_x() - 1, x * factor + factor / 2);
+                std::size_t fy = std::min(full.size_y() - 1, y * factor + factor / 2);
+                std::size_t fz = std::min(full.size_z() - 1, z * factor + factor / 2);
+                float dx = (2.0f * fx / full.size_x()) - 1.0f - selection.roiCenter[0];
+                float dy = (2.0f * fy / full.size_y()) - 1.0f - selection.roiCenter[1];
+                float dz = (2.0f * fz / full.size_z()) - 1.0f - selection.roiCenter[2];
+                if (std::sqrt(dx * dx + dy * dy + dz * dz) > selection.roiRadius) {
+                    continue;
+                }
+                seeds.push_back({static_cast<std::uint32_t>(fx), static_cast<std::uint32_t>(fy),
+                                 static_cast<std::uint32_t>(fz), static_cast<std::uint32_t>(frame), settings});
+            }
+        }
+    }
+}
+
+vtkSmartPointer<vtkPolyData> StreamlineCache::update(const SeedSelection& selection) {
+    if (!field) {
+        return vtkSmartPointer<vtkPolyData>::New();
+    }
+
+    std::vector<Key> seeds;
+    select_seeds(selection, seeds, settings_hash());
+
+    std::vector<Key> missing;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& entry : lines) {
+            entry.second.active = false;
+        }
+        for (const Key& key : seeds) {
+            auto it = lines.find(key);
+            if (it == lines.end()) {
+                missing.push_back(key);
+            } else {
+                it->second.active = true;
+            }
+        }
+    }
+
+    lastSelected = seeds.size();
+    lastTraced = missing.size();
+    if (!missing.empty()) {
+        trace(missing);
+    }
+    return assemble(seeds);
+}
+
+void StreamlineCache::trace(const std::vector<Key>& seeds) {
+    int dims[3];
+    seedGrid->GetDimensions(dims);
+
+    vtkSmartPointer<vtkPoints> seedPoints = vtkSmartPointer<vtkPoints>::New();
+    seedPoints->SetNumberOfPoints(static_cast<vtkIdType>(seeds.size()));
+    for (std::size_t i = 0; i < seeds.size(); i++) {
+        vtkIdType id = static_cast<vtkIdType>((static_cast<std::size_t>(seeds[i].z) * dims[1] + seeds[i].y) * dims[0] + seeds[i].x);
+        seedPoints->SetPoint(static_cast<vtkIdType>(i), seedGrid->GetPoint(id));
+    }
+    vtkSmartPointer<vtkPolyData> seedData = vtkSmartPointer<vtkPolyData>::New();
+    seedData->SetPoints(seedPoints);
+
+    streamTracer->SetInputData(field);
+    streamTracer->SetSourceData(seedData);
+    streamTracer->Update();
+    vtkPolyData* output = streamTracer->GetOutput();
+
+    // Point arrays of the first trace define the layout of every cached line
+    vtkPointData* pointData = output->GetPointData();
+    if (arrayNames.empty()) {
+        for (int a = 0; a < pointData->GetNumberOfArrays(); a++) {
+            vtkDataArray* array = pointData->GetArray(a);
+            if (array && array->GetName()) {
+                arrayNames.push_back(array->GetName());
+                arrayComponents.push_back(array->GetNumberOfComponents());
+            }
+        }
+    }
+    std::vector<vtkDataArray*> arrays(arrayNames.size(), nullptr);
+    for (std::size_t a = 0; a < arrayNames.size(); a++) {
+        vtkDataArray* array = pointData->GetArray(arrayNames[a].c_str());
+        if (array && array->GetNumberOfComponents() == arrayComponents[a]) {
+            arrays[a] = array;
+        }
+    }
+
+    // Group the output lines by seed (SeedIds indexes the seed points)
+    std::vector<Line> traced(seeds.size());
+    vtkDataArray* seedIds = output->GetCellData()->GetArray("SeedIds");
+    vtkCellArray* cells = output->GetLines();
+    vtkSmartPointer<vtkIdList> ids = vtkSmartPointer<vtkIdList>::New();
+    std::vector<double> tuple(9);
+    vtkIdType cellIndex = output->GetNumberOfVerts();
+    cells->InitTraversal();
+    while (cells->GetNextCell(ids)) {
+        vtkIdType seed = seedIds ? static_cast<vtkIdType>(seedIds->GetTuple1(cellIndex)) : -1;
+        cellIndex++;
+        if (seed < 0 || seed >= static_cast<vtkIdType>(seeds.size())) {
+            continue;
+        }
+        Line& line = traced[seed];
+        line.arrays.resize(arrayNames.size());
+        vtkIdType count = ids->GetNumberOfIds();
+        line.lengths.push_back(static_cast<std::uint32_t>(count));
+        for (vtkIdType i = 0; i < count; i++) {
+            double p[3];
+            output->GetPoint(ids->GetId(i), p);
+            line.points.push_back(static_cast<float>(p[0]));
+            line.points.push_back(static_cast<float>(p[1]));
+            line.points.push_back(static_cast<float>(p[2]));
+            for (std::size_t a = 0; a < arrayNames.size(); a++) {
+                int components = arrayComponents[a];
+                tuple.resize(components);
+                if (arrays[a]) {
+                    arrays[a]->GetTuple(ids->GetId(i), tuple.data());
+                } else {
+                    std::fill(tuple.begin(), tuple.end(), 0.0);
+                }
+                for (int c = 0; c < components; c++) {
+                    line.arrays[a].push_back(static_cast<float>(tuple[c]));
+                }
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < seeds.size(); i++) {
+        traced[i].active = true;
+        store(seeds[i], std::move(traced[i]));
+    }
+}
+
+void StreamlineCache::store(const Key& key, Line&& line) {
+    line.bytes = line.points.capacity() * sizeof(float) + line.lengths.capacity() * sizeof(std::uint32_t);
+    for (const auto& values : line.arrays) {
+        line.bytes += values.capacity() * sizeof(float);
+    }
+    // May evict inactive lines (ours or other caches'); throws MemoryBudgetError if nothing is left to evict.
+    // Reserved before locking, since our own evictor takes the lock.
+    MemoryManager::instance().reserve(MemoryCategory::Cache, line.bytes);
+    std::lock_guard<std::mutex> lock(mutex);
+    bytes += line.bytes;
+    lines[key] = std::move(line);
+}
+
+vtkSmartPointer<vtkPolyData> StreamlineCache::assemble(const std::vector<Key>& seeds) const {
+    // Selected lines are active and never evicted, but an eviction may still be erasing others
+    std::lock_guard<std::mutex> lock(mutex);
+    vtkIdType pointCount = 0;
+    for (const Key& key : seeds) {
+        const Line& line = lines.at(key);
+        pointCount += static_cast<vtkIdType>(line.points.size() / 3);
+    }
+
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetDataTypeToFloat();
+    points->Allocate(pointCount);
+    vtkSmartPointer<vtkCellArray> cells = vtkSmartPointer<vtkCellArray>::New();
+    vtkSmartPointer<vtkIntArray> seedIds = vtkSmartPointer<vtkIntArray>::New();
+    seedIds->SetName("SeedIds");
+
+    std::vector<vtkSmartPointer<vtkFloatArray>> arrays(arrayNames.size());
+    for (std::size_t a = 0; a < arrayNames.size(); a++) {
+        arrays[a] = vtkSmartPointer<vtkFloatArray>::New();
+        arrays[a]->SetName(arrayNames[a].c_str());
+        arrays[a]->SetNumberOfComponents(arrayComponents[a]);
+        arrays[a]->Allocate(pointCount * arrayComponents[a]);
+    }
+
+    for (std::size_t s = 0; s < seeds.size(); s++) {
+        const Line& line = lines.at(seeds[s]);
+        std::size_t pointIndex = 0;
+        for (std::uint32_t count : line.lengths) {
+            cells->InsertNextCell(static_cast<int>(count));
+            for (std::uint32_t i = 0; i < count; i++, pointIndex++) {
+                const float* p = &line.points[3 * pointIndex];
+                cells->InsertCellPoint(points->InsertNextPoint(p[0], p[1], p[2]));
+                for (std::size_t a = 0; a < arrays.size(); a++) {
+                    arrays[a]->InsertNextTuple(&line.arrays[a][pointIndex * arrayComponents[a]]);
+                }
+            }
+            seedIds->InsertNextValue(static_cast<int>(s));
+        }
+    }
+
+    vtkSmartPointer<vtkPolyData> result = vtkSmartPointer<vtkPolyData>::New();
+    result->SetPoints(points);
+    result->SetLines(cells);
+    for (const auto& array : arrays) {
+        result->GetPointData()->AddArray(array);
+    }
+    result->GetCellData()->AddArray(seedIds);
+    return result;
+}
+
+std::size_t StreamlineCache::cached_lines() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lines.size();
+}
+
+std::size_t StreamlineCache::cached_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+std::size_t StreamlineCache::evict_inactive(std::size_t bytesNeeded) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::size_t freed = 0;
+    for (auto it = lines.begin(); it != lines.end() && freed < bytesNeeded;) {
+        if (it->second.active) {
+            ++it;
+            continue;
+        }
+        freed += it->second.bytes;
+        it = lines.erase(it);
+    }
+    bytes -= freed;
+    MemoryManager::instance().release(MemoryCategory::Cache, freed);
+    return freed;
+}
+
+void StreamlineCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryManager::instance().release(MemoryCategory::Cache, bytes);
+    lines.clear();
+    arrayNames.clear();
+    arrayComponents.clear();
+    bytes = 0;
+}
@@ -0,0 +1,144 @@
+#ifndef STREAMLINE_CACHE_H
+#define STREAMLINE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkPolyData.h>
+#include <vtkStreamTracer.h>
+
+class VolumePyramid;
+
+/**
+ * Which grid points seed streamlines
+ */
+struct SeedSelection {
+    float minVelocity = 1.0f;                   // cm/s; slower voxels are not seeded
+    float maxVelocity = 300.0f;                 // cm/s; faster voxels are not seeded
+    float roiCenter[3] = {0.0f, 0.0f, 0.0f};    // Spherical ROI, normalized [-1, 1] grid coordinates
+    float roiRadius = 0.8f;                     // Normalized units
+    int sampleRate = 8;                         // Seed every sampleRate-th voxel along each axis
+};
+
+/**
+ * Streamlines traced per seed and cached, so changing the seed selection only traces new seeds
+ *
+ * Each traced line is stored under its seed voxel, the frame of the velocity field and a hash
+ * of the tracer settings. update() selects the seeds (threshold on the seed voxel's speed and
+ * a spherical ROI), traces the seeds that are not cached in one vtkStreamTracer pass, and
+ * assembles the lines of the selected seeds; deselected seeds simply drop out of the output.
+ * Changing the tracer settings or the frame keys new entries, so stale lines are never reused.
+ *
+ * With a seed pyramid, the seed scan and ROI test run on the coarsest pyramid level whose
+ * voxels are no larger than the sample spacing: each coarse voxel is tested by its averaged
+ * velocity (and skipped if mostly outside the pyramid's mask) and seeds the full-resolution
+ * voxel at its center.
+ *
+ * Cached lines are charged to MemoryCategory::Cache; lines of seeds outside the current
+ * selection are evicted first when the memory budget is tight. The eviction may run on any
+ * thread that reserves memory, so the line table is guarded by a mutex; the other methods
+ * are meant to be called from one thread.
+ */
+class StreamlineCache {
+public:
+    StreamlineCache();
+    ~StreamlineCache();
+
+    StreamlineCache(const StreamlineCache&) = delete;
+    StreamlineCache& operator=(const StreamlineCache&) = delete;
+
+    /**
+     * Set the velocity field to trace (point data vectors on an image grid)
+     *
+     * @param field Velocity field for one frame
+     * @param frame Frame index of the field, part of the cache key
+     * @param seedGrid Grid whose voxels are the seed candidates, e.g. the full-resolution field when
+     *                 tracing a coarse preview field with the same seeds (defaults to field)
+     */
+    void set_field(vtkImageData* field, std::size_t frame, vtkImageData* seedGrid = nullptr);
+
+    /**
+     * Tracer used for new seeds; configure its integration settings here (input and source are set by the cache)
+     */
+    vtkStreamTracer* tracer() const { return streamTracer; }
+
+    /**
+     * Select seeds on a velocity pyramid instead of the full-resolution field
+     *
+     * @param pyramid Built pyramid whose components 0-2 are the x/y/z velocity on the seed grid (null to scan the seed grid)
+     */
+    void set_seed_pyramid(const VolumePyramid* pyramid) { seedPyramid = pyramid; }
+
+    /**
+     * Select seeds, trace the ones not yet cached and assemble the selected lines
+     *
+     * @param selection Seed selection
+     * @return Polylines of the selected seeds with the tracer's point arrays and a SeedIds cell array
+     */
+    vtkSmartPointer<vtkPolyData> update(const SeedSelection& selection);
+
+    std::size_t cached_lines() const;
+    std::size_t cached_bytes() const;
+    std::size_t last_selected() const { return lastSelected; }
+    std::size_t last_traced() const { return lastTraced; }
+
+    /**
+     * Drop cached lines of seeds outside the current selection
+     *
+     * @param bytesNeeded Stop after freeing at least this many bytes
+     * @return Bytes freed
+     */
+    std::size_t evict_inactive(std::size_t bytesNeeded = static_cast<std::size_t>(-1));
+
+    void clear();
+
+private:
+    struct Key {
+        std::uint32_t x, y, z;
+        std::uint32_t frame;
+        std::uint64_t settings;
+        bool operator==(const Key& other) const {
+            return x == other.x && y == other.y && z == other.z && frame == other.frame && settings == other.settings;
+        }
+    };
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const;
+    };
+    struct Line {
+        std::vector<std::uint32_t> lengths;     // Points per polyline traced from the seed (none if it produced no line)
+        std::vector<float> points;              // Interleaved xyz of all its polylines
+        std::vector<std::vector<float>> arrays; // One per entry of arrayNames, arrayComponents values per point
+        std::size_t bytes = 0;
+        bool active = false;
+    };
+
+    std::uint64_t settings_hash() const;
+    void select_seeds(const SeedSelection& selection, std::vector<Key>& seeds, std::uint64_t settings) const;
+    void select_pyramid_seeds(const SeedSelection& selection, std::vector<Key>& seeds, std::uint64_t settings) const;
+    void trace(const std::vector<Key>& seeds);
+    void store(const Key& key, Line&& line);
+    vtkSmartPointer<vtkPolyData> assemble(const std::vector<Key>& seeds) const;
+
+    vtkSmartPointer<vtkImageData> field;
+    vtkSmartPointer<vtkImageData> seedGrid;
+    vtkSmartPointer<vtkStreamTracer> streamTracer;
+    std::size_t frame;
+    const VolumePyramid* seedPyramid;
+
+    mutable std::mutex mutex; // Guards lines and bytes
+    std::unordered_map<Key, Line, KeyHash> lines;
+    std::vector<std::string> arrayNames;
+    std::vector<int> arrayComponents;
+    std::size_t bytes;
+    std::size_t lastSelected;
+    std::size_t lastTraced;
+    int evictorId;
+};
+
+#endif // STREAMLINE_CACHE_H
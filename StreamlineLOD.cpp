@@ -0,0 +1,249 @@
+#include "StreamlineLOD.h"
+#include "parallel_utils.h"
+
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkCommand.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace {
+
+using Point3 = std::array<double, 3>;
+
+// Squared distance from p to the segment [a, b]
+double segmentDistance2(const Point3& p, const Point3& a, const Point3& b) {
+    double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    double ap[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+    double len2 = ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2];
+    double s = 0.0;
+    if (len2 > 0.0) {
+        s = (ap[0] * ab[0] + ap[1] * ab[1] + ap[2] * ab[2]) / len2;
+        s = std::clamp(s, 0.0, 1.0);
+    }
+    double d[3] = {ap[0] - s * ab[0], ap[1] - s * ab[1], ap[2] - s * ab[2]};
+    return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+}
+
+/**
+ * Douglas-Peucker on one polyline, using an explicit stack so long streamlines cannot overflow
+ *
+ * @param points Polyline vertices
+ * @param tolerance2 Squared distance tolerance
+ * @return Indices (into points) of the vertices to keep, in order
+ */
+std::vector<std::size_t> douglasPeucker(const std::vector<Point3>& points, double tolerance2) {
+    std::size_t n = points.size();
+    std::vector<std::size_t> kept;
+    if (n <= 2) {
+        for (std::size_t i = 0; i < n; i++) {
+            kept.push_back(i);
+        }
+        return kept;
+    }
+
+    std::vector<char> keep(n, 0);
+    keep[0] = 1;
+    keep[n - 1] = 1;
+
+    std::vector<std::pair<std::size_t, std::size_t>> stack;
+    stack.emplace_back(0, n - 1);
+    while (!stack.empty()) {
+        auto [first, last] = stack.back();
+        stack.pop_back();
+
+        double maxDist2 = 0.0;
+        std::size_t maxIndex = first;
+        for (std::size_t i = first + 1; i < last; i++) {
+            double d2 = segmentDistance2(points[i], points[first], points[last]);
+            if (d2 > maxDist2) {
+                maxDist2 = d2;
+                maxIndex = i;
+            }
+        }
+
+        if (maxDist2 > tolerance2) {
+            keep[maxIndex] = 1;
+            stack.emplace_back(first, maxIndex);
+            stack.emplace_back(maxIndex, last);
+        }
+    }
+
+    for (std::size_t i = 0; i < n; i++) {
+        if (keep[i]) {
+            kept.push_back(i);
+        }
+    }
+    return kept;
+}
+
+} // namespace
+
+vtkSmartPointer<vtkPolyData> simplifyPolylines(vtkPolyData* input, double tolerance) {
+    vtkSmartPointer<vtkPolyData> output = vtkSmartPointer<vtkPolyData>::New();
+    if (input == nullptr || input->GetPoints() == nullptr || input->GetLines() == nullptr) {
+        return output;
+    }
+
+    // Flatten the line connectivity first; cell array traversal is not thread safe
+    std::vector<vtkIdType> lineOffsets = {0};
+    std::vector<vtkIdType> lineIds;
+    vtkCellArray* lines = input->GetLines();
+    lines->InitTraversal();
+    vtkIdType npts = 0;
+    const vtkIdType* pts = nullptr;
+    while (lines->GetNextCell(npts, pts)) {
+        lineIds.insert(lineIds.end(), pts, pts + npts);
+        lineOffsets.push_back(static_cast<vtkIdType>(lineIds.size()));
+    }
+    std::size_t numLines = lineOffsets.size() - 1;
+
+    // Simplify each line independently
+    vtkPoints* inPoints = input->GetPoints();
+    double tolerance2 = tolerance * tolerance;
+    std::vector<std::vector<vtkIdType>> keptIds(numLines);
+    parallelFor(0, numLines, [&](std::size_t line) {
+        vtkIdType begin = lineOffsets[line];
+        vtkIdType end = lineOffsets[line + 1];
+        std::vector<Point3> points(static_cast<std::size_t>(end - begin));
+        for (vtkIdType i = begin; i < end; i++) {
+            inPoints->GetPoint(lineIds[i], points[i - begin].data());
+        }
+        for (std::size_t index : douglasPeucker(points, tolerance2)) {
+            keptIds[line].push_back(lineIds[begin + index]);
+        }
+    });
+
+    vtkIdType totalPoints = 0;
+    for (const auto& ids : keptIds) {
+        totalPoints += static_cast<vtkIdType>(ids.size());
+    }
+
+    // Assemble the output with attributes of the kept points
+    vtkSmartPointer<vtkPoints> outPoints = vtkSmartPointer<vtkPoints>::New();
+    outPoints->SetDataType(inPoints->GetDataType());
+    outPoints->SetNumberOfPoints(totalPoints);
+
+    vtkSmartPointer<vtkCellArray> outLines = vtkSmartPointer<vtkCellArray>::New();
+    outLines->AllocateExact(static_cast<vtkIdType>(numLines), totalPoints);
+
+    vtkPointData* inPD = input->GetPointData();
+    vtkPointData* outPD = output->GetPointData();
+    outPD->CopyAllocate(inPD, totalPoints);
+
+    vtkCellData* inCD = input->GetCellData();
+    vtkCellData* outCD = output->GetCellData();
+    outCD->CopyAllocate(inCD, static_cast<vtkIdType>(numLines));
+
+    // Polydata cell ids run over verts first, then lines
+    vtkIdType firstLineCell = input->GetNumberOfVerts();
+
+    vtkIdType nextPoint = 0;
+    std::vector<vtkIdType> newIds;
+    for (std::size_t line = 0; line < numLines; line++) {
+        newIds.clear();
+        for (vtkIdType oldId : keptIds[line]) {
+            double p[3];
+            inPoints->GetPoint(oldId, p);
+            outPoints->SetPoint(nextPoint, p);
+            outPD->CopyData(inPD, oldId, nextPoint);
+            newIds.push_back(nextPoint);
+            nextPoint++;
+        }
+        vtkIdType cellId = outLines->InsertNextCell(static_cast<vtkIdType>(newIds.size()), newIds.data());
+        outCD->CopyData(inCD, firstLineCell + static_cast<vtkIdType>(line), cellId);
+    }
+
+    output->SetPoints(outPoints);
+    output->SetLines(outLines);
+    return output;
+}
+
+StreamlineLOD::StreamlineLOD() : startObserverTag(0), endObserverTag(0), pointBudget(0) {}
+
+StreamlineLOD::~StreamlineLOD() {
+    if (style) {
+        style->RemoveObserver(startObserverTag);
+        style->RemoveObserver(endObserverTag);
+    }
+}
+
+void StreamlineLOD::build(vtkPolyData* fullDetail, const std::vector<double>& tolerances) {
+    levels.clear();
+
+    vtkSmartPointer<vtkPolyData> full = vtkSmartPointer<vtkPolyData>::New();
+    full->ShallowCopy(fullDetail);
+    levels.push_back(full);
+
+    for (double tolerance : tolerances) {
+        levels.push_back(simplifyPolylines(full, tolerance));
+    }
+
+    if (mapper) {
+        use_level(0);
+    }
+}
+
+vtkPolyData* StreamlineLOD::level(std::size_t index) const {
+    if (index >= levels.size()) {
+        throw std::out_of_range("StreamlineLOD::level: Index out of range");
+    }
+    return levels[index];
+}
+
+std::size_t StreamlineLOD::interactive_level(vtkIdType budget) const {
+    for (std::size_t i = 0; i < levels.size(); i++) {
+        if (levels[i]->GetNumberOfPoints() <= budget) {
+            return i;
+        }
+    }
+    return levels.empty() ? 0 : levels.size() - 1;
+}
+
+void StreamlineLOD::attach(vtkPolyDataMapper* lodMapper, vtkInteractorObserver* interactorStyle, vtkIdType budget) {
+    if (style) {
+        style->RemoveObserver(startObserverTag);
+        style->RemoveObserver(endObserverTag);
+    }
+
+    mapper = lodMapper;
+    style = interactorStyle;
+    pointBudget = budget;
+
+    startCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    startCallback->SetCallback(StreamlineLOD::OnStartInteraction);
+    startCallback->SetClientData(this);
+    startObserverTag = style->AddObserver(vtkCommand::StartInteractionEvent, startCallback);
+
+    // The style renders a still frame right after EndInteractionEvent, so the swap back is enough
+    endCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    endCallback->SetCallback(StreamlineLOD::OnEndInteraction);
+    endCallback->SetClientData(this);
+    endObserverTag = style->AddObserver(vtkCommand::EndInteractionEvent, endCallback);
+
+    use_level(0);
+}
+
+void StreamlineLOD::use_level(std::size_t index) {
+    if (!mapper || levels.empty()) {
+        return;
+    }
+    index = std::min(index, levels.size() - 1);
+    if (mapper->GetInput() != levels[index].GetPointer()) {
+        mapper->SetInputData(levels[index]);
+    }
+}
+
+void StreamlineLOD::OnStartInteraction(vtkObject*, unsigned long, void* clientData, void*) {
+    StreamlineLOD* self = static_cast<StreamlineLOD*>(clientData);
+    self->use_level(self->interactive_level(self->pointBudget));
+}
+
+void StreamlineLOD::OnEndInteraction(vtkObject*, unsigned long, void* clientData, void*) {
+    StreamlineLOD* self = static_cast<StreamlineLOD*>(clientData);
+    self->use_level(0);
+}
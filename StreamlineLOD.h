@@ -0,0 +1,86 @@
+#ifndef STREAMLINE_LOD_H
+#define STREAMLINE_LOD_H
+
+#include <cstddef>
+#include <vector>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkInteractorObserver.h>
+#include <vtkCallbackCommand.h>
+
+/**
+ * Simplify every polyline of a polydata with Douglas-Peucker, in parallel over lines
+ *
+ * Point and cell attributes (e.g. Vorticity, SeedIds) are carried over for the kept points.
+ *
+ * @param input Polydata whose lines should be simplified (e.g. vtkStreamTracer output)
+ * @param tolerance Maximum distance, in data coordinates, between a dropped point and the simplified line
+ * @return New polydata containing the simplified lines
+ */
+vtkSmartPointer<vtkPolyData> simplifyPolylines(vtkPolyData* input, double tolerance);
+
+/**
+ * Level-of-detail set of streamlines that swaps a mapper's input while the camera is moving
+ *
+ * Level 0 is always the full-detail input, so still frames and screenshots are unaffected.
+ */
+class StreamlineLOD {
+public:
+    StreamlineLOD();
+    ~StreamlineLOD();
+
+    StreamlineLOD(const StreamlineLOD&) = delete;
+    StreamlineLOD& operator=(const StreamlineLOD&) = delete;
+
+    /**
+     * Build the LOD levels from full-detail streamlines
+     *
+     * @param fullDetail Traced streamlines, kept untouched as level 0
+     * @param tolerances Douglas-Peucker tolerances for the coarser levels, in increasing order
+     */
+    void build(vtkPolyData* fullDetail, const std::vector<double>& tolerances);
+
+    std::size_t level_count() const { return levels.size(); }
+    vtkPolyData* level(std::size_t index) const;
+
+    /**
+     * Finest level whose point count fits in the budget (coarsest level if none does)
+     *
+     * @param pointBudget Maximum number of points to draw while interacting
+     * @return Level index
+     */
+    std::size_t interactive_level(vtkIdType pointBudget) const;
+
+    /**
+     * Drive a mapper from this LOD set: coarse level while the style is interacting, full detail otherwise
+     *
+     * @param mapper Mapper that draws the streamlines
+     * @param style Interactor style whose Start/EndInteraction events trigger the swap
+     * @param pointBudget Maximum number of points to draw while interacting
+     */
+    void attach(vtkPolyDataMapper* mapper, vtkInteractorObserver* style, vtkIdType pointBudget);
+
+    /**
+     * Set the mapper input to the given level
+     *
+     * @param index Level index (clamped to the available levels)
+     */
+    void use_level(std::size_t index);
+
+private:
+    static void OnStartInteraction(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+    static void OnEndInteraction(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+
+    std::vector<vtkSmartPointer<vtkPolyData>> levels;
+    vtkSmartPointer<vtkPolyDataMapper> mapper;
+    vtkSmartPointer<vtkInteractorObserver> style;
+    vtkSmartPointer<vtkCallbackCommand> startCallback;
+    vtkSmartPointer<vtkCallbackCommand> endCallback;
+    unsigned long startObserverTag;
+    unsigned long endObserverTag;
+    vtkIdType pointBudget;
+};
+
+#endif // STREAMLINE_LOD_H
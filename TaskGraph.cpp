@@ -0,0 +1,195 @@
+#include "TaskGraph.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <system_error>
+
+std::uint64_t hashBytes(const void* data, std::size_t size, std::uint64_t seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+        seed ^= bytes[i];
+        seed *= 0x100000001b3ull;
+    }
+    return seed;
+}
+
+std::uint64_t fingerprintPath(const std::string& path) {
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    if (std::filesystem::is_directory(path, error)) {
+        for (const auto& entry : std::filesystem::directory_iterator(path, error)) {
+            if (entry.is_regular_file()) {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+    } else {
+        files.push_back(path);
+    }
+
+    std::uint64_t seed = hashString(path);
+    for (const std::filesystem::path& file : files) {
+        seed = combineHash(seed, hashString(file.filename().string()));
+        std::uintmax_t size = std::filesystem::file_size(file, error);
+        seed = combineHash(seed, error ? 0 : static_cast<std::uint64_t>(size));
+        auto modified = std::filesystem::last_write_time(file, error);
+        seed = combineHash(seed, error ? 0 : static_cast<std::uint64_t>(modified.time_since_epoch().count()));
+    }
+    return seed;
+}
+
+TaskGraph::TaskGraph(WorkStealingPool& workerPool, const std::string& cacheDir) : pool(workerPool), cacheFolder(cacheDir) {
+    if (!cacheFolder.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(cacheFolder, error);
+        if (error) {
+            std::cerr << "Warning: Cannot create cache folder " << cacheFolder << ", results are not persisted" << std::endl;
+            cacheFolder.clear();
+        }
+    }
+}
+
+std::size_t TaskGraph::add_node(Node node) {
+    for (std::size_t input : node.inputs) {
+        if (input >= nodes.size()) {
+            throw std::invalid_argument("TaskGraph: inputs of " + node.name + " must be added first");
+        }
+    }
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+}
+
+void TaskGraph::set_parameters(std::size_t id, std::uint64_t parameters) {
+    nodes.at(id).parameters = parameters;
+}
+
+std::string TaskGraph::cache_path(const Node& node) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(node.key));
+    return (std::filesystem::path(cacheFolder) / (name + std::string(node.extension))).string();
+}
+
+void TaskGraph::execute(std::size_t id) {
+    Node& node = nodes[id];
+    auto start = std::chrono::steady_clock::now();
+    bool persisted = !cacheFolder.empty() && node.load;
+    std::string path = persisted ? cache_path(node) : std::string();
+
+    std::shared_ptr<void> result;
+    if (persisted && std::filesystem::exists(path)) {
+        result = node.load(path);
+    }
+    if (result) {
+        node.status = Status::Loaded;
+    } else {
+        result = node.compute();
+        node.status = Status::Computed;
+        // Written under a temporary name first, so an interrupted run never leaves a truncated result
+        if (persisted && node.save(path + ".tmp", result.get())) {
+            std::error_code error;
+            std::filesystem::rename(path + ".tmp", path, error);
+        }
+    }
+    node.result = std::move(result);
+    node.resultKey = node.key;
+    node.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TaskGraph::run() {
+    const std::size_t count = nodes.size();
+
+    // Keys in insertion (topological) order; nodes with a result for their key are done
+    std::vector<bool> dirty(count, false);
+    std::vector<std::vector<std::size_t>> dependents(count);
+    std::vector<std::size_t> waitingOn(count, 0);
+    std::size_t pending = 0;
+    for (std::size_t id = 0; id < count; id++) {
+        Node& node = nodes[id];
+        node.key = combineHash(hashString(node.name), node.parameters);
+        for (std::size_t input : node.inputs) {
+            node.key = combineHash(node.key, nodes[input].key);
+            if (dirty[input]) {
+                dependents[input].push_back(id);
+                waitingOn[id]++;
+            }
+        }
+        dirty[id] = !node.result || node.resultKey != node.key;
+        node.status = dirty[id] ? Status::Pending : Status::Memoized;
+        node.seconds = 0.0;
+        if (dirty[id]) {
+            pending++;
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr firstError;
+
+    std::function<void(std::size_t)> launch;
+    // Marks a failed node's dependents (transitively) as skipped; called with the mutex held
+    std::function<void(std::size_t)> skip = [&](std::size_t id) {
+        for (std::size_t dependent : dependents[id]) {
+            if (nodes[dependent].status == Status::Pending) {
+                nodes[dependent].status = Status::Skipped;
+                pending--;
+                skip(dependent);
+            }
+        }
+    };
+    launch = [&](std::size_t id) {
+        pool.submit([&, id]() {
+            bool failed = false;
+            try {
+                execute(id);
+            } catch (...) {
+                failed = true;
+                std::lock_guard<std::mutex> lock(mutex);
+                nodes[id].status = Status::Failed;
+                if (!firstError) {
+                    firstError = std::current_exception();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (failed) {
+                skip(id);
+            } else {
+                for (std::size_t dependent : dependents[id]) {
+                    if (--waitingOn[dependent] == 0 && nodes[dependent].status == Status::Pending) {
+                        launch(dependent);
+                    }
+                }
+            }
+            pending--;
+            done.notify_all();
+        });
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (std::size_t id = 0; id < count; id++) {
+            if (dirty[id] && waitingOn[id] == 0) {
+                launch(id);
+            }
+        }
+        done.wait(lock, [&]() { return pending == 0; });
+    }
+
+    if (firstError) {
+        std::rethrow_exception(firstError);
+    }
+}
+
+void TaskGraph::print_report() const {
+    const char* labels[] = {"pending", "computed", "loaded", "memoized", "failed", "skipped"};
+    std::cout << "Pipeline stages:" << std::endl;
+    for (const Node& node : nodes) {
+        std::printf("  %-24s %-9s %8.3f s\n", node.name.c_str(), labels[static_cast<int>(node.status)], node.seconds);
+    }
+    std::fflush(stdout);
+}
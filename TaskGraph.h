@@ -0,0 +1,191 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Volume4D.h"
+#include "VolumeCache.h"
+#include "WorkStealingPool.h"
+
+/**
+ * 64-bit FNV-1a hash of a byte range
+ */
+std::uint64_t hashBytes(const void* data, std::size_t size, std::uint64_t seed = 0xcbf29ce484222325ull);
+
+inline std::uint64_t hashString(const std::string& text) {
+    return hashBytes(text.data(), text.size());
+}
+
+inline std::uint64_t hashDouble(double value) {
+    return hashBytes(&value, sizeof(value));
+}
+
+/**
+ * Order-dependent combination of two hashes
+ */
+inline std::uint64_t combineHash(std::uint64_t seed, std::uint64_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+/**
+ * Fingerprint of a file, or of every regular file in a folder: names, sizes and modification times
+ *
+ * Stands in for a hash of the contents of a DICOM series, which would cost as much as
+ * decoding it; any rewritten, added or removed file changes the fingerprint.
+ */
+std::uint64_t fingerprintPath(const std::string& path);
+
+/**
+ * How a result type is stored in the graph's cache folder; results of other types are memoized in memory only
+ */
+template <typename T>
+struct TaskPersistence {
+    static constexpr bool enabled = false;
+};
+
+// The .v4d header records the volume's memory category, so a loaded result is charged like the computed one
+template <>
+struct TaskPersistence<Volume4D> {
+    static constexpr bool enabled = true;
+    static const char* extension() { return ".v4d"; }
+    static bool save(const std::string& path, const Volume4D& volume) { return !volume.empty() && writeVolumeCache(path, volume); }
+    static bool load(const std::string& path, Volume4D& volume) {
+        volume = readVolumeCache(path);
+        return !volume.empty();
+    }
+};
+
+/**
+ * Typed reference to a node of a TaskGraph
+ */
+template <typename T>
+struct TaskHandle {
+    std::size_t id = static_cast<std::size_t>(-1);
+};
+
+/**
+ * Pipeline stages as a dependency graph with memoized results
+ *
+ * Each node has a name, its input nodes, a hash of its parameters and a function computing
+ * its result (which reads the inputs through get()). A node's key is the hash of its name,
+ * parameters and the keys of its inputs, so it identifies the result by everything it was
+ * derived from. run() executes only the nodes whose key has no result yet; nodes whose
+ * inputs are ready run in parallel on the pool. After a parameter change, only that node
+ * and the nodes downstream of it run again.
+ *
+ * With a cache folder, results whose type has a TaskPersistence specialization (Volume4D)
+ * are also stored there as <key>.v4d and loaded instead of computed by later runs.
+ *
+ * Nodes must be added after their inputs. Results stay owned by the graph.
+ */
+class TaskGraph {
+public:
+    /**
+     * @param pool Pool the nodes run on
+     * @param cacheDir Folder for persisted results (empty = memoize in memory only)
+     */
+    explicit TaskGraph(WorkStealingPool& pool, const std::string& cacheDir = "");
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    /**
+     * Add a node
+     *
+     * @param name Stage name, part of the key and shown in reports
+     * @param inputs Ids of the nodes whose results compute reads
+     * @param parameters Hash of everything else the result depends on
+     * @param compute Produces the result
+     * @return Handle for get() and as an input of later nodes
+     */
+    template <typename T>
+    TaskHandle<T> add(const std::string& name, const std::vector<std::size_t>& inputs, std::uint64_t parameters,
+                      std::function<T()> compute);
+
+    /**
+     * Change a node's parameter hash; the next run() recomputes it and its dependents
+     */
+    void set_parameters(std::size_t id, std::uint64_t parameters);
+
+    /**
+     * Bring every node up to date; rethrows the first error of a node (its dependents are skipped)
+     *
+     * Must not be called from a task running on the graph's pool: it waits for nodes queued on
+     * that pool, which on a pool with one worker can never start.
+     */
+    void run();
+
+    /**
+     * Result of a node; valid after a successful run()
+     */
+    template <typename T>
+    const T& get(TaskHandle<T> handle) const {
+        const Node& node = nodes.at(handle.id);
+        if (!node.result) {
+            throw std::logic_error("TaskGraph::get: node " + node.name + " has no result");
+        }
+        return *static_cast<const T*>(node.result.get());
+    }
+
+    /**
+     * Print how each node was satisfied by the last run (computed, loaded, memoized) and its time
+     */
+    void print_report() const;
+
+private:
+    enum class Status { Pending, Computed, Loaded, Memoized, Failed, Skipped };
+
+    struct Node {
+        std::string name;
+        std::vector<std::size_t> inputs;
+        std::uint64_t parameters = 0;
+        std::function<std::shared_ptr<void>()> compute;
+        std::function<std::shared_ptr<void>(const std::string&)> load;        // Persisted types only
+        std::function<bool(const std::string&, const void*)> save;
+        const char* extension = nullptr;
+        std::uint64_t key = 0;
+        std::uint64_t resultKey = 0;
+        std::shared_ptr<void> result;
+        Status status = Status::Pending;
+        double seconds = 0.0;
+    };
+
+    std::size_t add_node(Node node);
+    void execute(std::size_t id);
+    std::string cache_path(const Node& node) const;
+
+    WorkStealingPool& pool;
+    std::string cacheFolder;
+    std::vector<Node> nodes;
+};
+
+template <typename T>
+TaskHandle<T> TaskGraph::add(const std::string& name, const std::vector<std::size_t>& inputs, std::uint64_t parameters,
+                             std::function<T()> compute) {
+    Node node;
+    node.name = name;
+    node.inputs = inputs;
+    node.parameters = parameters;
+    node.compute = [compute]() -> std::shared_ptr<void> { return std::make_shared<T>(compute()); };
+    if constexpr (TaskPersistence<T>::enabled) {
+        node.load = [](const std::string& path) -> std::shared_ptr<void> {
+            std::shared_ptr<T> value = std::make_shared<T>();
+            return TaskPersistence<T>::load(path, *value) ? value : nullptr;
+        };
+        node.save = [](const std::string& path, const void* value) {
+            return TaskPersistence<T>::save(path, *static_cast<const T*>(value));
+        };
+        node.extension = TaskPersistence<T>::extension();
+    }
+
+    TaskHandle<T> handle;
+    handle.id = add_node(std::move(node));
+    return handle;
+}
+
+#endif // TASK_GRAPH_H
@@ -0,0 +1,216 @@
+#include "TemporalInterpolator.h"
+#include "parallel_utils.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Elements per chunk; large enough to amortize handing a chunk to a pool worker
+const std::size_t kMinChunk = 1 << 15;
+
+/**
+ * Wrap a time into the cycle and split it into a frame index and fraction
+ */
+void splitTime(double time, std::size_t frameCount, std::size_t& frame, float& fraction) {
+    double cycle = static_cast<double>(frameCount);
+    double wrapped = std::fmod(time, cycle);
+    if (wrapped < 0.0) {
+        wrapped += cycle;
+    }
+    double base = std::floor(wrapped);
+    frame = static_cast<std::size_t>(base) % frameCount;
+    fraction = static_cast<float>(wrapped - base);
+}
+
+// Invert a small dense matrix (row-major, n x n) by Gauss-Jordan elimination with partial pivoting
+std::vector<double> invertMatrix(std::vector<double> a, std::size_t n) {
+    std::vector<double> inv(n * n, 0.0);
+    for (std::size_t i = 0; i < n; i++) {
+        inv[i * n + i] = 1.0;
+    }
+    for (std::size_t col = 0; col < n; col++) {
+        std::size_t pivot = col;
+        for (std::size_t row = col + 1; row < n; row++) {
+            if (std::fabs(a[row * n + col]) > std::fabs(a[pivot * n + col])) {
+                pivot = row;
+            }
+        }
+        if (std::fabs(a[pivot * n + col]) < 1e-12) {
+            throw std::runtime_error("TemporalInterpolator: Singular spline system");
+        }
+        for (std::size_t k = 0; k < n; k++) {
+            std::swap(a[col * n + k], a[pivot * n + k]);
+            std::swap(inv[col * n + k], inv[pivot * n + k]);
+        }
+        double scale = 1.0 / a[col * n + col];
+        for (std::size_t k = 0; k < n; k++) {
+            a[col * n + k] *= scale;
+            inv[col * n + k] *= scale;
+        }
+        for (std::size_t row = 0; row < n; row++) {
+            if (row == col) {
+                continue;
+            }
+            double factor = a[row * n + col];
+            for (std::size_t k = 0; k < n; k++) {
+                a[row * n + k] -= factor * a[col * n + k];
+                inv[row * n + k] -= factor * inv[col * n + k];
+            }
+        }
+    }
+    return inv;
+}
+
+} // namespace
+
+void weightedFrameSum(const float* const* inputs, const float* weights, std::size_t count, float* out, std::size_t n) {
+    if (count == 0) {
+        std::fill(out, out + n, 0.0f);
+        return;
+    }
+
+    parallelForRange(0, n, [&](std::size_t begin, std::size_t end) {
+        std::size_t i = begin;
+#if defined(__AVX__)
+        for (; i + 8 <= end; i += 8) {
+            __m256 acc = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_loadu_ps(inputs[0] + i));
+            for (std::size_t k = 1; k < count; k++) {
+                __m256 w = _mm256_set1_ps(weights[k]);
+#if defined(__FMA__)
+                acc = _mm256_fmadd_ps(w, _mm256_loadu_ps(inputs[k] + i), acc);
+#else
+                acc = _mm256_add_ps(_mm256_mul_ps(w, _mm256_loadu_ps(inputs[k] + i)), acc);
+#endif
+            }
+            _mm256_storeu_ps(out + i, acc);
+        }
+#endif
+        for (; i < end; i++) {
+            float acc = weights[0] * inputs[0][i];
+            for (std::size_t k = 1; k < count; k++) {
+                acc += weights[k] * inputs[k][i];
+            }
+            out[i] = acc;
+        }
+    }, kMinChunk);
+}
+
+TemporalInterpolator::TemporalInterpolator(const Volume4D& series, TemporalMode mode)
+    : series(series), mode(mode) {
+    if (series.empty()) {
+        throw std::invalid_argument("TemporalInterpolator: Series is empty");
+    }
+    if (mode == TemporalMode::PeriodicSpline) {
+        build_spline();
+    }
+}
+
+void TemporalInterpolator::build_spline() {
+    // Periodic cubic spline with unit spacing: M[k-1] + 4 M[k] + M[k+1] = 6 (y[k+1] - 2 y[k] + y[k-1]).
+    // The system is the same for every voxel, so M = G y with G = A^-1 * 6 D computed once,
+    // and each M frame is a weighted sum of the input frames.
+    std::size_t n = series.size_t();
+    std::vector<double> a(n * n, 0.0), d(n * n, 0.0);
+    for (std::size_t k = 0; k < n; k++) {
+        std::size_t prev = (k + n - 1) % n;
+        std::size_t next = (k + 1) % n;
+        a[k * n + k] += 4.0;
+        a[k * n + prev] += 1.0;
+        a[k * n + next] += 1.0;
+        d[k * n + k] -= 12.0;
+        d[k * n + prev] += 6.0;
+        d[k * n + next] += 6.0;
+    }
+    std::vector<double> inv = invertMatrix(a, n);
+
+    std::vector<const float*> frames(n);
+    for (std::size_t j = 0; j < n; j++) {
+        frames[j] = series.frame_data(j);
+    }
+
+    secondDerivatives.resize(series.size_x(), series.size_y(), series.size_z(), n);
+    std::vector<float> g(n);
+    for (std::size_t k = 0; k < n; k++) {
+        for (std::size_t j = 0; j < n; j++) {
+            double sum = 0.0;
+            for (std::size_t m = 0; m < n; m++) {
+                sum += inv[k * n + m] * d[m * n + j];
+            }
+            g[j] = static_cast<float>(sum);
+        }
+        weightedFrameSum(frames.data(), g.data(), n, secondDerivatives.frame_data(k), series.frame_size());
+    }
+}
+
+void TemporalInterpolator::hermite_terms(double time, std::size_t frameCount, std::size_t frames[4], float weights[4]) {
+    std::size_t k;
+    float u;
+    splitTime(time, frameCount, k, u);
+
+    for (std::size_t i = 0; i < 4; i++) {
+        frames[i] = (k + frameCount + i - 1) % frameCount;
+    }
+    float u2 = u * u;
+    float u3 = u2 * u;
+    weights[0] = 0.5f * (-u3 + 2.0f * u2 - u);
+    weights[1] = 0.5f * (3.0f * u3 - 5.0f * u2 + 2.0f);
+    weights[2] = 0.5f * (-3.0f * u3 + 4.0f * u2 + u);
+    weights[3] = 0.5f * (u3 - u2);
+}
+
+std::size_t TemporalInterpolator::terms(double time, const float* inputs[4], float weights[4]) const {
+    std::size_t n = series.size_t();
+    std::size_t k;
+    float u;
+    splitTime(time, n, k, u);
+    std::size_t next = (k + 1) % n;
+
+    switch (mode) {
+        case TemporalMode::Linear:
+            inputs[0] = series.frame_data(k);
+            inputs[1] = series.frame_data(next);
+            weights[0] = 1.0f - u;
+            weights[1] = u;
+            return 2;
+        case TemporalMode::CubicHermite: {
+            std::size_t frames[4];
+            hermite_terms(time, n, frames, weights);
+            for (int i = 0; i < 4; i++) {
+                inputs[i] = series.frame_data(frames[i]);
+            }
+            return 4;
+        }
+        case TemporalMode::PeriodicSpline: {
+            float v = 1.0f - u;
+            inputs[0] = series.frame_data(k);
+            inputs[1] = series.frame_data(next);
+            inputs[2] = secondDerivatives.frame_data(k);
+            inputs[3] = secondDerivatives.frame_data(next);
+            weights[0] = v;
+            weights[1] = u;
+            weights[2] = (v * v * v - v) / 6.0f;
+            weights[3] = (u * u * u - u) / 6.0f;
+            return 4;
+        }
+    }
+    return 0;
+}
+
+void TemporalInterpolator::frame_into(double time, float* out) const {
+    const float* inputs[4];
+    float weights[4];
+    std::size_t count = terms(time, inputs, weights);
+    weightedFrameSum(inputs, weights, count, out, series.frame_size());
+}
+
+const float* TemporalInterpolator::frame(double time) {
+    output.resize(series.frame_size());
+    frame_into(time, output.data());
+    return output.data();
+}
@@ -0,0 +1,94 @@
+#ifndef TEMPORAL_INTERPOLATOR_H
+#define TEMPORAL_INTERPOLATOR_H
+
+#include <cstddef>
+#include <vector>
+#include "Volume4D.h"
+
+/**
+ * Interpolation between cardiac frames; all modes wrap around the cycle
+ */
+enum class TemporalMode {
+    Linear,         // Two neighbouring frames
+    CubicHermite,   // Catmull-Rom through four neighbouring frames
+    PeriodicSpline  // Interpolating periodic cubic spline (C2 over the whole cycle)
+};
+
+/**
+ * Weighted sum of frame buffers: out[i] = sum_k weights[k] * inputs[k][i]
+ *
+ * Single pass over the output, vectorized with AVX where available, split across the worker threads.
+ *
+ * @param inputs Frame buffers, each n floats
+ * @param weights One weight per input
+ * @param count Number of inputs
+ * @param out Destination, n floats (must not alias an input)
+ * @param n Number of elements per buffer
+ */
+void weightedFrameSum(const float* const* inputs, const float* weights, std::size_t count, float* out, std::size_t n);
+
+/**
+ * Synthesizes frames at arbitrary (fractional) times of the cardiac cycle on demand
+ *
+ * Each requested frame is one weighted sum of up to four contiguous frame buffers written
+ * into a reused output buffer, so an upsampled series is never stored. The periodic
+ * spline precomputes one second-derivative frame per input frame.
+ */
+class TemporalInterpolator {
+public:
+    /**
+     * @param series Frames to interpolate (must outlive the interpolator and not be resized)
+     * @param mode Interpolation mode
+     */
+    explicit TemporalInterpolator(const Volume4D& series, TemporalMode mode = TemporalMode::CubicHermite);
+
+    TemporalMode get_mode() const { return mode; }
+    std::size_t frame_count() const { return series.size_t(); }
+    std::size_t frame_size() const { return series.frame_size(); }
+
+    /**
+     * Synthesize the frame at a time into the internal buffer
+     *
+     * @param time Time in frames (wraps around the cycle)
+     * @return Pointer to frame_size() floats, valid until the next call
+     */
+    const float* frame(double time);
+
+    /**
+     * Synthesize the frame at a time into a caller buffer (safe to call concurrently)
+     *
+     * @param time Time in frames (wraps around the cycle)
+     * @param out Destination, frame_size() floats
+     */
+    void frame_into(double time, float* out) const;
+
+    /**
+     * Frame buffers and weights that make up the frame at a time
+     *
+     * @param time Time in frames
+     * @param inputs Receives up to 4 buffer pointers
+     * @param weights Receives the matching weights
+     * @return Number of buffers used
+     */
+    std::size_t terms(double time, const float* inputs[4], float weights[4]) const;
+
+    /**
+     * Frame indices and weights of a cubic Hermite (Catmull-Rom) blend at a time, wrapping around the cycle
+     *
+     * @param time Time in frames
+     * @param frameCount Number of frames in the cycle
+     * @param frames Receives the 4 frame indices
+     * @param weights Receives the 4 weights
+     */
+    static void hermite_terms(double time, std::size_t frameCount, std::size_t frames[4], float weights[4]);
+
+private:
+    void build_spline();
+
+    const Volume4D& series;
+    TemporalMode mode;
+    Volume4D secondDerivatives; // PeriodicSpline only
+    std::vector<float> output;
+};
+
+#endif // TEMPORAL_INTERPOLATOR_H
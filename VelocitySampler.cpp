@@ -0,0 +1,393 @@
+#include "VelocitySampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Clamp to [0, hi]; NaN maps to 0 so it can never produce an out-of-range index
+inline float clampCoord(float v, float hi) {
+    return v > 0.0f ? (v < hi ? v : hi) : 0.0f;
+}
+
+inline std::size_t clampIndex(long i, std::size_t dim) {
+    if (i < 0) {
+        return 0;
+    }
+    return std::min(static_cast<std::size_t>(i), dim - 1);
+}
+
+// Catmull-Rom weights for taps at -1, 0, +1, +2
+inline void catmullRomWeights(float t, float w[4]) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    w[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+    w[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+    w[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+    w[3] = 0.5f * (t3 - t2);
+}
+
+#if defined(__AVX2__)
+
+inline __m256 madd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+inline __m256 lerp(__m256 a, __m256 b, __m256 t) {
+    return madd(t, _mm256_sub_ps(b, a), a);
+}
+
+inline void catmullRomWeights(__m256 t, __m256 w[4]) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 three = _mm256_set1_ps(3.0f);
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 five = _mm256_set1_ps(5.0f);
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 t3 = _mm256_mul_ps(t2, t);
+    w[0] = _mm256_mul_ps(half, _mm256_sub_ps(_mm256_mul_ps(two, t2), _mm256_add_ps(t3, t)));
+    w[1] = _mm256_mul_ps(half, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(three, t3), _mm256_mul_ps(five, t2)), two));
+    w[2] = _mm256_mul_ps(half, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(four, t2), _mm256_mul_ps(three, t3)), t));
+    w[3] = _mm256_mul_ps(half, _mm256_sub_ps(t3, t2));
+}
+
+inline __m256i clampIndex(__m256i i, __m256i hi) {
+    return _mm256_min_epi32(_mm256_max_epi32(i, _mm256_setzero_si256()), hi);
+}
+
+#endif
+
+} // namespace
+
+VelocitySampler::VelocitySampler(const Volume4D& vx, const Volume4D& vy, const Volume4D& vz)
+    : components{&vx, &vy, &vz},
+      splines{nullptr, nullptr, nullptr},
+      dim_x(vx.size_x()), dim_y(vx.size_y()), dim_z(vx.size_z()), dim_t(vx.size_t()),
+      interpolation(Interpolation::Trilinear),
+      temporalInterpolation(false),
+      temporalMode(TemporalMode::Linear),
+      periodicTime(true),
+      useSimd(simd_available()) {
+    for (const Volume4D* component : components) {
+        if (component->size_x() != dim_x || component->size_y() != dim_y ||
+            component->size_z() != dim_z || component->size_t() != dim_t) {
+            throw std::invalid_argument("VelocitySampler: Velocity components have different dimensions");
+        }
+    }
+    if (vx.empty()) {
+        throw std::invalid_argument("VelocitySampler: Velocity components are empty");
+    }
+
+    // Gather indices are 32-bit
+    if (vx.frame_size() > static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max())) {
+        useSimd = false;
+    }
+}
+
+bool VelocitySampler::simd_available() {
+#if defined(__AVX2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void VelocitySampler::set_temporal_mode(TemporalMode mode) {
+    if (mode == TemporalMode::PeriodicSpline && splines[0] == nullptr) {
+        throw std::invalid_argument("VelocitySampler: PeriodicSpline needs spline interpolators");
+    }
+    temporalMode = mode;
+}
+
+void VelocitySampler::set_spline_interpolators(const TemporalInterpolator* x, const TemporalInterpolator* y,
+                                               const TemporalInterpolator* z) {
+    const TemporalInterpolator* attached[3] = {x, y, z};
+    for (const TemporalInterpolator* spline : attached) {
+        if (spline == nullptr || spline->get_mode() != TemporalMode::PeriodicSpline ||
+            spline->frame_count() != dim_t || spline->frame_size() != components[0]->frame_size()) {
+            throw std::invalid_argument("VelocitySampler: Spline interpolators must be PeriodicSpline over the component volumes");
+        }
+    }
+    std::copy(attached, attached + 3, splines);
+}
+
+std::size_t VelocitySampler::wrap_frame(long frame) const {
+    long count = static_cast<long>(dim_t);
+    if (periodicTime) {
+        return static_cast<std::size_t>(((frame % count) + count) % count);
+    }
+    return clampIndex(frame, dim_t);
+}
+
+void VelocitySampler::sample(const float* xyz, std::size_t n, float* out, float time) const {
+    PointStream in = {{xyz, xyz + 1, xyz + 2}, 3};
+    VectorStream result = {{out, out + 1, out + 2}, 3};
+    sample_streams(in, n, result, time);
+}
+
+void VelocitySampler::sample_soa(const float* x, const float* y, const float* z, std::size_t n,
+                                 float* outX, float* outY, float* outZ, float time) const {
+    PointStream in = {{x, y, z}, 1};
+    VectorStream result = {{outX, outY, outZ}, 1};
+    sample_streams(in, n, result, time);
+}
+
+void VelocitySampler::sample_frame(const float* xyz, std::size_t n, float* out, std::size_t frame) const {
+    if (frame >= dim_t) {
+        throw std::out_of_range("VelocitySampler::sample_frame: Frame out of range");
+    }
+    PointStream in = {{xyz, xyz + 1, xyz + 2}, 3};
+    VectorStream result = {{out, out + 1, out + 2}, 3};
+    sample_frame_weighted(in, n, result, frame, 1.0f, false);
+}
+
+void VelocitySampler::sample_streams(const PointStream& in, std::size_t n, const VectorStream& out, float time) const {
+    if (!temporalInterpolation) {
+        sample_frame_weighted(in, n, out, wrap_frame(std::lround(time)), 1.0f, false);
+        return;
+    }
+
+    if (temporalMode == TemporalMode::PeriodicSpline) {
+        // Same weights for every component; term k of each interpolator is the same kind of frame
+        const float* inputs[3][4];
+        float weights[4];
+        std::size_t count = 0;
+        for (int c = 0; c < 3; c++) {
+            count = splines[c]->terms(time, inputs[c], weights);
+        }
+        for (std::size_t k = 0; k < count; k++) {
+            const float* fields[3] = {inputs[0][k], inputs[1][k], inputs[2][k]};
+            sample_weighted(in, n, out, fields, weights[k], k > 0);
+        }
+        return;
+    }
+
+    float base = std::floor(time);
+    float weight = time - base;
+
+    if (temporalMode != TemporalMode::Linear && weight > 0.0f && dim_t > 1) {
+        std::size_t unused[4];
+        float weights[4];
+        TemporalInterpolator::hermite_terms(time, dim_t, unused, weights);
+        for (int i = 0; i < 4; i++) {
+            std::size_t frame = wrap_frame(static_cast<long>(base) + i - 1);
+            sample_frame_weighted(in, n, out, frame, weights[i], i > 0);
+        }
+        return;
+    }
+
+    std::size_t f0 = wrap_frame(static_cast<long>(base));
+    std::size_t f1 = wrap_frame(static_cast<long>(base) + 1);
+
+    if (weight <= 0.0f || f0 == f1) {
+        sample_frame_weighted(in, n, out, f0, 1.0f, false);
+        return;
+    }
+    sample_frame_weighted(in, n, out, f0, 1.0f - weight, false);
+    sample_frame_weighted(in, n, out, f1, weight, true);
+}
+
+void VelocitySampler::sample_frame_weighted(const PointStream& in, std::size_t n, const VectorStream& out, std::size_t frame, float weight, bool accumulate) const {
+    const float* fields[3] = {
+        components[0]->frame_data(frame),
+        components[1]->frame_data(frame),
+        components[2]->frame_data(frame)
+    };
+    sample_weighted(in, n, out, fields, weight, accumulate);
+}
+
+void VelocitySampler::sample_weighted(const PointStream& in, std::size_t n, const VectorStream& out, const float* const fields[3], float weight, bool accumulate) const {
+    std::size_t done = 0;
+#if defined(__AVX2__)
+    if (useSimd) {
+        done = sample_avx2(in, n, out, fields, weight, accumulate);
+    }
+#endif
+    if (done < n) {
+        PointStream restIn = in;
+        VectorStream restOut = out;
+        for (int c = 0; c < 3; c++) {
+            restIn.p[c] += done * in.stride;
+            restOut.p[c] += done * out.stride;
+        }
+        sample_scalar(restIn, n - done, restOut, fields, weight, accumulate);
+    }
+}
+
+void VelocitySampler::sample_scalar(const PointStream& in, std::size_t n, const VectorStream& out, const float* const fields[3], float weight, bool accumulate) const {
+    const std::size_t dxy = dim_x * dim_y;
+    const float maxX = static_cast<float>(dim_x - 1);
+    const float maxY = static_cast<float>(dim_y - 1);
+    const float maxZ = static_cast<float>(dim_z - 1);
+
+    for (std::size_t i = 0; i < n; i++) {
+        float x = clampCoord(in.p[0][i * in.stride], maxX);
+        float y = clampCoord(in.p[1][i * in.stride], maxY);
+        float z = clampCoord(in.p[2][i * in.stride], maxZ);
+        float fx = std::floor(x), fy = std::floor(y), fz = std::floor(z);
+        float tx = x - fx, ty = y - fy, tz = z - fz;
+        long ix = static_cast<long>(fx), iy = static_cast<long>(fy), iz = static_cast<long>(fz);
+
+        float result[3] = {0.0f, 0.0f, 0.0f};
+
+        if (interpolation == Interpolation::Trilinear) {
+            std::size_t x0 = clampIndex(ix, dim_x), x1 = clampIndex(ix + 1, dim_x);
+            std::size_t y0 = clampIndex(iy, dim_y) * dim_x, y1 = clampIndex(iy + 1, dim_y) * dim_x;
+            std::size_t z0 = clampIndex(iz, dim_z) * dxy, z1 = clampIndex(iz + 1, dim_z) * dxy;
+            for (int c = 0; c < 3; c++) {
+                const float* f = fields[c];
+                float c00 = f[z0 + y0 + x0] + tx * (f[z0 + y0 + x1] - f[z0 + y0 + x0]);
+                float c10 = f[z0 + y1 + x0] + tx * (f[z0 + y1 + x1] - f[z0 + y1 + x0]);
+                float c01 = f[z1 + y0 + x0] + tx * (f[z1 + y0 + x1] - f[z1 + y0 + x0]);
+                float c11 = f[z1 + y1 + x0] + tx * (f[z1 + y1 + x1] - f[z1 + y1 + x0]);
+                float c0 = c00 + ty * (c10 - c00);
+                float c1 = c01 + ty * (c11 - c01);
+                result[c] = c0 + tz * (c1 - c0);
+            }
+        } else {
+            float wx[4], wy[4], wz[4];
+            catmullRomWeights(tx, wx);
+            catmullRomWeights(ty, wy);
+            catmullRomWeights(tz, wz);
+            std::size_t xs[4], ys[4], zs[4];
+            for (int k = 0; k < 4; k++) {
+                xs[k] = clampIndex(ix - 1 + k, dim_x);
+                ys[k] = clampIndex(iy - 1 + k, dim_y) * dim_x;
+                zs[k] = clampIndex(iz - 1 + k, dim_z) * dxy;
+            }
+            for (int c = 0; c < 3; c++) {
+                const float* f = fields[c];
+                float acc = 0.0f;
+                for (int kz = 0; kz < 4; kz++) {
+                    for (int ky = 0; ky < 4; ky++) {
+                        const float* row = f + zs[kz] + ys[ky];
+                        float rowSum = wx[0] * row[xs[0]] + wx[1] * row[xs[1]] + wx[2] * row[xs[2]] + wx[3] * row[xs[3]];
+                        acc += wz[kz] * wy[ky] * rowSum;
+                    }
+                }
+                result[c] = acc;
+            }
+        }
+
+        for (int c = 0; c < 3; c++) {
+            float& o = out.p[c][i * out.stride];
+            o = accumulate ? o + weight * result[c] : weight * result[c];
+        }
+    }
+}
+
+#if defined(__AVX2__)
+
+std::size_t VelocitySampler::sample_avx2(const PointStream& in, std::size_t n, const VectorStream& out, const float* const fields[3], float weight, bool accumulate) const {
+    const __m256i laneOffsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                                   _mm256_set1_epi32(static_cast<int>(in.stride)));
+    const __m256 weights = _mm256_set1_ps(weight);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 maxX = _mm256_set1_ps(static_cast<float>(dim_x - 1));
+    const __m256 maxY = _mm256_set1_ps(static_cast<float>(dim_y - 1));
+    const __m256 maxZ = _mm256_set1_ps(static_cast<float>(dim_z - 1));
+    const __m256i hiX = _mm256_set1_epi32(static_cast<int>(dim_x - 1));
+    const __m256i hiY = _mm256_set1_epi32(static_cast<int>(dim_y - 1));
+    const __m256i hiZ = _mm256_set1_epi32(static_cast<int>(dim_z - 1));
+    const __m256i strideY = _mm256_set1_epi32(static_cast<int>(dim_x));
+    const __m256i strideZ = _mm256_set1_epi32(static_cast<int>(dim_x * dim_y));
+    const __m256i one = _mm256_set1_epi32(1);
+
+    alignas(32) float result[3][8];
+    std::size_t blocks = n / 8;
+
+    for (std::size_t b = 0; b < blocks; b++) {
+        // Load (SoA) or deinterleave (strided) 8 positions
+        __m256 pos[3];
+        for (int c = 0; c < 3; c++) {
+            const float* p = in.p[c] + 8 * b * in.stride;
+            pos[c] = in.stride == 1 ? _mm256_loadu_ps(p) : _mm256_i32gather_ps(p, laneOffsets, 4);
+        }
+
+        // Clamp to the grid (max/min also map NaN to 0)
+        __m256 x = _mm256_min_ps(_mm256_max_ps(pos[0], zero), maxX);
+        __m256 y = _mm256_min_ps(_mm256_max_ps(pos[1], zero), maxY);
+        __m256 z = _mm256_min_ps(_mm256_max_ps(pos[2], zero), maxZ);
+
+        __m256 fx = _mm256_floor_ps(x), fy = _mm256_floor_ps(y), fz = _mm256_floor_ps(z);
+        __m256 tx = _mm256_sub_ps(x, fx), ty = _mm256_sub_ps(y, fy), tz = _mm256_sub_ps(z, fz);
+        __m256i ix = _mm256_cvttps_epi32(fx), iy = _mm256_cvttps_epi32(fy), iz = _mm256_cvttps_epi32(fz);
+
+        if (interpolation == Interpolation::Trilinear) {
+            __m256i x0 = ix;
+            __m256i x1 = _mm256_min_epi32(_mm256_add_epi32(ix, one), hiX);
+            __m256i y0 = _mm256_mullo_epi32(iy, strideY);
+            __m256i y1 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_add_epi32(iy, one), hiY), strideY);
+            __m256i z0 = _mm256_mullo_epi32(iz, strideZ);
+            __m256i z1 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_add_epi32(iz, one), hiZ), strideZ);
+
+            __m256i r00 = _mm256_add_epi32(z0, y0), r10 = _mm256_add_epi32(z0, y1);
+            __m256i r01 = _mm256_add_epi32(z1, y0), r11 = _mm256_add_epi32(z1, y1);
+
+            for (int c = 0; c < 3; c++) {
+                const float* f = fields[c];
+                __m256 c00 = lerp(_mm256_i32gather_ps(f, _mm256_add_epi32(r00, x0), 4), _mm256_i32gather_ps(f, _mm256_add_epi32(r00, x1), 4), tx);
+                __m256 c10 = lerp(_mm256_i32gather_ps(f, _mm256_add_epi32(r10, x0), 4), _mm256_i32gather_ps(f, _mm256_add_epi32(r10, x1), 4), tx);
+                __m256 c01 = lerp(_mm256_i32gather_ps(f, _mm256_add_epi32(r01, x0), 4), _mm256_i32gather_ps(f, _mm256_add_epi32(r01, x1), 4), tx);
+                __m256 c11 = lerp(_mm256_i32gather_ps(f, _mm256_add_epi32(r11, x0), 4), _mm256_i32gather_ps(f, _mm256_add_epi32(r11, x1), 4), tx);
+                _mm256_store_ps(result[c], _mm256_mul_ps(weights, lerp(lerp(c00, c10, ty), lerp(c01, c11, ty), tz)));
+            }
+        } else {
+            __m256 wx[4], wy[4], wz[4];
+            catmullRomWeights(tx, wx);
+            catmullRomWeights(ty, wy);
+            catmullRomWeights(tz, wz);
+
+            __m256i xs[4], ys[4], zs[4];
+            for (int k = 0; k < 4; k++) {
+                __m256i offset = _mm256_set1_epi32(k - 1);
+                xs[k] = clampIndex(_mm256_add_epi32(ix, offset), hiX);
+                ys[k] = _mm256_mullo_epi32(clampIndex(_mm256_add_epi32(iy, offset), hiY), strideY);
+                zs[k] = _mm256_mullo_epi32(clampIndex(_mm256_add_epi32(iz, offset), hiZ), strideZ);
+            }
+
+            for (int c = 0; c < 3; c++) {
+                const float* f = fields[c];
+                __m256 acc = _mm256_setzero_ps();
+                for (int kz = 0; kz < 4; kz++) {
+                    for (int ky = 0; ky < 4; ky++) {
+                        __m256i row = _mm256_add_epi32(zs[kz], ys[ky]);
+                        __m256 rowSum = _mm256_mul_ps(wx[0], _mm256_i32gather_ps(f, _mm256_add_epi32(row, xs[0]), 4));
+                        rowSum = madd(wx[1], _mm256_i32gather_ps(f, _mm256_add_epi32(row, xs[1]), 4), rowSum);
+                        rowSum = madd(wx[2], _mm256_i32gather_ps(f, _mm256_add_epi32(row, xs[2]), 4), rowSum);
+                        rowSum = madd(wx[3], _mm256_i32gather_ps(f, _mm256_add_epi32(row, xs[3]), 4), rowSum);
+                        acc = madd(_mm256_mul_ps(wz[kz], wy[ky]), rowSum, acc);
+                    }
+                }
+                _mm256_store_ps(result[c], _mm256_mul_ps(weights, acc));
+            }
+        }
+
+        // Store (SoA) or re-interleave (strided) into the output
+        for (int c = 0; c < 3; c++) {
+            float* o = out.p[c] + 8 * b * out.stride;
+            if (out.stride == 1) {
+                __m256 v = _mm256_load_ps(result[c]);
+                _mm256_storeu_ps(o, accumulate ? _mm256_add_ps(_mm256_loadu_ps(o), v) : v);
+            } else {
+                for (int lane = 0; lane < 8; lane++) {
+                    o[lane * out.stride] = accumulate ? o[lane * out.stride] + result[c][lane] : result[c][lane];
+                }
+            }
+        }
+    }
+
+    return blocks * 8;
+}
+
+#endif
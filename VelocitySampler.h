@@ -0,0 +1,130 @@
+#ifndef VELOCITY_SAMPLER_H
+#define VELOCITY_SAMPLER_H
+
+#include <cstddef>
+#include "Volume4D.h"
+#include "TemporalInterpolator.h"
+
+/**
+ * Spatial interpolation used by VelocitySampler
+ */
+enum class Interpolation {
+    Trilinear,
+    Tricubic // Catmull-Rom, 4x4x4 neighbourhood
+};
+
+/**
+ * Batched velocity field sampling at arbitrary positions
+ *
+ * Positions are voxel (index) coordinates and are clamped to the volume, so samples
+ * outside the grid take the edge value. Time is in frame units; with temporal
+ * interpolation enabled, fractional times blend the two (Linear) or four (CubicHermite)
+ * neighbouring frames, wrapping around the cardiac cycle when periodic time is on.
+ * PeriodicSpline blends two frames and their precomputed second-derivative frames, taken from
+ * one PeriodicSpline TemporalInterpolator per component (set_spline_interpolators); it always
+ * wraps around the cycle.
+ *
+ * On AVX2 builds 8 samples are interpolated at once with gather loads; otherwise a
+ * scalar kernel is used. The sampler keeps pointers to the component volumes, which
+ * must outlive it and must not be resized.
+ */
+class VelocitySampler {
+public:
+    VelocitySampler(const Volume4D& vx, const Volume4D& vy, const Volume4D& vz);
+
+    void set_interpolation(Interpolation mode) { interpolation = mode; }
+    void set_temporal_interpolation(bool enabled) { temporalInterpolation = enabled; }
+    /**
+     * Set the temporal interpolation mode
+     *
+     * @param mode Interpolation between frames; PeriodicSpline requires set_spline_interpolators() first
+     */
+    void set_temporal_mode(TemporalMode mode);
+
+    /**
+     * Attach the spline frames used by TemporalMode::PeriodicSpline
+     *
+     * @param x, y, z PeriodicSpline interpolators of the three components (must outlive the sampler)
+     */
+    void set_spline_interpolators(const TemporalInterpolator* x, const TemporalInterpolator* y, const TemporalInterpolator* z);
+    void set_periodic_time(bool periodic) { periodicTime = periodic; }
+    void set_simd(bool enabled) { useSimd = enabled && simd_available(); }
+
+    Interpolation get_interpolation() const { return interpolation; }
+    TemporalMode get_temporal_mode() const { return temporalMode; }
+    bool simd_enabled() const { return useSimd; }
+    std::size_t size_x() const { return dim_x; }
+    std::size_t size_y() const { return dim_y; }
+    std::size_t size_z() const { return dim_z; }
+    std::size_t size_t() const { return dim_t; }
+
+    /**
+     * Whether this build has the AVX2 gather kernels
+     */
+    static bool simd_available();
+
+    /**
+     * Sample the velocity at n positions
+     *
+     * @param xyz Interleaved positions (x0, y0, z0, x1, ...), 3 * n floats, in voxel coordinates
+     * @param n Number of positions
+     * @param out Interleaved velocities (vx0, vy0, vz0, ...), 3 * n floats
+     * @param time Time in frames; rounded to the nearest frame unless temporal interpolation is on
+     */
+    void sample(const float* xyz, std::size_t n, float* out, float time = 0.0f) const;
+
+    /**
+     * Sample the velocity at n positions in a single frame
+     *
+     * @param xyz Interleaved positions, 3 * n floats, in voxel coordinates
+     * @param n Number of positions
+     * @param out Interleaved velocities, 3 * n floats
+     * @param frame Frame index
+     */
+    void sample_frame(const float* xyz, std::size_t n, float* out, std::size_t frame) const;
+
+    /**
+     * Sample the velocity at n positions stored as separate x/y/z arrays (structure of arrays)
+     *
+     * @param x, y, z Position components, n floats each, in voxel coordinates
+     * @param n Number of positions
+     * @param outX, outY, outZ Velocity components, n floats each
+     * @param time Time in frames, as for sample()
+     */
+    void sample_soa(const float* x, const float* y, const float* z, std::size_t n,
+                    float* outX, float* outY, float* outZ, float time = 0.0f) const;
+
+private:
+    // Component pointers with a common element stride (3 for interleaved, 1 for SoA)
+    struct PointStream {
+        const float* p[3];
+        std::size_t stride;
+    };
+    struct VectorStream {
+        float* p[3];
+        std::size_t stride;
+    };
+
+    void sample_streams(const PointStream& in, std::size_t n, const VectorStream& out, float time) const;
+    // out (+)= weight * fields at each position; fields holds one frame buffer per component
+    void sample_weighted(const PointStream& in, std::size_t n, const VectorStream& out, const float* const fields[3], float weight, bool accumulate) const;
+    void sample_frame_weighted(const PointStream& in, std::size_t n, const VectorStream& out, std::size_t frame, float weight, bool accumulate) const;
+    void sample_scalar(const PointStream& in, std::size_t n, const VectorStream& out, const float* const fields[3], float weight, bool accumulate) const;
+#if defined(__AVX2__)
+    // Handles the largest multiple of 8 positions; returns how many were done
+    std::size_t sample_avx2(const PointStream& in, std::size_t n, const VectorStream& out, const float* const fields[3], float weight, bool accumulate) const;
+#endif
+
+    std::size_t wrap_frame(long frame) const;
+
+    const Volume4D* components[3];
+    const TemporalInterpolator* splines[3]; // PeriodicSpline frames, null until attached
+    std::size_t dim_x, dim_y, dim_z, dim_t;
+    Interpolation interpolation;
+    bool temporalInterpolation;
+    TemporalMode temporalMode;
+    bool periodicTime;
+    bool useSimd;
+};
+
+#endif // VELOCITY_SAMPLER_H
@@ -3,65 +3,78 @@
 #include <algorithm>
 
 // Default constructor
-Volume4D::Volume4D() : dim_x(0), dim_y(0), dim_z(0), dim_t(0) {}
+Volume4D::Volume4D() : dim_x(0), dim_y(0), dim_z(0), dim_t(0), category(MemoryCategory::Other) {}
 
 // Parameterized constructor
 Volume4D::Volume4D(std::size_t x, std::size_t y, std::size_t z, std::size_t t) 
-    : dim_x(x), dim_y(y), dim_z(z), dim_t(t) {
+    : dim_x(0), dim_y(0), dim_z(0), dim_t(0), category(MemoryCategory::Other) {
     resize(x, y, z, t);
 }
 
 // Destructor
-Volume4D::~Volume4D() = default;
+Volume4D::~Volume4D() {
+    MemoryManager::instance().release(category, memory_bytes());
+}
 
-// Copy constructor
+// Copy constructor (charged to the same category as the source). The data is copied before it is
+// charged, so a failed allocation leaves nothing reserved and a rejected charge frees the copy.
 Volume4D::Volume4D(const Volume4D& other) 
-    : data(other.data), dim_x(other.dim_x), dim_y(other.dim_y), dim_z(other.dim_z), dim_t(other.dim_t) {}
+    : data(other.data), dim_x(other.dim_x), dim_y(other.dim_y), dim_z(other.dim_z), dim_t(other.dim_t),
+      category(other.category) {
+    MemoryManager::instance().reserve(category, memory_bytes());
+}
 
 // Copy assignment operator
 Volume4D& Volume4D::operator=(const Volume4D& other) {
     if (this != &other) {
-        data = other.data;
-        dim_x = other.dim_x;
-        dim_y = other.dim_y;
-        dim_z = other.dim_z;
-        dim_t = other.dim_t;
+        Volume4D copy(other);
+        *this = std::move(copy);
     }
     return *this;
 }
 
 // Move constructor
 Volume4D::Volume4D(Volume4D&& other) noexcept 
-    : data(std::move(other.data)), dim_x(other.dim_x), dim_y(other.dim_y), dim_z(other.dim_z), dim_t(other.dim_t) {
+    : data(std::move(other.data)), dim_x(other.dim_x), dim_y(other.dim_y), dim_z(other.dim_z), dim_t(other.dim_t),
+      category(other.category) {
+    other.data.clear();
     other.dim_x = other.dim_y = other.dim_z = other.dim_t = 0;
 }
 
 // Move assignment operator
 Volume4D& Volume4D::operator=(Volume4D&& other) noexcept {
     if (this != &other) {
+        MemoryManager::instance().release(category, memory_bytes());
         data = std::move(other.data);
+        other.data.clear();
         dim_x = other.dim_x;
         dim_y = other.dim_y;
         dim_z = other.dim_z;
         dim_t = other.dim_t;
+        category = other.category;
         other.dim_x = other.dim_y = other.dim_z = other.dim_t = 0;
     }
     return *this;
 }
 
+void Volume4D::set_category(MemoryCategory newCategory) {
+    MemoryManager::instance().transfer(category, newCategory, memory_bytes());
+    category = newCategory;
+}
+
 // Access methods
 float& Volume4D::at(std::size_t x, std::size_t y, std::size_t z, std::size_t t) {
     if (x >= dim_x || y >= dim_y || z >= dim_z || t >= dim_t) {
         throw std::out_of_range("Volume4D::at: Index out of range");
     }
-    return data[t][z][y][x];
+    return data[((t * dim_z + z) * dim_y + y) * dim_x + x];
 }
 
 const float& Volume4D::at(std::size_t x, std::size_t y, std::size_t z, std::size_t t) const {
     if (x >= dim_x || y >= dim_y || z >= dim_z || t >= dim_t) {
         throw std::out_of_range("Volume4D::at: Index out of range");
     }
-    return data[t][z][y][x];
+    return data[((t * dim_z + z) * dim_y + y) * dim_x + x];
 }
 
 // Size and capacity
@@ -69,44 +82,59 @@ std::size_t Volume4D::total_elements() const {
     return dim_x * dim_y * dim_z * dim_t;
 }
 
+float* Volume4D::frame_data(std::size_t t) {
+    if (t >= dim_t) {
+        throw std::out_of_range("Volume4D::frame_data: Index out of range");
+    }
+    return data.data() + t * frame_size();
+}
+
+const float* Volume4D::frame_data(std::size_t t) const {
+    if (t >= dim_t) {
+        throw std::out_of_range("Volume4D::frame_data: Index out of range");
+    }
+    return data.data() + t * frame_size();
+}
+
 bool Volume4D::empty() const {
     return data.empty() || dim_x == 0 || dim_y == 0 || dim_z == 0 || dim_t == 0;
 }
 
 
 void Volume4D::clear() {
-    data.clear();
+    MemoryManager::instance().release(category, memory_bytes());
+    data = std::vector<float>();
     dim_x = dim_y = dim_z = dim_t = 0;
 }
 
 void Volume4D::resize(std::size_t x, std::size_t y, std::size_t z, std::size_t t) {
+    std::size_t count = x * y * z * t;
+    if (count == data.size()) {
+        std::fill(data.begin(), data.end(), 0.0f);
+    } else {
+        // Contents are discarded anyway, so free the old buffer first; charge the new one
+        // before allocating it, so an oversized volume fails cleanly
+        MemoryManager& memory = MemoryManager::instance();
+        memory.release(category, memory_bytes());
+        data = std::vector<float>();
+        dim_x = dim_y = dim_z = dim_t = 0;
+        memory.reserve(category, count * sizeof(float));
+        try {
+            data.assign(count, 0.0f);
+        } catch (...) {
+            memory.release(category, count * sizeof(float));
+            throw;
+        }
+    }
     dim_x = x;
     dim_y = y;
     dim_z = z;
     dim_t = t;
-    
-    // Resize the 4D vector structure
-    data.resize(t);
-    for (auto& time_slice : data) {
-        time_slice.resize(z);
-        for (auto& slice : time_slice) {
-            slice.resize(y);
-            for (auto& row : slice) {
-                row.resize(x, 0.0f);
-            }
-        }
-    }
 }
 
 // Fill methods
 void Volume4D::fill(float value) {
-    for (auto& time_slice : data) {
-        for (auto& slice : time_slice) {
-            for (auto& row : slice) {
-                std::fill(row.begin(), row.end(), value);
-            }
-        }
-    }
+    std::fill(data.begin(), data.end(), value);
 }
 
 void Volume4D::fill_random(float min_val, float max_val) {
@@ -114,14 +142,8 @@ void Volume4D::fill_random(float min_val, float max_val) {
     std::mt19937 gen(rd());
     std::uniform_real_distribution<float> dis(min_val, max_val);
     
-    for (auto& time_slice : data) {
-        for (auto& slice : time_slice) {
-            for (auto& row : slice) {
-                for (auto& val : row) {
-                    val = dis(gen);
-                }
-            }
-        }
+    for (auto& val : data) {
+        val = dis(gen);
     }
 }
 
@@ -146,7 +168,7 @@ void Volume4D::print_slice(std::size_t time, std::size_t slice) const {
     for (std::size_t y = 0; y < dim_y; ++y) {
         for (std::size_t x = 0; x < dim_x; ++x) {
             std::cout << std::setw(6) << std::fixed << std::setprecision(0) 
-                      << data[time][slice][y][x] << " ";
+                      << at(x, y, slice, time) << " ";
         }
         std::cout << std::endl;
     }
@@ -8,11 +8,15 @@
 #include <stdexcept>
 #include <cstring>
 #include <cstddef>
+#include "MemoryManager.h"
 
 class Volume4D {
 private:
-    std::vector<std::vector<std::vector<std::vector<float>>>> data;
+    // Contiguous storage, x fastest then y, z, t (one frame is a single block).
+    // Capacity always equals size, so memory_bytes() is what MemoryManager is charged.
+    std::vector<float> data;
     std::size_t dim_x, dim_y, dim_z, dim_t;
+    MemoryCategory category;
 
 public:
     // Constructors
@@ -40,9 +44,19 @@ public:
     std::size_t size_z() const { return dim_z; }
     std::size_t size_t() const { return dim_t; }
     std::size_t total_elements() const;
+    std::size_t frame_size() const { return dim_x * dim_y * dim_z; }
     bool empty() const;
+    std::size_t memory_bytes() const { return data.size() * sizeof(float); }
+
+    // Category charged in MemoryManager (default Other); changing it moves the charged bytes
+    MemoryCategory get_category() const { return category; }
+    void set_category(MemoryCategory newCategory);
+    
+    // Raw access to one time frame (frame_size() floats, x fastest)
+    float* frame_data(std::size_t t);
+    const float* frame_data(std::size_t t) const;
     
-    // Resize and clear
+    // Resize and clear; resize throws MemoryBudgetError if the new size does not fit the budget
     void resize(std::size_t x, std::size_t y, std::size_t z, std::size_t t);
     void clear();
     
@@ -0,0 +1,170 @@
+#include "VolumeCache.h"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char kMagic[4] = {'V', '4', 'D', 'C'};
+const std::uint32_t kVersion = 1;
+const std::uint32_t kFloat32 = 1;
+const std::size_t kHeaderBytes = 64;
+
+} // namespace
+
+VolumeCacheFile::VolumeCacheFile() : dim_x(0), dim_y(0), dim_z(0), dim_t(0), category(MemoryCategory::Other) {}
+
+bool VolumeCacheFile::open(const std::string& path) {
+    close();
+    file.open(path, std::ios::in | std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Cannot open volume cache " << path << std::endl;
+        return false;
+    }
+
+    char header[kHeaderBytes];
+    if (!file.read(header, kHeaderBytes) || std::memcmp(header, kMagic, 4) != 0) {
+        std::cerr << "Error: " << path << " is not a volume cache file" << std::endl;
+        close();
+        return false;
+    }
+    std::uint32_t version, type, storedCategory;
+    std::uint64_t dims[4];
+    std::memcpy(&version, header + 4, 4);
+    std::memcpy(&type, header + 8, 4);
+    std::memcpy(&storedCategory, header + 12, 4);
+    std::memcpy(dims, header + 16, sizeof(dims));
+    if (version != kVersion || type != kFloat32) {
+        std::cerr << "Error: Unsupported volume cache format in " << path << std::endl;
+        close();
+        return false;
+    }
+    dim_x = dims[0];
+    dim_y = dims[1];
+    dim_z = dims[2];
+    dim_t = dims[3];
+    // Stored as category + 1; files written before the category was recorded hold 0
+    category = storedCategory >= 1 && storedCategory <= static_cast<std::uint32_t>(MemoryCategory::Count)
+                   ? static_cast<MemoryCategory>(storedCategory - 1) : MemoryCategory::Other;
+    return true;
+}
+
+bool VolumeCacheFile::create(const std::string& path, std::size_t x, std::size_t y, std::size_t z, std::size_t t,
+                             MemoryCategory volumeCategory) {
+    close();
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Error: Cannot create volume cache " << path << std::endl;
+        return false;
+    }
+
+    char header[kHeaderBytes] = {};
+    std::uint64_t dims[4] = {x, y, z, t};
+    std::uint32_t storedCategory = static_cast<std::uint32_t>(volumeCategory) + 1;
+    std::memcpy(header, kMagic, 4);
+    std::memcpy(header + 4, &kVersion, 4);
+    std::memcpy(header + 8, &kFloat32, 4);
+    std::memcpy(header + 12, &storedCategory, 4);
+    std::memcpy(header + 16, dims, sizeof(dims));
+    file.write(header, kHeaderBytes);
+
+    // Extend to the full size so slabs can be written in any order
+    std::size_t total = x * y * z * t * sizeof(float);
+    if (total > 0) {
+        file.seekp(static_cast<std::streamoff>(kHeaderBytes + total - 1));
+        file.put('\0');
+    }
+    if (!file) {
+        std::cerr << "Error: Cannot write volume cache " << path << std::endl;
+        close();
+        return false;
+    }
+    dim_x = x;
+    dim_y = y;
+    dim_z = z;
+    dim_t = t;
+    category = volumeCategory;
+    return true;
+}
+
+void VolumeCacheFile::close() {
+    if (file.is_open()) {
+        file.close();
+    }
+    file.clear();
+    dim_x = dim_y = dim_z = dim_t = 0;
+    category = MemoryCategory::Other;
+}
+
+std::streamoff VolumeCacheFile::offset(std::size_t z, std::size_t t) const {
+    return static_cast<std::streamoff>(kHeaderBytes + ((t * dim_z + z) * dim_y * dim_x) * sizeof(float));
+}
+
+bool VolumeCacheFile::read_slab(std::size_t z0, std::size_t count, Volume4D& slab) {
+    if (z0 + count > dim_z) {
+        std::cerr << "Error: Volume cache slab out of range" << std::endl;
+        return false;
+    }
+    if (slab.size_x() != dim_x || slab.size_y() != dim_y || slab.size_z() != count || slab.size_t() != dim_t) {
+        slab.resize(dim_x, dim_y, count, dim_t);
+    }
+
+    std::size_t bytes = count * dim_y * dim_x * sizeof(float);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::size_t t = 0; t < dim_t; t++) {
+        file.seekg(offset(z0, t));
+        if (!file.read(reinterpret_cast<char*>(slab.frame_data(t)), static_cast<std::streamsize>(bytes))) {
+            std::cerr << "Error: Failed reading volume cache" << std::endl;
+            file.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VolumeCacheFile::write_slab(std::size_t z0, const Volume4D& slab, std::size_t localZ, std::size_t count) {
+    if (z0 + count > dim_z || localZ + count > slab.size_z() ||
+        slab.size_x() != dim_x || slab.size_y() != dim_y || slab.size_t() != dim_t) {
+        std::cerr << "Error: Volume cache slab does not match the file" << std::endl;
+        return false;
+    }
+
+    std::size_t sliceSize = dim_y * dim_x;
+    std::size_t bytes = count * sliceSize * sizeof(float);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::size_t t = 0; t < dim_t; t++) {
+        file.seekp(offset(z0, t));
+        const float* source = slab.frame_data(t) + localZ * sliceSize;
+        if (!file.write(reinterpret_cast<const char*>(source), static_cast<std::streamsize>(bytes))) {
+            std::cerr << "Error: Failed writing volume cache" << std::endl;
+            file.clear();
+            return false;
+        }
+    }
+    file.flush();
+    return static_cast<bool>(file);
+}
+
+bool writeVolumeCache(const std::string& path, const Volume4D& volume) {
+    VolumeCacheFile cache;
+    return cache.create(path, volume.size_x(), volume.size_y(), volume.size_z(), volume.size_t(), volume.get_category()) &&
+           cache.write_slab(0, volume, 0, volume.size_z());
+}
+
+Volume4D readVolumeCache(const std::string& path) {
+    VolumeCacheFile cache;
+    Volume4D volume;
+    if (!cache.open(path)) {
+        return volume;
+    }
+    volume.set_category(cache.get_category());
+    try {
+        if (!cache.read_slab(0, cache.size_z(), volume)) {
+            volume.clear();
+        }
+    } catch (const MemoryBudgetError& e) {
+        std::cerr << "Error: Cannot load " << path << ": " << e.what() << std::endl;
+        volume.clear();
+    }
+    return volume;
+}
@@ -0,0 +1,96 @@
+#ifndef VOLUME_CACHE_H
+#define VOLUME_CACHE_H
+
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include "Volume4D.h"
+
+/**
+ * Binary volume cache file (.v4d): a 64-byte header followed by float32 voxels in Volume4D
+ * order (x fastest, then y, z, t), so a z-range of one frame is one contiguous block
+ *
+ * The header also records the MemoryCategory of the written volume, so a volume read back is
+ * charged to the same category as the one that was saved.
+ *
+ * Slab reads and writes are serialized per file and may be called from several threads.
+ * Values are stored in host byte order (little-endian on all supported platforms).
+ */
+class VolumeCacheFile {
+public:
+    VolumeCacheFile();
+
+    VolumeCacheFile(const VolumeCacheFile&) = delete;
+    VolumeCacheFile& operator=(const VolumeCacheFile&) = delete;
+
+    /**
+     * Open an existing cache file for reading
+     *
+     * @return true if the header is valid
+     */
+    bool open(const std::string& path);
+
+    /**
+     * Create (or truncate) a cache file of the given size for writing; voxels start out as zero
+     *
+     * @param category Memory category recorded for the volume
+     * @return true on success
+     */
+    bool create(const std::string& path, std::size_t x, std::size_t y, std::size_t z, std::size_t t,
+                MemoryCategory category = MemoryCategory::Other);
+
+    void close();
+    bool is_open() const { return file.is_open(); }
+
+    std::size_t size_x() const { return dim_x; }
+    std::size_t size_y() const { return dim_y; }
+    std::size_t size_z() const { return dim_z; }
+    std::size_t size_t() const { return dim_t; }
+    MemoryCategory get_category() const { return category; }
+
+    /**
+     * Read slices [z0, z0 + count) of every frame
+     *
+     * @param z0 First slice
+     * @param count Number of slices
+     * @param slab Destination; resized to (size_x, size_y, count, size_t) if needed
+     * @return true on success
+     */
+    bool read_slab(std::size_t z0, std::size_t count, Volume4D& slab);
+
+    /**
+     * Write slices of a slab to [z0, z0 + count) of every frame
+     *
+     * @param z0 First slice in the file
+     * @param slab Source slab with the file's x/y/t size
+     * @param localZ First slice to take from the slab
+     * @param count Number of slices
+     * @return true on success
+     */
+    bool write_slab(std::size_t z0, const Volume4D& slab, std::size_t localZ, std::size_t count);
+
+private:
+    std::streamoff offset(std::size_t z, std::size_t t) const;
+
+    std::fstream file;
+    std::mutex mutex;
+    std::size_t dim_x, dim_y, dim_z, dim_t;
+    MemoryCategory category;
+};
+
+/**
+ * Write a whole volume to a cache file
+ *
+ * @return true on success
+ */
+bool writeVolumeCache(const std::string& path, const Volume4D& volume);
+
+/**
+ * Read a whole cache file
+ *
+ * @return Volume4D with the cached data and the category it was written with (empty if failed)
+ */
+Volume4D readVolumeCache(const std::string& path);
+
+#endif // VOLUME_CACHE_H
@@ -0,0 +1,358 @@
+#include "VolumeGeometry.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include "parallel_utils.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const double kIdentity[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+
+void cross(const double a[3], const double b[3], double out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+double norm(const double v[3]) {
+    return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+// Row-major 3x4 affine product a * b
+void composeAffine(const double a[12], const double b[12], double out[12]) {
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++) {
+            double value = a[r * 4] * b[c] + a[r * 4 + 1] * b[4 + c] + a[r * 4 + 2] * b[8 + c];
+            out[r * 4 + c] = c == 3 ? value + a[r * 4 + 3] : value;
+        }
+    }
+}
+
+} // namespace
+
+VolumeGeometry::VolumeGeometry() {
+    for (int i = 0; i < 3; i++) {
+        originMm[i] = 0.0;
+        spacingMm[i] = 1.0;
+    }
+    std::copy(kIdentity, kIdentity + 9, directionCosines);
+    update();
+}
+
+VolumeGeometry::VolumeGeometry(const double origin[3], const double spacing[3], const double direction[9]) {
+    for (int i = 0; i < 3; i++) {
+        originMm[i] = origin[i];
+        spacingMm[i] = spacing[i] > 0.0 ? spacing[i] : 1.0;
+    }
+    std::copy(direction, direction + 9, directionCosines);
+    update();
+}
+
+VolumeGeometry VolumeGeometry::from_slices(const double firstPosition[3], const double lastPosition[3],
+                                           const double orientation[6], const double pixelSpacing[2],
+                                           std::size_t sliceCount, double fallbackSliceSpacing) {
+    double row[3] = {orientation[0], orientation[1], orientation[2]};
+    double column[3] = {orientation[3], orientation[4], orientation[5]};
+    double normal[3];
+    cross(row, column, normal);
+
+    // PixelSpacing is (row spacing, column spacing): y first, then x
+    double spacing[3] = {pixelSpacing[1], pixelSpacing[0], fallbackSliceSpacing > 0.0 ? fallbackSliceSpacing : 1.0};
+    double sliceAxis[3] = {normal[0], normal[1], normal[2]};
+    if (sliceCount > 1) {
+        double step[3];
+        for (int i = 0; i < 3; i++) {
+            step[i] = (lastPosition[i] - firstPosition[i]) / static_cast<double>(sliceCount - 1);
+        }
+        double length = norm(step);
+        if (length > 1e-6) {
+            spacing[2] = length;
+            for (int i = 0; i < 3; i++) {
+                sliceAxis[i] = step[i] / length;
+            }
+        }
+    }
+
+    double direction[9];
+    for (int r = 0; r < 3; r++) {
+        direction[r * 3] = row[r];
+        direction[r * 3 + 1] = column[r];
+        direction[r * 3 + 2] = sliceAxis[r];
+    }
+    return VolumeGeometry(firstPosition, spacing, direction);
+}
+
+void VolumeGeometry::update() {
+    // Voxel to world: direction * diag(spacing), then origin
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            toWorld[r * 4 + c] = directionCosines[r * 3 + c] * spacingMm[c];
+        }
+        toWorld[r * 4 + 3] = originMm[r];
+    }
+
+    const double* m = toWorld;
+    double cofactor[9] = {
+        m[5] * m[10] - m[6] * m[9], m[2] * m[9] - m[1] * m[10], m[1] * m[6] - m[2] * m[5],
+        m[6] * m[8] - m[4] * m[10], m[0] * m[10] - m[2] * m[8], m[2] * m[4] - m[0] * m[6],
+        m[4] * m[9] - m[5] * m[8], m[1] * m[8] - m[0] * m[9], m[0] * m[5] - m[1] * m[4]
+    };
+    double determinant = m[0] * cofactor[0] + m[1] * cofactor[3] + m[2] * cofactor[6];
+    if (std::abs(determinant) < 1e-12) {
+        std::cerr << "Warning: Degenerate voxel axes in volume geometry, using the patient axes" << std::endl;
+        std::copy(kIdentity, kIdentity + 9, directionCosines);
+        update();
+        return;
+    }
+
+    // World to voxel: inverse linear part, translation -inverse * origin
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            toVoxel[r * 4 + c] = cofactor[r * 3 + c] / determinant;
+        }
+        toVoxel[r * 4 + 3] = -(toVoxel[r * 4] * originMm[0] + toVoxel[r * 4 + 1] * originMm[1] + toVoxel[r * 4 + 2] * originMm[2]);
+    }
+
+    // Axis-aligned if every voxel axis is a distinct signed patient axis
+    aligned = true;
+    bool used[3] = {false, false, false};
+    for (int c = 0; c < 3 && aligned; c++) {
+        int axis = -1;
+        for (int r = 0; r < 3; r++) {
+            double value = directionCosines[r * 3 + c];
+            if (std::abs(value) > 1.0 - 1e-6) {
+                axis = r;
+            } else if (std::abs(value) > 1e-6) {
+                aligned = false;
+            }
+        }
+        if (axis < 0 || used[axis]) {
+            aligned = false;
+            break;
+        }
+        used[axis] = true;
+        worldAxis[c] = axis;
+        axisScale[c] = directionCosines[axis * 3 + c] > 0.0 ? spacingMm[c] : -spacingMm[c];
+    }
+}
+
+void VolumeGeometry::voxel_to_world_matrix(double matrix[16]) const {
+    std::copy(toWorld, toWorld + 12, matrix);
+    matrix[12] = matrix[13] = matrix[14] = 0.0;
+    matrix[15] = 1.0;
+}
+
+void VolumeGeometry::voxel_to_world(const double ijk[3], double xyz[3]) const {
+    if (aligned) {
+        for (int c = 0; c < 3; c++) {
+            xyz[worldAxis[c]] = originMm[worldAxis[c]] + axisScale[c] * ijk[c];
+        }
+        return;
+    }
+    for (int r = 0; r < 3; r++) {
+        xyz[r] = toWorld[r * 4] * ijk[0] + toWorld[r * 4 + 1] * ijk[1] + toWorld[r * 4 + 2] * ijk[2] + toWorld[r * 4 + 3];
+    }
+}
+
+void VolumeGeometry::world_to_voxel(const double xyz[3], double ijk[3]) const {
+    if (aligned) {
+        for (int c = 0; c < 3; c++) {
+            ijk[c] = (xyz[worldAxis[c]] - originMm[worldAxis[c]]) / axisScale[c];
+        }
+        return;
+    }
+    for (int r = 0; r < 3; r++) {
+        ijk[r] = toVoxel[r * 4] * xyz[0] + toVoxel[r * 4 + 1] * xyz[1] + toVoxel[r * 4 + 2] * xyz[2] + toVoxel[r * 4 + 3];
+    }
+}
+
+void VolumeGeometry::voxel_to_world(float* points, std::size_t count) const {
+    if (aligned) {
+        float offset[3], scale[3];
+        for (int c = 0; c < 3; c++) {
+            offset[c] = static_cast<float>(originMm[worldAxis[c]]);
+            scale[c] = static_cast<float>(axisScale[c]);
+        }
+        for (std::size_t p = 0; p < count; p++) {
+            float* point = points + 3 * p;
+            float in[3] = {point[0], point[1], point[2]};
+            for (int c = 0; c < 3; c++) {
+                point[worldAxis[c]] = offset[c] + scale[c] * in[c];
+            }
+        }
+        return;
+    }
+    float m[12];
+    std::copy(toWorld, toWorld + 12, m);
+    for (std::size_t p = 0; p < count; p++) {
+        float* point = points + 3 * p;
+        float in[3] = {point[0], point[1], point[2]};
+        for (int r = 0; r < 3; r++) {
+            point[r] = m[r * 4] * in[0] + m[r * 4 + 1] * in[1] + m[r * 4 + 2] * in[2] + m[r * 4 + 3];
+        }
+    }
+}
+
+void VolumeGeometry::world_to_voxel(float* points, std::size_t count) const {
+    if (aligned) {
+        float offset[3], scale[3];
+        for (int c = 0; c < 3; c++) {
+            offset[c] = static_cast<float>(originMm[worldAxis[c]]);
+            scale[c] = static_cast<float>(1.0 / axisScale[c]);
+        }
+        for (std::size_t p = 0; p < count; p++) {
+            float* point = points + 3 * p;
+            float in[3] = {point[0], point[1], point[2]};
+            for (int c = 0; c < 3; c++) {
+                point[c] = (in[worldAxis[c]] - offset[c]) * scale[c];
+            }
+        }
+        return;
+    }
+    float m[12];
+    std::copy(toVoxel, toVoxel + 12, m);
+    for (std::size_t p = 0; p < count; p++) {
+        float* point = points + 3 * p;
+        float in[3] = {point[0], point[1], point[2]};
+        for (int r = 0; r < 3; r++) {
+            point[r] = m[r * 4] * in[0] + m[r * 4 + 1] * in[1] + m[r * 4 + 2] * in[2] + m[r * 4 + 3];
+        }
+    }
+}
+
+void VolumeGeometry::print_info() const {
+    std::cout << "Origin: (" << originMm[0] << ", " << originMm[1] << ", " << originMm[2] << ") mm, spacing "
+              << spacingMm[0] << " x " << spacingMm[1] << " x " << spacingMm[2] << " mm"
+              << (aligned ? ", axis-aligned" : ", oblique") << std::endl;
+}
+
+Volume4D resampleVolume(const Volume4D& source, const VolumeGeometry& sourceGeometry,
+                        const VolumeGeometry& targetGeometry, std::size_t nx, std::size_t ny, std::size_t nz,
+                        ResampleMode mode, float outside) {
+    Volume4D target;
+    target.set_category(source.get_category());
+    target.resize(nx, ny, nz, source.size_t());
+    if (source.empty() || target.empty()) {
+        return target;
+    }
+
+    // Target voxel -> patient -> source voxel, formed once
+    double targetToWorld[16], worldToSource[12], map[12];
+    targetGeometry.voxel_to_world_matrix(targetToWorld);
+    {
+        // Rows of the source's world-to-voxel affine, recovered by mapping the patient origin and axes
+        const double zero[3] = {0.0, 0.0, 0.0};
+        double base[3];
+        sourceGeometry.world_to_voxel(zero, base);
+        for (int c = 0; c < 3; c++) {
+            double unit[3] = {0.0, 0.0, 0.0};
+            double mapped[3];
+            unit[c] = 1.0;
+            sourceGeometry.world_to_voxel(unit, mapped);
+            for (int r = 0; r < 3; r++) {
+                worldToSource[r * 4 + c] = mapped[r] - base[r];
+            }
+        }
+        for (int r = 0; r < 3; r++) {
+            worldToSource[r * 4 + 3] = base[r];
+        }
+    }
+    composeAffine(worldToSource, targetToWorld, map);
+
+    const std::size_t sx = source.size_x(), sy = source.size_y(), sz = source.size_z();
+    const std::size_t sourceSlice = sx * sy;
+    const float step[3] = {static_cast<float>(map[0]), static_cast<float>(map[4]), static_cast<float>(map[8])};
+
+#if defined(__AVX2__)
+    // Gathers index with 32-bit offsets
+    const bool vectorGather = mode == ResampleMode::Nearest &&
+                              source.frame_size() <= static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max());
+#endif
+
+    parallelFor(0, source.size_t() * nz, [&](std::size_t task) {
+        std::size_t t = task / nz;
+        std::size_t k = task % nz;
+        const float* in = source.frame_data(t);
+        for (std::size_t j = 0; j < ny; j++) {
+            float* out = target.frame_data(t) + (k * ny + j) * nx;
+            float base[3];
+            for (int r = 0; r < 3; r++) {
+                base[r] = static_cast<float>(map[r * 4 + 1] * j + map[r * 4 + 2] * k + map[r * 4 + 3]);
+            }
+
+            std::size_t i = 0;
+#if defined(__AVX2__)
+            if (vectorGather) {
+                const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+                const __m256i minusOne = _mm256_set1_epi32(-1);
+                const __m256i limitX = _mm256_set1_epi32(static_cast<int>(sx));
+                const __m256i limitY = _mm256_set1_epi32(static_cast<int>(sy));
+                const __m256i limitZ = _mm256_set1_epi32(static_cast<int>(sz));
+                const __m256i strideY = _mm256_set1_epi32(static_cast<int>(sx));
+                const __m256i strideZ = _mm256_set1_epi32(static_cast<int>(sourceSlice));
+                const __m256 outsideValue = _mm256_set1_ps(outside);
+                for (; i + 8 <= nx; i += 8) {
+                    __m256 position = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes);
+                    __m256i ix = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_set1_ps(base[0]), _mm256_mul_ps(position, _mm256_set1_ps(step[0]))));
+                    __m256i iy = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_set1_ps(base[1]), _mm256_mul_ps(position, _mm256_set1_ps(step[1]))));
+                    __m256i iz = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_set1_ps(base[2]), _mm256_mul_ps(position, _mm256_set1_ps(step[2]))));
+                    // Out-of-range (and overflowed) indices fail one of the comparisons
+                    __m256i inside = _mm256_and_si256(_mm256_cmpgt_epi32(ix, minusOne), _mm256_cmpgt_epi32(limitX, ix));
+                    inside = _mm256_and_si256(inside, _mm256_and_si256(_mm256_cmpgt_epi32(iy, minusOne), _mm256_cmpgt_epi32(limitY, iy)));
+                    inside = _mm256_and_si256(inside, _mm256_and_si256(_mm256_cmpgt_epi32(iz, minusOne), _mm256_cmpgt_epi32(limitZ, iz)));
+                    __m256i index = _mm256_add_epi32(ix, _mm256_add_epi32(_mm256_mullo_epi32(iy, strideY), _mm256_mullo_epi32(iz, strideZ)));
+                    __m256 values = _mm256_mask_i32gather_ps(outsideValue, in, index, _mm256_castsi256_ps(inside), 4);
+                    _mm256_storeu_ps(out + i, values);
+                }
+            }
+#endif
+            for (; i < nx; i++) {
+                float p[3];
+                for (int r = 0; r < 3; r++) {
+                    p[r] = base[r] + static_cast<float>(i) * step[r];
+                }
+
+                if (mode == ResampleMode::Nearest) {
+                    float rx = std::nearbyint(p[0]), ry = std::nearbyint(p[1]), rz = std::nearbyint(p[2]);
+                    // Written as an inside test so NaN positions (degenerate geometry) land outside too
+                    if (!(rx >= 0.0f && ry >= 0.0f && rz >= 0.0f && rx < sx && ry < sy && rz < sz)) {
+                        out[i] = outside;
+                        continue;
+                    }
+                    out[i] = in[static_cast<std::size_t>(rz) * sourceSlice + static_cast<std::size_t>(ry) * sx + static_cast<std::size_t>(rx)];
+                    continue;
+                }
+
+                // Trilinear: inside within half a voxel of the grid, edge values beyond the last sample
+                if (!(p[0] >= -0.5f && p[1] >= -0.5f && p[2] >= -0.5f && p[0] <= sx - 0.5f && p[1] <= sy - 0.5f && p[2] <= sz - 0.5f)) {
+                    out[i] = outside;
+                    continue;
+                }
+                std::size_t i0[3], i1[3];
+                float f[3];
+                const std::size_t dims[3] = {sx, sy, sz};
+                for (int a = 0; a < 3; a++) {
+                    float c = std::min(std::max(p[a], 0.0f), static_cast<float>(dims[a] - 1));
+                    i0[a] = static_cast<std::size_t>(c);
+                    i1[a] = std::min(i0[a] + 1, dims[a] - 1);
+                    f[a] = c - static_cast<float>(i0[a]);
+                }
+                auto at = [&](std::size_t x, std::size_t y, std::size_t z) { return in[z * sourceSlice + y * sx + x]; };
+                float c00 = at(i0[0], i0[1], i0[2]) + f[0] * (at(i1[0], i0[1], i0[2]) - at(i0[0], i0[1], i0[2]));
+                float c10 = at(i0[0], i1[1], i0[2]) + f[0] * (at(i1[0], i1[1], i0[2]) - at(i0[0], i1[1], i0[2]));
+                float c01 = at(i0[0], i0[1], i1[2]) + f[0] * (at(i1[0], i0[1], i1[2]) - at(i0[0], i0[1], i1[2]));
+                float c11 = at(i0[0], i1[1], i1[2]) + f[0] * (at(i1[0], i1[1], i1[2]) - at(i0[0], i1[1], i1[2]));
+                float c0 = c00 + f[1] * (c10 - c00);
+                float c1 = c01 + f[1] * (c11 - c01);
+                out[i] = c0 + f[2] * (c1 - c0);
+            }
+        }
+    });
+    return target;
+}
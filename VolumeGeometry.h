@@ -0,0 +1,116 @@
+#ifndef VOLUME_GEOMETRY_H
+#define VOLUME_GEOMETRY_H
+
+#include <cstddef>
+#include "Volume4D.h"
+
+/**
+ * Placement of a voxel grid in patient space (DICOM LPS, millimetres)
+ *
+ * world = origin + direction * diag(spacing) * (i, j, k), where column c of direction is the
+ * unit patient-space vector of voxel axis c. The voxel-to-world affine and its inverse are
+ * precomputed when the geometry is set. Grids whose axes are a signed permutation of the
+ * patient axes (the usual axial/sagittal/coronal acquisitions) are detected and transformed
+ * with one multiply-add per axis instead of a full matrix product.
+ *
+ * A default geometry is the identity: unit spacing, origin at 0, voxel axes = patient axes.
+ */
+class VolumeGeometry {
+public:
+    VolumeGeometry();
+    VolumeGeometry(const double origin[3], const double spacing[3], const double direction[9]);
+
+    /**
+     * Geometry of a stack of parallel slices from DICOM plane attributes
+     *
+     * The slice axis runs from the first to the last slice, so stacks stored in either order
+     * (or with a gantry tilt) are placed correctly. With a single slice (or coincident
+     * positions) it is the plane normal and fallbackSliceSpacing is used.
+     *
+     * @param firstPosition ImagePositionPatient of slice 0
+     * @param lastPosition ImagePositionPatient of slice sliceCount - 1
+     * @param orientation ImageOrientationPatient (row direction, then column direction)
+     * @param pixelSpacing PixelSpacing (between rows, then between columns)
+     * @param sliceCount Number of slices
+     * @param fallbackSliceSpacing SpacingBetweenSlices or SliceThickness (1 if not positive)
+     */
+    static VolumeGeometry from_slices(const double firstPosition[3], const double lastPosition[3],
+                                      const double orientation[6], const double pixelSpacing[2],
+                                      std::size_t sliceCount, double fallbackSliceSpacing = 0.0);
+
+    const double* origin() const { return originMm; }
+    const double* spacing() const { return spacingMm; }
+    const double* direction() const { return directionCosines; } // Row-major 3x3
+    bool axis_aligned() const { return aligned; }
+
+    /**
+     * Voxel-to-world affine as a row-major 4x4 matrix (e.g. for vtkMatrix4x4::DeepCopy)
+     */
+    void voxel_to_world_matrix(double matrix[16]) const;
+
+    /**
+     * Patient position of a (possibly fractional) voxel index
+     */
+    void voxel_to_world(const double ijk[3], double xyz[3]) const;
+
+    /**
+     * Fractional voxel index of a patient position
+     */
+    void world_to_voxel(const double xyz[3], double ijk[3]) const;
+
+    /**
+     * Transform count interleaved xyz points in place, voxel to world
+     */
+    void voxel_to_world(float* points, std::size_t count) const;
+
+    /**
+     * Transform count interleaved xyz points in place, world to voxel
+     */
+    void world_to_voxel(float* points, std::size_t count) const;
+
+    void print_info() const;
+
+private:
+    void update();
+
+    double originMm[3];
+    double spacingMm[3];
+    double directionCosines[9];
+
+    double toWorld[12];    // Row-major 3x4
+    double toVoxel[12];    // Row-major 3x4
+    bool aligned;
+    int worldAxis[3];      // Aligned grids: patient axis of voxel axis c
+    double axisScale[3];   // Aligned grids: signed spacing along that axis
+};
+
+/**
+ * Interpolation used by resampleVolume
+ */
+enum class ResampleMode {
+    Nearest,    // Labels and binary masks
+    Trilinear   // Continuous images; a resampled binary mask gives partial-volume fractions
+};
+
+/**
+ * Resample a volume acquired on one grid onto another grid in patient space, every frame in one pass
+ *
+ * The composite target-voxel to source-voxel affine is formed once; along each target row the
+ * source position then advances by a constant step. Rows run in parallel over (frame, slice);
+ * on AVX2 builds nearest-neighbour rows are gathered 8 voxels at a time.
+ *
+ * @param source Volume on the source grid
+ * @param sourceGeometry Placement of the source grid
+ * @param targetGeometry Placement of the target grid
+ * @param nx Target size along x
+ * @param ny Target size along y
+ * @param nz Target size along z
+ * @param mode Interpolation
+ * @param outside Value for target voxels outside the source grid
+ * @return Resampled volume with the source's frames, charged to the source's category
+ */
+Volume4D resampleVolume(const Volume4D& source, const VolumeGeometry& sourceGeometry,
+                        const VolumeGeometry& targetGeometry, std::size_t nx, std::size_t ny, std::size_t nz,
+                        ResampleMode mode = ResampleMode::Nearest, float outside = 0.0f);
+
+#endif // VOLUME_GEOMETRY_H
@@ -0,0 +1,231 @@
+#include "VolumePyramid.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include "parallel_utils.h"
+
+Volume4D downsampleVolume(const Volume4D& fine, const Volume4D* fineWeights, Volume4D* coarseWeights) {
+    std::size_t nx = fine.size_x(), ny = fine.size_y(), nz = fine.size_z(), nt = fine.size_t();
+    std::size_t cx = (nx + 1) / 2, cy = (ny + 1) / 2, cz = (nz + 1) / 2;
+    if (fineWeights && (fineWeights->size_x() != nx || fineWeights->size_y() != ny || fineWeights->size_z() != nz ||
+                        (fineWeights->size_t() != 1 && fineWeights->size_t() != nt))) {
+        throw std::invalid_argument("downsampleVolume: weights do not match the volume");
+    }
+
+    Volume4D coarse;
+    coarse.set_category(fine.get_category());
+    coarse.resize(cx, cy, cz, nt);
+    std::size_t weightFrames = fineWeights ? fineWeights->size_t() : 0;
+    if (coarseWeights) {
+        coarseWeights->set_category(fineWeights ? fineWeights->get_category() : fine.get_category());
+        coarseWeights->resize(cx, cy, cz, fineWeights ? weightFrames : nt);
+    }
+
+    // One task per (frame, coarse slice); weight frames shared by every frame are written once
+    parallelFor(0, nt * cz, [&](std::size_t task) {
+        std::size_t t = task / cz;
+        std::size_t k = task % cz;
+        const float* values = fine.frame_data(t);
+        const float* weights = fineWeights ? fineWeights->frame_data(weightFrames == 1 ? 0 : t) : nullptr;
+        float* out = coarse.frame_data(t) + k * cx * cy;
+        float* outWeights = nullptr;
+        if (coarseWeights && (!fineWeights || weightFrames > 1 || t == 0)) {
+            outWeights = coarseWeights->frame_data(fineWeights && weightFrames == 1 ? 0 : t) + k * cx * cy;
+        }
+
+        std::size_t z0 = 2 * k, z1 = std::min(nz, z0 + 2);
+        for (std::size_t j = 0; j < cy; j++) {
+            std::size_t y0 = 2 * j, y1 = std::min(ny, y0 + 2);
+            for (std::size_t i = 0; i < cx; i++) {
+                std::size_t x0 = 2 * i, x1 = std::min(nx, x0 + 2);
+                float sum = 0.0f, weightSum = 0.0f;
+                std::size_t count = 0;
+                for (std::size_t z = z0; z < z1; z++) {
+                    for (std::size_t y = y0; y < y1; y++) {
+                        std::size_t row = (z * ny + y) * nx;
+                        for (std::size_t x = x0; x < x1; x++) {
+                            float w = weights ? weights[row + x] : 1.0f;
+                            sum += w * values[row + x];
+                            weightSum += w;
+                            count++;
+                        }
+                    }
+                }
+                out[j * cx + i] = weightSum > 0.0f ? sum / weightSum : 0.0f;
+                if (outWeights) {
+                    outWeights[j * cx + i] = weightSum / count;
+                }
+            }
+        }
+    });
+    return coarse;
+}
+
+namespace {
+
+/**
+ * Whether a mask or coverage volume lies on the grid of a volume (one frame or one per frame)
+ */
+bool matchesGrid(const Volume4D& weights, const Volume4D& volume) {
+    return weights.size_x() == volume.size_x() && weights.size_y() == volume.size_y() &&
+           weights.size_z() == volume.size_z() && (weights.size_t() == 1 || weights.size_t() == volume.size_t());
+}
+
+} // namespace
+
+std::vector<Volume4D> buildCoverageLevels(const Volume4D& mask, float maskThreshold, std::size_t coarseLevels) {
+    std::vector<Volume4D> levels;
+    if (mask.empty()) {
+        return levels;
+    }
+    Volume4D inside;
+    inside.set_category(mask.get_category());
+    inside.resize(mask.size_x(), mask.size_y(), mask.size_z(), mask.size_t());
+    for (std::size_t t = 0; t < mask.size_t(); t++) {
+        const float* values = mask.frame_data(t);
+        float* out = inside.frame_data(t);
+        for (std::size_t i = 0; i < mask.frame_size(); i++) {
+            out[i] = values[i] > maskThreshold ? 1.0f : 0.0f;
+        }
+    }
+    levels.reserve(coarseLevels + 1);
+    levels.push_back(std::move(inside));
+
+    // A block's covered fraction is the plain mean of the finer fractions
+    for (std::size_t level = 1; level <= coarseLevels; level++) {
+        levels.push_back(downsampleVolume(levels[level - 1]));
+    }
+    return levels;
+}
+
+std::vector<Volume4D> buildPyramidLevels(const Volume4D& full, const std::vector<Volume4D>* coverage, std::size_t coarseLevels) {
+    std::vector<Volume4D> levels;
+    if (full.empty()) {
+        return levels;
+    }
+    if (coverage && (coverage->size() <= coarseLevels || !matchesGrid(coverage->front(), full))) {
+        coverage = nullptr;
+    }
+    levels.reserve(coarseLevels);
+    for (std::size_t level = 1; level <= coarseLevels; level++) {
+        const Volume4D& fine = level == 1 ? full : levels.back();
+        const Volume4D* weights = coverage ? &(*coverage)[level - 1] : nullptr;
+        levels.push_back(downsampleVolume(fine, weights));
+    }
+    return levels;
+}
+
+VolumePyramid::VolumePyramid(std::size_t levels, const Volume4D* maskVolume, float threshold)
+    : coarseLevels(levels), mask(maskVolume), maskThreshold(threshold) {}
+
+VolumePyramid::VolumePyramid(std::size_t levels, const std::vector<Volume4D>* coverage)
+    : coarseLevels(levels), mask(nullptr), maskThreshold(0.0f) {
+    if (coverage && !coverage->empty()) {
+        coverageLevels = coverage;
+    }
+}
+
+VolumePyramid::~VolumePyramid() {
+    // Background builds reference this object, so they must finish first
+    try {
+        wait();
+    } catch (const std::exception&) {
+    }
+}
+
+bool VolumePyramid::accepts(const Volume4D& full) const {
+    if (full.empty()) {
+        std::cerr << "Error: Cannot build a pyramid of an empty volume" << std::endl;
+        return false;
+    }
+    if (!components.empty()) {
+        const Volume4D& first = *components.front().full;
+        if (full.size_x() != first.size_x() || full.size_y() != first.size_y() ||
+            full.size_z() != first.size_z() || full.size_t() != first.size_t()) {
+            std::cerr << "Error: Pyramid components differ in size" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VolumePyramid::add_component(const Volume4D& full) {
+    if (!accepts(full)) {
+        return false;
+    }
+    if (components.empty() && mask) {
+        if (!matchesGrid(*mask, full)) {
+            std::cout << "Warning: Pyramid mask size differs from the volume, averaging without mask" << std::endl;
+            mask = nullptr;
+        } else {
+            coverageLevels = &builtCoverage;
+            coverageBuilt = std::async(std::launch::async, [this]() {
+                builtCoverage = buildCoverageLevels(*mask, maskThreshold, coarseLevels);
+            }).share();
+        }
+    }
+
+    components.emplace_back();
+    Component& target = components.back();
+    target.full = &full;
+    target.levels = &target.builtLevels;
+    target.built = std::async(std::launch::async, [this, &target]() {
+        if (coverageBuilt.valid()) {
+            coverageBuilt.get();
+        }
+        target.builtLevels = buildPyramidLevels(*target.full, coverageLevels, coarseLevels);
+    }).share();
+    return true;
+}
+
+bool VolumePyramid::add_component(const Volume4D& full, const std::vector<Volume4D>& levels) {
+    if (!accepts(full)) {
+        return false;
+    }
+    if (levels.size() != coarseLevels) {
+        std::cerr << "Error: Pyramid component has " << levels.size() << " coarse levels instead of " << coarseLevels << std::endl;
+        return false;
+    }
+    // buildPyramidLevels ignored such a coverage as well
+    if (components.empty() && coverageLevels && !matchesGrid(coverageLevels->front(), full)) {
+        std::cout << "Warning: Pyramid mask size differs from the volume, averaging without mask" << std::endl;
+        coverageLevels = nullptr;
+    }
+
+    std::promise<void> done;
+    done.set_value();
+    components.emplace_back();
+    Component& target = components.back();
+    target.full = &full;
+    target.levels = &levels;
+    target.built = done.get_future().share();
+    return true;
+}
+
+bool VolumePyramid::ready() const {
+    for (const Component& entry : components) {
+        if (entry.built.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void VolumePyramid::wait() const {
+    for (const Component& entry : components) {
+        entry.built.get();
+    }
+}
+
+const Volume4D& VolumePyramid::component(std::size_t level, std::size_t index) const {
+    const Component& entry = components.at(index);
+    return level == 0 ? *entry.full : entry.levels->at(level - 1);
+}
+
+const Volume4D& VolumePyramid::coverage(std::size_t level) const {
+    if (!coverageLevels) {
+        throw std::logic_error("VolumePyramid::coverage: pyramid has no mask");
+    }
+    return coverageLevels->at(level);
+}
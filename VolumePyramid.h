@@ -0,0 +1,142 @@
+#ifndef VOLUME_PYRAMID_H
+#define VOLUME_PYRAMID_H
+
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <vector>
+#include "Volume4D.h"
+
+/**
+ * Halve every spatial axis of a volume by averaging 2 x 2 x 2 blocks, in parallel over slices
+ *
+ * Odd sizes round up; the last block along such an axis averages only the voxels that exist.
+ * With weights, each fine voxel counts with its weight and voxels whose block has no weight
+ * are 0, so background outside a mask does not bleed into the coarse values.
+ *
+ * @param fine Volume to downsample
+ * @param fineWeights Optional per-voxel weights with the same x/y/z size (one frame, or one per frame)
+ * @param coarseWeights Optional output: mean weight of each block, i.e. the covered fraction
+ * @return Downsampled volume, charged to the same category as fine
+ */
+Volume4D downsampleVolume(const Volume4D& fine, const Volume4D* fineWeights = nullptr, Volume4D* coarseWeights = nullptr);
+
+/**
+ * Coverage levels of a mask: level 0 is 1 inside the mask and 0 outside, each further level the
+ * covered fraction of a 2 x 2 x 2 block of the level above
+ *
+ * @param mask Mask volume (one frame or one per frame)
+ * @param maskThreshold Mask voxels above this value are inside
+ * @param coarseLevels Number of levels below full resolution
+ * @return Levels 0..coarseLevels (empty for an empty mask)
+ */
+std::vector<Volume4D> buildCoverageLevels(const Volume4D& mask, float maskThreshold, std::size_t coarseLevels);
+
+/**
+ * Coarse levels of a volume, each averaging 2 x 2 x 2 blocks of the level above
+ *
+ * @param full Full-resolution volume
+ * @param coverage Optional levels from buildCoverageLevels, weighting the averages; ignored if
+ *                 their level 0 does not match the x/y/z size of full
+ * @param coarseLevels Number of levels below full resolution
+ * @return Levels 1..coarseLevels (empty for an empty volume)
+ */
+std::vector<Volume4D> buildPyramidLevels(const Volume4D& full, const std::vector<Volume4D>* coverage, std::size_t coarseLevels);
+
+/**
+ * Mipmap-style pyramid of one or more volumes on the same grid, built in the background
+ *
+ * Level 0 is the full-resolution input itself (not copied); level i is 2^i times coarser along
+ * each axis. With a mask (e.g. a thresholded magnitude image) every level also has a coverage
+ * volume, the fraction of full-resolution voxels inside the mask, and averages only count
+ * masked voxels. Each component's levels are built on a background thread as soon as it is
+ * added, so the pyramid of one velocity component builds while the next one loads. Levels
+ * built elsewhere (e.g. by stages of a loading graph, with buildCoverageLevels and
+ * buildPyramidLevels) can be adopted instead.
+ *
+ * Inputs, mask and adopted levels are referenced, not copied, and must stay alive and unchanged
+ * while the pyramid is in use.
+ */
+class VolumePyramid {
+public:
+    /**
+     * @param coarseLevels Number of levels below full resolution
+     * @param mask Optional mask with the components' x/y/z size and one frame or one per frame
+     * @param maskThreshold Mask voxels above this value are inside
+     */
+    explicit VolumePyramid(std::size_t coarseLevels, const Volume4D* mask = nullptr, float maskThreshold = 0.0f);
+
+    /**
+     * Pyramid of levels that are already built; components are added with the levels overload of add_component
+     *
+     * @param coarseLevels Number of levels below full resolution
+     * @param coverage Levels 0..coarseLevels from buildCoverageLevels, or null without a mask
+     */
+    VolumePyramid(std::size_t coarseLevels, const std::vector<Volume4D>* coverage);
+    ~VolumePyramid();
+
+    VolumePyramid(const VolumePyramid&) = delete;
+    VolumePyramid& operator=(const VolumePyramid&) = delete;
+
+    /**
+     * Add a full-resolution volume and start building its coarse levels asynchronously
+     *
+     * @param full Component volume; all components must have the same size
+     * @return false if the volume is empty or does not match the first component
+     */
+    bool add_component(const Volume4D& full);
+
+    /**
+     * Add a full-resolution volume with its coarse levels already built
+     *
+     * @param full Component volume; all components must have the same size
+     * @param levels Levels 1..coarseLevels of full, built with this pyramid's coverage
+     * @return false if the volume is empty, does not match the first component or levels are missing
+     */
+    bool add_component(const Volume4D& full, const std::vector<Volume4D>& levels);
+
+    /**
+     * True once every added component has been built
+     */
+    bool ready() const;
+
+    /**
+     * Block until every added component has been built; rethrows a build error (e.g. MemoryBudgetError)
+     */
+    void wait() const;
+
+    std::size_t level_count() const { return coarseLevels + 1; }
+    std::size_t component_count() const { return components.size(); }
+    std::size_t factor(std::size_t level) const { return std::size_t(1) << level; }
+    bool has_mask() const { return coverageLevels != nullptr; }
+
+    /**
+     * Component volume at a level (level 0 is the input); call wait() first
+     */
+    const Volume4D& component(std::size_t level, std::size_t index) const;
+
+    /**
+     * Fraction of masked full-resolution voxels per voxel of a level (0 or 1 at level 0); only with a mask
+     */
+    const Volume4D& coverage(std::size_t level) const;
+
+private:
+    struct Component {
+        const Volume4D* full = nullptr;
+        std::vector<Volume4D> builtLevels;            // Levels 1..coarseLevels built by this pyramid
+        const std::vector<Volume4D>* levels = nullptr; // builtLevels or adopted levels
+        std::shared_future<void> built;
+    };
+
+    bool accepts(const Volume4D& full) const;
+
+    std::size_t coarseLevels;
+    const Volume4D* mask;
+    float maskThreshold;
+    std::vector<Volume4D> builtCoverage;                   // Levels 0..coarseLevels built from mask
+    const std::vector<Volume4D>* coverageLevels = nullptr; // builtCoverage or adopted levels
+    std::shared_future<void> coverageBuilt;
+    std::deque<Component> components;                      // Deque, so running builds keep valid references
+};
+
+#endif // VOLUME_PYRAMID_H
@@ -0,0 +1,101 @@
+#include "WorkStealingPool.h"
+#include "parallel_utils.h"
+
+namespace {
+
+// Pool and deque of the worker running on this thread, if any
+thread_local const WorkStealingPool* currentPool = nullptr;
+thread_local std::size_t currentQueue = 0;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(std::size_t threads) {
+    std::size_t count = threads > 0 ? threads : workerThreadCount();
+    for (std::size_t i = 0; i < count; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    workers.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        workers.emplace_back([this, i]() { worker(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+}
+
+WorkStealingPool& WorkStealingPool::shared() {
+    static WorkStealingPool pool;
+    return pool;
+}
+
+bool WorkStealingPool::on_worker() const {
+    return currentPool == this;
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    std::size_t index = currentPool == this ? currentQueue : nextQueue++ % queues.size();
+    // Counted before it is visible, so a worker taking it never sees the count drop below zero
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+bool WorkStealingPool::take(std::size_t index, std::function<void()>& task) {
+    // Own deque from the back (newest), others from the front (oldest)
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (std::size_t offset = 1; offset < queues.size(); offset++) {
+        Queue& victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::worker(std::size_t index) {
+    currentPool = this;
+    currentQueue = index;
+    std::function<void()> task;
+    while (true) {
+        if (take(index, task)) {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                queued--;
+            }
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        if (stopping && queued == 0) {
+            return;
+        }
+        // A counted task may not be pushed yet; waking on queued > 0 retries until it is
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+    }
+}
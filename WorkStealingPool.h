@@ -0,0 +1,73 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Thread pool with one task deque per worker
+ *
+ * A worker runs its own newest task first and, when its deque is empty, steals the oldest
+ * task of another worker. Tasks submitted from a worker go to that worker's deque; tasks
+ * from other threads are spread round-robin.
+ *
+ * Tasks should not block on anything but work that is already running (a task that waits
+ * for a queued task may wait for itself); parallelFor follows this by running unclaimed
+ * chunks on the waiting thread.
+ */
+class WorkStealingPool {
+public:
+    /**
+     * @param threads Worker threads; 0 = hardware threads
+     */
+    explicit WorkStealingPool(std::size_t threads = 0);
+
+    /**
+     * Runs the tasks still queued, then joins the workers
+     */
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * Process-wide pool (hardware threads) behind parallelFor and the loading graph,
+     * created on first use
+     */
+    static WorkStealingPool& shared();
+
+    void submit(std::function<void()> task);
+
+    std::size_t thread_count() const { return workers.size(); }
+
+    /**
+     * Whether the calling thread is one of this pool's workers
+     */
+    bool on_worker() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take(std::size_t index, std::function<void()>& task);
+    void worker(std::size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> nextQueue{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::size_t queued = 0;     // Submitted and not yet taken; guarded by sleepMutex
+    bool stopping = false;
+};
+
+#endif // WORK_STEALING_POOL_H
@@ -0,0 +1,1039 @@
+#include <dcmtk/dcmimgle/dcmimage.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "dicom_utils.h"
+#include "dicom_pipeline.h"
+#include "Volume4D.h"
+#include "VelocitySampler.h"
+#include "TemporalInterpolator.h"
+#include "streamline_io.h"
+#include "MemoryManager.h"
+#include "SlabPipeline.h"
+#include "VolumeCache.h"
+#include "VolumeGeometry.h"
+#include "VolumePyramid.h"
+#include "FlowStatistics.h"
+#include "FrameEncoder.h"
+#include "TaskGraph.h"
+#include "parallel_utils.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Stand-in for a slow disk or network mount: every read pays a fixed latency plus a
+ * bandwidth-limited transfer time on top of the real read
+ */
+void throttleDelay(std::size_t bytes, double latencyMs, double megabytesPerSecond) {
+    double seconds = latencyMs / 1000.0;
+    if (megabytesPerSecond > 0.0) {
+        seconds += bytes / (megabytesPerSecond * 1024.0 * 1024.0);
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+FileReadFn throttledReader(double latencyMs, double megabytesPerSecond) {
+    return [latencyMs, megabytesPerSecond](const std::string& path, std::vector<char>& buffer) {
+        if (!readWholeFile(path, buffer)) {
+            return false;
+        }
+        throttleDelay(buffer.size(), latencyMs, megabytesPerSecond);
+        return true;
+    };
+}
+
+std::vector<std::string> sortedFiles(const std::string& folder) {
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(folder)) {
+        if (entry.is_regular_file()) {
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// The loader before the pipeline: DCMTK opens and decodes each file into a one-slice volume,
+// which is then copied voxel by voxel. DCMTK reads the file itself, so the throttle is paid up front
+bool loadOriginal(const std::vector<std::string>& paths, Volume4D& volume, double latencyMs, double megabytesPerSecond) {
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        std::size_t z = i % volume.size_z();
+        std::size_t t = i / volume.size_z();
+        if (t >= volume.size_t()) {
+            break;
+        }
+        throttleDelay(static_cast<std::size_t>(std::filesystem::file_size(paths[i])), latencyMs, megabytesPerSecond);
+        Volume4D slice = readDicomToVolume4D(paths[i]);
+        if (slice.size_x() != volume.size_x() || slice.size_y() != volume.size_y()) {
+            return false;
+        }
+        for (std::size_t x = 0; x < volume.size_x(); x++) {
+            for (std::size_t y = 0; y < volume.size_y(); y++) {
+                volume.at(x, y, z, t) = slice.at(x, y, 0, 0);
+            }
+        }
+    }
+    return true;
+}
+
+// Read, parse and convert one file at a time with the same reader (no overlap)
+bool loadSerial(const std::vector<std::string>& paths, Volume4D& volume, const FileReadFn& readFile) {
+    std::vector<char> buffer;
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        std::size_t z = i % volume.size_z();
+        std::size_t t = i / volume.size_z();
+        if (t >= volume.size_t()) {
+            break;
+        }
+        DcmFileFormat fileformat;
+        if (!readFile(paths[i], buffer) || !parseDicomBuffer(buffer.data(), buffer.size(), fileformat)) {
+            return false;
+        }
+        DicomImage image(&fileformat, fileformat.getDataset()->getOriginalXfer());
+        if (image.getStatus() != EIS_Normal || !copyDicomImageToVolume(&image, volume, z, t)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int benchIO(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: bench io <dicom_folder> [latency_ms=5] [MB/s=100]" << std::endl;
+        return 1;
+    }
+    std::string folder = argv[2];
+    double latencyMs = argc > 3 ? std::stod(argv[3]) : 5.0;
+    double bandwidth = argc > 4 ? std::stod(argv[4]) : 100.0;
+
+    std::vector<int> dims = get4DSize(folder);
+    std::vector<std::string> paths = sortedFiles(folder);
+    std::uintmax_t totalBytes = 0;
+    for (const auto& path : paths) {
+        totalBytes += std::filesystem::file_size(path);
+    }
+    double megabytes = totalBytes / (1024.0 * 1024.0);
+
+    std::cout << "\n" << paths.size() << " files, " << megabytes << " MB, throttle: "
+              << latencyMs << " ms + " << bandwidth << " MB/s per read" << std::endl;
+
+    FileReadFn throttled = throttledReader(latencyMs, bandwidth);
+
+    Volume4D original(dims[0], dims[1], dims[2], dims[3]);
+    auto start = Clock::now();
+    bool originalOk = loadOriginal(paths, original, latencyMs, bandwidth);
+    double originalSeconds = secondsSince(start);
+
+    Volume4D serial(dims[0], dims[1], dims[2], dims[3]);
+    start = Clock::now();
+    bool serialOk = loadSerial(paths, serial, throttled);
+    double serialSeconds = secondsSince(start);
+
+    for (std::size_t readers : {1, 2, 4, 8}) {
+        DicomPipelineOptions options;
+        options.readerThreads = readers;
+        options.readFile = throttled;
+
+        Volume4D pipelined(dims[0], dims[1], dims[2], dims[3]);
+        start = Clock::now();
+        bool ok = loadDicomFilesPipelined(paths, pipelined, options);
+        double seconds = secondsSince(start);
+
+        std::size_t differing = 0;
+        for (std::size_t t = 0; t < original.size_t(); t++) {
+            for (std::size_t i = 0; i < original.frame_size(); i++) {
+                differing += original.frame_data(t)[i] != pipelined.frame_data(t)[i];
+            }
+        }
+        std::cout << "pipelined (" << readers << " readers): " << seconds << " s, "
+                  << paths.size() / seconds << " files/s, " << megabytes / seconds << " MB/s, "
+                  << originalSeconds / seconds << "x vs original, " << differing << " voxels differ"
+                  << (ok ? "" : " [errors]") << std::endl;
+    }
+
+    std::cout << "serial, same reader: " << serialSeconds << " s, " << paths.size() / serialSeconds << " files/s, "
+              << megabytes / serialSeconds << " MB/s" << (serialOk ? "" : " [errors]") << std::endl;
+    std::cout << "original (DicomImage per file): " << originalSeconds << " s, " << paths.size() / originalSeconds
+              << " files/s, " << megabytes / originalSeconds << " MB/s" << (originalOk ? "" : " [errors]") << std::endl;
+    return 0;
+}
+
+int benchSample(int argc, char** argv) {
+    std::size_t nx = argc > 2 ? std::stoul(argv[2]) : 160;
+    std::size_t ny = argc > 3 ? std::stoul(argv[3]) : 160;
+    std::size_t nz = argc > 4 ? std::stoul(argv[4]) : 40;
+    std::size_t nt = argc > 5 ? std::stoul(argv[5]) : 20;
+    std::size_t n = argc > 6 ? std::stoul(argv[6]) : (1u << 20);
+
+    Volume4D vx(nx, ny, nz, nt), vy(nx, ny, nz, nt), vz(nx, ny, nz, nt);
+    vx.fill_random(-100.0f, 100.0f);
+    vy.fill_random(-100.0f, 100.0f);
+    vz.fill_random(-100.0f, 100.0f);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> ux(0.0f, nx - 1.0f), uy(0.0f, ny - 1.0f), uz(0.0f, nz - 1.0f);
+    std::uniform_real_distribution<float> step(-0.3f, 0.3f);
+
+    // Random: uniformly scattered positions. Coherent: short random walks, like points along streamlines
+    std::vector<float> random(3 * n), coherent(3 * n);
+    for (std::size_t i = 0; i < n; i++) {
+        random[3 * i] = ux(gen);
+        random[3 * i + 1] = uy(gen);
+        random[3 * i + 2] = uz(gen);
+        if (i % 256 == 0) {
+            coherent[3 * i] = ux(gen);
+            coherent[3 * i + 1] = uy(gen);
+            coherent[3 * i + 2] = uz(gen);
+        } else {
+            coherent[3 * i] = coherent[3 * (i - 1)] + step(gen);
+            coherent[3 * i + 1] = coherent[3 * (i - 1) + 1] + step(gen);
+            coherent[3 * i + 2] = coherent[3 * (i - 1) + 2] + step(gen);
+        }
+    }
+    std::vector<float> out(3 * n);
+
+    std::cout << "\nSampling " << n << " positions in " << nx << " x " << ny << " x " << nz << " x " << nt
+              << " (AVX2 " << (VelocitySampler::simd_available() ? "available" : "not built") << ")" << std::endl;
+
+    VelocitySampler sampler(vx, vy, vz);
+    for (Interpolation mode : {Interpolation::Trilinear, Interpolation::Tricubic}) {
+        for (bool temporal : {false, true}) {
+            for (bool simd : {false, true}) {
+                if (simd && !VelocitySampler::simd_available()) {
+                    continue;
+                }
+                sampler.set_interpolation(mode);
+                sampler.set_temporal_interpolation(temporal);
+                sampler.set_simd(simd);
+
+                for (const auto* pattern : {&random, &coherent}) {
+                    auto start = Clock::now();
+                    sampler.sample(pattern->data(), n, out.data(), temporal ? 2.5f : 2.0f);
+                    double seconds = secondsSince(start);
+
+                    std::cout << (mode == Interpolation::Trilinear ? "trilinear" : "tricubic ")
+                              << (temporal ? " +time" : "      ")
+                              << (simd ? " avx2  " : " scalar")
+                              << (pattern == &random ? " random:   " : " coherent: ")
+                              << n / seconds / 1e6 << " Msamples/s" << std::endl;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int benchTemporal(int argc, char** argv) {
+    std::size_t nx = argc > 2 ? std::stoul(argv[2]) : 160;
+    std::size_t ny = argc > 3 ? std::stoul(argv[3]) : 160;
+    std::size_t nz = argc > 4 ? std::stoul(argv[4]) : 40;
+    std::size_t nt = argc > 5 ? std::stoul(argv[5]) : 20;
+    std::size_t upsample = argc > 6 ? std::stoul(argv[6]) : 8;
+
+    Volume4D series(nx, ny, nz, nt);
+    series.fill_random(-100.0f, 100.0f);
+    double megabytes = series.frame_size() * sizeof(float) / (1024.0 * 1024.0);
+
+    std::cout << "\nSynthesizing " << nt * upsample << " frames of " << nx << " x " << ny << " x " << nz
+              << " (" << megabytes << " MB each) from " << nt << std::endl;
+
+    for (TemporalMode mode : {TemporalMode::Linear, TemporalMode::CubicHermite, TemporalMode::PeriodicSpline}) {
+        auto start = Clock::now();
+        TemporalInterpolator interpolator(series, mode);
+        double setupSeconds = secondsSince(start);
+
+        start = Clock::now();
+        for (std::size_t i = 0; i < nt * upsample; i++) {
+            interpolator.frame(static_cast<double>(i) / upsample);
+        }
+        double seconds = secondsSince(start);
+        double frames = static_cast<double>(nt * upsample);
+
+        std::cout << (mode == TemporalMode::Linear ? "linear:          " :
+                      mode == TemporalMode::CubicHermite ? "cubic Hermite:   " : "periodic spline: ")
+                  << frames / seconds << " frames/s, " << frames * megabytes / seconds << " MB/s written"
+                  << " (setup " << setupSeconds << " s)" << std::endl;
+    }
+
+    // Pathline sampling with the spline frames must reproduce the synthesized frame at voxel centers
+    TemporalInterpolator spline(series, TemporalMode::PeriodicSpline);
+    VelocitySampler sampler(series, series, series);
+    sampler.set_spline_interpolators(&spline, &spline, &spline);
+    sampler.set_temporal_interpolation(true);
+    sampler.set_temporal_mode(TemporalMode::PeriodicSpline);
+    const double time = nt - 0.63; // Wraps from the last frame to the first
+    std::vector<float> expected(series.frame_size());
+    spline.frame_into(time, expected.data());
+    std::vector<float> xyz, velocity;
+    for (std::size_t i = 0; i < series.frame_size(); i += 97) {
+        xyz.push_back(static_cast<float>(i % nx));
+        xyz.push_back(static_cast<float>(i / nx % ny));
+        xyz.push_back(static_cast<float>(i / (nx * ny)));
+    }
+    velocity.resize(xyz.size());
+    sampler.sample(xyz.data(), xyz.size() / 3, velocity.data(), static_cast<float>(time));
+    float difference = 0.0f;
+    for (std::size_t p = 0; p < xyz.size() / 3; p++) {
+        difference = std::max(difference, std::abs(velocity[3 * p] - expected[p * 97]));
+    }
+    std::cout << "sampler spline vs synthesized frame: max difference " << difference << std::endl;
+    return 0;
+}
+
+int benchExport(int argc, char** argv) {
+    std::string prefix = argc > 2 ? argv[2] : "bench_lines";
+    std::size_t lineCount = argc > 3 ? std::stoul(argv[3]) : 100000;
+    std::size_t pointsPerLine = argc > 4 ? std::stoul(argv[4]) : 200;
+    std::size_t frames = 20;
+
+    // Wandering lines spread over the frames of a 160 x 160 x 40 grid, like traced pathlines
+    PolylineSet lines;
+    lines.add_attribute("Speed");
+    lines.add_attribute("Vorticity");
+    lines.add_attribute("IntegrationTime");
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> origin(0.0f, 160.0f), step(-0.5f, 0.5f);
+    std::vector<float> xyz(3 * pointsPerLine);
+    std::vector<std::vector<float>> values(3, std::vector<float>(pointsPerLine));
+    const float* valuePointers[3] = {values[0].data(), values[1].data(), values[2].data()};
+    for (std::size_t l = 0; l < lineCount; l++) {
+        float p[3] = {origin(gen), origin(gen), origin(gen) / 4.0f};
+        for (std::size_t i = 0; i < pointsPerLine; i++) {
+            for (int c = 0; c < 3; c++) {
+                p[c] += step(gen);
+                xyz[3 * i + c] = p[c];
+            }
+            values[0][i] = 100.0f + 50.0f * step(gen);
+            values[1][i] = 10.0f * step(gen);
+            values[2][i] = 0.1f * i;
+        }
+        lines.add_line(xyz.data(), pointsPerLine, static_cast<std::uint32_t>(l % frames), valuePointers);
+    }
+    double megabytes = (lines.points.size() + lines.attributes.size() * lines.point_count()) * sizeof(float) / (1024.0 * 1024.0);
+
+    std::cout << "\nExporting " << lineCount << " lines, " << lines.point_count() << " points ("
+              << megabytes << " MB of float data)" << std::endl;
+
+    auto start = Clock::now();
+    bool binaryOk = writeStreamlineBinary(prefix + ".4dsl", lines);
+    double seconds = secondsSince(start);
+    double fileMegabytes = std::filesystem::file_size(prefix + ".4dsl") / (1024.0 * 1024.0);
+    std::cout << "binary: " << seconds << " s, " << megabytes / seconds << " MB/s in, "
+              << fileMegabytes / seconds << " MB/s written (" << fileMegabytes << " MB)"
+              << (binaryOk ? "" : " [errors]") << std::endl;
+
+    start = Clock::now();
+    bool vtpOk = writeStreamlineVTP(prefix + ".vtp", lines);
+    seconds = secondsSince(start);
+    fileMegabytes = std::filesystem::file_size(prefix + ".vtp") / (1024.0 * 1024.0);
+    std::cout << "vtp:    " << seconds << " s, " << fileMegabytes / seconds << " MB/s written ("
+              << fileMegabytes << " MB)" << (vtpOk ? "" : " [errors]") << std::endl;
+
+    StreamlineReader reader;
+    PolylineSet frame;
+    start = Clock::now();
+    bool readOk = reader.open(prefix + ".4dsl") && reader.read_frame(frames / 2, frame);
+    seconds = secondsSince(start);
+    std::cout << "read one frame: " << seconds << " s, " << frame.line_count() << " lines"
+              << (readOk ? "" : " [errors]") << std::endl;
+    return 0;
+}
+
+/**
+ * Speed, vorticity and speed statistics of velocity channels 0-2 into channels 3 and 4
+ */
+void addDerivedStages(std::vector<SlabStage>& stages, SlabStatistics& statistics) {
+    const float spacing[3] = {1.0f, 1.0f, 1.0f};
+    stages.push_back(speedStage(0, 1, 2, 3));
+    stages.push_back(vorticityStage(0, 1, 2, 4, spacing));
+    stages.push_back(statistics.stage());
+}
+
+/**
+ * Run a pass and report its time, throughput and peak accounted memory
+ */
+template <typename Pass>
+bool timeSlabPass(const std::string& label, double megabytes, Pass pass) {
+    MemoryManager& memory = MemoryManager::instance();
+    memory.reset_peak();
+    auto start = Clock::now();
+    bool ok = pass();
+    double seconds = secondsSince(start);
+    std::cout << label << ": " << seconds << " s, " << megabytes / seconds << " MB/s, peak "
+              << memory.peak_total() / (1024.0 * 1024.0) << " MB" << (ok ? "" : " [errors]") << std::endl;
+    return ok;
+}
+
+/**
+ * Largest voxel difference between two cache files of the same size
+ */
+float maxCacheDifference(const std::string& first, const std::string& second) {
+    Volume4D a = readVolumeCache(first);
+    Volume4D b = readVolumeCache(second);
+    float maxDifference = 0.0f;
+    for (std::size_t t = 0; t < a.size_t() && t < b.size_t(); t++) {
+        for (std::size_t i = 0; i < a.frame_size() && i < b.frame_size(); i++) {
+            maxDifference = std::max(maxDifference, std::abs(a.frame_data(t)[i] - b.frame_data(t)[i]));
+        }
+    }
+    return maxDifference;
+}
+
+/**
+ * Whole-volume baseline vs slab streaming for three phase series
+ *
+ * @param loadVelocity Baseline: loads one whole velocity component with the existing loader
+ * @param sources Slab sources of the raw phase series
+ * @param slopes, intercepts Rescale of each series, applied by the streamed pass
+ */
+template <typename LoadVelocity>
+int compareSlabPasses(LoadVelocity loadVelocity, const std::vector<SlabSource*>& sources,
+                      const std::vector<double>& slopes, const std::vector<double>& intercepts,
+                      float venc, std::size_t depth, const std::string& prefix) {
+    const SlabSource& first = *sources[0];
+    std::size_t nx = first.size_x(), ny = first.size_y(), nz = first.size_z(), nt = first.size_t();
+    double megabytes = 3.0 * nx * ny * nz * nt * sizeof(float) / (1024.0 * 1024.0);
+    std::cout << "\nProcessing 3 x " << nx << " x " << ny << " x " << nz << " x " << nt
+              << " (" << megabytes << " MB of phase data)" << std::endl;
+
+    VolumeCacheFile speedFull, vorticityFull, speedSlab, vorticitySlab;
+    if (!speedFull.create(prefix + "_speed_full.v4d", nx, ny, nz, nt) ||
+        !vorticityFull.create(prefix + "_vorticity_full.v4d", nx, ny, nz, nt) ||
+        !speedSlab.create(prefix + "_speed_slab.v4d", nx, ny, nz, nt) ||
+        !vorticitySlab.create(prefix + "_vorticity_slab.v4d", nx, ny, nz, nt)) {
+        return 1;
+    }
+
+    // Existing loader: whole velocity volumes in memory, then the derived quantities over the whole study
+    SlabStatistics fullStatistics(3);
+    timeSlabPass("whole volumes", megabytes, [&]() {
+        std::vector<Volume4D> velocities;
+        for (std::size_t c = 0; c < 3; c++) {
+            velocities.push_back(loadVelocity(c));
+            if (velocities.back().empty()) {
+                return false;
+            }
+        }
+        VolumeSource x(velocities[0]), y(velocities[1]), z(velocities[2]);
+        std::vector<SlabStage> stages;
+        addDerivedStages(stages, fullStatistics);
+        SlabOptions options;
+        options.slabDepth = nz;
+        return runSlabPipeline({&x, &y, &z}, stages, {{3, &speedFull}, {4, &vorticityFull}}, options);
+    });
+
+    // Streamed: rescale and VENC slab by slab straight from the phase series
+    SlabStatistics slabStatistics(3);
+    timeSlabPass("slabs of " + std::to_string(depth), megabytes, [&]() {
+        std::vector<SlabStage> stages;
+        for (std::size_t c = 0; c < 3; c++) {
+            stages.push_back(rescaleStage(c, slopes[c], intercepts[c]));
+            stages.push_back(vencStage(c, venc));
+        }
+        addDerivedStages(stages, slabStatistics);
+        SlabOptions options;
+        options.slabDepth = depth;
+        options.halo = 1;
+        return runSlabPipeline(sources, stages, {{3, &speedSlab}, {4, &vorticitySlab}}, options);
+    });
+
+    // Both paths must agree voxel for voxel
+    float maxDifference = std::max(maxCacheDifference(prefix + "_speed_full.v4d", prefix + "_speed_slab.v4d"),
+                                   maxCacheDifference(prefix + "_vorticity_full.v4d", prefix + "_vorticity_slab.v4d"));
+    SlabStatistics::Summary summary = slabStatistics.summary();
+    std::cout << "max difference: " << maxDifference << ", speed mean " << summary.mean << " (whole volumes "
+              << fullStatistics.summary().mean << "), max " << summary.max << std::endl;
+    return 0;
+}
+
+// Three DICOM phase folders: generateVelVecField against DicomSliceSource slabs
+int benchSlabDicom(int argc, char** argv) {
+    std::size_t depth = argc > 5 ? std::stoul(argv[5]) : 8;
+    std::string prefix = argc > 6 ? argv[6] : "bench_slab";
+    const float venc = 1.70f; // As generateVelVecField
+
+    std::vector<std::string> folders = {argv[2], argv[3], argv[4]};
+    std::vector<DicomSliceSource> sources;
+    sources.reserve(3);
+    std::vector<SlabSource*> inputs;
+    std::vector<double> slopes, intercepts;
+    for (const std::string& folder : folders) {
+        sources.emplace_back(folder);
+        if (!sources.back().valid()) {
+            return 1;
+        }
+        inputs.push_back(&sources.back());
+        slopes.push_back(sources.back().rescale_slope());
+        intercepts.push_back(sources.back().rescale_intercept());
+    }
+    return compareSlabPasses([&](std::size_t c) { return generateVelVecField(folders[c]); },
+                             inputs, slopes, intercepts, venc, depth, prefix);
+}
+
+int benchSlab(int argc, char** argv) {
+    if (argc > 4 && std::filesystem::is_directory(argv[2])) {
+        return benchSlabDicom(argc, argv);
+    }
+    std::size_t nx = argc > 2 ? std::stoul(argv[2]) : 160;
+    std::size_t ny = argc > 3 ? std::stoul(argv[3]) : 160;
+    std::size_t nz = argc > 4 ? std::stoul(argv[4]) : 40;
+    std::size_t nt = argc > 5 ? std::stoul(argv[5]) : 20;
+    std::size_t depth = argc > 6 ? std::stoul(argv[6]) : 8;
+    std::string prefix = argc > 7 ? argv[7] : "bench_slab";
+
+    // Raw 12-bit phase caches, as a stand-in for a study converted once from DICOM
+    const double PI = 3.14159265359;
+    const double slope = 2.0 * PI / 4096.0, intercept = -PI;
+    const float venc = 150.0f;
+    std::vector<std::string> phasePaths;
+    for (const char* axis : {"x", "y", "z"}) {
+        Volume4D phase(nx, ny, nz, nt);
+        phase.fill_random(0.0f, 4096.0f);
+        phasePaths.push_back(prefix + "_phase_" + axis + ".v4d");
+        if (!writeVolumeCache(phasePaths.back(), phase)) {
+            return 1;
+        }
+    }
+
+    // Baseline as the loader does it: whole volume, rescale as rescalePhase, then applyVENC
+    auto loadVelocity = [&](std::size_t c) {
+        Volume4D phase = readVolumeCache(phasePaths[c]);
+        for (std::size_t t = 0; t < phase.size_t(); t++) {
+            float* frame = phase.frame_data(t);
+            for (std::size_t i = 0; i < phase.frame_size(); i++) {
+                frame[i] = static_cast<float>(frame[i] * slope + intercept);
+            }
+        }
+        return applyVENC(std::move(phase), venc);
+    };
+    VolumeCacheSource x(phasePaths[0]), y(phasePaths[1]), z(phasePaths[2]);
+    return compareSlabPasses(loadVelocity, {&x, &y, &z}, {slope, slope, slope}, {intercept, intercept, intercept},
+                             venc, depth, prefix);
+}
+
+int benchResample(int argc, char** argv) {
+    std::size_t nx = argc > 2 ? std::stoul(argv[2]) : 160;
+    std::size_t ny = argc > 3 ? std::stoul(argv[3]) : 160;
+    std::size_t nz = argc > 4 ? std::stoul(argv[4]) : 40;
+    std::size_t repeats = argc > 5 ? std::stoul(argv[5]) : 10;
+
+    // Labels on an oblique 1 mm grid, resampled onto an axial 2 x 2 x 3 mm velocity grid
+    const double c = std::cos(0.35), s = std::sin(0.35);
+    const double labelOrigin[3] = {-20.0, -30.0, -10.0};
+    const double labelSpacing[3] = {1.0, 1.0, 1.0};
+    const double labelDirection[9] = {c, 0.0, s, 0.0, 1.0, 0.0, -s, 0.0, c};
+    const double velocityOrigin[3] = {0.0, 0.0, 0.0};
+    const double velocitySpacing[3] = {2.0, 2.0, 3.0};
+    const double axial[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+    VolumeGeometry labelGeometry(labelOrigin, labelSpacing, labelDirection);
+    VolumeGeometry velocityGeometry(velocityOrigin, velocitySpacing, axial);
+
+    Volume4D labels(2 * nx, 2 * ny, 3 * nz, 1);
+    labels.fill_random(0.0f, 4.0f);
+    double voxels = static_cast<double>(nx * ny * nz);
+    std::cout << "\nResampling " << labels.size_x() << " x " << labels.size_y() << " x " << labels.size_z()
+              << " labels onto " << nx << " x " << ny << " x " << nz << std::endl;
+
+    for (ResampleMode mode : {ResampleMode::Nearest, ResampleMode::Trilinear}) {
+        Volume4D target;
+        auto start = Clock::now();
+        for (std::size_t r = 0; r < repeats; r++) {
+            target = resampleVolume(labels, labelGeometry, velocityGeometry, nx, ny, nz, mode);
+        }
+        double seconds = secondsSince(start) / repeats;
+        std::cout << (mode == ResampleMode::Nearest ? "nearest:   " : "trilinear: ")
+                  << voxels / seconds / 1e6 << " Mvoxels/s" << std::endl;
+
+        // Per-voxel transform through patient space as the reference for the nearest-neighbour path
+        if (mode == ResampleMode::Nearest) {
+            std::size_t mismatches = 0;
+            for (std::size_t k = 0; k < nz; k++) {
+                for (std::size_t j = 0; j < ny; j++) {
+                    for (std::size_t i = 0; i < nx; i++) {
+                        double ijk[3] = {double(i), double(j), double(k)}, world[3], source[3];
+                        velocityGeometry.voxel_to_world(ijk, world);
+                        labelGeometry.world_to_voxel(world, source);
+                        long x = std::lround(source[0]), y = std::lround(source[1]), z = std::lround(source[2]);
+                        bool inside = x >= 0 && y >= 0 && z >= 0 && x < long(labels.size_x()) &&
+                                      y < long(labels.size_y()) && z < long(labels.size_z());
+                        float expected = inside ? labels.at(x, y, z, 0) : 0.0f;
+                        mismatches += expected != target.at(i, j, k, 0);
+                    }
+                }
+            }
+            std::cout << "nearest mismatches vs per-voxel reference: " << mismatches << std::endl;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Fused flow statistics against one parallel pass per quantity, on the same data
+ */
+void compareFlowPasses(const std::string& label, const Volume4D& vx, const Volume4D& vy, const Volume4D& vz,
+                       const Volume4D& mag) {
+    const std::size_t nz = vx.size_z(), nt = vx.size_t();
+    const std::size_t sliceSize = vx.size_x() * vx.size_y();
+    double megabytes = 4.0 * vx.frame_size() * nt * sizeof(float) / (1024.0 * 1024.0);
+    std::cout << label << " (" << megabytes << " MB):" << std::endl;
+
+    FlowStatisticsOptions options;
+    options.mask = &mag;
+    options.maskThreshold = 100.0f;
+    auto start = Clock::now();
+    FlowStatistics fused = computeFlowStatistics(vx, vy, vz, &mag, options);
+    double seconds = secondsSince(start);
+    std::cout << "  fused pass:   " << seconds << " s, " << megabytes / seconds << " MB/s" << std::endl;
+
+    // The same results one quantity at a time, each its own pass over the data, parallel over slices like the fused pass
+    const std::size_t bins = options.histogramBins;
+    auto speedAt = [&](std::size_t t, std::size_t i) {
+        float u = vx.frame_data(t)[i], v = vy.frame_data(t)[i], w = vz.frame_data(t)[i];
+        return std::sqrt(u * u + v * v + w * w);
+    };
+    start = Clock::now();
+    std::vector<double> sliceEnergy(nz * nt, 0.0);
+    parallelFor(0, nz, [&](std::size_t k) {
+        for (std::size_t t = 0; t < nt; t++) {
+            double energy = 0.0;
+            for (std::size_t i = k * sliceSize; i < (k + 1) * sliceSize; i++) {
+                float u = vx.frame_data(t)[i], v = vy.frame_data(t)[i], w = vz.frame_data(t)[i];
+                energy += u * u + v * v + w * w;
+            }
+            sliceEnergy[k * nt + t] = energy;
+        }
+    });
+    std::vector<float> sliceMax(nz, 0.0f);
+    parallelFor(0, nz, [&](std::size_t k) {
+        for (std::size_t t = 0; t < nt; t++) {
+            for (std::size_t i = k * sliceSize; i < (k + 1) * sliceSize; i++) {
+                if (mag.frame_data(t)[i] > options.maskThreshold) {
+                    sliceMax[k] = std::max(sliceMax[k], speedAt(t, i));
+                }
+            }
+        }
+    });
+    float range = std::max(1e-30f, *std::max_element(sliceMax.begin(), sliceMax.end()));
+    std::vector<std::uint64_t> sliceHistograms(nz * bins, 0);
+    parallelFor(0, nz, [&](std::size_t k) {
+        std::uint64_t* histogram = sliceHistograms.data() + k * bins;
+        for (std::size_t t = 0; t < nt; t++) {
+            for (std::size_t i = k * sliceSize; i < (k + 1) * sliceSize; i++) {
+                if (mag.frame_data(t)[i] > options.maskThreshold) {
+                    float speed = speedAt(t, i);
+                    histogram[speed < range ? std::min(bins - 1, static_cast<std::size_t>(speed * (bins / range))) : bins - 1]++;
+                }
+            }
+        }
+    });
+    Volume4D pcmra(vx.size_x(), vx.size_y(), nz, 1), variance(vx.size_x(), vx.size_y(), nz, 1);
+    parallelFor(0, nz, [&](std::size_t k) {
+        for (std::size_t i = k * sliceSize; i < (k + 1) * sliceSize; i++) {
+            double sum = 0.0;
+            for (std::size_t t = 0; t < nt; t++) {
+                sum += mag.frame_data(t)[i] * speedAt(t, i);
+            }
+            pcmra.frame_data(0)[i] = static_cast<float>(sum / nt);
+        }
+    });
+    parallelFor(0, nz, [&](std::size_t k) {
+        for (const Volume4D* component : {&vx, &vy, &vz}) {
+            for (std::size_t i = k * sliceSize; i < (k + 1) * sliceSize; i++) {
+                double sum = 0.0, sumSquares = 0.0;
+                for (std::size_t t = 0; t < nt; t++) {
+                    sum += component->frame_data(t)[i];
+                    sumSquares += static_cast<double>(component->frame_data(t)[i]) * component->frame_data(t)[i];
+                }
+                variance.frame_data(0)[i] += static_cast<float>(std::max(0.0, sumSquares / nt - (sum / nt) * (sum / nt)));
+            }
+        }
+    });
+    seconds = secondsSince(start);
+    std::cout << "  separate:     " << seconds << " s, " << megabytes / seconds << " MB/s (5 parallel passes)" << std::endl;
+
+    double energyDifference = 0.0;
+    double scale = 0.5 * options.density * options.voxelVolume * options.velocityScale * options.velocityScale;
+    for (std::size_t t = 0; t < nt; t++) {
+        double energy = 0.0;
+        for (std::size_t k = 0; k < nz; k++) {
+            energy += sliceEnergy[k * nt + t];
+        }
+        energyDifference = std::max(energyDifference, std::abs(fused.frames[t].kineticEnergy - energy * scale) /
+                                                          std::max(1e-30, energy * scale));
+    }
+    std::size_t histogramDifference = 0;
+    for (std::size_t b = 0; b < bins; b++) {
+        std::uint64_t count = 0;
+        for (std::size_t k = 0; k < nz; k++) {
+            count += sliceHistograms[k * bins + b];
+        }
+        histogramDifference += count != fused.histogram[b];
+    }
+    std::cout << "  relative energy difference " << energyDifference << ", histogram bins differing "
+              << histogramDifference << ", speed p50/p99 " << fused.percentile(0.5) << " / "
+              << fused.percentile(0.99) << ", last bin " << 100.0f * fused.saturated_fraction() << "%" << std::endl;
+}
+
+int benchFlow(int argc, char** argv) {
+    std::size_t nx = argc > 2 ? std::stoul(argv[2]) : 160;
+    std::size_t ny = argc > 3 ? std::stoul(argv[3]) : 160;
+    std::size_t nz = argc > 4 ? std::stoul(argv[4]) : 40;
+    std::size_t nt = argc > 5 ? std::stoul(argv[5]) : 20;
+
+    Volume4D vx(nx, ny, nz, nt), vy(nx, ny, nz, nt), vz(nx, ny, nz, nt), mag(nx, ny, nz, nt);
+    mag.fill_random(0.0f, 1000.0f);
+    std::cout << "\nReducing " << nx << " x " << ny << " x " << nz << " x " << nt << " velocity and magnitude" << std::endl;
+
+    vx.fill_random(-1.0f, 1.0f);
+    vy.fill_random(-1.0f, 1.0f);
+    vz.fill_random(-1.0f, 1.0f);
+    compareFlowPasses("unit velocities", vx, vy, vz, mag);
+
+    // Magnitudes as generateVelVecField produces them: stored 12-bit phase, x 2 - 4096, x VENC / pi
+    const float PI = 3.14159265359f;
+    for (Volume4D* component : {&vx, &vy, &vz}) {
+        component->fill_random(0.0f, 4096.0f);
+        for (std::size_t t = 0; t < nt; t++) {
+            float* frame = component->frame_data(t);
+            for (std::size_t i = 0; i < component->frame_size(); i++) {
+                frame[i] = (frame[i] * 2.0f - 4096.0f) * 1.70f / PI;
+            }
+        }
+    }
+    compareFlowPasses("loader velocities", vx, vy, vz, mag);
+    return 0;
+}
+
+int benchEncode(int argc, char** argv) {
+    std::string prefix = argc > 2 ? argv[2] : "bench_frames";
+    std::size_t frameCount = argc > 3 ? std::stoul(argv[3]) : 40;
+    int width = argc > 4 ? std::stoi(argv[4]) : 1000;
+    int height = argc > 5 ? std::stoi(argv[5]) : 800;
+
+    // Binary PPM stands in for the PNG writer, which needs VTK
+    FrameWriteFn writePPM = [](const std::string& path, const CapturedFrame& frame) {
+        std::ofstream file(path, std::ios::binary);
+        file << "P6\n" << frame.width << " " << frame.height << "\n255\n";
+        for (int y = frame.height - 1; y >= 0; y--) {
+            file.write(reinterpret_cast<const char*>(frame.rgb.data()) + static_cast<std::size_t>(y) * frame.width * 3, frame.width * 3);
+        }
+        return static_cast<bool>(file);
+    };
+
+    // Smooth gradients with a moving band, roughly like rendered streamlines on a dark background
+    std::vector<CapturedFrame> frames(frameCount);
+    for (std::size_t i = 0; i < frameCount; i++) {
+        frames[i].index = i;
+        frames[i].width = width;
+        frames[i].height = height;
+        frames[i].rgb.resize(static_cast<std::size_t>(width) * height * 3);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                unsigned char* p = frames[i].rgb.data() + (static_cast<std::size_t>(y) * width + x) * 3;
+                bool band = std::abs(x - static_cast<int>((i * 20 + y / 2) % width)) < 30;
+                p[0] = band ? 230 : 25;
+                p[1] = static_cast<unsigned char>(25 + 200 * y / height);
+                p[2] = static_cast<unsigned char>(band ? 40 : 25 + 100 * x / width);
+            }
+        }
+    }
+    std::cout << "\nEncoding " << frameCount << " frames of " << width << " x " << height << " (PPM + GIF)" << std::endl;
+
+    for (std::size_t threads : {std::size_t(1), std::size_t(std::max(1u, workerThreadCount() - 1))}) {
+        FrameEncoderOptions options;
+        options.threads = threads;
+        options.gifPath = prefix + ".gif";
+        auto start = Clock::now();
+        bool ok;
+        {
+            FrameEncoder encoder(prefix, "ppm", writePPM, options);
+            for (const CapturedFrame& frame : frames) {
+                encoder.submit(frame);
+            }
+            ok = encoder.finish();
+        }
+        double seconds = secondsSince(start);
+        std::cout << threads << " encoder thread(s): " << frameCount / seconds << " frames/s"
+                  << (ok ? "" : " [errors]") << std::endl;
+    }
+    std::cout << "GIF size: " << std::filesystem::file_size(prefix + ".gif") / 1024 << " KB" << std::endl;
+    return 0;
+}
+
+int benchGraph(int argc, char** argv) {
+    std::size_t nx = argc > 2 ? std::stoul(argv[2]) : 160;
+    std::size_t ny = argc > 3 ? std::stoul(argv[3]) : 160;
+    std::size_t nz = argc > 4 ? std::stoul(argv[4]) : 40;
+    std::size_t nt = argc > 5 ? std::stoul(argv[5]) : 20;
+    std::string cacheDir = argc > 6 ? argv[6] : "bench_graph_cache";
+    std::filesystem::remove_all(cacheDir);
+
+    // Synthetic phase series stand in for the DICOM loads; VENC scaling is the per-component parameter
+    float vencs[3] = {1.70f, 1.70f, 1.70f};
+    auto build = [&](TaskGraph& graph) {
+        TaskHandle<Volume4D> components[3];
+        for (int c = 0; c < 3; c++) {
+            components[c] = graph.add<Volume4D>("velocity " + std::to_string(c), {}, hashDouble(vencs[c]),
+                std::function<Volume4D()>([&, c]() {
+                    Volume4D phase(nx, ny, nz, nt);
+                    phase.fill_random(-3.14159f, 3.14159f);
+                    return applyVENC(std::move(phase), vencs[c]);
+                }));
+        }
+        auto magnitude = graph.add<Volume4D>("magnitude", {}, 0, std::function<Volume4D()>([&]() {
+            Volume4D mag(nx, ny, nz, nt);
+            mag.fill_random(0.0f, 1000.0f);
+            return mag;
+        }));
+        return graph.add<FlowStatistics>("flow statistics", {components[0].id, components[1].id, components[2].id, magnitude.id}, 0,
+            std::function<FlowStatistics()>([&graph, components, magnitude]() {
+                FlowStatisticsOptions options;
+                options.mask = &graph.get(magnitude);
+                options.maskThreshold = 100.0f;
+                return computeFlowStatistics(graph.get(components[0]), graph.get(components[1]), graph.get(components[2]),
+                                             &graph.get(magnitude), options);
+            }));
+    };
+    std::cout << "\nPipeline of 3 velocity components, magnitude and flow statistics on " << nx << " x " << ny
+              << " x " << nz << " x " << nt << std::endl;
+
+    WorkStealingPool& pool = WorkStealingPool::shared();
+    {
+        TaskGraph graph(pool, cacheDir);
+        auto statistics = build(graph);
+        auto start = Clock::now();
+        graph.run();
+        std::cout << "cold run:            " << secondsSince(start) << " s" << std::endl;
+
+        start = Clock::now();
+        graph.run();
+        std::cout << "unchanged rerun:     " << secondsSince(start) << " s" << std::endl;
+
+        vencs[1] = 1.50f;
+        graph.set_parameters(1, hashDouble(vencs[1]));
+        start = Clock::now();
+        graph.run();
+        std::cout << "one VENC changed:    " << secondsSince(start) << " s" << std::endl;
+        graph.print_report();
+        std::cout << "speed p99 " << graph.get(statistics).percentile(0.99) << std::endl;
+    }
+    {
+        // A new process would start here: volumes come from the cache folder
+        TaskGraph graph(pool, cacheDir);
+        build(graph);
+        auto start = Clock::now();
+        graph.run();
+        std::cout << "fresh graph, cached: " << secondsSince(start) << " s" << std::endl;
+        graph.print_report();
+    }
+    std::filesystem::remove_all(cacheDir);
+    return 0;
+}
+
+
+/**
+ * Advance lines through a field with midpoint steps of a fixed length in that field's voxels
+ *
+ * @param xyz Seed positions in the field's voxel coordinates; receives the end points
+ * @return Number of velocity samples taken
+ */
+std::size_t traceLines(const VelocitySampler& sampler, std::vector<float>& xyz, std::size_t steps, float stepLength) {
+    std::size_t n = xyz.size() / 3;
+    std::vector<float> mid(3 * n), velocity(3 * n);
+    auto advance = [&](const std::vector<float>& from, std::vector<float>& to, float length) {
+        for (std::size_t i = 0; i < n; i++) {
+            const float* v = &velocity[3 * i];
+            float speed = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            float scale = speed > 0.0f ? length / speed : 0.0f;
+            for (int c = 0; c < 3; c++) {
+                to[3 * i + c] = from[3 * i + c] + scale * v[c];
+            }
+        }
+    };
+    for (std::size_t s = 0; s < steps; s++) {
+        sampler.sample_frame(xyz.data(), n, velocity.data(), 0);
+        advance(xyz, mid, 0.5f * stepLength);
+        sampler.sample_frame(mid.data(), n, velocity.data(), 0);
+        advance(xyz, xyz, stepLength);
+    }
+    return 2 * steps * n;
+}
+
+int benchPyramid(int argc, char** argv) {
+    std::size_t nx = argc > 2 ? std::stoul(argv[2]) : 160;
+    std::size_t ny = argc > 3 ? std::stoul(argv[3]) : 160;
+    std::size_t nz = argc > 4 ? std::stoul(argv[4]) : 40;
+    std::size_t nt = argc > 5 ? std::stoul(argv[5]) : 20;
+    std::size_t seeds = argc > 6 ? std::stoul(argv[6]) : 4096;
+    std::size_t previewLevel = argc > 7 ? std::stoul(argv[7]) : 2;
+
+    // Swirl around the z axis with a through-plane component and noise, inside a cylindrical "vessel"
+    Volume4D vx(nx, ny, nz, nt), vy(nx, ny, nz, nt), vz(nx, ny, nz, nt), magnitude(nx, ny, nz, 1);
+    vx.fill_random(-5.0f, 5.0f);
+    vy.fill_random(-5.0f, 5.0f);
+    vz.fill_random(-5.0f, 5.0f);
+    float cx = 0.5f * nx, cy = 0.5f * ny, radius = 0.45f * std::min(nx, ny);
+    for (std::size_t z = 0; z < nz; z++) {
+        for (std::size_t y = 0; y < ny; y++) {
+            for (std::size_t x = 0; x < nx; x++) {
+                float dx = x - cx, dy = y - cy;
+                magnitude.at(x, y, z, 0) = dx * dx + dy * dy < radius * radius ? 1000.0f : 10.0f;
+                for (std::size_t t = 0; t < nt; t++) {
+                    vx.at(x, y, z, t) += -100.0f * dy / radius;
+                    vy.at(x, y, z, t) += 100.0f * dx / radius;
+                    vz.at(x, y, z, t) += 30.0f;
+                }
+            }
+        }
+    }
+    std::cout << "\nPyramid of 3 x " << nx << " x " << ny << " x " << nz << " x " << nt
+              << ", preview level " << previewLevel << ", " << seeds << " seeds" << std::endl;
+
+    auto start = Clock::now();
+    VolumePyramid pyramid(previewLevel, &magnitude, 100.0f);
+    pyramid.add_component(vx);
+    pyramid.add_component(vy);
+    pyramid.add_component(vz);
+    pyramid.wait();
+    std::cout << "build: " << secondsSince(start) << " s" << std::endl;
+
+    // The same levels built as loading graph stages, each component's depending only on it and the coverage
+    start = Clock::now();
+    TaskGraph graph(WorkStealingPool::shared());
+    auto coverageNode = graph.add<std::vector<Volume4D>>("pyramid coverage", {}, 0,
+        std::function<std::vector<Volume4D>()>([&]() { return buildCoverageLevels(magnitude, 100.0f, previewLevel); }));
+    const Volume4D* components[3] = {&vx, &vy, &vz};
+    TaskHandle<std::vector<Volume4D>> levelNodes[3];
+    for (int c = 0; c < 3; c++) {
+        levelNodes[c] = graph.add<std::vector<Volume4D>>("pyramid " + std::to_string(c), {coverageNode.id}, 0,
+            std::function<std::vector<Volume4D>()>([&, c]() {
+                return buildPyramidLevels(*components[c], &graph.get(coverageNode), previewLevel);
+            }));
+    }
+    graph.run();
+    VolumePyramid staged(previewLevel, &graph.get(coverageNode));
+    float stagedDifference = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        staged.add_component(*components[c], graph.get(levelNodes[c]));
+        const Volume4D& a = staged.component(previewLevel, c);
+        const Volume4D& b = pyramid.component(previewLevel, c);
+        for (std::size_t t = 0; t < a.size_t(); t++) {
+            for (std::size_t i = 0; i < a.frame_size(); i++) {
+                stagedDifference = std::max(stagedDifference, std::abs(a.frame_data(t)[i] - b.frame_data(t)[i]));
+            }
+        }
+    }
+    std::cout << "graph stages: " << secondsSince(start) << " s, max difference " << stagedDifference << std::endl;
+
+    // The same seeds traced over the same physical length (half the grid width) on both levels,
+    // with steps of half a voxel of the traced level, as vtkStreamTracer steps in cell lengths
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> ux(0.25f * nx, 0.75f * nx), uy(0.25f * ny, 0.75f * ny), uz(0.0f, nz - 1.0f);
+    std::vector<float> seedPoints(3 * seeds);
+    for (std::size_t i = 0; i < seeds; i++) {
+        seedPoints[3 * i] = ux(gen);
+        seedPoints[3 * i + 1] = uy(gen);
+        seedPoints[3 * i + 2] = uz(gen);
+    }
+    const float length = 0.5f * nx;
+
+    std::vector<float> full = seedPoints;
+    VelocitySampler fullSampler(vx, vy, vz);
+    start = Clock::now();
+    std::size_t fullSamples = traceLines(fullSampler, full, static_cast<std::size_t>(length / 0.5f), 0.5f);
+    double fullSeconds = secondsSince(start);
+
+    float factor = static_cast<float>(pyramid.factor(previewLevel));
+    std::vector<float> preview(3 * seeds);
+    for (std::size_t i = 0; i < preview.size(); i++) {
+        preview[i] = (seedPoints[i] + 0.5f) / factor - 0.5f;   // Voxel centers of the coarse grid
+    }
+    VelocitySampler previewSampler(pyramid.component(previewLevel, 0), pyramid.component(previewLevel, 1),
+                                   pyramid.component(previewLevel, 2));
+    start = Clock::now();
+    std::size_t previewSamples = traceLines(previewSampler, preview, static_cast<std::size_t>(length / factor / 0.5f), 0.5f);
+    double previewSeconds = secondsSince(start);
+
+    // End points of the preview lines back in full-resolution voxels
+    double distance = 0.0;
+    for (std::size_t i = 0; i < seeds; i++) {
+        double squared = 0.0;
+        for (int c = 0; c < 3; c++) {
+            double d = (preview[3 * i + c] + 0.5) * factor - 0.5 - full[3 * i + c];
+            squared += d * d;
+        }
+        distance += std::sqrt(squared);
+    }
+
+    std::cout << "full resolution: " << fullSeconds << " s, " << fullSamples << " samples" << std::endl;
+    std::cout << "preview:         " << previewSeconds << " s, " << previewSamples << " samples, "
+              << fullSeconds / previewSeconds << "x faster" << std::endl;
+    std::cout << "mean end point distance: " << distance / seeds << " voxels over lines of " << length << std::endl;
+    return 0;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "";
+
+    if (mode == "io") {
+        return benchIO(argc, argv);
+    }
+    if (mode == "sample") {
+        return benchSample(argc, argv);
+    }
+    if (mode == "temporal") {
+        return benchTemporal(argc, argv);
+    }
+    if (mode == "export") {
+        return benchExport(argc, argv);
+    }
+    if (mode == "slab") {
+        return benchSlab(argc, argv);
+    }
+    if (mode == "resample") {
+        return benchResample(argc, argv);
+    }
+    if (mode == "flow") {
+        return benchFlow(argc, argv);
+    }
+    if (mode == "encode") {
+        return benchEncode(argc, argv);
+    }
+    if (mode == "graph") {
+        return benchGraph(argc, argv);
+    }
+    if (mode == "pyramid") {
+        return benchPyramid(argc, argv);
+    }
+
+    std::cerr << "Usage: bench <mode> [args]" << std::endl;
+    std::cerr << "  io <dicom_folder> [latency_ms] [MB/s]   DICOM read/parse/convert pipeline vs serial" << std::endl;
+    std::cerr << "  sample [nx ny nz nt n]                  Velocity sampling throughput" << std::endl;
+    std::cerr << "  temporal [nx ny nz nt upsample]         Temporal frame synthesis throughput" << std::endl;
+    std::cerr << "  export [prefix lines points_per_line]   Streamline binary/VTP write throughput" << std::endl;
+    std::cerr << "  slab [nx ny nz nt depth prefix]         Slab-streamed vs whole-volume velocity stages" << std::endl;
+    std::cerr << "  slab <x_dir> <y_dir> <z_dir> [depth prefix]  Same on three DICOM phase folders" << std::endl;
+    std::cerr << "  resample [nx ny nz repeats]             Oblique label mask onto the velocity grid" << std::endl;
+    std::cerr << "  flow [nx ny nz nt]                      Fused hemodynamic reductions vs parallel separate passes" << std::endl;
+    std::cerr << "  encode [prefix frames width height]     Frame sequence + GIF encoder pool throughput" << std::endl;
+    std::cerr << "  graph [nx ny nz nt cache_dir]           Memoized pipeline stages: cold, rerun, one change, cached" << std::endl;
+    std::cerr << "  pyramid [nx ny nz nt seeds level]       Pyramid build and coarse preview tracing vs full resolution" << std::endl;
+    return 1;
+}
@@ -0,0 +1,274 @@
+#include "dicom_pipeline.h"
+#include "dicom_utils.h"
+#include "BoundedQueue.h"
+#include "MemoryManager.h"
+#include "parallel_utils.h"
+#include <dcmtk/dcmimgle/dcmimage.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcistrmb.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DICOM_PIPELINE_POSIX_IO 1
+#endif
+
+bool readWholeFile(const std::string& path, std::vector<char>& buffer) {
+#ifdef DICOM_PIPELINE_POSIX_IO
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    std::size_t size = static_cast<std::size_t>(info.st_size);
+    buffer.resize(size);
+
+    // One large read per file instead of DCMTK's many small element reads
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::read(fd, buffer.data() + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;   // Interrupted by a signal before any data arrived
+        }
+        if (n <= 0) {
+            ::close(fd);
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    ::close(fd);
+    return true;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    buffer.resize(static_cast<std::size_t>(size));
+    return static_cast<bool>(file.read(buffer.data(), size));
+#endif
+}
+
+void prefetchFileHint(const std::string& path) {
+#ifdef DICOM_PIPELINE_POSIX_IO
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+#if defined(POSIX_FADV_WILLNEED)
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+    struct stat info;
+    if (::fstat(fd, &info) == 0) {
+        struct radvisory advice;
+        advice.ra_offset = 0;
+        advice.ra_count = static_cast<int>(info.st_size);
+        ::fcntl(fd, F_RDADVISE, &advice);
+    }
+#endif
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
+
+bool parseDicomBuffer(const char* data, std::size_t size, DcmFileFormat& fileformat) {
+    DcmInputBufferStream stream;
+    stream.setBuffer(data, static_cast<offile_off_t>(size));
+    stream.setEos();
+
+    fileformat.transferInit();
+    OFCondition status = fileformat.read(stream);
+    fileformat.transferEnd();
+    return status.good();
+}
+
+namespace {
+
+struct FileBuffer {
+    std::size_t index = 0;
+    PooledBuffer bytes;
+};
+
+struct ParsedFile {
+    std::size_t index = 0;
+    std::unique_ptr<DcmFileFormat> fileformat;
+};
+
+std::mutex decodeThreadsMutex;
+std::size_t decodeThreadsInUse = 0; // Parser and converter threads of the loads in flight
+
+/**
+ * Parser and converter threads of one load, counted against the hardware threads
+ *
+ * A stage left at its default gets half the hardware threads when it loads alone, but only
+ * what the loads already running leave over (at least one), so the stages of a loading
+ * graph that decode several series at once do not each start a full set of threads.
+ */
+class DecodeThreads {
+public:
+    DecodeThreads(std::size_t parserRequest, std::size_t converterRequest) {
+        std::lock_guard<std::mutex> lock(decodeThreadsMutex);
+        std::size_t total = workerThreadCount();
+        std::size_t share = (total > decodeThreadsInUse ? total - decodeThreadsInUse : 0) / 2;
+        std::size_t fallback = std::max<std::size_t>(1, std::min<std::size_t>(total / 2, share));
+        parsers = parserRequest > 0 ? parserRequest : fallback;
+        converters = converterRequest > 0 ? converterRequest : fallback;
+        decodeThreadsInUse += parsers + converters;
+    }
+
+    ~DecodeThreads() {
+        std::lock_guard<std::mutex> lock(decodeThreadsMutex);
+        decodeThreadsInUse -= parsers + converters;
+    }
+
+    DecodeThreads(const DecodeThreads&) = delete;
+    DecodeThreads& operator=(const DecodeThreads&) = delete;
+
+    std::size_t parsers = 1;
+    std::size_t converters = 1;
+};
+
+} // namespace
+
+bool loadDicomFilesPipelined(const std::vector<std::string>& filePaths, Volume4D& volume,
+                             const DicomPipelineOptions& options) {
+    if (filePaths.empty() || volume.size_z() == 0) {
+        return false;
+    }
+
+    FileReadFn readFile = options.readFile ? options.readFile : FileReadFn(readWholeFile);
+    std::size_t depth = std::max<std::size_t>(1, options.queueDepth);
+    std::size_t readers = std::max<std::size_t>(1, options.readerThreads);
+    DecodeThreads decodeThreads(options.parserThreads, options.converterThreads);
+    std::size_t parsers = decodeThreads.parsers;
+    std::size_t converters = decodeThreads.converters;
+
+    // Buffers cycle reader -> parser -> pool, so at most `depth` files are held in memory.
+    // They are borrowed from the shared pool, so later loads reuse their capacity.
+    BoundedQueue<PooledBuffer> bufferPool(depth);
+    for (std::size_t i = 0; i < depth; i++) {
+        bufferPool.push(BufferPool::shared().acquire());
+    }
+    BoundedQueue<FileBuffer> readQueue(depth);
+    BoundedQueue<ParsedFile> parseQueue(depth);
+
+    std::atomic<std::size_t> nextFile{0};
+    std::atomic<std::size_t> activeReaders{readers};
+    std::atomic<std::size_t> activeParsers{parsers};
+    std::atomic<std::size_t> failures{0};
+
+    std::vector<std::thread> threads;
+
+    // Stage 1: whole-file reads into pooled buffers, with readahead hints for upcoming files
+    for (std::size_t r = 0; r < readers; r++) {
+        threads.emplace_back([&]() {
+            std::size_t i;
+            while ((i = nextFile.fetch_add(1)) < filePaths.size()) {
+                if (options.readahead > 0 && i + options.readahead < filePaths.size()) {
+                    prefetchFileHint(filePaths[i + options.readahead]);
+                }
+
+                FileBuffer item;
+                item.index = i;
+                if (!bufferPool.pop(item.bytes)) {
+                    break;
+                }
+                // Charge the file size before the read grows the buffer
+                std::error_code sizeError;
+                std::uintmax_t fileSize = std::filesystem::file_size(filePaths[i], sizeError);
+                if (!sizeError && !item.bytes.reserve_capacity(static_cast<std::size_t>(fileSize))) {
+                    std::cerr << "Error: Memory budget exceeded reading file: " << filePaths[i] << std::endl;
+                    failures++;
+                    bufferPool.push(std::move(item.bytes));
+                    continue;
+                }
+                if (!readFile(filePaths[i], item.bytes.bytes())) {
+                    std::cerr << "Error: Could not read file: " << filePaths[i] << std::endl;
+                    failures++;
+                    bufferPool.push(std::move(item.bytes));
+                    continue;
+                }
+                readQueue.push(std::move(item));
+            }
+            if (--activeReaders == 0) {
+                readQueue.close();
+            }
+        });
+    }
+
+    // Stage 2: parse datasets from memory and hand the buffer back to the pool
+    for (std::size_t p = 0; p < parsers; p++) {
+        threads.emplace_back([&]() {
+            FileBuffer item;
+            while (readQueue.pop(item)) {
+                ParsedFile parsed;
+                parsed.index = item.index;
+                parsed.fileformat = std::make_unique<DcmFileFormat>();
+                const std::vector<char>& bytes = item.bytes.bytes();
+                bool ok = parseDicomBuffer(bytes.data(), bytes.size(), *parsed.fileformat);
+                bufferPool.push(std::move(item.bytes));
+
+                if (!ok) {
+                    std::cerr << "Error: Could not parse DICOM file: " << filePaths[item.index] << std::endl;
+                    failures++;
+                    continue;
+                }
+                parseQueue.push(std::move(parsed));
+            }
+            if (--activeParsers == 0) {
+                parseQueue.close();
+            }
+        });
+    }
+
+    // Stage 3: render pixels and copy them into the file's (z, t) slice
+    for (std::size_t c = 0; c < converters; c++) {
+        threads.emplace_back([&]() {
+            ParsedFile parsed;
+            while (parseQueue.pop(parsed)) {
+                std::size_t z = parsed.index % volume.size_z();
+                std::size_t t = parsed.index / volume.size_z();
+                if (t >= volume.size_t()) {
+                    std::cerr << "Warning: Extra DICOM file ignored: " << filePaths[parsed.index] << std::endl;
+                    continue;
+                }
+
+                DcmFileFormat* fileformat = parsed.fileformat.get();
+                DicomImage image(fileformat, fileformat->getDataset()->getOriginalXfer());
+                if (image.getStatus() != EIS_Normal || !copyDicomImageToVolume(&image, volume, z, t)) {
+                    std::cerr << "Error: Could not decode DICOM file: " << filePaths[parsed.index] << std::endl;
+                    failures++;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return failures == 0;
+}
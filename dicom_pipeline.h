@@ -0,0 +1,70 @@
+#ifndef DICOM_PIPELINE_H
+#define DICOM_PIPELINE_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Volume4D.h"
+
+class DcmFileFormat;
+
+/**
+ * Reads a whole file into a buffer; returns false on failure
+ */
+using FileReadFn = std::function<bool(const std::string& path, std::vector<char>& buffer)>;
+
+/**
+ * Settings for the read -> parse -> convert DICOM pipeline
+ */
+struct DicomPipelineOptions {
+    std::size_t readerThreads = 2;    // I/O stage
+    std::size_t parserThreads = 0;    // 0 = half the hardware threads, less those of concurrent loads
+    std::size_t converterThreads = 0; // 0 = half the hardware threads, less those of concurrent loads
+    std::size_t queueDepth = 16;      // Capacity of each queue and number of pooled file buffers
+    std::size_t readahead = 8;        // Files ahead of the reader to hint to the OS
+    FileReadFn readFile;              // Defaults to readWholeFile
+};
+
+/**
+ * Read an entire file into a buffer with large sequential reads and a sequential-access hint
+ *
+ * @param path File to read
+ * @param buffer Receives the file contents (capacity is reused)
+ * @return true if the whole file was read
+ */
+bool readWholeFile(const std::string& path, std::vector<char>& buffer);
+
+/**
+ * Ask the OS to start reading a file into the page cache without waiting for it
+ *
+ * @param path File that will be read soon
+ */
+void prefetchFileHint(const std::string& path);
+
+/**
+ * Parse a DICOM file held in memory using DCMTK's buffer input stream
+ *
+ * @param data File contents (including preamble / meta header)
+ * @param size Number of bytes in data
+ * @param fileformat Receives the parsed file; pixel data is copied, so data can be reused afterwards
+ * @return true if parsing succeeded
+ */
+bool parseDicomBuffer(const char* data, std::size_t size, DcmFileFormat& fileformat);
+
+/**
+ * Load single-frame DICOM slice files into a volume through a bounded three-stage pipeline
+ *
+ * Reader threads pull whole files into pooled buffers, parser threads build datasets from
+ * those buffers in memory, and converter threads render the pixels into the volume. The
+ * stages are joined by bounded queues so I/O overlaps decoding with bounded memory.
+ *
+ * @param filePaths Slice files in acquisition order; file i goes to z = i % size_z(), t = i / size_z()
+ * @param volume Volume already sized to hold every slice
+ * @param options Thread counts, queue depth and file reader
+ * @return true if every file was loaded
+ */
+bool loadDicomFilesPipelined(const std::vector<std::string>& filePaths, Volume4D& volume,
+                             const DicomPipelineOptions& options = DicomPipelineOptions());
+
+#endif // DICOM_PIPELINE_H
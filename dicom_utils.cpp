@@ -5,10 +5,15 @@
 #include <dcmtk/dcmdata/dcfilefo.h>
 #include <dcmtk/dcmdata/dcdeftag.h>
 #include <dcmtk/dcmdata/dcuid.h>
+#include <dcmtk/dcmdata/dcsequen.h>
+#include "parallel_utils.h"
+#include "dicom_pipeline.h"
 #include <iostream>
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <algorithm>
+#include <cmath>
 
 /**
  * Read DICOM file and return pixel values as a Volume4D slice
@@ -40,92 +45,152 @@ Volume4D readDicomToVolume4D(const std::string& filepath) {
 
         volume.resize(width, height, 1, 1);
         
-        // Get pixel data
-        const void* pixelData = image->getOutputData(depth);
-        if (pixelData == nullptr) {
-            std::cerr << "Error: Could not get pixel data from DICOM file" << std::endl;
+        if (!copyDicomImageToVolume(image, volume, 0, 0)) {
             delete image;
             return volume;
         }
         
-        // Convert pixel data based on bit depth and store in Volume4D
-        // Handle non-standard bit depths by treating them as 16-bit
-        int effectiveDepth = depth;
-        if (depth != 8 && depth != 16 && depth != 32) {
-            //std::cout << "Note: Converting non-standard bit depth " << depth << " to 16-bit" << std::endl;
-            effectiveDepth = 16;
-        }
+        delete image;
         
-        switch (effectiveDepth) {
-            case 8: {
-                const Uint8* data = static_cast<const Uint8*>(pixelData);
-                for (int y = 0; y < height; y++) {
-                    for (int x = 0; x < width; x++) {
-                        int index = y * width + x;
-                        volume.at(x, y, 0, 0) = static_cast<float>(data[index]);
-                    }
-                }
-                break;
-            }
-            case 16: {
-                const Uint16* data = static_cast<const Uint16*>(pixelData);
-                for (int y = 0; y < height; y++) {
-                    for (int x = 0; x < width; x++) {
-                        int index = y * width + x;
-                        volume.at(x, y, 0, 0) = static_cast<float>(data[index]);
-                    }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception while reading DICOM file: " << e.what() << std::endl;
+    }
+    
+    return volume;
+}
+
+bool copyDicomImageToVolume(DicomImage* image, Volume4D& volume, std::size_t z, std::size_t t) {
+    int width = image->getWidth();
+    int height = image->getHeight();
+    int depth = image->getDepth();
+
+    if (static_cast<std::size_t>(width) != volume.size_x() || static_cast<std::size_t>(height) != volume.size_y()) {
+        std::cerr << "Error: DICOM image size " << width << " x " << height << " does not match volume" << std::endl;
+        return false;
+    }
+    
+    // Get pixel data
+    const void* pixelData = image->getOutputData(depth);
+    if (pixelData == nullptr) {
+        std::cerr << "Error: Could not get pixel data from DICOM file" << std::endl;
+        return false;
+    }
+    
+    // Convert pixel data based on bit depth and store in Volume4D
+    // Handle non-standard bit depths by treating them as 16-bit
+    int effectiveDepth = depth;
+    if (depth != 8 && depth != 16 && depth != 32) {
+        //std::cout << "Note: Converting non-standard bit depth " << depth << " to 16-bit" << std::endl;
+        effectiveDepth = 16;
+    }
+    
+    switch (effectiveDepth) {
+        case 8: {
+            const Uint8* data = static_cast<const Uint8*>(pixelData);
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    int index = y * width + x;
+                    volume.at(x, y, z, t) = static_cast<float>(data[index]);
                 }
-                break;
             }
-            case 32: {
-                const Uint32* data = static_cast<const Uint32*>(pixelData);
-                for (int y = 0; y < height; y++) {
-                    for (int x = 0; x < width; x++) {
-                        int index = y * width + x;
-                        volume.at(x, y, 0, 0) = static_cast<float>(data[index]);
-                    }
+            break;
+        }
+        case 16: {
+            const Uint16* data = static_cast<const Uint16*>(pixelData);
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    int index = y * width + x;
+                    volume.at(x, y, z, t) = static_cast<float>(data[index]);
                 }
-                break;
             }
-            default:
-                std::cerr << "Error: Unsupported bit depth: " << depth << std::endl;
-                delete image;
-                return volume;
+            break;
         }
-        
-        // Print some statistics
-        if (!volume.empty()) {
-            float min_val = volume.at(0, 0, 0, 0);
-            float max_val = volume.at(0, 0, 0, 0);
-            float sum = 0.0f;
-            int count = 0;
-            
-            for (std::size_t x = 0; x < volume.size_x(); x++) {
-                for (std::size_t y = 0; y < volume.size_y(); y++) {
-                    float val = volume.at(x, y, 0, 0);
-                    min_val = std::min(min_val, val);
-                    max_val = std::max(max_val, val);
-                    sum += val;
-                    count++;
+        case 32: {
+            const Uint32* data = static_cast<const Uint32*>(pixelData);
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    int index = y * width + x;
+                    volume.at(x, y, z, t) = static_cast<float>(data[index]);
                 }
             }
-            float mean = sum / count;
-            
-            //std::cout << "✓ Successfully read " << count << " pixel values into Volume4D" << std::endl;
-            //std::cout << "Min: " << min_val << ", Max: " << max_val << ", Mean: " << mean << std::endl;
+            break;
         }
-        
-        delete image;
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Exception while reading DICOM file: " << e.what() << std::endl;
+        default:
+            std::cerr << "Error: Unsupported bit depth: " << depth << std::endl;
+            return false;
     }
-    
-    return volume;
+    return true;
+}
+
+/**
+ * Read the image plane attributes of one single-frame DICOM file
+ * 
+ * @param filepath Path to the DICOM file
+ * @param position Receives ImagePositionPatient
+ * @param orientation Receives ImageOrientationPatient (row direction, then column direction)
+ * @param pixelSpacing Receives PixelSpacing (between rows, then between columns)
+ * @param sliceSpacing Receives SpacingBetweenSlices, or SliceThickness if absent (0 if neither)
+ * @return true if the file has a position and orientation
+ */
+static bool readPlaneGeometry(const std::string& filepath, double position[3], double orientation[6],
+                              double pixelSpacing[2], double& sliceSpacing) {
+    // The plane attributes precede the pixel data, so the pixels are never read
+    DcmFileFormat fileformat;
+    if (fileformat.loadFileUntilTag(filepath.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength,
+                                    ERM_autoDetect, DCM_PixelData).bad()) {
+        return false;
+    }
+    DcmDataset* dataset = fileformat.getDataset();
+
+    bool found = true;
+    for (int i = 0; i < 3; i++) {
+        found = dataset->findAndGetFloat64(DCM_ImagePositionPatient, position[i], i).good() && found;
+    }
+    for (int i = 0; i < 6; i++) {
+        found = dataset->findAndGetFloat64(DCM_ImageOrientationPatient, orientation[i], i).good() && found;
+    }
+    pixelSpacing[0] = pixelSpacing[1] = 1.0;
+    for (int i = 0; i < 2; i++) {
+        dataset->findAndGetFloat64(DCM_PixelSpacing, pixelSpacing[i], i);
+    }
+    sliceSpacing = 0.0;
+    if (dataset->findAndGetFloat64(DCM_SpacingBetweenSlices, sliceSpacing).bad()) {
+        dataset->findAndGetFloat64(DCM_SliceThickness, sliceSpacing);
+    }
+    return found;
+}
+
+/**
+ * Place a single-frame series from the plane attributes of the first and last slice of its first frame
+ * 
+ * @param dicomFolderPath Folder of the series (for messages)
+ * @param dicomFilePaths Sorted files of the series; file i is slice i % zLength of frame i / zLength
+ * @param zLength Slices per frame
+ * @param geometry Receives the placement (voxel coordinates if the attributes are missing)
+ * @return true if the slices had plane attributes
+ */
+static bool readSeriesGeometry(const std::string& dicomFolderPath, const std::vector<std::string>& dicomFilePaths,
+                               int zLength, VolumeGeometry& geometry) {
+    double first[3], last[3], orientation[6], pixelSpacing[2], sliceSpacing;
+    if (zLength > 0 && dicomFilePaths.size() >= static_cast<std::size_t>(zLength) &&
+        readPlaneGeometry(dicomFilePaths.front(), first, orientation, pixelSpacing, sliceSpacing) &&
+        readPlaneGeometry(dicomFilePaths[zLength - 1], last, orientation, pixelSpacing, sliceSpacing)) {
+        geometry = VolumeGeometry::from_slices(first, last, orientation, pixelSpacing, zLength, sliceSpacing);
+        return true;
+    }
+    std::cout << "Warning: No image plane attributes in " << dicomFolderPath << ", using voxel coordinates" << std::endl;
+    geometry = VolumeGeometry();
+    return false;
 }
 
-Volume4D DicomFolderToVolume4D(const std::string& dicomFolderPath) {
+Volume4D DicomFolderToVolume4D(const std::string& dicomFolderPath, VolumeGeometry* geometry) {
+    // A single file is an Enhanced multi-frame object holding every slice and phase
+    if (std::filesystem::is_regular_file(dicomFolderPath)) {
+        return EnhancedDicomToVolume4D(dicomFolderPath, false, nullptr, geometry, "MAGNITUDE");
+    }
+
     Volume4D volume;
+    volume.set_category(MemoryCategory::Raw);
     // Get filepaths for all files in dicomFolderPath
     std::vector<std::string> dicomFilePaths;
 
@@ -133,7 +198,12 @@ Volume4D DicomFolderToVolume4D(const std::string& dicomFolderPath) {
 
     int slices = dimensions[2]*dimensions[3];
 
-    volume.resize(dimensions[0], dimensions[1], dimensions[2], dimensions[3]);
+    try {
+        volume.resize(dimensions[0], dimensions[1], dimensions[2], dimensions[3]);
+    } catch (const MemoryBudgetError& e) {
+        std::cerr << "Error: Cannot load " << dicomFolderPath << ": " << e.what() << std::endl;
+        return Volume4D();
+    }
     
     // First, collect all file paths
     for (const auto& entry : std::filesystem::directory_iterator(dicomFolderPath)) {
@@ -146,29 +216,443 @@ Volume4D DicomFolderToVolume4D(const std::string& dicomFolderPath) {
     std::sort(dicomFilePaths.begin(), dicomFilePaths.end());
     
     
-    // Now iterate through the sorted paths
-    int t = 0;
-    int z = 0;
-    for (size_t i = 0; i < dicomFilePaths.size(); i++) {
-
-        //std::cout << "i: " << i << std::endl;
-        //std::cout << "Filepath: " << dicomFilePaths[i] << std::endl;
-        Volume4D slice = readDicomToVolume4D(dicomFilePaths[i]);
-        
-        for (int x = 0; x < dimensions[0]; x++) {
-            for (int y = 0; y < dimensions[1]; y++) {
-                volume.at(x, y, z, t) = slice.at(x, y, 0, 0);
+    // Read, parse and convert the sorted files through the prefetch pipeline
+    if (!loadDicomFilesPipelined(dicomFilePaths, volume)) {
+        std::cerr << "Error: Failed to load some DICOM files from " << dicomFolderPath << std::endl;
+    }
+
+    if (geometry != nullptr) {
+        readSeriesGeometry(dicomFolderPath, dicomFilePaths, dimensions[2], *geometry);
+    }
+
+    //std::cout << "Slices: " << slices << std::endl;
+    return volume;
+}
+
+/**
+ * Find a functional group macro for a frame, looking in the per-frame item first and then
+ * in the shared functional groups
+ * 
+ * @param perFrame Item of PerFrameFunctionalGroupsSequence for the frame (may be null)
+ * @param shared Item of SharedFunctionalGroupsSequence (may be null)
+ * @param sequenceTag Functional group sequence to look up (e.g. PlanePositionSequence)
+ * @return First item of the functional group sequence, or nullptr if absent
+ */
+static DcmItem* findFunctionalGroup(DcmItem* perFrame, DcmItem* shared, const DcmTagKey& sequenceTag) {
+    DcmItem* group = nullptr;
+    if (perFrame != nullptr && perFrame->findAndGetSequenceItem(sequenceTag, group, 0).good() && group != nullptr) {
+        return group;
+    }
+    group = nullptr;
+    if (shared != nullptr && shared->findAndGetSequenceItem(sequenceTag, group, 0).good() && group != nullptr) {
+        return group;
+    }
+    return nullptr;
+}
+
+/**
+ * Map sorted unique values to indices, merging values closer than tolerance
+ * 
+ * @param values Value for each frame
+ * @param tolerance Values closer than this are treated as equal
+ * @param indices Output index for each frame
+ * @return Number of distinct values
+ */
+static std::size_t assignSortedIndices(const std::vector<double>& values, double tolerance, std::vector<std::size_t>& indices) {
+    std::vector<double> unique = values;
+    std::sort(unique.begin(), unique.end());
+    std::vector<double> levels;
+    for (double v : unique) {
+        if (levels.empty() || v - levels.back() > tolerance) {
+            levels.push_back(v);
+        }
+    }
+
+    indices.resize(values.size());
+    for (std::size_t i = 0; i < values.size(); i++) {
+        auto it = std::lower_bound(levels.begin(), levels.end(), values[i] - tolerance);
+        indices[i] = static_cast<std::size_t>(it - levels.begin());
+    }
+    return levels.size();
+}
+
+namespace {
+
+/**
+ * Frame layout of an Enhanced multi-frame object, from its attributes and functional groups
+ */
+struct EnhancedLayout {
+    Uint16 rows = 0, cols = 0, bitsAllocated = 0, pixelRepresentation = 0;
+    std::size_t frameCount = 0;             // Frames in the object
+    std::size_t zLength = 0, tLength = 0;
+    std::vector<EnhancedFrameInfo> frames;  // Frames of the selected image type, with z and t assigned
+    VolumeGeometry geometry;
+    bool triggerTimes = true;               // Every frame had a trigger delay (else t orders temporal position indices)
+};
+
+} // namespace
+
+/**
+ * Parse the functional groups of an Enhanced multi-frame dataset once for all frames
+ *
+ * Only attributes before the pixel data are used, so the dataset may be loaded up to PixelData.
+ *
+ * @param dataset Dataset of the object
+ * @param filepath File of the object (for messages)
+ * @param imageType Image type to keep from a mixed object
+ * @param layout Receives sizes, frames and placement
+ * @return false if the object is not a supported multi-frame image or its frames do not fill the grid
+ */
+static bool parseEnhancedLayout(DcmDataset* dataset, const std::string& filepath, const std::string& imageType,
+                                EnhancedLayout& layout) {
+    Sint32 numberOfFrames = 0;
+    dataset->findAndGetUint16(DCM_Rows, layout.rows);
+    dataset->findAndGetUint16(DCM_Columns, layout.cols);
+    dataset->findAndGetUint16(DCM_BitsAllocated, layout.bitsAllocated);
+    dataset->findAndGetUint16(DCM_PixelRepresentation, layout.pixelRepresentation);
+    dataset->findAndGetSint32(DCM_NumberOfFrames, numberOfFrames);
+
+    if (layout.rows == 0 || layout.cols == 0 || numberOfFrames <= 0) {
+        std::cerr << "Error: Not a multi-frame image: " << filepath << std::endl;
+        return false;
+    }
+    if (layout.bitsAllocated != 8 && layout.bitsAllocated != 16) {
+        std::cerr << "Error: Unsupported BitsAllocated: " << layout.bitsAllocated << std::endl;
+        return false;
+    }
+
+    DcmItem* shared = nullptr;
+    dataset->findAndGetSequenceItem(DCM_SharedFunctionalGroupsSequence, shared, 0);
+    DcmSequenceOfItems* perFrameSeq = nullptr;
+    dataset->findAndGetSequence(DCM_PerFrameFunctionalGroupsSequence, perFrameSeq);
+
+    std::size_t frameCount = static_cast<std::size_t>(numberOfFrames);
+    layout.frameCount = frameCount;
+    if (perFrameSeq == nullptr || perFrameSeq->card() < frameCount) {
+        std::cerr << "Error: PerFrameFunctionalGroupsSequence missing or incomplete in " << filepath << std::endl;
+        return false;
+    }
+
+    // Parse the functional groups once for all frames
+    std::vector<EnhancedFrameInfo>& info = layout.frames;
+    info.assign(frameCount, EnhancedFrameInfo());
+    std::vector<double> slicePositions(frameCount, 0.0);
+    std::vector<double> triggerTimes(frameCount, 0.0);
+    double firstOrientation[6] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0};
+    for (std::size_t f = 0; f < frameCount; f++) {
+        DcmItem* perFrame = perFrameSeq->getItem(static_cast<unsigned long>(f));
+        EnhancedFrameInfo& frame = info[f];
+        frame.index = f;
+
+        if (DcmItem* group = findFunctionalGroup(perFrame, shared, DCM_MRImageFrameTypeSequence)) {
+            OFString value;
+            if (group->findAndGetOFString(DCM_ComplexImageComponent, value).good() && !value.empty()) {
+                frame.imageType = value.c_str();
+            } else if (group->findAndGetOFString(DCM_FrameType, value, 2).good()) {
+                frame.imageType = value.c_str();
             }
         }
 
-        t = i / dimensions[2];
-        z = i % dimensions[2]; 
+        // Slice position along the plane normal
+        double orientation[6] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0};
+        if (DcmItem* group = findFunctionalGroup(perFrame, shared, DCM_PlaneOrientationSequence)) {
+            for (int i = 0; i < 6; i++) {
+                group->findAndGetFloat64(DCM_ImageOrientationPatient, orientation[i], i);
+            }
+        }
+        if (f == 0) {
+            std::copy(orientation, orientation + 6, firstOrientation);
+        }
+        if (DcmItem* group = findFunctionalGroup(perFrame, shared, DCM_PlanePositionSequence)) {
+            for (int i = 0; i < 3; i++) {
+                group->findAndGetFloat64(DCM_ImagePositionPatient, frame.position[i], i);
+            }
+        }
+        double normal[3] = {
+            orientation[1] * orientation[5] - orientation[2] * orientation[4],
+            orientation[2] * orientation[3] - orientation[0] * orientation[5],
+            orientation[0] * orientation[4] - orientation[1] * orientation[3]
+        };
+        slicePositions[f] = frame.position[0] * normal[0] + frame.position[1] * normal[1] + frame.position[2] * normal[2];
+
+        // Cardiac phase from the trigger delay, falling back to the temporal position index
+        bool haveTrigger = false;
+        if (DcmItem* group = findFunctionalGroup(perFrame, shared, DCM_CardiacSynchronizationSequence)) {
+            haveTrigger = group->findAndGetFloat64(DCM_NominalCardiacTriggerDelayTime, frame.triggerTime).good();
+        }
+        if (!haveTrigger) {
+            layout.triggerTimes = false;
+            if (DcmItem* group = findFunctionalGroup(perFrame, shared, DCM_FrameContentSequence)) {
+                Uint32 temporalIndex = 0;
+                if (group->findAndGetUint32(DCM_TemporalPositionIndex, temporalIndex).good()) {
+                    frame.triggerTime = static_cast<double>(temporalIndex);
+                }
+            }
+        }
+        triggerTimes[f] = frame.triggerTime;
+
+        if (DcmItem* group = findFunctionalGroup(perFrame, shared, DCM_PixelValueTransformationSequence)) {
+            group->findAndGetFloat64(DCM_RescaleSlope, frame.rescaleSlope);
+            group->findAndGetFloat64(DCM_RescaleIntercept, frame.rescaleIntercept);
+        }
+    }
+
+    // Frames of several image types would share slice/phase slots; keep the requested type
+    std::vector<std::string> types;
+    for (const EnhancedFrameInfo& frame : info) {
+        if (std::find(types.begin(), types.end(), frame.imageType) == types.end()) {
+            types.push_back(frame.imageType);
+        }
+    }
+    if (types.size() > 1) {
+        std::string typeList;
+        for (const std::string& type : types) {
+            typeList += (typeList.empty() ? "" : ", ") + (type.empty() ? std::string("(none)") : type);
+        }
+        if (imageType.empty() || std::find(types.begin(), types.end(), imageType) == types.end()) {
+            std::cerr << "Error: " << filepath << " mixes image types (" << typeList << ")"
+                      << (imageType.empty() ? "" : " without " + imageType + " frames") << std::endl;
+            return false;
+        }
+        std::size_t kept = 0;
+        for (std::size_t f = 0; f < frameCount; f++) {
+            if (info[f].imageType == imageType) {
+                info[kept] = info[f];
+                slicePositions[kept] = slicePositions[f];
+                triggerTimes[kept] = triggerTimes[f];
+                kept++;
+            }
+        }
+        info.resize(kept);
+        slicePositions.resize(kept);
+        triggerTimes.resize(kept);
+        std::cout << "Reading the " << kept << " " << imageType << " frames of " << frameCount
+                  << " (image types: " << typeList << ")" << std::endl;
+    }
+
+    std::vector<std::size_t> zIndex, tIndex;
+    std::size_t zLength = assignSortedIndices(slicePositions, 1e-3, zIndex);
+    std::size_t tLength = assignSortedIndices(triggerTimes, 1e-3, tIndex);
+    layout.zLength = zLength;
+    layout.tLength = tLength;
+    std::vector<unsigned char> filled(zLength * tLength, 0);
+    bool complete = zLength * tLength == info.size();
+    for (std::size_t f = 0; f < info.size(); f++) {
+        info[f].z = zIndex[f];
+        info[f].t = tIndex[f];
+        unsigned char& slot = filled[tIndex[f] * zLength + zIndex[f]];
+        complete = complete && slot == 0;
+        slot = 1;
+    }
+
+    std::cout << "Enhanced multi-frame: " << info.size() << " frames -> "
+              << layout.cols << " x " << layout.rows << " x " << zLength << " x " << tLength << std::endl;
+    if (!complete) {
+        std::cerr << "Error: " << info.size() << " frames of " << filepath << " do not fill a " << zLength << " x "
+                  << tLength << " slice/phase grid once each" << std::endl;
+        return false;
+    }
+
+    {
+        // Slices are ordered along the plane normal; spacing comes from the pixel measures
+        double pixelSpacing[2] = {1.0, 1.0};
+        double sliceSpacing = 0.0;
+        if (DcmItem* group = findFunctionalGroup(perFrameSeq->getItem(0), shared, DCM_PixelMeasuresSequence)) {
+            for (int i = 0; i < 2; i++) {
+                group->findAndGetFloat64(DCM_PixelSpacing, pixelSpacing[i], i);
+            }
+            if (group->findAndGetFloat64(DCM_SpacingBetweenSlices, sliceSpacing).bad()) {
+                group->findAndGetFloat64(DCM_SliceThickness, sliceSpacing);
+            }
+        }
+        const double* first = info[0].position;
+        const double* last = info[0].position;
+        for (const EnhancedFrameInfo& frame : info) {
+            if (frame.z == 0) {
+                first = frame.position;
+            } else if (frame.z + 1 == zLength) {
+                last = frame.position;
+            }
+        }
+        layout.geometry = VolumeGeometry::from_slices(first, last, firstOrientation, pixelSpacing, zLength, sliceSpacing);
+    }
+    return true;
+}
+
+Volume4D EnhancedDicomToVolume4D(const std::string& filepath, bool applyRescale, std::vector<EnhancedFrameInfo>* frames,
+                                 VolumeGeometry* geometry, const std::string& imageType) {
+    Volume4D volume;
+    volume.set_category(MemoryCategory::Raw);
+
+    try {
+        DcmFileFormat fileformat;
+        if (fileformat.loadFile(filepath.c_str()).bad()) {
+            std::cerr << "Error: Could not load DICOM file: " << filepath << std::endl;
+            return volume;
+        }
+        DcmDataset* dataset = fileformat.getDataset();
+
+        EnhancedLayout layout;
+        if (!parseEnhancedLayout(dataset, filepath, imageType, layout)) {
+            return volume;
+        }
+        if (geometry != nullptr) {
+            *geometry = layout.geometry;
+        }
+        const Uint16 rows = layout.rows, cols = layout.cols, bitsAllocated = layout.bitsAllocated;
+        const std::size_t frameCount = layout.frameCount;
+        std::vector<EnhancedFrameInfo>& info = layout.frames;
+
+        // Decompress encapsulated pixel data (no-op for native transfer syntaxes) if a codec is registered
+        dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr);
+        if (!dataset->canWriteXfer(EXS_LittleEndianExplicit)) {
+            std::cerr << "Error: Cannot decompress pixel data of " << filepath << std::endl;
+            return volume;
+        }
+
+        const Uint8* pixels8 = nullptr;
+        const Uint16* pixels16 = nullptr;
+        unsigned long pixelCount = 0;
+        OFCondition pixelStatus = (bitsAllocated == 8)
+            ? dataset->findAndGetUint8Array(DCM_PixelData, pixels8, &pixelCount)
+            : dataset->findAndGetUint16Array(DCM_PixelData, pixels16, &pixelCount);
+        std::size_t frameSize = static_cast<std::size_t>(rows) * cols;
+        if (pixelStatus.bad() || pixelCount < frameSize * frameCount) {
+            std::cerr << "Error: Could not read PixelData from " << filepath << std::endl;
+            return volume;
+        }
+
+        volume.resize(cols, rows, layout.zLength, layout.tLength);
+        bool isSigned = layout.pixelRepresentation == 1;
+
+        // Each frame writes its own (z, t) slice, so frames decode independently
+        parallelFor(0, info.size(), [&](std::size_t f) {
+            const EnhancedFrameInfo& frame = info[f];
+            float slope = applyRescale ? static_cast<float>(frame.rescaleSlope) : 1.0f;
+            float intercept = applyRescale ? static_cast<float>(frame.rescaleIntercept) : 0.0f;
+            std::size_t offset = frame.index * frameSize;
+            for (std::size_t y = 0; y < rows; y++) {
+                for (std::size_t x = 0; x < cols; x++) {
+                    std::size_t index = offset + y * cols + x;
+                    float raw;
+                    if (bitsAllocated == 8) {
+                        raw = isSigned ? static_cast<float>(static_cast<Sint8>(pixels8[index])) : static_cast<float>(pixels8[index]);
+                    } else {
+                        raw = isSigned ? static_cast<float>(static_cast<Sint16>(pixels16[index])) : static_cast<float>(pixels16[index]);
+                    }
+                    volume.at(x, y, frame.z, frame.t) = raw * slope + intercept;
+                }
+            }
+        });
+
+        if (frames != nullptr) {
+            *frames = std::move(info);
+        }
+
+    } catch (const std::exception& e) {
+        std::cerr << "Exception while reading enhanced DICOM file: " << e.what() << std::endl;
+        volume.clear();
     }
 
-    //std::cout << "Slices: " << slices << std::endl;
     return volume;
 }
 
+/**
+ * Read the TriggerTime of a single-frame file without its pixel data
+ *
+ * @return true if the file has a trigger time
+ */
+static bool readTriggerTime(const std::string& filepath, double& triggerTime) {
+    DcmFileFormat fileformat;
+    if (fileformat.loadFileUntilTag(filepath.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength,
+                                    ERM_autoDetect, DCM_PixelData).bad()) {
+        return false;
+    }
+    return fileformat.getDataset()->findAndGetFloat64(DCM_TriggerTime, triggerTime).good();
+}
+
+bool readFrameInterval(const std::string& dicomFolderPath, double& interval) {
+    interval = 0.0;
+    if (std::filesystem::is_regular_file(dicomFolderPath)) {
+        try {
+            DcmFileFormat fileformat;
+            if (fileformat.loadFileUntilTag(dicomFolderPath.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength,
+                                            ERM_autoDetect, DCM_PixelData).bad()) {
+                return false;
+            }
+            EnhancedLayout layout;
+            if (!parseEnhancedLayout(fileformat.getDataset(), dicomFolderPath, "MAGNITUDE", layout) ||
+                !layout.triggerTimes || layout.tLength < 2) {
+                return false;
+            }
+            double first = layout.frames.front().triggerTime, last = first;
+            for (const EnhancedFrameInfo& frame : layout.frames) {
+                first = std::min(first, frame.triggerTime);
+                last = std::max(last, frame.triggerTime);
+            }
+            interval = (last - first) / (layout.tLength - 1);
+        } catch (const std::exception& e) {
+            std::cerr << "Exception while reading enhanced DICOM file: " << e.what() << std::endl;
+            return false;
+        }
+        return interval > 0.0;
+    }
+
+    // File i is slice i % zLength of frame i / zLength: compare the first slices of the first and last frame
+    std::vector<int> dimensions = get4DSize(dicomFolderPath);
+    std::vector<std::string> dicomFilePaths;
+    for (const auto& entry : std::filesystem::directory_iterator(dicomFolderPath)) {
+        if (entry.is_regular_file()) {
+            dicomFilePaths.push_back(entry.path().string());
+        }
+    }
+    std::sort(dicomFilePaths.begin(), dicomFilePaths.end());
+    std::size_t zLength = static_cast<std::size_t>(std::max(0, dimensions[2]));
+    std::size_t tLength = static_cast<std::size_t>(std::max(0, dimensions[3]));
+    double first = 0.0, last = 0.0;
+    if (zLength == 0 || tLength < 2 || dicomFilePaths.size() < zLength * tLength ||
+        !readTriggerTime(dicomFilePaths.front(), first) ||
+        !readTriggerTime(dicomFilePaths[(tLength - 1) * zLength], last)) {
+        return false;
+    }
+    interval = (last - first) / (tLength - 1);
+    return interval > 0.0;
+}
+
+bool readVolumeGeometry(const std::string& dicomFolderPath, VolumeGeometry& geometry) {
+    // The functional groups of an Enhanced object precede its pixel data, which is never read
+    if (std::filesystem::is_regular_file(dicomFolderPath)) {
+        geometry = VolumeGeometry();
+        try {
+            DcmFileFormat fileformat;
+            if (fileformat.loadFileUntilTag(dicomFolderPath.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength,
+                                            ERM_autoDetect, DCM_PixelData).bad()) {
+                std::cerr << "Error: Could not load DICOM file: " << dicomFolderPath << std::endl;
+                return false;
+            }
+            EnhancedLayout layout;
+            if (!parseEnhancedLayout(fileformat.getDataset(), dicomFolderPath, "MAGNITUDE", layout)) {
+                return false;
+            }
+            geometry = layout.geometry;
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Exception while reading enhanced DICOM file: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<int> dimensions = get4DSize(dicomFolderPath);
+    std::vector<std::string> dicomFilePaths;
+    for (const auto& entry : std::filesystem::directory_iterator(dicomFolderPath)) {
+        if (entry.is_regular_file()) {
+            dicomFilePaths.push_back(entry.path().string());
+        }
+    }
+    std::sort(dicomFilePaths.begin(), dicomFilePaths.end());
+    return readSeriesGeometry(dicomFolderPath, dicomFilePaths, dimensions[2], geometry);
+}
+
 std::vector<int> get4DSize(const std::string& dicomFolderPath) {
     std::vector<int> dimensions = {0, 0, 0, 0}; // [xLength, yLength, zLength, tLength]
     
@@ -233,6 +717,10 @@ std::vector<int> get4DSize(const std::string& dicomFolderPath) {
         std::cout << "Total files found: " << numSlices << std::endl;
 
         if (gotVolumeInfo) {
+            // Static series (e.g. segmentations) have no cardiac phases
+            if (tLength <= 0) {
+                tLength = 1;
+            }
             zLength = numSlices/tLength;
             std::cout << "Volume size: " << xLength << " x " << yLength << " x " << zLength;
             if (tLength > 0) {
@@ -255,44 +743,40 @@ std::vector<int> get4DSize(const std::string& dicomFolderPath) {
     return dimensions;
 }
 
-Volume4D generateVelVecField(const std::string& phase_path){
+Volume4D generateVelVecField(const std::string& phase_path, VolumeGeometry* geometry){
     std::cout << "phase_path: " << phase_path << std::endl;
     float venc = 1.70;
 
 
-    Volume4D rescale = rescalePhase(phase_path);
+    Volume4D rescale = rescalePhase(phase_path, geometry);
 
 
 
-    Volume4D vel = applyVENC(rescale, venc);
+    Volume4D vel = applyVENC(std::move(rescale), venc);
 
 
     return vel;
 
 }
 Volume4D applyVENC(Volume4D rescaledPhase, float venc){
-    Volume4D velocityField = rescaledPhase;
-    
-    // Convert phase to velocity: velocity = (phase / π) × VENC
+    // Convert phase to velocity in place: velocity = (phase / π) × VENC
     const float PI = 3.14159265359f;
+    const float scale = venc / PI;
     
-    for (std::size_t x = 0; x < velocityField.size_x(); x++) {
-        for (std::size_t y = 0; y < velocityField.size_y(); y++) {
-            for (std::size_t z = 0; z < velocityField.size_z(); z++) {
-                for (std::size_t t = 0; t < velocityField.size_t(); t++) {
-                    float phaseValue = velocityField.at(x, y, z, t);
-                    float velocityValue = (phaseValue / PI) * venc;
-                    velocityField.at(x, y, z, t) = velocityValue;
-                }
-            }
+    for (std::size_t t = 0; t < rescaledPhase.size_t(); t++) {
+        float* frame = rescaledPhase.frame_data(t);
+        for (std::size_t i = 0; i < rescaledPhase.frame_size(); i++) {
+            frame[i] *= scale;
         }
     }
     
-    return velocityField;
+    rescaledPhase.set_category(MemoryCategory::Velocity);
+    return rescaledPhase;
 }
-Volume4D rescalePhase(const std::string& dicomFolderPath) {
-    Volume4D volume = DicomFolderToVolume4D(dicomFolderPath);
-    
+bool readRescaleParameters(const std::string& dicomFolderPath, double& slope, double& intercept) {
+    slope = 1.0;
+    intercept = 0.0;
+
     // Find the first DICOM file in the folder to extract rescaling parameters
     std::string firstDicomFile;
     try {
@@ -304,35 +788,46 @@ Volume4D rescalePhase(const std::string& dicomFolderPath) {
         }
     } catch (const std::exception& e) {
         std::cerr << "Error accessing folder: " << e.what() << std::endl;
-        return volume;
+        return false;
     }
     
     if (firstDicomFile.empty()) {
         std::cerr << "No DICOM files found in folder: " << dicomFolderPath << std::endl;
-        return volume;
+        return false;
     }
     
     DcmFileFormat fileformat;
     if (fileformat.loadFile(firstDicomFile.c_str()).bad()) {
         std::cerr << "Error loading DICOM file: " << firstDicomFile << std::endl;
-        return volume;
+        return false;
     }
     
     DcmDataset *dataset = fileformat.getDataset();
     
-    Float64 rescaleSlope = 1.0;
-    Float64 rescaleIntercept = 0.0;
-    
     // Try to get rescaling parameters, use defaults if not found
-    if (dataset->findAndGetFloat64(DcmTag(0x0028, 0x1053), rescaleSlope).bad()) {
-        rescaleSlope = 1.0;
+    Float64 value;
+    if (dataset->findAndGetFloat64(DcmTag(0x0028, 0x1053), value).good()) {
+        slope = value;
+    }
+    if (dataset->findAndGetFloat64(DcmTag(0x0028, 0x1052), value).good()) {
+        intercept = value;
     }
-    if (dataset->findAndGetFloat64(DcmTag(0x0028, 0x1052), rescaleIntercept).bad()) {
-        rescaleIntercept = 0.0;
+    return true;
+}
+
+Volume4D rescalePhase(const std::string& dicomFolderPath, VolumeGeometry* geometry) {
+    // Enhanced multi-frame objects carry rescale values per frame
+    if (std::filesystem::is_regular_file(dicomFolderPath)) {
+        return EnhancedDicomToVolume4D(dicomFolderPath, true, nullptr, geometry, "PHASE");
+    }
+
+    Volume4D volume = DicomFolderToVolume4D(dicomFolderPath, geometry);
+
+    double rescaleSlope = 1.0;
+    double rescaleIntercept = 0.0;
+    if (!readRescaleParameters(dicomFolderPath, rescaleSlope, rescaleIntercept)) {
+        return volume;
     }
-    // for now
-    //rescaleSlope = 1.0;
-    //rescaleIntercept = 0.0;
     std::cout << "rescaleSlope: " << rescaleSlope << std::endl;
     std::cout << "rescaleIntercept: " << rescaleIntercept << std::endl;
     for (std::size_t x = 0; x < volume.size_x(); x++) {
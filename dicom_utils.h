@@ -4,7 +4,25 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <cstddef>
 #include "Volume4D.h"
+#include "VolumeGeometry.h"
+
+class DicomImage;
+
+/**
+ * Geometry and rescale values of one frame of an Enhanced MR multi-frame object
+ */
+struct EnhancedFrameInfo {
+    double position[3] = {0.0, 0.0, 0.0}; // ImagePositionPatient
+    double triggerTime = 0.0;             // NominalCardiacTriggerDelayTime (ms)
+    double rescaleSlope = 1.0;
+    double rescaleIntercept = 0.0;
+    std::string imageType;                // ComplexImageComponent (or FrameType value 3), e.g. MAGNITUDE, PHASE
+    std::size_t index = 0;                // Frame number in the object
+    std::size_t z = 0;                    // Slice index in the output volume
+    std::size_t t = 0;                    // Cardiac phase index in the output volume
+};
 
 /**
  * Read DICOM file and return pixel values as a Volume4D slice
@@ -14,13 +32,72 @@
  */
 Volume4D readDicomToVolume4D(const std::string& filepath);
 
+/**
+ * Copy the rendered pixels of a DicomImage into one (z, t) slice of a volume
+ * 
+ * @param image Loaded DICOM image whose size matches the volume's x/y size
+ * @param volume Destination volume
+ * @param z Slice index
+ * @param t Time index
+ * @return true if the pixels were copied
+ */
+bool copyDicomImageToVolume(DicomImage* image, Volume4D& volume, std::size_t z, std::size_t t);
+
 /**
  * Read DICOM files from a folder and return a Volume4D object
  * 
+ * If the path is a single file it is read as an Enhanced multi-frame object (raw values,
+ * MAGNITUDE frames if it mixes image types).
+ * 
  * @param dicomFolderPath Path to the folder containing DICOM files
+ * @param geometry Optional output: patient-space placement from the first and last slice headers
  * @return Volume4D containing the 4D volume (empty if failed)
  */
-Volume4D DicomFolderToVolume4D(const std::string& dicomFolderPath);
+Volume4D DicomFolderToVolume4D(const std::string& dicomFolderPath, VolumeGeometry* geometry = nullptr);
+
+/**
+ * Read only the patient-space placement of a series, without decoding its pixels
+ * 
+ * An Enhanced multi-frame file is read up to its PixelData element; the functional groups
+ * that place its frames come before it.
+ * 
+ * @param dicomFolderPath Path to the folder containing DICOM files (or a multi-frame file)
+ * @param geometry Receives the placement (voxel coordinates if the headers have none)
+ * @return true if the headers had plane attributes
+ */
+bool readVolumeGeometry(const std::string& dicomFolderPath, VolumeGeometry& geometry);
+
+/**
+ * Read the time between cardiac frames of a series from its trigger times, without decoding its pixels
+ * 
+ * @param dicomFolderPath Path to the folder containing DICOM files (or a multi-frame file)
+ * @param interval Receives the mean interval between frames in ms (0 if unknown)
+ * @return true if the headers had trigger times for at least two frames
+ */
+bool readFrameInterval(const std::string& dicomFolderPath, double& interval);
+
+/**
+ * Read an Enhanced MR multi-frame DICOM file (all slices and phases in one object)
+ * 
+ * The shared and per-frame functional groups are parsed once to place every frame by
+ * slice position and trigger time; the PixelData frames are then decoded in parallel
+ * straight into the volume.
+ * 
+ * An object holding frames of several image types (e.g. magnitude and phase) is read only
+ * when imageType selects one of them. The selected frames must fill the slice/phase grid
+ * exactly once, otherwise the read fails.
+ * 
+ * @param filepath Path to the multi-frame DICOM file
+ * @param applyRescale Apply each frame's RescaleSlope/RescaleIntercept while decoding
+ * @param frames Optional output for the parsed information of the frames read
+ * @param geometry Optional output: patient-space placement from the plane functional groups
+ * @param imageType Image type to read from a mixed object (ignored if all frames share one type)
+ * @return Volume4D containing the 4D volume (empty if failed)
+ */
+Volume4D EnhancedDicomToVolume4D(const std::string& filepath, bool applyRescale = true,
+                                 std::vector<EnhancedFrameInfo>* frames = nullptr,
+                                 VolumeGeometry* geometry = nullptr,
+                                 const std::string& imageType = "");
 
 /**
  * Get 4D volume dimensions from a folder containing DICOM files
@@ -34,9 +111,11 @@ std::vector<int> get4DSize(const std::string& dicomFolderPath);
 /**
  * Apply VENC scaling to convert phase values to velocity values
  * 
+ * Converts in place; pass the phase volume with std::move to avoid copying it.
+ * 
  * @param rescaledPhase Input 4D phase volume
  * @param venc Velocity encoding value in cm/s
- * @return Volume4D containing velocity values
+ * @return Volume4D containing velocity values (charged to MemoryCategory::Velocity)
  */
 Volume4D applyVENC(Volume4D rescaledPhase, float venc);
 
@@ -44,17 +123,32 @@ Volume4D applyVENC(Volume4D rescaledPhase, float venc);
  * Generate velocity vector field from a 4D phase volume folder
  * 
  * @param phase_path Path to folder containing DICOM files for the phase volume
+ * @param geometry Optional output: patient-space placement of the velocity grid
  * @return Volume4D containing the velocity field
  */
-Volume4D generateVelVecField(const std::string& phase_path);
+Volume4D generateVelVecField(const std::string& phase_path, VolumeGeometry* geometry = nullptr);
 
 
+/**
+ * Read RescaleSlope and RescaleIntercept from the first DICOM file in a folder
+ * 
+ * @param dicomFolderPath Path to folder containing DICOM files
+ * @param slope Receives RescaleSlope (1 if the tag is absent)
+ * @param intercept Receives RescaleIntercept (0 if the tag is absent)
+ * @return true if a DICOM file was read
+ */
+bool readRescaleParameters(const std::string& dicomFolderPath, double& slope, double& intercept);
+
 /**
  * Rescale phase Volume4D using RescaleSlope and RescaleIntercept from DICOM file
  * 
+ * If the path is a single Enhanced multi-frame file, the per-frame rescale values are used
+ * (and its PHASE frames are read if it mixes image types).
+ * 
  * @param dicomFolderPath Path to folder containing DICOM files to extract rescaling parameters
+ * @param geometry Optional output: patient-space placement of the volume
  * @return Rescaled Volume4D
  */
-Volume4D rescalePhase(const std::string& dicomFolderPath);
+Volume4D rescalePhase(const std::string& dicomFolderPath, VolumeGeometry* geometry = nullptr);
 
 #endif // DICOM_UTILS_H 
\ No newline at end of file
@@ -9,6 +9,21 @@
 #include <algorithm>
 #include "dicom_utils.h"
 #include "Volume4D.h"
+#include "StreamlineLOD.h"
+#include "VelocitySampler.h"
+#include "ParticleSystem.h"
+#include "ParticleRenderer.h"
+#include "FTLEEngine.h"
+#include "streamline_io.h"
+#include "MemoryManager.h"
+#include "StreamlineCache.h"
+#include "SlabPipeline.h"
+#include "VolumeCache.h"
+#include "VolumePyramid.h"
+#include "VolumeGeometry.h"
+#include "FlowStatistics.h"
+#include "FrameEncoder.h"
+#include "TaskGraph.h"
 
 // VTK includes for visualization
 #include <vtkSmartPointer.h>
@@ -38,30 +53,616 @@
 #include <vtkUnsignedCharArray.h>
 #include <vtkLookupTable.h>
 #include <vtkColorTransferFunction.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+#include <vtkMarchingCubes.h>
+#include <vtkMatrix4x4.h>
+#include <vtkWindowToImageFilter.h>
+#include <vtkPNGWriter.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
 
-int main() {
+/**
+ * State for the particle animation timer
+ */
+struct ParticleAnimation {
+    ParticleSystem* particles;
+    ParticleRenderer* renderer;
+    vtkRenderWindow* window;
+    float time;          // Current time in frames
+    float step;          // Frames advanced per timer tick
+    float frameCount;    // Length of the cardiac cycle in frames
+    long lastEmitFrame;
+};
+
+/**
+ * Advance the animation by one step: emit once per cardiac frame, advect, wrap around the cycle
+ */
+void AdvanceParticles(ParticleAnimation* anim) {
+    long frame = static_cast<long>(std::floor(anim->time));
+    if (frame != anim->lastEmitFrame) {
+        anim->particles->emit(static_cast<float>(frame));
+        anim->lastEmitFrame = frame;
+    }
+
+    anim->particles->advance(anim->time, anim->step);
+    anim->time += anim->step;
+    if (anim->time >= anim->frameCount) {
+        anim->time -= anim->frameCount;
+        anim->lastEmitFrame = -1;
+    }
+}
+
+/**
+ * Timer callback: emit once per cardiac frame, advect, refresh the VTK buffers and render
+ */
+void OnParticleTimer(vtkObject*, unsigned long, void* clientData, void*) {
+    ParticleAnimation* anim = static_cast<ParticleAnimation*>(clientData);
+    AdvanceParticles(anim);
+    anim->renderer->update();
+    anim->window->Render();
+}
+
+/**
+ * State for keyboard tuning of the streamline seeds
+ */
+struct StreamlineControls {
+    StreamlineCache* cache;
+    StreamlineCache* preview;          // Traces a coarse pyramid level while keys are pressed (may be null)
+    SeedSelection* selection;
+    StreamlineLOD* lod;
+    std::vector<double> lodTolerances;
+    vtkRenderWindow* window;
+    vtkRenderWindowInteractor* interactor;
+    int refineTimer;                   // Pending full-resolution update, -1 if none
+    unsigned long refineDelayMs;       // Quiet time after the last key before refining
+};
+
+/**
+ * Trace the current seed selection with a cache and show it through the LOD set
+ */
+void ShowStreamlines(StreamlineControls* controls, StreamlineCache* cache, const char* label) {
+    const SeedSelection& selection = *controls->selection;
+    try {
+        vtkSmartPointer<vtkPolyData> lines = cache->update(selection);
+        controls->lod->build(lines, controls->lodTolerances);
+        controls->lod->use_level(0);
+        std::cout << label << " seeds: " << cache->last_selected() << " (" << cache->last_traced()
+                  << " traced), velocity " << selection.minVelocity << "-" << selection.maxVelocity
+                  << " cm/s, ROI (" << selection.roiCenter[0] << ", " << selection.roiCenter[1] << ", "
+                  << selection.roiCenter[2] << ") r=" << selection.roiRadius << ", every " << selection.sampleRate
+                  << " voxels" << std::endl;
+    } catch (const MemoryBudgetError& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+    controls->window->Render();
+}
+
+/**
+ * Timer callback: once the keys have been quiet, replace the preview with full-resolution streamlines
+ */
+void OnStreamlineRefine(vtkObject*, unsigned long, void* clientData, void* callData) {
+    StreamlineControls* controls = static_cast<StreamlineControls*>(clientData);
+    if (callData == nullptr || *static_cast<int*>(callData) != controls->refineTimer) {
+        return;
+    }
+    controls->refineTimer = -1;
+    ShowStreamlines(controls, controls->cache, "Full resolution");
+}
+
+/**
+ * Key callback: adjust the seed selection, show a coarse preview and schedule the full-resolution update
+ */
+void OnStreamlineKey(vtkObject* caller, unsigned long, void* clientData, void*) {
+    StreamlineControls* controls = static_cast<StreamlineControls*>(clientData);
+    vtkRenderWindowInteractor* interactor = static_cast<vtkRenderWindowInteractor*>(caller);
+    // Key symbols differ between platforms, so printable keys are also matched by character
+    std::string key = interactor->GetKeySym() ? interactor->GetKeySym() : "";
+    char code = interactor->GetKeyCode();
+    SeedSelection& selection = *controls->selection;
+    const float roiStep = 0.05f;
+
+    if (key == "comma" || code == ',') {
+        selection.minVelocity = std::max(0.0f, selection.minVelocity - 5.0f);
+    } else if (key == "period" || code == '.') {
+        selection.minVelocity = std::min(selection.maxVelocity, selection.minVelocity + 5.0f);
+    } else if (key == "semicolon" || code == ';') {
+        selection.maxVelocity = std::max(selection.minVelocity, selection.maxVelocity - 10.0f);
+    } else if (key == "apostrophe" || code == '\'') {
+        selection.maxVelocity += 10.0f;
+    } else if (key == "bracketleft" || code == '[') {
+        selection.roiRadius = std::max(roiStep, selection.roiRadius - roiStep);
+    } else if (key == "bracketright" || code == ']') {
+        selection.roiRadius += roiStep;
+    } else if (key == "Left") {
+        selection.roiCenter[0] -= roiStep;
+    } else if (key == "Right") {
+        selection.roiCenter[0] += roiStep;
+    } else if (key == "Down") {
+        selection.roiCenter[1] -= roiStep;
+    } else if (key == "Up") {
+        selection.roiCenter[1] += roiStep;
+    } else if (key == "Next") {
+        selection.roiCenter[2] -= roiStep;
+    } else if (key == "Prior") {
+        selection.roiCenter[2] += roiStep;
+    } else if (key == "minus" || code == '-') {
+        selection.sampleRate++;
+    } else if (key == "equal" || code == '=') {
+        selection.sampleRate = std::max(1, selection.sampleRate - 1);
+    } else {
+        return;
+    }
+
+    if (!controls->preview) {
+        ShowStreamlines(controls, controls->cache, "Full resolution");
+        return;
+    }
+
+    // Coarse preview now; full resolution once no key has been pressed for refineDelayMs
+    ShowStreamlines(controls, controls->preview, "Preview");
+    if (controls->refineTimer >= 0) {
+        controls->interactor->DestroyTimer(controls->refineTimer);
+    }
+    controls->refineTimer = controls->interactor->CreateOneShotTimer(controls->refineDelayMs);
+}
+
+/**
+ * Overwrite the "Velocity" vectors of an image made by velocityImage with component frame buffers
+ */
+static void copyVelocityFrame(vtkImageData* image, const float* frameX, const float* frameY, const float* frameZ) {
+    vtkFloatArray* vectors = vtkFloatArray::SafeDownCast(image->GetPointData()->GetVectors());
+    float* tuples = vectors->GetPointer(0);
+    for (vtkIdType i = 0; i < vectors->GetNumberOfTuples(); i++) {
+        tuples[3 * i] = frameX[i];
+        tuples[3 * i + 1] = frameY[i];
+        tuples[3 * i + 2] = frameZ[i];
+    }
+    vectors->Modified();
+    image->Modified();
+}
+
+/**
+ * Overwrite the "Velocity" vectors of an image made by velocityImage with another frame
+ */
+static void copyVelocityFrame(vtkImageData* image, const Volume4D& x, const Volume4D& y, const Volume4D& z,
+                              std::size_t frame) {
+    copyVelocityFrame(image, x.frame_data(frame), y.frame_data(frame), z.frame_data(frame));
+}
+
+/**
+ * Copy one frame of the velocity components into an image with a "Velocity" vector array
+ *
+ * @param factor Voxel size in full-resolution voxels (pyramid level factor); coarse voxels are
+ *               placed at the centers of the full-resolution blocks they average
+ * @return Image in full-resolution voxel coordinates
+ */
+static vtkSmartPointer<vtkImageData> velocityImage(const Volume4D& x, const Volume4D& y, const Volume4D& z,
+                                                   std::size_t frame, std::size_t factor) {
+    vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+    image->SetDimensions(x.size_x(), x.size_y(), x.size_z());
+    image->SetSpacing(factor, factor, factor);
+    double origin = 0.5 * (factor - 1.0);
+    image->SetOrigin(origin, origin, origin);
+
+    std::size_t voxelCount = x.frame_size();
+    vtkSmartPointer<vtkFloatArray> vectors = vtkSmartPointer<vtkFloatArray>::New();
+    vectors->SetNumberOfComponents(3);
+    vectors->SetNumberOfTuples(voxelCount);
+    vectors->SetName("Velocity");
+    image->GetPointData()->SetVectors(vectors);
+    copyVelocityFrame(image, x, y, z, frame);
+    return image;
+}
+
+/**
+ * Write a captured frame as PNG (runs on the encoder threads; each call uses its own writer)
+ */
+static bool writePngFrame(const std::string& path, const CapturedFrame& frame) {
+    vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+    image->SetDimensions(frame.width, frame.height, 1);
+    image->AllocateScalars(VTK_UNSIGNED_CHAR, 3);
+    std::memcpy(image->GetScalarPointer(), frame.rgb.data(), frame.rgb.size());
+
+    vtkSmartPointer<vtkPNGWriter> writer = vtkSmartPointer<vtkPNGWriter>::New();
+    writer->SetFileName(path.c_str());
+    writer->SetInputData(image);
+    writer->Write();
+    return writer->GetErrorCode() == 0;
+}
+
+/**
+ * Camera keyframe of an offscreen render, relative to the initial view
+ */
+struct CameraKey {
+    double frame;       // Cardiac frame (fractional frames allowed)
+    double azimuth;     // Degrees about the view up vector
+    double elevation;   // Degrees about the cross product of view plane normal and view up
+    double zoom;        // Zoom factor (1 = initial view)
+};
+
+/**
+ * Read a camera path: one "frame azimuth elevation [zoom]" keyframe per line, '#' starts a comment
+ *
+ * @return Keyframes sorted by frame (empty if the file cannot be read)
+ */
+static std::vector<CameraKey> readCameraPath(const std::string& path) {
+    std::vector<CameraKey> keys;
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error: Cannot open camera path: " << path << std::endl;
+        return keys;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        CameraKey key = {0.0, 0.0, 0.0, 1.0};
+        if (fields >> key.frame >> key.azimuth >> key.elevation) {
+            fields >> key.zoom;
+            keys.push_back(key);
+        }
+    }
+    std::sort(keys.begin(), keys.end(), [](const CameraKey& a, const CameraKey& b) { return a.frame < b.frame; });
+    return keys;
+}
+
+/**
+ * Place the camera on a path at a frame, interpolating linearly between keyframes
+ *
+ * @param camera Camera to move
+ * @param start Initial view the keyframes are relative to
+ * @param keys Keyframes sorted by frame (not empty)
+ * @param frame Frame to render
+ */
+static void applyCameraPath(vtkCamera* camera, vtkCamera* start, const std::vector<CameraKey>& keys, double frame) {
+    CameraKey key = frame <= keys.front().frame ? keys.front() : keys.back();
+    for (std::size_t i = 0; i + 1 < keys.size(); i++) {
+        const CameraKey& a = keys[i];
+        const CameraKey& b = keys[i + 1];
+        if (frame >= a.frame && frame < b.frame) {
+            double f = (frame - a.frame) / (b.frame - a.frame);
+            key = {frame, a.azimuth + f * (b.azimuth - a.azimuth), a.elevation + f * (b.elevation - a.elevation),
+                   a.zoom + f * (b.zoom - a.zoom)};
+            break;
+        }
+    }
+    camera->DeepCopy(start);
+    camera->Azimuth(key.azimuth);
+    camera->Elevation(key.elevation);
+    camera->OrthogonalizeViewUp();
+    camera->Zoom(key.zoom);
+}
+
+/**
+ * Convert the three phase folders to velocity, speed and vorticity caches slab by slab
+ *
+ * Only a few slabs are in memory at a time, so studies larger than RAM can be processed.
+ *
+ * @param phasePaths DICOM folders of the x, y and z phase series
+ * @param outputDir Folder receiving velocity_{x,y,z}.v4d, speed.v4d and vorticity.v4d
+ * @return Process exit code
+ */
+static int streamStudy(const std::vector<std::string>& phasePaths, const std::string& outputDir) {
+    const float venc = 1.70f; // Same VENC as generateVelVecField
+    const float spacing[3] = {1.0f, 1.0f, 1.0f};
+
+    std::vector<DicomSliceSource> sources;
+    sources.reserve(phasePaths.size());
+    std::vector<SlabSource*> inputs;
+    std::vector<SlabStage> stages;
+    for (std::size_t c = 0; c < phasePaths.size(); c++) {
+        sources.emplace_back(phasePaths[c]);
+        if (!sources.back().valid()) {
+            return 1;
+        }
+        inputs.push_back(&sources.back());
+        stages.push_back(rescaleStage(c, sources.back().rescale_slope(), sources.back().rescale_intercept()));
+        stages.push_back(vencStage(c, venc));
+    }
+    stages.push_back(speedStage(0, 1, 2, 3));
+    stages.push_back(vorticityStage(0, 1, 2, 4, spacing));
+    SlabStatistics speedStatistics(3);
+    stages.push_back(speedStatistics.stage());
+
+    std::filesystem::create_directories(outputDir);
+    const char* names[5] = {"velocity_x", "velocity_y", "velocity_z", "speed", "vorticity"};
+    VolumeCacheFile files[5];
+    std::vector<SlabOutput> outputs;
+    const SlabSource& first = *inputs[0];
+    for (std::size_t c = 0; c < 5; c++) {
+        std::string path = (std::filesystem::path(outputDir) / (std::string(names[c]) + ".v4d")).string();
+        if (!files[c].create(path, first.size_x(), first.size_y(), first.size_z(), first.size_t())) {
+            return 1;
+        }
+        outputs.push_back({c, &files[c]});
+    }
+
+    SlabOptions options;
+    options.halo = 1;
+    std::cout << "Streaming " << first.size_z() << " slices in slabs of " << options.slabDepth << " to " << outputDir << std::endl;
+    if (!runSlabPipeline(inputs, stages, outputs, options)) {
+        return 1;
+    }
+
+    SlabStatistics::Summary speed = speedStatistics.summary();
+    std::cout << "Speed: mean " << speed.mean << " cm/s, std " << speed.stddev << ", max " << speed.max
+              << " over " << speed.count << " voxels" << std::endl;
+    MemoryManager::instance().print_report();
+    return 0;
+}
+
+int main(int argc, char** argv) {
     
+    // --particles animates emitted particles instead of drawing static streamlines
+    // --ftle computes forward FTLE over the cycle and shows its ridges for the first frame
+    // --export <prefix> saves the traced streamlines as <prefix>.4dsl and <prefix>.vtp (and the PC-MRA and variance maps)
+    // --memory-budget <MB> caps accounted memory; loads that would exceed it fail with an error
+    // --stream <dir> converts the study to velocity/speed/vorticity caches slab by slab and exits
+    // --mask <dicom folder> segmentation (any grid) resampled onto the velocity grid to mask the pyramid
+    // --offscreen <dir> renders every cardiac frame without a window to <dir>/frame_NNNN.png and exits
+    // --camera-path <file> moves the camera along keyframes while rendering offscreen
+    // --gif also writes <dir>/animation.gif when rendering offscreen
+    // --upsample <N> renders N frames per cardiac frame offscreen, synthesized by a periodic spline that particles also follow
+    // --cache <dir> keeps the loaded and preprocessed volumes there, keyed by their sources and parameters
+    bool particleMode = false;
+    bool ftleMode = false;
+    std::string exportPrefix;
+    std::string streamDir;
+    std::string maskPath;
+    std::string offscreenDir;
+    std::string cameraPathFile;
+    bool offscreenGif = false;
+    std::size_t upsample = 1;
+    std::string cacheDir;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--offscreen" && i + 1 < argc) {
+            offscreenDir = argv[++i];
+            continue;
+        }
+        if (std::string(argv[i]) == "--camera-path" && i + 1 < argc) {
+            cameraPathFile = argv[++i];
+            continue;
+        }
+        if (std::string(argv[i]) == "--cache" && i + 1 < argc) {
+            cacheDir = argv[++i];
+            continue;
+        }
+        if (std::string(argv[i]) == "--gif") {
+            offscreenGif = true;
+        }
+        if (std::string(argv[i]) == "--upsample" && i + 1 < argc) {
+            upsample = std::max<std::size_t>(1, std::stoul(argv[++i]));
+            continue;
+        }
+        if (std::string(argv[i]) == "--mask" && i + 1 < argc) {
+            maskPath = argv[++i];
+            continue;
+        }
+        if (std::string(argv[i]) == "--stream" && i + 1 < argc) {
+            streamDir = argv[++i];
+            continue;
+        }
+        if (std::string(argv[i]) == "--export" && i + 1 < argc) {
+            exportPrefix = argv[++i];
+            continue;
+        }
+        if (std::string(argv[i]) == "--memory-budget" && i + 1 < argc) {
+            MemoryManager::instance().set_budget(std::stoull(argv[++i]) * 1024 * 1024);
+            continue;
+        }
+        if (std::string(argv[i]) == "--particles") {
+            particleMode = true;
+        }
+        if (std::string(argv[i]) == "--ftle") {
+            ftleMode = true;
+        }
+    }
+
     std::string x_phase_path = "/Users/edisonsun/Documents/4Dsamples/2150/4D/1";
     std::string y_phase_path = "/Users/edisonsun/Documents/4Dsamples/2150/4D/2";
     std::string z_phase_path = "/Users/edisonsun/Documents/4Dsamples/2150/4D/3";
     std::string mag_path = "/Users/edisonsun/Documents/4Dsamples/2150/4D/mag";
 
-    Volume4D x_vel = generateVelVecField(x_phase_path);
-    Volume4D y_vel = generateVelVecField(y_phase_path);
-    Volume4D z_vel = generateVelVecField(z_phase_path);
-    Volume4D mag = DicomFolderToVolume4D(mag_path);
+    if (!streamDir.empty()) {
+        return streamStudy({x_phase_path, y_phase_path, z_phase_path}, streamDir);
+    }
+
+    // Loading and preprocessing run as a graph of memoized stages: independent stages (the three
+    // components, the magnitude) load in parallel, and with --cache their volumes are stored by a key
+    // of their sources and parameters, so a rerun only recomputes what changed. Declared before the
+    // pyramid, which keeps pointers into the graph's volumes
+    // The graph runs on the pool behind parallelFor, so stages decoding in parallel share its workers
+    TaskGraph pipeline(WorkStealingPool::shared(), cacheDir);
+    const float venc = 1.70f; // VENC of the phase series, applied by the velocity stages
+    const float velocityScale = 0.01f; // Velocities are in cm/s (as the seed thresholds); kinetic energy needs m/s
+    // Part of every stage's parameters: bump it when a stage computes something different from the
+    // same sources, so results cached by an older build are not loaded
+    const std::uint64_t stageVersion = hashString("stages 1");
+    auto stageParameters = [&](std::uint64_t parameters) { return combineHash(stageVersion, parameters); };
+
+    auto magGeometryNode = pipeline.add<VolumeGeometry>("magnitude geometry", {}, stageParameters(fingerprintPath(mag_path)),
+        std::function<VolumeGeometry()>([&]() {
+            VolumeGeometry geometry;
+            readVolumeGeometry(mag_path, geometry);
+            return geometry;
+        }));
+    auto magNode = pipeline.add<Volume4D>("magnitude", {}, stageParameters(fingerprintPath(mag_path)),
+        std::function<Volume4D()>([&]() { return DicomFolderToVolume4D(mag_path); }));
+
+    // A segmentation replaces the magnitude threshold; it is matched to the magnitude grid
+    // (the grid of the velocity series) through patient space, so it may come from any acquisition
+    TaskHandle<Volume4D> maskNode;
+    if (!maskPath.empty()) {
+        maskNode = pipeline.add<Volume4D>("mask", {magGeometryNode.id, magNode.id}, stageParameters(fingerprintPath(maskPath)),
+            std::function<Volume4D()>([&]() {
+                const Volume4D& mag = pipeline.get(magNode);
+                if (mag.empty()) {
+                    return Volume4D();
+                }
+                VolumeGeometry maskGeometry;
+                Volume4D labels = DicomFolderToVolume4D(maskPath, &maskGeometry);
+                if (labels.empty()) {
+                    return Volume4D();
+                }
+                std::cout << "Resampled mask " << maskPath << " onto the velocity grid" << std::endl;
+                return resampleVolume(labels, maskGeometry, pipeline.get(magGeometryNode), mag.size_x(), mag.size_y(), mag.size_z());
+            }));
+    }
+
+    auto velocityGeometryNode = pipeline.add<VolumeGeometry>("velocity geometry", {}, stageParameters(fingerprintPath(x_phase_path)),
+        std::function<VolumeGeometry()>([&]() {
+            VolumeGeometry geometry;
+            readVolumeGeometry(x_phase_path, geometry);
+            return geometry;
+        }));
+    auto frameIntervalNode = pipeline.add<double>("frame interval", {}, stageParameters(fingerprintPath(x_phase_path)),
+        std::function<double()>([&]() {
+            double interval = 0.0;
+            readFrameInterval(x_phase_path, interval);
+            return interval;
+        }));
+    TaskHandle<Volume4D> velocityNodes[3];
+    const std::string phasePaths[3] = {x_phase_path, y_phase_path, z_phase_path};
+    const char* velocityNames[3] = {"velocity x", "velocity y", "velocity z"};
+    for (int c = 0; c < 3; c++) {
+        const std::string& path = phasePaths[c];
+        velocityNodes[c] = pipeline.add<Volume4D>(velocityNames[c], {},
+            stageParameters(combineHash(fingerprintPath(path), hashDouble(venc))),
+            std::function<Volume4D()>([&path, venc]() { return applyVENC(rescalePhase(path), venc); }));
+    }
+
+    // Kinetic energy, speed histograms and PC-MRA of the whole cycle in one pass, inside the pyramid mask
+    std::vector<std::size_t> flowInputs = {velocityNodes[0].id, velocityNodes[1].id, velocityNodes[2].id,
+                                           velocityGeometryNode.id, magNode.id};
+    if (!maskPath.empty()) {
+        flowInputs.push_back(maskNode.id);
+    }
+    auto pyramidMaskOf = [&]() -> const Volume4D* {
+        if (!maskPath.empty() && !pipeline.get(maskNode).empty()) {
+            return &pipeline.get(maskNode);
+        }
+        return pipeline.get(magNode).empty() ? nullptr : &pipeline.get(magNode);
+    };
+    auto pyramidThresholdOf = [&]() {
+        if (!maskPath.empty() && !pipeline.get(maskNode).empty()) {
+            return 0.5f;
+        }
+        const Volume4D& mag = pipeline.get(magNode);
+        float maximum = 0.0f;
+        for (std::size_t t = 0; t < mag.size_t(); t++) {
+            const float* frame = mag.frame_data(t);
+            maximum = std::max(maximum, *std::max_element(frame, frame + mag.frame_size()));
+        }
+        return 0.1f * maximum;
+    };
+    auto flowNode = pipeline.add<FlowStatistics>("flow statistics", flowInputs, stageParameters(hashDouble(velocityScale)),
+        std::function<FlowStatistics()>([&]() {
+            const Volume4D& x_vel = pipeline.get(velocityNodes[0]);
+            const Volume4D& mag = pipeline.get(magNode);
+            const VolumeGeometry& geometry = pipeline.get(velocityGeometryNode);
+            FlowStatisticsOptions flowOptions;
+            flowOptions.velocityScale = velocityScale;
+            flowOptions.voxelVolume = geometry.spacing()[0] * geometry.spacing()[1] * geometry.spacing()[2] * 1e-9;
+            flowOptions.mask = pyramidMaskOf();
+            flowOptions.maskThreshold = pyramidThresholdOf();
+            try {
+                return computeFlowStatistics(x_vel, pipeline.get(velocityNodes[1]), pipeline.get(velocityNodes[2]),
+                                             mag.empty() ? nullptr : &mag, flowOptions);
+            } catch (const std::exception& e) {
+                std::cerr << "Warning: Flow statistics not computed: " << e.what() << std::endl;
+                return FlowStatistics();
+            }
+        }));
+
+    // Coarse levels of each velocity component build as soon as it and the pyramid mask are loaded,
+    // while the other components are still loading; a pyramid that does not fit the budget is left out
+    const std::size_t pyramidLevels = 3;
+    std::vector<std::size_t> coverageInputs = {magNode.id};
+    if (!maskPath.empty()) {
+        coverageInputs.push_back(maskNode.id);
+    }
+    auto coverageNode = pipeline.add<std::vector<Volume4D>>("pyramid coverage", coverageInputs,
+        stageParameters(hashDouble(static_cast<double>(pyramidLevels))),
+        std::function<std::vector<Volume4D>()>([&]() {
+            const Volume4D* mask = pyramidMaskOf();
+            if (mask == nullptr) {
+                return std::vector<Volume4D>();
+            }
+            try {
+                return buildCoverageLevels(*mask, pyramidThresholdOf(), pyramidLevels);
+            } catch (const MemoryBudgetError& e) {
+                std::cerr << "Warning: Pyramid mask not built: " << e.what() << std::endl;
+                return std::vector<Volume4D>();
+            }
+        }));
+    TaskHandle<std::vector<Volume4D>> pyramidNodes[3];
+    const char* pyramidNames[3] = {"pyramid x", "pyramid y", "pyramid z"};
+    for (int c = 0; c < 3; c++) {
+        pyramidNodes[c] = pipeline.add<std::vector<Volume4D>>(pyramidNames[c], {velocityNodes[c].id, coverageNode.id},
+            stageParameters(hashDouble(static_cast<double>(pyramidLevels))),
+            std::function<std::vector<Volume4D>()>([&, c]() {
+                const std::vector<Volume4D>& coverage = pipeline.get(coverageNode);
+                try {
+                    return buildPyramidLevels(pipeline.get(velocityNodes[c]), coverage.empty() ? nullptr : &coverage,
+                                              pyramidLevels);
+                } catch (const MemoryBudgetError& e) {
+                    std::cerr << "Error: Velocity pyramid not built: " << e.what() << std::endl;
+                    return std::vector<Volume4D>();
+                }
+            }));
+    }
+
+    try {
+        pipeline.run();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: Loading pipeline failed: " << e.what() << std::endl;
+        pipeline.print_report();
+        return 1;
+    }
+    pipeline.print_report();
+
+    const Volume4D& x_vel = pipeline.get(velocityNodes[0]);
+    const Volume4D& y_vel = pipeline.get(velocityNodes[1]);
+    const Volume4D& z_vel = pipeline.get(velocityNodes[2]);
+    const VolumeGeometry& velocityGeometry = pipeline.get(velocityGeometryNode);
+    double frameInterval = pipeline.get(frameIntervalNode); // ms
+    const FlowStatistics& flowStatistics = pipeline.get(flowNode);
 
     // Check if velocity volumes were loaded successfully
     if (x_vel.empty() || y_vel.empty() || z_vel.empty()) {
         std::cerr << "Error: Failed to load velocity volumes" << std::endl;
         return 1;
     }
+
+    // The pyramid adopts the levels of the pyramid stages
+    const std::vector<Volume4D>& pyramidCoverage = pipeline.get(coverageNode);
+    VolumePyramid velocityPyramid(pyramidLevels, pyramidCoverage.empty() ? nullptr : &pyramidCoverage);
+    bool pyramidReady = true;
+    for (int c = 0; c < 3; c++) {
+        const std::vector<Volume4D>& levels = pipeline.get(pyramidNodes[c]);
+        pyramidReady = pyramidReady && !levels.empty() && velocityPyramid.add_component(pipeline.get(velocityNodes[c]), levels);
+    }
     
     std::cout << "Velocity volumes loaded successfully!" << std::endl;
+    velocityGeometry.print_info();
+    MemoryManager::instance().print_report();
     std::cout << "X velocity dimensions: " << x_vel.size_x() << " x " << x_vel.size_y() << " x " << x_vel.size_z() << " x " << x_vel.size_t() << std::endl;
     std::cout << "Y velocity dimensions: " << y_vel.size_x() << " x " << y_vel.size_y() << " x " << y_vel.size_z() << " x " << y_vel.size_t() << std::endl;
     std::cout << "Z velocity dimensions: " << z_vel.size_x() << " x " << z_vel.size_y() << " x " << z_vel.size_z() << " x " << x_vel.size_t() << std::endl;
 
+    if (!flowStatistics.frames.empty()) {
+        std::size_t peak = flowStatistics.peak_frame();
+        std::cout << "Peak kinetic energy: " << flowStatistics.frames[peak].maskedKineticEnergy * 1e3 << " mJ in frame " << peak
+                  << " (" << flowStatistics.frames[peak].maskedVoxels << " voxels in mask)" << std::endl;
+        std::cout << "Speed percentiles (50/90/99.9): " << flowStatistics.percentile(0.5) << " / "
+                  << flowStatistics.percentile(0.9) << " / " << flowStatistics.percentile(0.999) << std::endl;
+    }
+
     // Create VTK visualization for velocity field
     std::cout << "\nCreating VTK streamline visualization..." << std::endl;
     
@@ -69,119 +670,102 @@ int main() {
     vtkSmartPointer<vtkRenderer> renderer = vtkSmartPointer<vtkRenderer>::New();
     renderer->SetBackground(0.1, 0.1, 0.1);
 
-    // Create 3D volume data for velocity field
-    vtkSmartPointer<vtkImageData> velocityField = vtkSmartPointer<vtkImageData>::New();
-    velocityField->SetDimensions(x_vel.size_x(), x_vel.size_y(), x_vel.size_z());
-    velocityField->AllocateScalars(VTK_FLOAT, 3); // 3 components for velocity vectors
-    
-    // Copy velocity data to VTK volume (using first time point)
+    // Tracing, seeding and particles work in voxel coordinates; actors are placed in patient space (mm)
+    double voxelToPatient[16];
+    velocityGeometry.voxel_to_world_matrix(voxelToPatient);
+    vtkSmartPointer<vtkMatrix4x4> patientMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    patientMatrix->DeepCopy(voxelToPatient);
+
+    // Velocity field of the first time point; its vector array is the only VTK copy of the data
     int timePoint = 0;
-    for (std::size_t z = 0; z < x_vel.size_z(); z++) {
-        for (std::size_t y = 0; y < x_vel.size_y(); y++) {
-            for (std::size_t x = 0; x < x_vel.size_x(); x++) {
-                float vx = x_vel.at(x, y, z, timePoint);
-                float vy = y_vel.at(x, y, z, timePoint);
-                float vz = z_vel.at(x, y, z, timePoint);
-                
-                // Store velocity components
-                float* ptr = static_cast<float*>(velocityField->GetScalarPointer(x, y, z));
-                ptr[0] = vx;
-                ptr[1] = vy;
-                ptr[2] = vz;
-            }
+    MemoryReservation vtkVelocityMemory;
+    try {
+        vtkVelocityMemory = MemoryReservation(MemoryCategory::VTK, 3 * x_vel.frame_size() * sizeof(float));
+    } catch (const MemoryBudgetError& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    vtkSmartPointer<vtkImageData> velocityField = velocityImage(x_vel, y_vel, z_vel, timePoint, 1);
+
+    // Coarse field for previews while seeds are being tuned; without a pyramid every update is full resolution
+    const std::size_t previewLevel = 2;
+    vtkSmartPointer<vtkImageData> previewField;
+    MemoryReservation vtkPreviewMemory;
+    if (pyramidReady) {
+        const Volume4D& previewX = velocityPyramid.component(previewLevel, 0);
+        try {
+            vtkPreviewMemory = MemoryReservation(MemoryCategory::VTK, 3 * previewX.frame_size() * sizeof(float));
+            previewField = velocityImage(previewX, velocityPyramid.component(previewLevel, 1),
+                                         velocityPyramid.component(previewLevel, 2), timePoint,
+                                         velocityPyramid.factor(previewLevel));
+        } catch (const MemoryBudgetError& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
         }
     }
     
-    // Set velocity field as vector field
-    vtkSmartPointer<vtkFloatArray> vectors = vtkSmartPointer<vtkFloatArray>::New();
-    vectors->SetNumberOfComponents(3);
-    vectors->SetName("Velocity");
-    
-    // Copy velocity data to vector array
-    for (std::size_t z = 0; z < x_vel.size_z(); z++) {
-        for (std::size_t y = 0; y < x_vel.size_y(); y++) {
-            for (std::size_t x = 0; x < x_vel.size_x(); x++) {
-                float vx = x_vel.at(x, y, z, timePoint);
-                float vy = y_vel.at(x, y, z, timePoint);
-                float vz = z_vel.at(x, y, z, timePoint);
-                vectors->InsertNextTuple3(vx, vy, vz);
-            }
+    // Seed selection for aorta flow; adjustable from the keyboard in the viewer (see OnStreamlineKey)
+    SeedSelection seedSelection;
+    seedSelection.minVelocity = 1.0f;   // cm/s - minimum velocity to show
+    seedSelection.maxVelocity = 300.0f; // cm/s - maximum velocity to show
+    if (!flowStatistics.histogram.empty() && flowStatistics.percentile(1.0) > 0.0f) {
+        if (flowStatistics.saturated_fraction() > 0.5f) {
+            // Most speeds fell beyond the histogram range, so its percentiles say nothing
+            std::cout << "Warning: Speed histogram saturated, using the default velocity thresholds" << std::endl;
+        } else {
+            // Seed and color the fastest 10% of the masked voxels, ignoring the top 0.1% (aliasing, noise)
+            seedSelection.minVelocity = flowStatistics.percentile(0.9);
+            seedSelection.maxVelocity = flowStatistics.percentile(0.999);
         }
     }
-    
-    velocityField->GetPointData()->SetVectors(vectors);
-    
-    // Create seed points for streamlines
-    vtkSmartPointer<vtkPoints> seedPoints = vtkSmartPointer<vtkPoints>::New();
-    
-    // Threshold parameters for aorta flow
-    float minVelocityThreshold = 1.0; // cm/s - minimum velocity to show
-    float maxVelocityThreshold = 300.0; // cm/s - maximum velocity to show
-    
-    // ROI parameters for aorta
-    float roiCenterX = 0.0;
-    float roiCenterY = 0.0;
-    float roiCenterZ = 0.0;
-    float roiRadius = 0.8;
+    seedSelection.roiRadius = 0.8f;     // Normalized coordinates, centered on the volume
+    seedSelection.sampleRate = 8;       // Use every nth voxel to avoid overcrowding
     
     std::cout << "Creating seed points for streamlines..." << std::endl;
-    std::cout << "Velocity thresholds: " << minVelocityThreshold << " to " << maxVelocityThreshold << " cm/s" << std::endl;
-    std::cout << "ROI radius: " << roiRadius << " (normalized coordinates)" << std::endl;
+    std::cout << "Velocity thresholds: " << seedSelection.minVelocity << " to " << seedSelection.maxVelocity << " cm/s" << std::endl;
+    std::cout << "ROI radius: " << seedSelection.roiRadius << " (normalized coordinates)" << std::endl;
     
-    // Sample points for seed generation (use every nth point to avoid overcrowding)
-    int sampleRate = 8; // Adjust this to control density of streamlines
+    // Streamlines are traced per seed and cached, so changing the selection only traces new seeds
+    StreamlineCache streamlineCache;
+    StreamlineCache previewCache;
+    streamlineCache.set_field(velocityField, timePoint);
+    previewCache.set_field(previewField, timePoint, velocityField); // Same seeds, traced through the coarse field
+    for (StreamlineCache* cache : {&streamlineCache, &previewCache}) {
+        // Seed scan and ROI test on the pyramid level matching the sample spacing
+        cache->set_seed_pyramid(pyramidReady ? &velocityPyramid : nullptr);
+        vtkStreamTracer* streamTracer = cache->tracer();
+        streamTracer->SetMaximumPropagation(100); // Maximum steps for streamline
+        streamTracer->SetIntegrationStepUnit(2); // Cell length units, so coarse cells take proportionally fewer steps
+        streamTracer->SetInitialIntegrationStep(0.1); // Initial step size
+        streamTracer->SetMinimumIntegrationStep(0.01); // Minimum step size
+        streamTracer->SetMaximumIntegrationStep(0.5); // Maximum step size
+        streamTracer->SetIntegrationDirection(0); // Forward integration
+        streamTracer->SetComputeVorticity(1); // Compute vorticity for coloring
+    }
+    vtkSmartPointer<vtkPolyData> streamlines = streamlineCache.update(seedSelection);
     
-    for (std::size_t z = 0; z < x_vel.size_z(); z += sampleRate) {
-        for (std::size_t y = 0; y < x_vel.size_y(); y += sampleRate) {
-            for (std::size_t x = 0; x < x_vel.size_x(); x += sampleRate) {
-                // Get velocity components
-                float vx = x_vel.at(x, y, z, timePoint);
-                float vy = y_vel.at(x, y, z, timePoint);
-                float vz = z_vel.at(x, y, z, timePoint);
-                
-                // Calculate velocity magnitude
-                float magnitude = sqrt(vx*vx + vy*vy + vz*vz);
-                
-                // Check velocity magnitude threshold (aorta flow range)
-                if (magnitude >= minVelocityThreshold && magnitude <= maxVelocityThreshold) {
-                    // Normalize coordinates to [-1, 1] range
-                    float nx = (2.0f * x / x_vel.size_x()) - 1.0f;
-                    float ny = (2.0f * y / x_vel.size_y()) - 1.0f;
-                    float nz = (2.0f * z / x_vel.size_z()) - 1.0f;
-                    
-                    // Check if point is within ROI (simple spherical region)
-                    float distFromCenter = sqrt((nx - roiCenterX)*(nx - roiCenterX) + 
-                                              (ny - roiCenterY)*(ny - roiCenterY) + 
-                                              (nz - roiCenterZ)*(nz - roiCenterZ));
-                    
-                    if (distFromCenter <= roiRadius) {
-                        seedPoints->InsertNextPoint(nx, ny, nz);
-                    }
-                }
-            }
+    std::cout << "Created " << streamlineCache.last_selected() << " seed points for streamlines" << std::endl;
+    std::cout << "Generated " << streamlines->GetNumberOfLines() << " streamlines" << std::endl;
+
+    if (!exportPrefix.empty()) {
+        PolylineSet exported = polylinesFromPolyData(streamlines);
+        if (writeStreamlineBinary(exportPrefix + ".4dsl", exported) && writeStreamlineVTP(exportPrefix + ".vtp", exported)) {
+            std::cout << "Exported " << exported.line_count() << " streamlines to " << exportPrefix << ".4dsl/.vtp" << std::endl;
+        }
+        if (!flowStatistics.pcmra.empty() && writeVolumeCache(exportPrefix + "_pcmra.v4d", flowStatistics.pcmra) &&
+            writeVolumeCache(exportPrefix + "_variance.v4d", flowStatistics.velocityVariance)) {
+            std::cout << "Exported PC-MRA and velocity variance to " << exportPrefix << "_pcmra.v4d/_variance.v4d" << std::endl;
         }
     }
     
-    std::cout << "Created " << seedPoints->GetNumberOfPoints() << " seed points for streamlines" << std::endl;
-    
-    // Create polydata for seed points
-    vtkSmartPointer<vtkPolyData> seedData = vtkSmartPointer<vtkPolyData>::New();
-    seedData->SetPoints(seedPoints);
-    
-    // Create streamline tracer
-    vtkSmartPointer<vtkStreamTracer> streamTracer = vtkSmartPointer<vtkStreamTracer>::New();
-    streamTracer->SetInputData(velocityField);
-    streamTracer->SetSourceData(seedData);
-    streamTracer->SetMaximumPropagation(100); // Maximum steps for streamline
-    streamTracer->SetIntegrationStepUnit(2); // Cell length units
-    streamTracer->SetInitialIntegrationStep(0.1); // Initial step size
-    streamTracer->SetMinimumIntegrationStep(0.01); // Minimum step size
-    streamTracer->SetMaximumIntegrationStep(0.5); // Maximum step size
-    streamTracer->SetIntegrationDirection(0); // Forward integration
-    streamTracer->SetComputeVorticity(1); // Compute vorticity for coloring
-    streamTracer->Update();
-    
-    std::cout << "Generated " << streamTracer->GetOutput()->GetNumberOfLines() << " streamlines" << std::endl;
+    // Simplified copies of the streamlines to draw while the camera is moving
+    const std::vector<double> lodTolerances = {0.05, 0.25, 1.0}; // Tolerances in voxels
+    StreamlineLOD streamlineLOD;
+    streamlineLOD.build(streamlines, lodTolerances);
+    std::cout << "Streamline LOD levels (points):";
+    for (std::size_t i = 0; i < streamlineLOD.level_count(); i++) {
+        std::cout << " " << streamlineLOD.level(i)->GetNumberOfPoints();
+    }
+    std::cout << std::endl;
     
     // Create color lookup table for velocity magnitude
     vtkSmartPointer<vtkLookupTable> colorTable = vtkSmartPointer<vtkLookupTable>::New();
@@ -194,10 +778,10 @@ int main() {
     
     // Create mapper for streamlines
     vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-    mapper->SetInputConnection(streamTracer->GetOutputPort());
+    mapper->SetInputData(streamlineLOD.level(0));
     mapper->SetScalarModeToUsePointFieldData();
     mapper->SelectColorArray("Vorticity");
-    mapper->SetScalarRange(minVelocityThreshold, maxVelocityThreshold);
+    mapper->SetScalarRange(seedSelection.minVelocity, seedSelection.maxVelocity);
     mapper->SetLookupTable(colorTable);
     
     // Create actor for streamlines
@@ -205,17 +789,210 @@ int main() {
     actor->SetMapper(mapper);
     actor->GetProperty()->SetLineWidth(2.0); // Make streamlines thicker
     actor->GetProperty()->SetOpacity(0.9);
+    actor->SetUserMatrix(patientMatrix);
     
     // Add actor to renderer
     renderer->AddActor(actor);
 
+    // Particle advection through the time-resolved field, emitted from an axial plane through the volume center
+    VelocitySampler sampler(x_vel, y_vel, z_vel);
+    sampler.set_temporal_interpolation(true);
+    sampler.set_temporal_mode(TemporalMode::CubicHermite); // Linear blending smears jets between frames
+
+    // With --upsample, frames between the acquired ones come from a periodic spline (C2 over the
+    // cycle), both for the rendered velocity field and for the particles
+    std::unique_ptr<TemporalInterpolator> splines[3];
+    if (upsample > 1) {
+        try {
+            const Volume4D* velocities[3] = {&x_vel, &y_vel, &z_vel};
+            for (int c = 0; c < 3; c++) {
+                splines[c] = std::make_unique<TemporalInterpolator>(*velocities[c], TemporalMode::PeriodicSpline);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error: Cannot upsample the cardiac cycle: " << e.what() << std::endl;
+            return 1;
+        }
+        sampler.set_spline_interpolators(splines[0].get(), splines[1].get(), splines[2].get());
+        sampler.set_temporal_mode(TemporalMode::PeriodicSpline);
+    }
+
+    // Particles and FTLE tracers move in voxels per frame: cm/s -> mm/s, times the frame interval, over the voxel spacing
+    if (frameInterval <= 0.0) {
+        frameInterval = 1000.0 / x_vel.size_t();
+        std::cout << "Warning: No trigger times in " << x_phase_path << ", assuming a 1 s cardiac cycle" << std::endl;
+    }
+    float voxelsPerFrame[3];
+    for (int axis = 0; axis < 3; axis++) {
+        voxelsPerFrame[axis] = static_cast<float>(10.0 * frameInterval * 1e-3 / velocityGeometry.spacing()[axis]);
+    }
+
+    ParticleSystem particles(sampler);
+    particles.set_max_particles(2000000);
+    particles.set_lifetime(2.0f * x_vel.size_t()); // Two cardiac cycles
+    particles.set_velocity_scale(voxelsPerFrame[0], voxelsPerFrame[1], voxelsPerFrame[2]);
+
+    PlaneSource inlet;
+    inlet.center[0] = 0.5f * x_vel.size_x();
+    inlet.center[1] = 0.5f * x_vel.size_y();
+    inlet.center[2] = 0.5f * x_vel.size_z();
+    inlet.u[0] = seedSelection.roiRadius * 0.5f * x_vel.size_x();
+    inlet.u[1] = 0.0f;
+    inlet.v[0] = 0.0f;
+    inlet.v[1] = seedSelection.roiRadius * 0.5f * x_vel.size_y();
+    inlet.countU = 256;
+    inlet.countV = 256;
+    particles.add_plane_source(inlet);
+
+    std::unique_ptr<ParticleRenderer> particleRenderer;
+    if (particleMode) {
+        particleRenderer = std::make_unique<ParticleRenderer>(particles);
+        particleRenderer->set_speed_range(seedSelection.minVelocity, seedSelection.maxVelocity);
+        actor->VisibilityOff();
+        particleRenderer->actor()->SetUserMatrix(patientMatrix);
+        renderer->AddActor(particleRenderer->actor());
+    }
+
+    // FTLE ridges (vortex and jet boundaries) as an isosurface at half the maximum FTLE of frame 0
+    if (ftleMode) {
+        FTLEOptions ftleOptions;
+        ftleOptions.windowFrames = std::max<std::size_t>(1, x_vel.size_t() / 4);
+        std::copy(voxelsPerFrame, voxelsPerFrame + 3, ftleOptions.velocityScale); // Same scale as the particle advection
+        ftleOptions.frameDuration = static_cast<float>(frameInterval * 1e-3); // FTLE per second
+        FTLEEngine ftleEngine(x_vel, y_vel, z_vel, ftleOptions);
+        Volume4D ftle = ftleEngine.compute();
+
+        vtkSmartPointer<vtkImageData> ftleImage = vtkSmartPointer<vtkImageData>::New();
+        ftleImage->SetDimensions(ftle.size_x(), ftle.size_y(), ftle.size_z());
+        double tracerSpacing = 1.0 / ftleOptions.refinement;
+        ftleImage->SetSpacing(tracerSpacing, tracerSpacing, tracerSpacing);
+        ftleImage->AllocateScalars(VTK_FLOAT, 1);
+        const float* ftleFrame = ftle.frame_data(0);
+        std::copy(ftleFrame, ftleFrame + ftle.frame_size(), static_cast<float*>(ftleImage->GetScalarPointer()));
+        float ftleMax = *std::max_element(ftleFrame, ftleFrame + ftle.frame_size());
+        std::cout << "Max FTLE (frame 0): " << ftleMax << std::endl;
+
+        vtkSmartPointer<vtkMarchingCubes> ftleSurface = vtkSmartPointer<vtkMarchingCubes>::New();
+        ftleSurface->SetInputData(ftleImage);
+        ftleSurface->SetValue(0, 0.5 * ftleMax);
+        ftleSurface->Update();
+
+        vtkSmartPointer<vtkPolyDataMapper> ftleMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+        ftleMapper->SetInputConnection(ftleSurface->GetOutputPort());
+        ftleMapper->ScalarVisibilityOff();
+        vtkSmartPointer<vtkActor> ftleActor = vtkSmartPointer<vtkActor>::New();
+        ftleActor->SetMapper(ftleMapper);
+        ftleActor->GetProperty()->SetColor(1.0, 0.8, 0.3);
+        ftleActor->GetProperty()->SetOpacity(0.4);
+        ftleActor->SetUserMatrix(patientMatrix);
+        renderer->AddActor(ftleActor);
+    }
+
     // Create render window
     vtkSmartPointer<vtkRenderWindow> renderWindow = vtkSmartPointer<vtkRenderWindow>::New();
     renderWindow->AddRenderer(renderer);
     renderWindow->SetSize(1000, 800);
     renderWindow->SetWindowName("4D Aorta Streamline Visualization");
+    if (!offscreenDir.empty()) {
+        // Needs a VTK built with an offscreen backend (EGL or OSMesa) to run without a display
+        renderWindow->SetOffScreenRendering(1);
+    }
+
+    // Set up camera for better initial view: pick the direction, then fit the patient-space bounds
+    vtkSmartPointer<vtkCamera> camera = renderer->GetActiveCamera();
+    camera->SetPosition(2, 2, 2);
+    camera->SetFocalPoint(0, 0, 0);
+    camera->SetViewUp(0, 0, 1);
+    renderer->ResetCamera();
+
+    // Particles advance from a repeating timer (~30 ticks/s), or per rendered frame offscreen
+    ParticleAnimation particleAnimation = {&particles, particleRenderer.get(), renderWindow, 0.0f, 0.1f,
+                                           static_cast<float>(x_vel.size_t()), -1};
+
+    // Batch mode: render each (acquired or synthesized) frame offscreen while the encoder threads write the previous ones
+    if (!offscreenDir.empty()) {
+        std::vector<CameraKey> cameraPath;
+        if (!cameraPathFile.empty()) {
+            cameraPath = readCameraPath(cameraPathFile);
+            if (cameraPath.empty()) {
+                return 1;
+            }
+        }
+        std::filesystem::create_directories(offscreenDir);
+        FrameEncoderOptions encoderOptions;
+        if (offscreenGif) {
+            encoderOptions.gifPath = (std::filesystem::path(offscreenDir) / "animation.gif").string();
+        }
+        FrameEncoder encoder((std::filesystem::path(offscreenDir) / "frame").string(), "png", writePngFrame, encoderOptions);
 
-    // Create render window interactor
+        vtkSmartPointer<vtkCamera> startCamera = vtkSmartPointer<vtkCamera>::New();
+        startCamera->DeepCopy(camera);
+        vtkSmartPointer<vtkWindowToImageFilter> capture = vtkSmartPointer<vtkWindowToImageFilter>::New();
+        capture->SetInput(renderWindow);
+        capture->SetInputBufferTypeToRGB();
+        capture->ReadFrontBufferOff();
+        capture->ShouldRerenderOff(); // Each frame is rendered explicitly before it is captured
+
+        // upsample rendered frames per cardiac frame; particle steps no longer than the timer's that
+        // land exactly on each rendered time
+        std::size_t frameCount = x_vel.size_t();
+        std::size_t outputCount = frameCount * upsample;
+        std::size_t stepsPerOutput = static_cast<std::size_t>(std::ceil(1.0 / (upsample * particleAnimation.step) - 1e-3));
+        particleAnimation.step = 1.0f / static_cast<float>(upsample * stepsPerOutput);
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t t = 0; t < outputCount; t++) {
+            double time = static_cast<double>(t) / upsample;
+            if (particleMode) {
+                for (std::size_t s = 0; s < stepsPerOutput; s++) {
+                    AdvanceParticles(&particleAnimation);
+                }
+                particleRenderer->update();
+            } else {
+                if (upsample > 1) {
+                    copyVelocityFrame(velocityField, splines[0]->frame(time), splines[1]->frame(time), splines[2]->frame(time));
+                } else {
+                    copyVelocityFrame(velocityField, x_vel, y_vel, z_vel, t);
+                }
+                // Nearest acquired frame for the pyramid seed test; the field's modification time keeps the keys apart
+                streamlineCache.set_field(velocityField, static_cast<std::size_t>(std::lround(time)) % frameCount);
+                try {
+                    streamlineLOD.build(streamlineCache.update(seedSelection), lodTolerances);
+                    streamlineLOD.use_level(0);
+                    // Earlier frames' lines are inactive now and never selected again
+                    streamlineCache.evict_inactive();
+                } catch (const MemoryBudgetError& e) {
+                    std::cerr << "Error: Frame " << t << ": " << e.what() << std::endl;
+                }
+            }
+            if (!cameraPath.empty()) {
+                applyCameraPath(camera, startCamera, cameraPath, time);
+                renderer->ResetCameraClippingRange();
+            }
+
+            renderWindow->Render();
+            capture->Modified();
+            capture->Update();
+            vtkImageData* image = capture->GetOutput();
+            int* size = image->GetDimensions();
+            CapturedFrame frame;
+            frame.index = t;
+            frame.width = size[0];
+            frame.height = size[1];
+            const unsigned char* pixels = static_cast<const unsigned char*>(image->GetScalarPointer());
+            frame.rgb.assign(pixels, pixels + static_cast<std::size_t>(size[0]) * size[1] * 3);
+            if (!encoder.submit(std::move(frame))) {
+                std::cerr << "Error: Frame encoding failed, stopping after frame " << t << std::endl;
+                break;
+            }
+        }
+        bool encoded = encoder.finish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Rendered " << encoder.frames_written() << " of " << outputCount << " frames to " << offscreenDir
+                  << " in " << seconds << " s (" << outputCount / seconds << " frames/s)"
+                  << (encoded ? "" : " [errors]") << std::endl;
+        return encoded ? 0 : 1;
+    }
+
+    // Create render window interactor (interactive viewer only; batch mode has returned above)
     vtkSmartPointer<vtkRenderWindowInteractor> renderWindowInteractor = 
         vtkSmartPointer<vtkRenderWindowInteractor>::New();
     renderWindowInteractor->SetRenderWindow(renderWindow);
@@ -226,6 +1003,34 @@ int main() {
     renderWindowInteractor->SetInteractorStyle(style);
     style->SetMotionFactor(1.5);
 
+    // Swap to a coarse LOD level while rotating/zooming, full detail for still frames
+    vtkIdType interactivePointBudget = 200000;
+    streamlineLOD.attach(mapper, style, interactivePointBudget);
+
+    // Keyboard tuning of the seed selection, re-tracing only newly admitted seeds
+    StreamlineControls streamlineControls = {&streamlineCache, previewField ? &previewCache : nullptr, &seedSelection,
+                                             &streamlineLOD, lodTolerances, renderWindow, renderWindowInteractor, -1, 400};
+    vtkSmartPointer<vtkCallbackCommand> streamlineKeys = vtkSmartPointer<vtkCallbackCommand>::New();
+    streamlineKeys->SetCallback(OnStreamlineKey);
+    streamlineKeys->SetClientData(&streamlineControls);
+    vtkSmartPointer<vtkCallbackCommand> streamlineRefine = vtkSmartPointer<vtkCallbackCommand>::New();
+    streamlineRefine->SetCallback(OnStreamlineRefine);
+    streamlineRefine->SetClientData(&streamlineControls);
+    if (!particleMode) {
+        renderWindowInteractor->AddObserver(vtkCommand::KeyPressEvent, streamlineKeys);
+        renderWindowInteractor->AddObserver(vtkCommand::TimerEvent, streamlineRefine);
+    }
+
+    // Animate the particles from a repeating timer (~30 ticks/s)
+    vtkSmartPointer<vtkCallbackCommand> particleTimer = vtkSmartPointer<vtkCallbackCommand>::New();
+    particleTimer->SetCallback(OnParticleTimer);
+    particleTimer->SetClientData(&particleAnimation);
+    if (particleMode) {
+        renderWindowInteractor->Initialize();
+        renderWindowInteractor->AddObserver(vtkCommand::TimerEvent, particleTimer);
+        renderWindowInteractor->CreateRepeatingTimer(33);
+    }
+
     // Add axes for orientation
     vtkSmartPointer<vtkAxesActor> axes = vtkSmartPointer<vtkAxesActor>::New();
     vtkSmartPointer<vtkOrientationMarkerWidget> widget = 
@@ -237,18 +1042,12 @@ int main() {
     widget->SetEnabled(1);
     widget->InteractiveOff();
 
-    // Set up camera for better initial view
-    renderer->ResetCamera();
-    vtkSmartPointer<vtkCamera> camera = renderer->GetActiveCamera();
-    camera->SetPosition(2, 2, 2);
-    camera->SetFocalPoint(0, 0, 0);
-    camera->SetViewUp(0, 0, 1);
-
     std::cout << "Starting aorta streamline visualization..." << std::endl;
     std::cout << "Use mouse to rotate, scroll to zoom, and right-click to pan" << std::endl;
     std::cout << "Colored streamlines represent aorta flow patterns" << std::endl;
     std::cout << "Color indicates velocity magnitude (Blue=low, Red=high)" << std::endl;
-    std::cout << "Velocity range: " << minVelocityThreshold << " to " << maxVelocityThreshold << " cm/s" << std::endl;
+    std::cout << "Velocity range: " << seedSelection.minVelocity << " to " << seedSelection.maxVelocity << " cm/s" << std::endl;
+    std::cout << "Seeds: , / . min velocity, ; / ' max velocity, [ / ] ROI radius, arrows and PgUp/PgDn move the ROI, - / = density" << std::endl;
 
     // Start rendering
     renderWindow->Render();
@@ -0,0 +1,138 @@
+#ifndef PARALLEL_UTILS_H
+#define PARALLEL_UTILS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "WorkStealingPool.h"
+
+/**
+ * Number of worker threads used by the parallel helpers
+ *
+ * @return Hardware concurrency reported by the system (at least 1)
+ */
+inline unsigned int workerThreadCount() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+namespace parallel_detail {
+
+/**
+ * Chunks of one parallelForRange call, claimed in order by the caller and by pool helpers
+ *
+ * Shared with the helper tasks, which may start after the call has returned; a helper that
+ * finds no unclaimed chunk never touches the caller's function.
+ */
+struct ChunkState {
+    explicit ChunkState(std::size_t count) : chunks(count), errors(count) {}
+
+    void work() {
+        std::size_t c;
+        while ((c = next.fetch_add(1)) < chunks) {
+            try {
+                (*run)(c);
+            } catch (...) {
+                errors[c] = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++finished == chunks) {
+                done.notify_all();
+            }
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return finished == chunks; });
+    }
+
+    const std::size_t chunks;
+    const std::function<void(std::size_t)>* run = nullptr;
+    std::atomic<std::size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable done;
+    std::size_t finished = 0;
+    std::vector<std::exception_ptr> errors;
+};
+
+} // namespace parallel_detail
+
+/**
+ * Split [begin, end) into contiguous chunks and call fn(chunkBegin, chunkEnd) for each chunk in parallel
+ *
+ * Chunks are assigned statically, so the same range always produces the same partitioning.
+ * They run on the shared WorkStealingPool, with the calling thread taking chunks too, so no
+ * threads are started per call and nested calls (e.g. from a loading graph stage) share the
+ * same workers. The first exception thrown by a chunk is rethrown on the calling thread.
+ *
+ * @param begin First index of the range
+ * @param end One past the last index of the range
+ * @param fn Callable taking (std::size_t chunkBegin, std::size_t chunkEnd)
+ * @param minChunk Minimum number of indices per chunk
+ */
+template <typename Fn>
+void parallelForRange(std::size_t begin, std::size_t end, Fn&& fn, std::size_t minChunk = 1) {
+    if (end <= begin) {
+        return;
+    }
+
+    std::size_t count = end - begin;
+    std::size_t maxChunks = std::max<std::size_t>(1, count / std::max<std::size_t>(1, minChunk));
+    std::size_t chunks = std::min<std::size_t>(workerThreadCount(), maxChunks);
+
+    if (chunks <= 1) {
+        fn(begin, end);
+        return;
+    }
+
+    std::size_t chunkSize = (count + chunks - 1) / chunks;
+    chunks = (count + chunkSize - 1) / chunkSize;
+    std::function<void(std::size_t)> run = [&fn, begin, end, chunkSize](std::size_t c) {
+        std::size_t chunkBegin = begin + c * chunkSize;
+        fn(chunkBegin, std::min(end, chunkBegin + chunkSize));
+    };
+
+    auto state = std::make_shared<parallel_detail::ChunkState>(chunks);
+    state->run = &run;
+    WorkStealingPool& pool = WorkStealingPool::shared();
+    std::size_t helpers = std::min(chunks - 1, pool.thread_count());
+    for (std::size_t h = 0; h < helpers; h++) {
+        pool.submit([state]() { state->work(); });
+    }
+
+    // The calling thread claims chunks as well, so the call completes even if every worker is busy
+    state->work();
+    state->wait();
+
+    for (const auto& error : state->errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+/**
+ * Call fn(i) for every i in [begin, end) in parallel
+ *
+ * @param begin First index of the range
+ * @param end One past the last index of the range
+ * @param fn Callable taking (std::size_t index)
+ */
+template <typename Fn>
+void parallelFor(std::size_t begin, std::size_t end, Fn&& fn) {
+    parallelForRange(begin, end, [&fn](std::size_t chunkBegin, std::size_t chunkEnd) {
+        for (std::size_t i = chunkBegin; i < chunkEnd; i++) {
+            fn(i);
+        }
+    });
+}
+
+#endif // PARALLEL_UTILS_H
@@ -0,0 +1,622 @@
+#include "streamline_io.h"
+#include "parallel_utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const char kMagic[4] = {'4', 'D', 'S', 'L'};
+const std::uint32_t kVersion = 1;
+const std::size_t kChunkEntryBytes = 32;
+const std::size_t kChunkHeaderBytes = 24; // min[3], step[3]
+
+bool hostIsLittleEndian() {
+    std::uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+std::uint16_t floatToHalf(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    std::uint32_t sign = (bits >> 16) & 0x8000u;
+    std::uint32_t absBits = bits & 0x7fffffffu;
+
+    if (absBits >= 0x7f800000u) { // Inf or NaN
+        return static_cast<std::uint16_t>(sign | 0x7c00u | (absBits > 0x7f800000u ? 0x200u : 0u));
+    }
+    if (absBits >= 0x477ff000u) { // Rounds past the largest half (65504)
+        return static_cast<std::uint16_t>(sign | 0x7c00u);
+    }
+    if (absBits < 0x38800000u) { // Below the smallest normal half: subnormal or zero
+        if (absBits < 0x33000000u) {
+            return static_cast<std::uint16_t>(sign);
+        }
+        std::uint32_t exponent = absBits >> 23;
+        std::uint32_t mantissa = (absBits & 0x7fffffu) | 0x800000u;
+        std::uint32_t shift = 126 - exponent;
+        std::uint32_t half = mantissa >> shift;
+        std::uint32_t rest = mantissa & ((1u << shift) - 1);
+        std::uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u))) {
+            half++;
+        }
+        return static_cast<std::uint16_t>(sign | half);
+    }
+    std::uint32_t half = (absBits - 0x38000000u) >> 13;
+    std::uint32_t rest = absBits & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+        half++;
+    }
+    return static_cast<std::uint16_t>(sign | half);
+}
+
+float halfToFloat(std::uint16_t half) {
+    std::uint32_t sign = static_cast<std::uint32_t>(half & 0x8000u) << 16;
+    std::uint32_t exponent = (half >> 10) & 0x1fu;
+    std::uint32_t mantissa = half & 0x3ffu;
+    std::uint32_t bits;
+    if (exponent == 0x1fu) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void encodeHalves(const float* in, std::size_t n, std::uint16_t* out) {
+    std::size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i packed = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = floatToHalf(in[i]);
+    }
+}
+
+void decodeHalves(const std::uint16_t* in, std::size_t n, float* out) {
+    std::size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(packed));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = halfToFloat(in[i]);
+    }
+}
+
+template <typename T>
+void appendValue(std::vector<char>& buffer, T value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T readValue(const char*& cursor) {
+    T value;
+    std::memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+    return value;
+}
+
+// Lines of one chunk: a run of lines (in frame order) with a common frame
+struct ChunkPlan {
+    std::size_t firstLine;  // Index into the frame-ordered line list
+    std::size_t lineCount;
+    std::uint64_t pointCount;
+    std::uint32_t frame;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+std::uint64_t chunkBytes(std::size_t lineCount, std::uint64_t pointCount, std::size_t attributeCount) {
+    return kChunkHeaderBytes + 4 * lineCount + 6 * pointCount + 2 * attributeCount * pointCount;
+}
+
+/**
+ * Encode one chunk: bounding box, line lengths, 16-bit positions, float16 attributes (one plane per attribute)
+ */
+void encodeChunk(const PolylineSet& lines, const std::vector<std::size_t>& order, const ChunkPlan& plan, char* out) {
+    float lo[3] = {INFINITY, INFINITY, INFINITY};
+    float hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (std::size_t l = plan.firstLine; l < plan.firstLine + plan.lineCount; l++) {
+        std::size_t line = order[l];
+        for (std::uint64_t p = lines.lineOffsets[line]; p < lines.lineOffsets[line + 1]; p++) {
+            for (int c = 0; c < 3; c++) {
+                float value = lines.points[3 * p + c];
+                if (std::isfinite(value)) {
+                    lo[c] = std::min(lo[c], value);
+                    hi[c] = std::max(hi[c], value);
+                }
+            }
+        }
+    }
+    float step[3], inverse[3];
+    for (int c = 0; c < 3; c++) {
+        if (lo[c] > hi[c]) {  // No finite coordinate (or no points)
+            lo[c] = hi[c] = 0.0f;
+        }
+        step[c] = (hi[c] - lo[c]) / 65535.0f;
+        inverse[c] = step[c] > 0.0f ? 1.0f / step[c] : 0.0f;
+    }
+    std::memcpy(out, lo, sizeof(lo));
+    std::memcpy(out + sizeof(lo), step, sizeof(step));
+
+    char* lengths = out + kChunkHeaderBytes;
+    std::uint16_t* positions = reinterpret_cast<std::uint16_t*>(lengths + 4 * plan.lineCount);
+    std::uint16_t* values = positions + 3 * plan.pointCount;
+
+    std::uint64_t written = 0;
+    for (std::size_t l = plan.firstLine; l < plan.firstLine + plan.lineCount; l++) {
+        std::size_t line = order[l];
+        std::uint64_t begin = lines.lineOffsets[line];
+        std::uint64_t end = lines.lineOffsets[line + 1];
+        std::uint32_t count = static_cast<std::uint32_t>(end - begin);
+        std::memcpy(lengths + 4 * (l - plan.firstLine), &count, 4);
+
+        for (std::uint64_t p = begin; p < end; p++, written++) {
+            for (int c = 0; c < 3; c++) {
+                // Non-finite coordinates are clamped into the box (NaN to its low corner) before the cast
+                float q = (lines.points[3 * p + c] - lo[c]) * inverse[c] + 0.5f;
+                q = q >= 0.0f ? std::min(q, 65535.0f) : 0.0f;
+                positions[3 * written + c] = static_cast<std::uint16_t>(q);
+            }
+        }
+        for (std::size_t a = 0; a < lines.attributes.size(); a++) {
+            encodeHalves(lines.attributes[a].data() + begin, count, values + a * plan.pointCount + (written - count));
+        }
+    }
+}
+
+bool writeAll(std::ofstream& file, const char* data, std::size_t size) {
+    file.write(data, static_cast<std::streamsize>(size));
+    return static_cast<bool>(file);
+}
+
+} // namespace
+
+void PolylineSet::add_line(const float* xyz, std::size_t count, std::uint32_t frame, const float* const* values) {
+    points.insert(points.end(), xyz, xyz + 3 * count);
+    for (std::size_t a = 0; a < attributes.size(); a++) {
+        if (values && values[a]) {
+            attributes[a].insert(attributes[a].end(), values[a], values[a] + count);
+        } else {
+            attributes[a].resize(attributes[a].size() + count, 0.0f);
+        }
+    }
+    lineOffsets.push_back(lineOffsets.back() + count);
+    lineFrames.push_back(frame);
+}
+
+std::size_t PolylineSet::add_attribute(const std::string& name) {
+    attributeNames.push_back(name);
+    attributes.emplace_back(point_count(), 0.0f);
+    return attributes.size() - 1;
+}
+
+long PolylineSet::find_attribute(const std::string& name) const {
+    for (std::size_t a = 0; a < attributeNames.size(); a++) {
+        if (attributeNames[a] == name) {
+            return static_cast<long>(a);
+        }
+    }
+    return -1;
+}
+
+void PolylineSet::clear() {
+    points.clear();
+    lineOffsets.assign(1, 0);
+    lineFrames.clear();
+    attributeNames.clear();
+    attributes.clear();
+}
+
+bool writeStreamlineBinary(const std::string& path, const PolylineSet& lines, const StreamlineWriteOptions& options) {
+    if (!hostIsLittleEndian()) {
+        std::cerr << "Error: Streamline export requires a little-endian host" << std::endl;
+        return false;
+    }
+
+    // Lines in frame order (stable, so lines within a frame keep their order)
+    std::vector<std::size_t> order(lines.line_count());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return lines.lineFrames[a] < lines.lineFrames[b];
+    });
+    std::uint32_t frameCount = lines.line_count() == 0 ? 0 : lines.lineFrames[order.back()] + 1;
+
+    // Split into chunks that never span frames
+    std::vector<ChunkPlan> plans;
+    std::vector<std::uint32_t> frameChunks(frameCount + 1, 0);
+    std::size_t chunkTarget = std::max<std::size_t>(1, options.chunkPoints);
+    for (std::size_t l = 0; l < order.size(); l++) {
+        std::size_t line = order[l];
+        std::uint32_t frame = lines.lineFrames[line];
+        std::uint64_t count = lines.lineOffsets[line + 1] - lines.lineOffsets[line];
+        if (plans.empty() || plans.back().frame != frame || plans.back().pointCount >= chunkTarget) {
+            plans.push_back({l, 0, 0, frame, 0, 0});
+        }
+        plans.back().lineCount++;
+        plans.back().pointCount += count;
+    }
+    for (std::uint32_t f = 0, c = 0; f <= frameCount; f++) {
+        while (c < plans.size() && plans[c].frame < f) {
+            c++;
+        }
+        frameChunks[f] = c;
+    }
+
+    // Header and tables; chunk sizes are known up front, so offsets are too
+    std::vector<char> header(kMagic, kMagic + 4);
+    appendValue<std::uint32_t>(header, kVersion);
+    appendValue<std::uint64_t>(header, lines.line_count());
+    appendValue<std::uint64_t>(header, lines.point_count());
+    appendValue<std::uint32_t>(header, static_cast<std::uint32_t>(lines.attributes.size()));
+    appendValue<std::uint32_t>(header, frameCount);
+    appendValue<std::uint32_t>(header, static_cast<std::uint32_t>(plans.size()));
+    appendValue<std::uint32_t>(header, 0); // Reserved
+    for (const auto& name : lines.attributeNames) {
+        appendValue<std::uint32_t>(header, static_cast<std::uint32_t>(name.size()));
+        header.insert(header.end(), name.begin(), name.end());
+    }
+    for (std::uint32_t first : frameChunks) {
+        appendValue<std::uint32_t>(header, first);
+    }
+    std::uint64_t offset = header.size() + kChunkEntryBytes * plans.size();
+    for (auto& plan : plans) {
+        plan.offset = offset;
+        plan.size = chunkBytes(plan.lineCount, plan.pointCount, lines.attributes.size());
+        offset += plan.size;
+        appendValue<std::uint64_t>(header, plan.offset);
+        appendValue<std::uint64_t>(header, plan.size);
+        appendValue<std::uint32_t>(header, plan.frame);
+        appendValue<std::uint32_t>(header, static_cast<std::uint32_t>(plan.lineCount));
+        appendValue<std::uint64_t>(header, plan.pointCount);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file || !writeAll(file, header.data(), header.size())) {
+        std::cerr << "Error: Cannot write " << path << std::endl;
+        return false;
+    }
+
+    // Encode batches of chunks in parallel; write each batch while the next one is encoded
+    std::size_t batchChunks = std::max<std::size_t>(1, 4 * workerThreadCount());
+    std::vector<char> buffers[2];
+    std::thread writer;
+    bool writeOk = true;
+    for (std::size_t first = 0, batch = 0; first < plans.size(); first += batchChunks, batch++) {
+        std::size_t last = std::min(plans.size(), first + batchChunks);
+        std::vector<char>& buffer = buffers[batch % 2];
+        std::uint64_t base = plans[first].offset;
+        buffer.resize(plans[last - 1].offset + plans[last - 1].size - base);
+
+        parallelFor(first, last, [&](std::size_t c) {
+            encodeChunk(lines, order, plans[c], buffer.data() + (plans[c].offset - base));
+        });
+
+        if (writer.joinable()) {
+            writer.join();
+        }
+        writer = std::thread([&file, &buffer, &writeOk]() {
+            writeOk = writeOk && writeAll(file, buffer.data(), buffer.size());
+        });
+    }
+    if (writer.joinable()) {
+        writer.join();
+    }
+    file.close();
+    if (!writeOk || !file) {
+        std::cerr << "Error: Failed writing " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool writeStreamlineVTP(const std::string& path, const PolylineSet& lines) {
+    std::size_t nPoints = lines.point_count();
+    std::size_t nLines = lines.line_count();
+
+    // Appended blocks, each preceded by a UInt64 byte count: point attributes, points,
+    // connectivity, offsets, frames
+    std::ostringstream xml;
+    std::uint64_t offset = 0;
+    auto arrayTag = [&](const std::string& type, const std::string& name, int components, std::uint64_t bytes) {
+        xml << "        <DataArray type=\"" << type << "\" Name=\"" << name << "\"";
+        if (components > 1) {
+            xml << " NumberOfComponents=\"" << components << "\"";
+        }
+        xml << " format=\"appended\" offset=\"" << offset << "\"/>\n";
+        offset += sizeof(std::uint64_t) + bytes;
+    };
+
+    xml << "<?xml version=\"1.0\"?>\n"
+        << "<VTKFile type=\"PolyData\" version=\"1.0\" byte_order=\""
+        << (hostIsLittleEndian() ? "LittleEndian" : "BigEndian") << "\" header_type=\"UInt64\">\n"
+        << "  <PolyData>\n"
+        << "    <Piece NumberOfPoints=\"" << nPoints << "\" NumberOfVerts=\"0\" NumberOfLines=\"" << nLines
+        << "\" NumberOfStrips=\"0\" NumberOfPolys=\"0\">\n";
+    xml << "      <PointData>\n";
+    for (const auto& name : lines.attributeNames) {
+        arrayTag("Float32", name, 1, 4 * nPoints);
+    }
+    xml << "      </PointData>\n      <CellData>\n";
+    arrayTag("UInt32", "Frame", 1, 4 * nLines);
+    xml << "      </CellData>\n      <Points>\n";
+    arrayTag("Float32", "Points", 3, 12 * nPoints);
+    xml << "      </Points>\n      <Lines>\n";
+    arrayTag("Int64", "connectivity", 1, 8 * nPoints);
+    arrayTag("Int64", "offsets", 1, 8 * nLines);
+    xml << "      </Lines>\n    </Piece>\n  </PolyData>\n  <AppendedData encoding=\"raw\">\n   _";
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Error: Cannot write " << path << std::endl;
+        return false;
+    }
+    std::string head = xml.str();
+    bool ok = writeAll(file, head.data(), head.size());
+
+    auto writeBlock = [&](const void* data, std::uint64_t bytes) {
+        ok = ok && writeAll(file, reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+        ok = ok && writeAll(file, static_cast<const char*>(data), bytes);
+    };
+
+    for (const auto& values : lines.attributes) {
+        writeBlock(values.data(), 4 * nPoints);
+    }
+    writeBlock(lines.lineFrames.data(), 4 * nLines);
+    writeBlock(lines.points.data(), 12 * nPoints);
+
+    // Connectivity is just 0..nPoints-1; generate it in slices instead of storing it
+    std::uint64_t bytes = 8 * nPoints;
+    ok = ok && writeAll(file, reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+    const std::size_t slice = 1 << 20;
+    std::vector<std::int64_t> ids(std::min(nPoints, slice));
+    for (std::size_t first = 0; first < nPoints && ok; first += slice) {
+        std::size_t count = std::min(slice, nPoints - first);
+        parallelForRange(0, count, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                ids[i] = static_cast<std::int64_t>(first + i);
+            }
+        }, 1 << 16);
+        ok = ok && writeAll(file, reinterpret_cast<const char*>(ids.data()), 8 * count);
+    }
+
+    // Offsets are the end of each line, i.e. lineOffsets[1..]
+    writeBlock(lines.lineOffsets.data() + 1, 8 * nLines);
+
+    const char tail[] = "\n  </AppendedData>\n</VTKFile>\n";
+    ok = ok && writeAll(file, tail, sizeof(tail) - 1);
+    file.close();
+    if (!ok || !file) {
+        std::cerr << "Error: Failed writing " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool StreamlineReader::open(const std::string& path) {
+    file.close();
+    file.clear();
+    attributeNames.clear();
+    frameChunks.clear();
+    chunks.clear();
+    totalLines = totalPoints = 0;
+
+    file.open(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Cannot open " << path << std::endl;
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    const std::uint64_t fileSize = static_cast<std::uint64_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    char fixed[40];
+    if (!file.read(fixed, sizeof(fixed)) || std::memcmp(fixed, kMagic, 4) != 0) {
+        std::cerr << "Error: " << path << " is not a streamline file" << std::endl;
+        return false;
+    }
+    const char* cursor = fixed + 4;
+    std::uint32_t version = readValue<std::uint32_t>(cursor);
+    if (version != kVersion) {
+        std::cerr << "Error: Unsupported streamline file version " << version << std::endl;
+        return false;
+    }
+    totalLines = readValue<std::uint64_t>(cursor);
+    totalPoints = readValue<std::uint64_t>(cursor);
+    std::uint32_t attributeCount = readValue<std::uint32_t>(cursor);
+    std::uint32_t frameCount = readValue<std::uint32_t>(cursor);
+    std::uint32_t chunkCount = readValue<std::uint32_t>(cursor);
+
+    // Every count is checked against the bytes left before anything is allocated or indexed
+    auto truncated = [&]() {
+        std::cerr << "Error: Truncated or corrupt streamline file " << path << std::endl;
+        attributeNames.clear();
+        frameChunks.clear();
+        chunks.clear();
+        totalLines = totalPoints = 0;
+        return false;
+    };
+    auto remaining = [&]() {
+        std::streamoff position = file.tellg();
+        return position < 0 ? 0 : fileSize - std::min<std::uint64_t>(fileSize, static_cast<std::uint64_t>(position));
+    };
+
+    for (std::uint32_t a = 0; a < attributeCount; a++) {
+        std::uint32_t length = 0;
+        if (remaining() < sizeof(length) || !file.read(reinterpret_cast<char*>(&length), sizeof(length)) ||
+            remaining() < length) {
+            return truncated();
+        }
+        std::string name(length, '\0');
+        file.read(&name[0], length);
+        attributeNames.push_back(name);
+    }
+    if (remaining() < 4 * (static_cast<std::uint64_t>(frameCount) + 1)) {
+        return truncated();
+    }
+    frameChunks.resize(frameCount + 1);
+    file.read(reinterpret_cast<char*>(frameChunks.data()), 4 * frameChunks.size());
+
+    if (remaining() < kChunkEntryBytes * static_cast<std::uint64_t>(chunkCount)) {
+        return truncated();
+    }
+    std::vector<char> table(kChunkEntryBytes * chunkCount);
+    file.read(table.data(), table.size());
+    if (!file) {
+        return truncated();
+    }
+
+    // Chunks must tile the rest of the file in order, with the size their counts imply
+    std::uint64_t expectedOffset = static_cast<std::uint64_t>(file.tellg());
+    std::uint64_t lineSum = 0, pointSum = 0;
+    cursor = table.data();
+    for (std::uint32_t c = 0; c < chunkCount; c++) {
+        Chunk chunk;
+        chunk.offset = readValue<std::uint64_t>(cursor);
+        chunk.size = readValue<std::uint64_t>(cursor);
+        chunk.frame = readValue<std::uint32_t>(cursor);
+        chunk.lineCount = readValue<std::uint32_t>(cursor);
+        chunk.pointCount = readValue<std::uint64_t>(cursor);
+        if (chunk.offset != expectedOffset || chunk.size > fileSize - chunk.offset || chunk.pointCount > chunk.size ||
+            chunk.size != chunkBytes(chunk.lineCount, chunk.pointCount, attributeCount)) {
+            return truncated();
+        }
+        expectedOffset += chunk.size;
+        lineSum += chunk.lineCount;
+        pointSum += chunk.pointCount;
+        chunks.push_back(chunk);
+    }
+    if (lineSum != totalLines || pointSum != totalPoints) {
+        return truncated();
+    }
+    for (std::size_t f = 0; f < frameChunks.size(); f++) {
+        if (frameChunks[f] > chunkCount || (f > 0 && frameChunks[f] < frameChunks[f - 1])) {
+            return truncated();
+        }
+    }
+    if (frameChunks.back() != chunkCount) {
+        return truncated();
+    }
+    return true;
+}
+
+bool StreamlineReader::read_frame(std::size_t frame, PolylineSet& out) {
+    if (frame >= frame_count()) {
+        out.clear();
+        out.attributeNames = attributeNames;
+        out.attributes.resize(attributeNames.size());
+        return false;
+    }
+    return read_chunks(frameChunks[frame], frameChunks[frame + 1], out);
+}
+
+bool StreamlineReader::read_all(PolylineSet& out) {
+    return read_chunks(0, chunks.size(), out);
+}
+
+bool StreamlineReader::read_chunks(std::size_t first, std::size_t last, PolylineSet& out) {
+    out.clear();
+    out.attributeNames = attributeNames;
+    out.attributes.resize(attributeNames.size());
+    if (first >= last) {
+        return true;
+    }
+
+    // Chunks of a range are contiguous in the file: one read, then decode in parallel
+    std::uint64_t base = chunks[first].offset;
+    std::vector<char> data(chunks[last - 1].offset + chunks[last - 1].size - base);
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(base));
+    if (!file.read(data.data(), static_cast<std::streamsize>(data.size()))) {
+        std::cerr << "Error: Failed reading streamline chunks" << std::endl;
+        return false;
+    }
+
+    std::vector<std::size_t> lineStart(last - first + 1, 0), pointStart(last - first + 1, 0);
+    for (std::size_t c = first; c < last; c++) {
+        lineStart[c - first + 1] = lineStart[c - first] + chunks[c].lineCount;
+        pointStart[c - first + 1] = pointStart[c - first] + chunks[c].pointCount;
+    }
+    std::size_t nLines = lineStart.back();
+    std::size_t nPoints = pointStart.back();
+    out.points.resize(3 * nPoints);
+    out.lineOffsets.resize(nLines + 1);
+    out.lineFrames.resize(nLines);
+    for (auto& values : out.attributes) {
+        values.resize(nPoints);
+    }
+
+    std::atomic<bool> valid{true};
+    parallelFor(first, last, [&](std::size_t c) {
+        const Chunk& chunk = chunks[c];
+        const char* cursor = data.data() + (chunk.offset - base);
+        float lo[3], step[3];
+        std::memcpy(lo, cursor, sizeof(lo));
+        std::memcpy(step, cursor + sizeof(lo), sizeof(step));
+        cursor += kChunkHeaderBytes;
+
+        std::size_t line = lineStart[c - first];
+        std::uint64_t point = pointStart[c - first];
+        for (std::uint32_t l = 0; l < chunk.lineCount; l++) {
+            std::uint32_t count = readValue<std::uint32_t>(cursor);
+            out.lineOffsets[line + l + 1] = point + count;
+            out.lineFrames[line + l] = chunk.frame;
+            point += count;
+        }
+        if (point != pointStart[c - first + 1]) {  // Line lengths must add up to the chunk's points
+            valid = false;
+        }
+
+        std::size_t begin = pointStart[c - first];
+        for (std::uint64_t p = 0; p < chunk.pointCount; p++) {
+            for (int k = 0; k < 3; k++) {
+                std::uint16_t q;
+                std::memcpy(&q, cursor + 2 * (3 * p + k), 2);
+                out.points[3 * (begin + p) + k] = lo[k] + q * step[k];
+            }
+        }
+        cursor += 6 * chunk.pointCount;
+
+        for (std::size_t a = 0; a < out.attributes.size(); a++) {
+            std::vector<std::uint16_t> halves(chunk.pointCount);
+            std::memcpy(halves.data(), cursor + 2 * a * chunk.pointCount, 2 * chunk.pointCount);
+            decodeHalves(halves.data(), chunk.pointCount, out.attributes[a].data() + begin);
+        }
+    });
+    out.lineOffsets[0] = 0;
+    if (!valid) {
+        std::cerr << "Error: Corrupt streamline chunk (line lengths do not match the point count)" << std::endl;
+        out.clear();
+        out.attributeNames = attributeNames;
+        out.attributes.resize(attributeNames.size());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,158 @@
+#ifndef STREAMLINE_IO_H
+#define STREAMLINE_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class vtkPolyData;
+
+/**
+ * Polylines with per-point attributes, independent of VTK
+ *
+ * Line i spans points [lineOffsets[i], lineOffsets[i + 1]). Each line carries the frame it
+ * belongs to (0 for streamlines of a single frame, the start frame for pathlines and
+ * particle tracks). Attributes hold one float per point (e.g. speed, vorticity, time).
+ */
+struct PolylineSet {
+    std::vector<float> points;                   // Interleaved xyz
+    std::vector<std::uint64_t> lineOffsets{0};   // line_count() + 1 entries
+    std::vector<std::uint32_t> lineFrames;       // One per line
+    std::vector<std::string> attributeNames;
+    std::vector<std::vector<float>> attributes;  // One array of point_count() floats per name
+
+    std::size_t line_count() const { return lineFrames.size(); }
+    std::size_t point_count() const { return points.size() / 3; }
+
+    /**
+     * Append a line
+     *
+     * @param xyz Interleaved positions, 3 * count floats
+     * @param count Number of points
+     * @param frame Frame the line belongs to
+     * @param values One pointer per attribute to count values (may be nullptr if there are no attributes)
+     */
+    void add_line(const float* xyz, std::size_t count, std::uint32_t frame, const float* const* values = nullptr);
+
+    /**
+     * Register an attribute; its array is sized to the current point count
+     *
+     * @return Index of the attribute
+     */
+    std::size_t add_attribute(const std::string& name);
+
+    /**
+     * Index of an attribute by name, or -1 if missing
+     */
+    long find_attribute(const std::string& name) const;
+
+    void clear();
+};
+
+/**
+ * Settings for the binary streamline writer
+ */
+struct StreamlineWriteOptions {
+    std::size_t chunkPoints = 1 << 16; // Target points per chunk (a longer line gets its own chunk)
+};
+
+/**
+ * Write polylines in the compact chunked binary format (.4dsl)
+ *
+ * Lines are grouped by frame and split into chunks; a frame table and a chunk table
+ * (file offset, size, line and point counts) at the front of the file allow reading a
+ * single frame without touching the rest. Within a chunk, positions are quantized to
+ * 16 bits over the chunk bounding box and attributes are stored as IEEE float16.
+ * Non-finite coordinates are left out of the bounding box and clamped into it.
+ * Chunks are encoded in parallel, and each batch is written while the next is encoded.
+ * Multi-byte values are little-endian.
+ *
+ * @param path Output file
+ * @param lines Polylines to write
+ * @param options Writer settings
+ * @return true on success
+ */
+bool writeStreamlineBinary(const std::string& path, const PolylineSet& lines,
+                           const StreamlineWriteOptions& options = StreamlineWriteOptions());
+
+/**
+ * Write polylines as VTK XML PolyData (.vtp) with raw appended binary data
+ *
+ * Attributes become Float32 point data, the line frames become UInt32 cell data ("Frame").
+ * Readable by ParaView and vtkXMLPolyDataReader.
+ *
+ * @param path Output file
+ * @param lines Polylines to write
+ * @return true on success
+ */
+bool writeStreamlineVTP(const std::string& path, const PolylineSet& lines);
+
+/**
+ * Random-access reader for the chunked binary format
+ */
+class StreamlineReader {
+public:
+    /**
+     * Open a file and read its header and tables
+     *
+     * The frame and chunk tables are checked against the file size and against each other
+     * (chunks in order, sizes matching their counts), so later reads stay inside the file.
+     *
+     * @return true if the file is a valid .4dsl file
+     */
+    bool open(const std::string& path);
+
+    std::size_t frame_count() const { return frameChunks.empty() ? 0 : frameChunks.size() - 1; }
+    std::size_t line_count() const { return totalLines; }
+    std::size_t point_count() const { return totalPoints; }
+    const std::vector<std::string>& attribute_names() const { return attributeNames; }
+
+    /**
+     * Read the lines of one frame (replaces the contents of out)
+     *
+     * @return true on success
+     */
+    bool read_frame(std::size_t frame, PolylineSet& out);
+
+    /**
+     * Read every line in the file (replaces the contents of out)
+     *
+     * @return true on success
+     */
+    bool read_all(PolylineSet& out);
+
+private:
+    struct Chunk {
+        std::uint64_t offset;
+        std::uint64_t size;
+        std::uint32_t frame;
+        std::uint32_t lineCount;
+        std::uint64_t pointCount;
+    };
+
+    bool read_chunks(std::size_t first, std::size_t last, PolylineSet& out);
+
+    std::ifstream file;
+    std::vector<std::string> attributeNames;
+    std::vector<std::uint32_t> frameChunks; // frame_count() + 1 entries: first chunk of each frame
+    std::vector<Chunk> chunks;
+    std::size_t totalLines = 0;
+    std::size_t totalPoints = 0;
+};
+
+/**
+ * Convert the lines of a polydata (e.g. vtkStreamTracer output) to a PolylineSet
+ *
+ * Single-component point arrays are copied, three-component arrays (Velocity, Vorticity)
+ * are stored as their magnitude under the same name. Defined in streamline_io_vtk.cpp,
+ * so only targets that link VTK can use it.
+ *
+ * @param polyData Polydata with polyline cells
+ * @param frame Frame assigned to every line
+ * @return The converted lines
+ */
+PolylineSet polylinesFromPolyData(vtkPolyData* polyData, std::uint32_t frame = 0);
+
+#endif // STREAMLINE_IO_H
@@ -0,0 +1,60 @@
+#include "streamline_io.h"
+#include <cmath>
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkIdList.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+PolylineSet polylinesFromPolyData(vtkPolyData* polyData, std::uint32_t frame) {
+    PolylineSet result;
+    if (!polyData || !polyData->GetPoints()) {
+        return result;
+    }
+
+    // Usable point arrays: scalars as-is, 3-vectors as magnitude
+    vtkPointData* pointData = polyData->GetPointData();
+    std::vector<vtkDataArray*> arrays;
+    for (int i = 0; i < pointData->GetNumberOfArrays(); i++) {
+        vtkDataArray* array = pointData->GetArray(i);
+        if (array && array->GetName() && (array->GetNumberOfComponents() == 1 || array->GetNumberOfComponents() == 3)) {
+            arrays.push_back(array);
+            result.add_attribute(array->GetName());
+        }
+    }
+
+    vtkPoints* points = polyData->GetPoints();
+    vtkCellArray* lines = polyData->GetLines();
+    std::vector<float> xyz;
+    std::vector<std::vector<float>> values(arrays.size());
+    std::vector<const float*> valuePointers(arrays.size());
+
+    vtkSmartPointer<vtkIdList> ids = vtkSmartPointer<vtkIdList>::New();
+    lines->InitTraversal();
+    while (lines->GetNextCell(ids)) {
+        vtkIdType count = ids->GetNumberOfIds();
+        xyz.resize(3 * count);
+        for (vtkIdType i = 0; i < count; i++) {
+            double p[3];
+            points->GetPoint(ids->GetId(i), p);
+            xyz[3 * i] = static_cast<float>(p[0]);
+            xyz[3 * i + 1] = static_cast<float>(p[1]);
+            xyz[3 * i + 2] = static_cast<float>(p[2]);
+        }
+        for (std::size_t a = 0; a < arrays.size(); a++) {
+            values[a].resize(count);
+            for (vtkIdType i = 0; i < count; i++) {
+                double tuple[3] = {0.0, 0.0, 0.0};
+                arrays[a]->GetTuple(ids->GetId(i), tuple);
+                values[a][i] = arrays[a]->GetNumberOfComponents() == 1
+                    ? static_cast<float>(tuple[0])
+                    : static_cast<float>(std::sqrt(tuple[0] * tuple[0] + tuple[1] * tuple[1] + tuple[2] * tuple[2]));
+            }
+            valuePointers[a] = values[a].data();
+        }
+        result.add_line(xyz.data(), count, frame, valuePointers.data());
+    }
+    return result;
+}
@@ -12,14 +12,47 @@
 #include <vtkOrientationMarkerWidget.h>
 #include <vtkInteractorStyleTrackballCamera.h>
 #include <vtkType.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+#include <vtkAlgorithmOutput.h>
+#include <vtkMatrix4x4.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "Volume4D.h"
+#include "VolumePyramid.h"
 #include "dicom_utils.h"
 
+/**
+ * Isosurface mappers with a full-resolution and a coarse (pyramid level 1) input each
+ */
+struct IsosurfaceLOD {
+    std::vector<vtkSmartPointer<vtkPolyDataMapper>> mappers;
+    std::vector<vtkSmartPointer<vtkAlgorithmOutput>> full;
+    std::vector<vtkSmartPointer<vtkAlgorithmOutput>> coarse;
+};
+
+/**
+ * Interaction callbacks: coarse surfaces while the camera moves, full resolution for still frames
+ */
+void OnIsosurfaceStartInteraction(vtkObject*, unsigned long, void* clientData, void*) {
+    IsosurfaceLOD* lod = static_cast<IsosurfaceLOD*>(clientData);
+    for (std::size_t i = 0; i < lod->mappers.size(); i++) {
+        lod->mappers[i]->SetInputConnection(lod->coarse[i]);
+    }
+}
+
+void OnIsosurfaceEndInteraction(vtkObject*, unsigned long, void* clientData, void*) {
+    IsosurfaceLOD* lod = static_cast<IsosurfaceLOD*>(clientData);
+    for (std::size_t i = 0; i < lod->mappers.size(); i++) {
+        lod->mappers[i]->SetInputConnection(lod->full[i]);
+    }
+}
+
 int main() {
     std::string mag_path = "/Users/edisonsun/Documents/4Dsamples/D29/4D/mag";
     if (!std::filesystem::exists(mag_path)) {
@@ -27,7 +60,8 @@ int main() {
         return 1;
     }
 
-    Volume4D mag = DicomFolderToVolume4D(mag_path);
+    VolumeGeometry geometry;
+    Volume4D mag = DicomFolderToVolume4D(mag_path, &geometry);
     if (mag.empty()) {
         std::cerr << "Failed to load magnitude volume" << std::endl;
         return 1;
@@ -35,6 +69,17 @@ int main() {
 
     std::cout << "Volume loaded successfully!" << std::endl;
     std::cout << "Dimensions: " << mag.size_x() << " x " << mag.size_y() << " x " << mag.size_z() << " x " << mag.size_t() << std::endl;
+    geometry.print_info();
+
+    // Surfaces are extracted in voxel coordinates and placed in patient space (mm) by the actors
+    double voxelToPatient[16];
+    geometry.voxel_to_world_matrix(voxelToPatient);
+    vtkSmartPointer<vtkMatrix4x4> patientMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    patientMatrix->DeepCopy(voxelToPatient);
+
+    // Half-resolution copy for the interactive isosurfaces, built while the full-resolution data is prepared
+    VolumePyramid magPyramid(1);
+    magPyramid.add_component(mag);
 
     // Create renderer
     vtkSmartPointer<vtkRenderer> renderer = vtkSmartPointer<vtkRenderer>::New();
@@ -69,6 +114,18 @@ int main() {
         }
     }
 
+    // Level 1 of the pyramid, with voxels at the centers of the 2 x 2 x 2 blocks they average
+    magPyramid.wait();
+    const Volume4D& coarseMag = magPyramid.component(1, 0);
+    vtkSmartPointer<vtkImageData> coarseData = vtkSmartPointer<vtkImageData>::New();
+    coarseData->SetDimensions(coarseMag.size_x(), coarseMag.size_y(), coarseMag.size_z());
+    coarseData->SetSpacing(2.0, 2.0, 2.0);
+    coarseData->SetOrigin(0.5, 0.5, 0.5);
+    coarseData->AllocateScalars(VTK_FLOAT, 1);
+    std::copy(coarseMag.frame_data(0), coarseMag.frame_data(0) + coarseMag.frame_size(),
+              static_cast<float*>(coarseData->GetScalarPointer()));
+    IsosurfaceLOD isosurfaceLOD;
+
     // Create multiple isosurfaces at different thresholds
     // Use lower thresholds to make surfaces more visible
     float thresholds[] = {static_cast<float>(min_val + (max_val - min_val) * 0.1), 
@@ -96,6 +153,15 @@ int main() {
         // Create mapper
         vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
         mapper->SetInputConnection(marchingCubes->GetOutputPort());
+
+        // Same surface from the coarse level, drawn while interacting
+        vtkSmartPointer<vtkMarchingCubes> coarseCubes = vtkSmartPointer<vtkMarchingCubes>::New();
+        coarseCubes->SetInputData(coarseData);
+        coarseCubes->SetValue(0, thresholds[i]);
+        coarseCubes->Update();
+        isosurfaceLOD.mappers.push_back(mapper);
+        isosurfaceLOD.full.push_back(marchingCubes->GetOutputPort());
+        isosurfaceLOD.coarse.push_back(coarseCubes->GetOutputPort());
         
         // Create actor
         vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
@@ -104,6 +170,7 @@ int main() {
         actor->GetProperty()->SetOpacity(0.8);  // More opaque
         actor->GetProperty()->SetAmbient(0.3);  // Add ambient lighting
         actor->GetProperty()->SetDiffuse(0.7);  // Add diffuse lighting
+        actor->SetUserMatrix(patientMatrix);
         
         // Add actor to renderer
         renderer->AddActor(actor);
@@ -128,6 +195,16 @@ int main() {
     // Set slower rotation speed
     style->SetMotionFactor(1.8);  // Reduce motion sensitivity
 
+    // Swap to the coarse isosurfaces while rotating/zooming
+    vtkSmartPointer<vtkCallbackCommand> startInteraction = vtkSmartPointer<vtkCallbackCommand>::New();
+    startInteraction->SetCallback(OnIsosurfaceStartInteraction);
+    startInteraction->SetClientData(&isosurfaceLOD);
+    style->AddObserver(vtkCommand::StartInteractionEvent, startInteraction);
+    vtkSmartPointer<vtkCallbackCommand> endInteraction = vtkSmartPointer<vtkCallbackCommand>::New();
+    endInteraction->SetCallback(OnIsosurfaceEndInteraction);
+    endInteraction->SetClientData(&isosurfaceLOD);
+    style->AddObserver(vtkCommand::EndInteractionEvent, endInteraction);
+
     // Add axes for orientation
     vtkSmartPointer<vtkAxesActor> axes = vtkSmartPointer<vtkAxesActor>::New();
     vtkSmartPointer<vtkOrientationMarkerWidget> widget = 
@@ -139,12 +216,12 @@ int main() {
     widget->SetEnabled(1);
     widget->InteractiveOff();
 
-    // Set up camera for better initial view
-    renderer->ResetCamera();
+    // Set up camera for better initial view: pick the direction, then fit the patient-space bounds
     vtkSmartPointer<vtkCamera> camera = renderer->GetActiveCamera();
     camera->SetPosition(1, 1, 1);  // Position camera at an angle
     camera->SetFocalPoint(0, 0, 0);
     camera->SetViewUp(0, 0, 1);
+    renderer->ResetCamera();
 
     std::cout << "Starting 3D isosurface visualization..." << std::endl;
     std::cout << "Use mouse to rotate, scroll to zoom, and right-click to pan" << std::endl;